@@ -68,7 +68,7 @@ enum ConnectionStringSource
 typedef enum ConnectionStringSource ConnectionStringSource;
 static ConnectionStringSource g_connectionStringSource = FromAis;
 
-static int g_stopSignal = 0;
+static volatile sig_atomic_t g_stopSignal = 0;
 static int g_refreshSignal = 0;
 
 static bool g_isIotHubEnabled = false;
@@ -145,12 +145,15 @@ static void SignalInterrupt(int signal)
     }
     else
     {
-        OsConfigLogInfo(g_agentLog, "Interrupt signal (%d)", signal);
+        // Logged by the main loop once it stops, logging takes locks and allocates
         g_stopSignal = signal;
     }
 
     if (NULL != errorMessage)
     {
+        // Lines the writer thread did not get to go first, they lead to the crash
+        WriteQueuedLogLines();
+
         if (0 < (logDescriptor = open(LOG_FILE, O_APPEND | O_WRONLY | O_NONBLOCK)))
         {
             ssize_t writeResult = -1;
@@ -708,6 +711,8 @@ int main(int argc, char *argv[])
         }
     }
 
+    OsConfigLogInfo(GetLog(), "Interrupt signal (%d)", g_stopSignal);
+
 done:
     OsConfigLogInfo(GetLog(), "OSConfig Agent (PID: %d) exiting with %d", pid, g_stopSignal);
 
@@ -955,6 +955,7 @@ void AsbInitialize(OsConfigLogHandle log)
             SetLoggingLevel(GetLoggingLevelFromJsonConfig(jsonConfiguration, log));
             SetMaxLogSize(GetMaxLogSizeFromJsonConfig(jsonConfiguration, log));
             SetMaxLogSizeDebugMultiplier(GetMaxLogSizeDebugMultiplierFromJsonConfig(jsonConfiguration, log));
+            SetTelemetryAggregationSeconds((unsigned int)GetTelemetryAggregationFromJsonConfig(jsonConfiguration, log));
             FREE_MEMORY(jsonConfiguration);
         }
 
@@ -4297,8 +4298,7 @@ int AsbMmiGet(const char* componentName, const char* objectName, char** payload,
     }
     else
     {
-        setenv(TELEMETRY_RULECODENAME_ENVIRONMENT_VAR, objectName, 1);
-        setenv(TELEMETRY_SCENARIONAME_ENVIRONMENT_VAR, g_asbName, 1);
+        OSConfigTelemetrySetContext(objectName, g_asbName);
         OSConfigTimeStampSave();
 
         if (0 == strcmp(objectName, g_auditEnsureLoggingLevelObject))
@@ -100,6 +100,10 @@ int InstallPackage(const char* packageName, OsConfigLogHandle log);
 int UninstallPackage(const char* packageName, OsConfigLogHandle log);
 void PackageUtilsCleanup(void);
 
+typedef void (*DpkgPackageCallback)(const char* name, const char* architecture, const char* version, void* context);
+int EnumerateDpkgInstalledPackages(const char* statusFile, DpkgPackageCallback callback, void* context, OsConfigLogHandle log);
+char* GetPackageDatabaseStamp(const char* database, OsConfigLogHandle log);
+
 unsigned int GetNumberOfLinesInFile(const char* fileName);
 bool CharacterFoundInFile(const char* fileName, char what);
 int CheckNoLegacyPlusEntriesInFile(const char* fileName, char** reason, OsConfigLogHandle log);
@@ -206,6 +210,49 @@ bool UnlockFile(FILE* file, OsConfigLogHandle log);
 char* ReadUriFromSocket(int socketHandle, OsConfigLogHandle log);
 int ReadHttpStatusFromSocket(int socketHandle, OsConfigLogHandle log);
 int ReadHttpContentLengthFromSocket(int socketHandle, OsConfigLogHandle log);
+int ReadHttpHeadersFromSocket(int socketHandle, bool* keepAlive, OsConfigLogHandle log);
+
+// Bodies of at least this size are passed as a sealed memfd along with the headers, to receivers that accept these.
+// Below it, filling a memfd (page by page allocation of shared memory) costs more than copying through the socket.
+// MPI payloads today are hundreds of KB to a few MB, so they all go inline: the memfd path is effectively off for current traffic.
+#define HTTP_MEMFD_BODY_THRESHOLD 33554432
+
+// Tells the other side that bodies can be passed as memfd
+#define HTTP_ACCEPT_MEMFD_BODY_HEADER "OSConfig-Accept-Body: memfd\r\n"
+
+typedef struct HttpMessage
+{
+    // Method and URI (without the enclosing slashes) of a request, both pointing into header
+    char* method;
+    char* uri;
+
+    // Status code of a response
+    int status;
+
+    int contentLength;
+    bool keepAlive;
+
+    // The body was passed as a memfd, and the sender accepts bodies passed so in return
+    bool memfdBody;
+    bool acceptsMemfdBody;
+
+    // Set when the body is a read-only mapping of the memfd, which only FreeHttpMessage can release
+    size_t mappedBodySize;
+
+    // Start line and header lines, and the body of contentLength bytes, both null-terminated
+    char* header;
+    char* body;
+
+    // Number of receive calls made to read the message
+    unsigned int reads;
+} HttpMessage;
+
+int ReadHttpMessageFromSocket(int socketHandle, HttpMessage* message, OsConfigLogHandle log);
+void FreeHttpMessage(HttpMessage* message);
+
+// Sends the headers (the start line and header lines, without Content-Length) followed by the body. When memfdBody is set
+// and the body is large enough, the body is passed as a sealed memfd instead, falling back to inline when that fails.
+int SendHttpMessageToSocket(int socketHandle, const char* headers, const char* body, int bodySize, bool memfdBody, OsConfigLogHandle log);
 
 int SleepMilliseconds(long milliseconds);
 
@@ -241,10 +288,13 @@ typedef struct ReportedProperty
 } ReportedProperty;
 
 bool IsIotHubManagementEnabledInJsonConfig(const char* jsonString);
+bool IsStructuredLoggingEnabledInJsonConfig(const char* jsonString);
 LoggingLevel GetLoggingLevelFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetMaxLogSizeFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetMaxLogSizeDebugMultiplierFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetReportingIntervalFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
+int GetMetricsIntervalFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
+int GetTelemetryAggregationFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetModelVersionFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetLocalManagementFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 int GetIotHubProtocolFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
@@ -255,6 +305,28 @@ int GetGitManagementFromJsonConfig(const char* jsonString, OsConfigLogHandle log
 char* GetGitRepositoryUrlFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 char* GetGitBranchFromJsonConfig(const char* jsonString, OsConfigLogHandle log);
 
+// A member of a JSON object located in the original text, the value is a slice of that text and is not null terminated
+typedef struct JsonMember
+{
+    char* name;
+    const char* value;
+    int valueSize;
+} JsonMember;
+
+int ReadJsonObjectMembers(const char* json, int jsonSize, JsonMember** members, int* memberCount, OsConfigLogHandle log);
+void FreeJsonMembers(JsonMember* members, int memberCount);
+
+// A request-scoped arena for parson values. While an arena is used on a thread, everything parson allocates on that thread
+// comes from the arena and is released at once with it. Values from the arena must not outlive it nor be freed after it
+// stops being used, values from the heap can still be freed while it is used.
+typedef struct JsonArena JsonArena;
+
+JsonArena* CreateJsonArena(void);
+JsonArena* UseJsonArena(JsonArena* arena);
+void ResetJsonArena(JsonArena* arena);
+void FreeJsonArena(JsonArena* arena);
+void GetJsonArenaStatistics(const JsonArena* arena, unsigned int* allocations, unsigned int* chunks);
+
 typedef struct PerfClock
 {
     struct timespec start;
@@ -9,11 +9,21 @@
 // 24 hours
 #define MAX_REPORTING_INTERVAL 86400
 
+// 0 disables the periodic metrics dump, 24 hours at most
+#define MIN_METRICS_INTERVAL 0
+#define MAX_METRICS_INTERVAL 86400
+
+// 0 forwards every telemetry event as is, 24 hours at most
+#define MIN_TELEMETRY_AGGREGATION 0
+#define MAX_TELEMETRY_AGGREGATION 86400
+
 #define REPORTED_NAME "Reported"
 #define REPORTED_COMPONENT_NAME "ComponentName"
 #define REPORTED_SETTING_NAME "ObjectName"
 #define MODEL_VERSION_NAME "ModelVersion"
 #define REPORTING_INTERVAL_SECONDS "ReportingIntervalSeconds"
+#define METRICS_INTERVAL_SECONDS "MetricsIntervalSeconds"
+#define TELEMETRY_AGGREGATION_SECONDS "TelemetryAggregationSeconds"
 #define IOT_HUB_MANAGEMENT "IotHubManagement"
 #define LOCAL_MANAGEMENT "LocalManagement"
 #define PROTOCOL "IotHubProtocol"
@@ -23,6 +33,7 @@
 #define LOGGING_LEVEL "LoggingLevel"
 #define MAX_LOG_SIZE "MaxLogSize"
 #define MAX_LOG_SIZE_DEBUG_MULTIPLIER "MaxLogSizeDebugMultiplier"
+#define STRUCTURED_LOGGING "StructuredLogging"
 
 #define MIN_DEVICE_MODEL_ID 7
 #define MAX_DEVICE_MODEL_ID 999
@@ -67,6 +78,11 @@ bool IsIotHubManagementEnabledInJsonConfig(const char* jsonString)
     return IsOptionEnabledInJsonConfig(jsonString, IOT_HUB_MANAGEMENT);
 }
 
+bool IsStructuredLoggingEnabledInJsonConfig(const char* jsonString)
+{
+    return IsOptionEnabledInJsonConfig(jsonString, STRUCTURED_LOGGING);
+}
+
 static int GetIntegerFromJsonConfig(const char* valueName, const char* jsonString, int defaultValue, int minValue, int maxValue, OsConfigLogHandle log)
 {
     JSON_Value* rootValue = NULL;
@@ -151,6 +167,16 @@ int GetReportingIntervalFromJsonConfig(const char* jsonString, OsConfigLogHandle
     return GetIntegerFromJsonConfig(REPORTING_INTERVAL_SECONDS, jsonString, DEFAULT_REPORTING_INTERVAL, MIN_REPORTING_INTERVAL, MAX_REPORTING_INTERVAL, log);
 }
 
+int GetMetricsIntervalFromJsonConfig(const char* jsonString, OsConfigLogHandle log)
+{
+    return GetIntegerFromJsonConfig(METRICS_INTERVAL_SECONDS, jsonString, MIN_METRICS_INTERVAL, MIN_METRICS_INTERVAL, MAX_METRICS_INTERVAL, log);
+}
+
+int GetTelemetryAggregationFromJsonConfig(const char* jsonString, OsConfigLogHandle log)
+{
+    return GetIntegerFromJsonConfig(TELEMETRY_AGGREGATION_SECONDS, jsonString, MIN_TELEMETRY_AGGREGATION, MIN_TELEMETRY_AGGREGATION, MAX_TELEMETRY_AGGREGATION, log);
+}
+
 int GetModelVersionFromJsonConfig(const char* jsonString, OsConfigLogHandle log)
 {
     return GetIntegerFromJsonConfig(MODEL_VERSION_NAME, jsonString, DEFAULT_DEVICE_MODEL_ID, MIN_DEVICE_MODEL_ID, MAX_DEVICE_MODEL_ID, log);
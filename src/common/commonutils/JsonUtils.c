@@ -0,0 +1,192 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Internal.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define JSON_ARENA_CHUNK_SIZE 16384
+#define MAX_JSON_ARENA_CHUNK_SIZE 1048576
+#define JSON_ARENA_ALIGNMENT _Alignof(max_align_t)
+#define JSON_ARENA_ALIGN(size) (((size) + JSON_ARENA_ALIGNMENT - 1) & ~(JSON_ARENA_ALIGNMENT - 1))
+
+typedef struct JSON_ARENA_CHUNK
+{
+    struct JSON_ARENA_CHUNK* next;
+    size_t size;
+    size_t used;
+} JSON_ARENA_CHUNK;
+
+struct JsonArena
+{
+    // Most recent chunk first, allocations are only made from the first one
+    JSON_ARENA_CHUNK* chunks;
+    size_t nextChunkSize;
+    unsigned int allocations;
+    unsigned int chunkCount;
+};
+
+static pthread_once_t g_jsonArenaOnce = PTHREAD_ONCE_INIT;
+
+// The arena parson allocates from on this thread, NULL for the heap
+static __thread JsonArena* g_jsonArena = NULL;
+
+static char* GetChunkData(JSON_ARENA_CHUNK* chunk)
+{
+    return (char*)chunk + JSON_ARENA_ALIGN(sizeof(JSON_ARENA_CHUNK));
+}
+
+static bool IsInJsonArena(JsonArena* arena, void* pointer)
+{
+    JSON_ARENA_CHUNK* chunk = NULL;
+    char* data = NULL;
+
+    for (chunk = arena->chunks; NULL != chunk; chunk = chunk->next)
+    {
+        data = GetChunkData(chunk);
+
+        if (((char*)pointer >= data) && ((char*)pointer < (data + chunk->size)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void* AllocateFromJsonArena(JsonArena* arena, size_t size)
+{
+    JSON_ARENA_CHUNK* chunk = arena->chunks;
+    size_t chunkSize = 0;
+    void* pointer = NULL;
+
+    size = JSON_ARENA_ALIGN((size > 0) ? size : 1);
+
+    if ((NULL == chunk) || ((chunk->size - chunk->used) < size))
+    {
+        // Chunks grow with the request up to a limit, larger values get a chunk of their own
+        chunkSize = (size > arena->nextChunkSize) ? size : arena->nextChunkSize;
+
+        if (NULL == (chunk = (JSON_ARENA_CHUNK*)malloc(JSON_ARENA_ALIGN(sizeof(JSON_ARENA_CHUNK)) + chunkSize)))
+        {
+            return NULL;
+        }
+
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunkCount += 1;
+
+        if (arena->nextChunkSize < MAX_JSON_ARENA_CHUNK_SIZE)
+        {
+            arena->nextChunkSize *= 2;
+        }
+    }
+
+    pointer = GetChunkData(chunk) + chunk->used;
+    chunk->used += size;
+    arena->allocations += 1;
+
+    return pointer;
+}
+
+static void* JsonArenaMalloc(size_t size)
+{
+    JsonArena* arena = g_jsonArena;
+    return (NULL != arena) ? AllocateFromJsonArena(arena, size) : malloc(size);
+}
+
+// Values in the arena go with it, anything else was allocated on the heap
+static void JsonArenaFree(void* pointer)
+{
+    JsonArena* arena = g_jsonArena;
+
+    if ((NULL != pointer) && ((NULL == arena) || !IsInJsonArena(arena, pointer)))
+    {
+        free(pointer);
+    }
+}
+
+// Values allocated before the functions are set keep working, outside of an arena parson uses malloc and free as before
+static void SetJsonArenaAllocationFunctions(void)
+{
+    json_set_allocation_functions(JsonArenaMalloc, JsonArenaFree);
+}
+
+JsonArena* CreateJsonArena(void)
+{
+    JsonArena* arena = NULL;
+
+    pthread_once(&g_jsonArenaOnce, SetJsonArenaAllocationFunctions);
+
+    if (NULL != (arena = (JsonArena*)calloc(1, sizeof(JsonArena))))
+    {
+        arena->nextChunkSize = JSON_ARENA_CHUNK_SIZE;
+    }
+
+    return arena;
+}
+
+JsonArena* UseJsonArena(JsonArena* arena)
+{
+    JsonArena* previous = g_jsonArena;
+    g_jsonArena = arena;
+    return previous;
+}
+
+void ResetJsonArena(JsonArena* arena)
+{
+    JSON_ARENA_CHUNK* chunk = NULL;
+
+    if ((NULL == arena) || (NULL == arena->chunks))
+    {
+        return;
+    }
+
+    // The most recent chunk is kept for reuse
+    while (NULL != (chunk = arena->chunks->next))
+    {
+        arena->chunks->next = chunk->next;
+        FREE_MEMORY(chunk);
+    }
+
+    arena->chunks->used = 0;
+}
+
+void FreeJsonArena(JsonArena* arena)
+{
+    JSON_ARENA_CHUNK* chunk = NULL;
+
+    if (NULL == arena)
+    {
+        return;
+    }
+
+    if (arena == g_jsonArena)
+    {
+        g_jsonArena = NULL;
+    }
+
+    while (NULL != (chunk = arena->chunks))
+    {
+        arena->chunks = chunk->next;
+        FREE_MEMORY(chunk);
+    }
+
+    FREE_MEMORY(arena);
+}
+
+void GetJsonArenaStatistics(const JsonArena* arena, unsigned int* allocations, unsigned int* chunks)
+{
+    if (NULL != allocations)
+    {
+        *allocations = (NULL != arena) ? arena->allocations : 0;
+    }
+
+    if (NULL != chunks)
+    {
+        *chunks = (NULL != arena) ? arena->chunkCount : 0;
+    }
+}
@@ -165,6 +165,273 @@ size_t HashString(const char* source)
     return hash;
 }
 
+#define MAX_JSON_NESTING 2048
+
+static const char* SkipJsonWhitespace(const char* current, const char* end)
+{
+    while ((current < end) && ((' ' == *current) || ('\t' == *current) || ('\n' == *current) || ('\r' == *current)))
+    {
+        current++;
+    }
+
+    return current;
+}
+
+// Returns the end of the string starting at current, or NULL when it is not terminated
+static const char* SkipJsonString(const char* current, const char* end)
+{
+    for (current++; current < end; current++)
+    {
+        if ('\\' == *current)
+        {
+            current++;
+        }
+        else if ('"' == *current)
+        {
+            return current + 1;
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the end of the value starting at current without parsing it, or NULL when it is not well formed
+static const char* SkipJsonValue(const char* current, const char* end)
+{
+    char nesting[MAX_JSON_NESTING] = {0};
+    int depth = 0;
+    const char* start = NULL;
+
+    do
+    {
+        if (current >= end)
+        {
+            return NULL;
+        }
+        else if ('"' == *current)
+        {
+            current = SkipJsonString(current, end);
+        }
+        else if (('{' == *current) || ('[' == *current))
+        {
+            if (depth >= MAX_JSON_NESTING)
+            {
+                return NULL;
+            }
+
+            nesting[depth++] = ('{' == *current) ? '}' : ']';
+            current++;
+        }
+        else if (('}' == *current) || (']' == *current))
+        {
+            if ((0 == depth) || (nesting[depth - 1] != *current))
+            {
+                return NULL;
+            }
+
+            depth--;
+            current++;
+        }
+        else if ((',' == *current) || (':' == *current))
+        {
+            if (0 == depth)
+            {
+                return NULL;
+            }
+
+            current++;
+        }
+        else if (strchr("-0123456789tfn", *current))
+        {
+            for (start = current; (current < end) && (NULL != strchr("+-.0123456789eEtruefalsn", *current)); current++)
+            {
+            }
+
+            if (current == start)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            return NULL;
+        }
+
+        if (NULL == current)
+        {
+            return NULL;
+        }
+
+        current = SkipJsonWhitespace(current, end);
+    }
+    while (depth > 0);
+
+    return current;
+}
+
+static char* ReadJsonMemberName(const char* start, const char* end)
+{
+    JSON_Value* nameValue = NULL;
+    char* quoted = NULL;
+    char* name = NULL;
+
+    // Names with escape sequences are rare, parson decodes those
+    if (NULL == memchr(start + 1, '\\', end - start - 1))
+    {
+        return strndup(start + 1, end - start - 2);
+    }
+
+    if ((NULL != (quoted = strndup(start, end - start))) && (NULL != (nameValue = json_parse_string(quoted))) && (NULL != json_value_get_string(nameValue)))
+    {
+        name = strdup(json_value_get_string(nameValue));
+    }
+
+    json_value_free(nameValue);
+    FREE_MEMORY(quoted);
+
+    return name;
+}
+
+void FreeJsonMembers(JsonMember* members, int memberCount)
+{
+    int i = 0;
+
+    if (NULL != members)
+    {
+        for (i = 0; i < memberCount; i++)
+        {
+            FREE_MEMORY(members[i].name);
+        }
+
+        FREE_MEMORY(members);
+    }
+}
+
+int ReadJsonObjectMembers(const char* json, int jsonSize, JsonMember** members, int* memberCount, OsConfigLogHandle log)
+{
+    const char* end = json + jsonSize;
+    const char* current = NULL;
+    const char* nameEnd = NULL;
+    JsonMember* list = NULL;
+    JsonMember* grown = NULL;
+    int count = 0;
+    int capacity = 0;
+    int status = 0;
+
+    if ((NULL == json) || (0 > jsonSize) || (NULL == members) || (NULL == memberCount))
+    {
+        OsConfigLogError(log, "ReadJsonObjectMembers: invalid arguments");
+        return EINVAL;
+    }
+
+    *members = NULL;
+    *memberCount = 0;
+
+    current = SkipJsonWhitespace(json, end);
+
+    if ((current >= end) || ('{' != *current))
+    {
+        OsConfigLogError(log, "ReadJsonObjectMembers: not a JSON object");
+        return EINVAL;
+    }
+
+    current = SkipJsonWhitespace(current + 1, end);
+
+    if ((current < end) && ('}' == *current))
+    {
+        current++;
+    }
+    else
+    {
+        while (0 == status)
+        {
+            if ((current >= end) || ('"' != *current) || (NULL == (nameEnd = SkipJsonString(current, end))))
+            {
+                status = EINVAL;
+                break;
+            }
+
+            if (count == capacity)
+            {
+                capacity = (0 == capacity) ? 8 : capacity * 2;
+
+                if (NULL == (grown = (JsonMember*)realloc(list, capacity * sizeof(JsonMember))))
+                {
+                    status = ENOMEM;
+                    break;
+                }
+
+                list = grown;
+            }
+
+            memset(&list[count], 0, sizeof(JsonMember));
+
+            if (NULL == (list[count].name = ReadJsonMemberName(current, nameEnd)))
+            {
+                status = ENOMEM;
+                break;
+            }
+
+            count++;
+
+            current = SkipJsonWhitespace(nameEnd, end);
+
+            if ((current >= end) || (':' != *current))
+            {
+                status = EINVAL;
+                break;
+            }
+
+            list[count - 1].value = current = SkipJsonWhitespace(current + 1, end);
+
+            if (NULL == (current = SkipJsonValue(current, end)))
+            {
+                status = EINVAL;
+                break;
+            }
+
+            // The value ends before the whitespace that follows it
+            for (nameEnd = current; (nameEnd > list[count - 1].value) && isspace((unsigned char)nameEnd[-1]); nameEnd--)
+            {
+            }
+
+            list[count - 1].valueSize = (int)(nameEnd - list[count - 1].value);
+
+            if ((current < end) && (',' == *current))
+            {
+                current = SkipJsonWhitespace(current + 1, end);
+            }
+            else if ((current < end) && ('}' == *current))
+            {
+                current++;
+                break;
+            }
+            else
+            {
+                status = EINVAL;
+            }
+        }
+    }
+
+    if ((0 == status) && (SkipJsonWhitespace(current, end) != end))
+    {
+        status = EINVAL;
+    }
+
+    if (0 == status)
+    {
+        *members = list;
+        *memberCount = count;
+    }
+    else
+    {
+        OsConfigLogError(log, "ReadJsonObjectMembers: failed to read the members of the JSON object (%d)", status);
+        FreeJsonMembers(list, count);
+    }
+
+    return status;
+}
+
 bool FreeAndReturnTrue(void* value)
 {
     FREE_MEMORY(value);
@@ -37,11 +37,266 @@ static atomic_int g_updateInstalledPackagesCache = 0;
 #else
 static int g_updateInstalledPackagesCache = 0;
 #endif
-static char* g_installedPackagesCache = NULL;
+
+typedef struct InstalledPackage
+{
+    char* name;
+    struct InstalledPackage* next;
+} InstalledPackage;
+
+// Must be a power of two
+#define INSTALLED_PACKAGES_BUCKETS 4096
+
+static const char* g_dpkgStatusFile = "/var/lib/dpkg/status";
+static const char* g_rpmDatabase = "/var/lib/rpm";
+
+// Hashed set of installed package names, NULL until the first enumeration succeeds
+static InstalledPackage** g_installedPackages = NULL;
+static char* g_packageDatabaseStamp = NULL;
+
+static void FreeInstalledPackages(InstalledPackage** buckets)
+{
+    InstalledPackage* package = NULL;
+    InstalledPackage* next = NULL;
+    size_t i = 0;
+
+    if (NULL == buckets)
+    {
+        return;
+    }
+
+    for (i = 0; i < INSTALLED_PACKAGES_BUCKETS; i++)
+    {
+        for (package = buckets[i]; NULL != package; package = next)
+        {
+            next = package->next;
+            FREE_MEMORY(package->name);
+            FREE_MEMORY(package);
+        }
+    }
+
+    FREE_MEMORY(buckets);
+}
+
+static bool FindInstalledPackage(InstalledPackage** buckets, const char* name)
+{
+    InstalledPackage* package = NULL;
+
+    if ((NULL == buckets) || (NULL == name))
+    {
+        return false;
+    }
+
+    for (package = buckets[HashString(name) & (INSTALLED_PACKAGES_BUCKETS - 1)]; NULL != package; package = package->next)
+    {
+        if (0 == strcmp(package->name, name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int AddInstalledPackage(InstalledPackage** buckets, const char* name)
+{
+    InstalledPackage* package = NULL;
+    size_t bucket = 0;
+
+    if ((NULL == name) || (0 == name[0]) || FindInstalledPackage(buckets, name))
+    {
+        return 0;
+    }
+
+    if (NULL == (package = (InstalledPackage*)malloc(sizeof(InstalledPackage))))
+    {
+        return ENOMEM;
+    }
+
+    if (NULL == (package->name = DuplicateString(name)))
+    {
+        FREE_MEMORY(package);
+        return ENOMEM;
+    }
+
+    bucket = HashString(name) & (INSTALLED_PACKAGES_BUCKETS - 1);
+    package->next = buckets[bucket];
+    buckets[bucket] = package;
+
+    return 0;
+}
 
 void PackageUtilsCleanup(void)
 {
-    FREE_MEMORY(g_installedPackagesCache);
+    FreeInstalledPackages(g_installedPackages);
+    g_installedPackages = NULL;
+    FREE_MEMORY(g_packageDatabaseStamp);
+}
+
+static char* DuplicateDpkgFieldValue(const char* value)
+{
+    char* result = NULL;
+
+    if (NULL != (result = DuplicateString(value + strspn(value, " \t"))))
+    {
+        RemoveTrailingBlanks(result);
+    }
+
+    return result;
+}
+
+static bool IsDpkgStatusInstalled(const char* status)
+{
+    // The status field holds the wanted state, an error flag and the current state, only 'install ok installed' is what dpkg -l lists as 'ii'
+    status += strlen("Status:");
+    while (isspace((unsigned char)*status))
+    {
+        status++;
+    }
+    return (0 == strcmp(status, "install ok installed")) ? true : false;
+}
+
+int EnumerateDpkgInstalledPackages(const char* statusFile, DpkgPackageCallback callback, void* context, OsConfigLogHandle log)
+{
+    FILE* file = NULL;
+    char* line = NULL;
+    size_t lineSize = 0;
+    ssize_t lineLength = 0;
+    char* name = NULL;
+    char* architecture = NULL;
+    char* version = NULL;
+    bool installed = false;
+    bool endOfParagraph = false;
+    int status = 0;
+
+    if ((NULL == statusFile) || (NULL == callback))
+    {
+        OsConfigLogError(log, "EnumerateDpkgInstalledPackages: invalid arguments");
+        OSConfigTelemetryStatusTrace("statusFile", EINVAL);
+        return EINVAL;
+    }
+
+    if (NULL == (file = fopen(statusFile, "r")))
+    {
+        status = errno ? errno : ENOENT;
+        OsConfigLogInfo(log, "EnumerateDpkgInstalledPackages: cannot open '%s' (%d)", statusFile, status);
+        return status;
+    }
+
+    while (0 == status)
+    {
+        lineLength = getline(&line, &lineSize, file);
+        endOfParagraph = (lineLength < 0) ? true : false;
+
+        if (false == endOfParagraph)
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            endOfParagraph = (0 == line[0]) ? true : false;
+        }
+
+        if (endOfParagraph)
+        {
+            if (installed && (NULL != name))
+            {
+                callback(name, architecture, version, context);
+            }
+
+            FREE_MEMORY(name);
+            FREE_MEMORY(architecture);
+            FREE_MEMORY(version);
+            installed = false;
+
+            if (lineLength < 0)
+            {
+                break;
+            }
+        }
+        else if (0 == strncmp(line, "Package:", strlen("Package:")))
+        {
+            FREE_MEMORY(name);
+            status = (NULL == (name = DuplicateDpkgFieldValue(line + strlen("Package:")))) ? ENOMEM : 0;
+        }
+        else if (0 == strncmp(line, "Architecture:", strlen("Architecture:")))
+        {
+            FREE_MEMORY(architecture);
+            status = (NULL == (architecture = DuplicateDpkgFieldValue(line + strlen("Architecture:")))) ? ENOMEM : 0;
+        }
+        else if (0 == strncmp(line, "Version:", strlen("Version:")))
+        {
+            FREE_MEMORY(version);
+            status = (NULL == (version = DuplicateDpkgFieldValue(line + strlen("Version:")))) ? ENOMEM : 0;
+        }
+        else if (0 == strncmp(line, "Status:", strlen("Status:")))
+        {
+            RemoveTrailingBlanks(line);
+            installed = IsDpkgStatusInstalled(line);
+        }
+    }
+
+    if (ENOMEM == status)
+    {
+        OsConfigLogError(log, "EnumerateDpkgInstalledPackages: out of memory");
+        OSConfigTelemetryStatusTrace("DuplicateString", ENOMEM);
+    }
+
+    FREE_MEMORY(name);
+    FREE_MEMORY(architecture);
+    FREE_MEMORY(version);
+    FREE_MEMORY(line);
+    fclose(file);
+
+    return status;
+}
+
+static char* AppendToPackageDatabaseStamp(char* stamp, const char* path, const struct stat* st)
+{
+    char* newStamp = FormatAllocateString("%s%s:%lu:%ld:%ld.%09ld;", stamp ? stamp : "", path, (unsigned long)st->st_ino, (long)st->st_size,
+        (long)st->st_mtim.tv_sec, (long)st->st_mtim.tv_nsec);
+    FREE_MEMORY(stamp);
+    return newStamp;
+}
+
+char* GetPackageDatabaseStamp(const char* database, OsConfigLogHandle log)
+{
+    struct stat st = {0};
+    DIR* directory = NULL;
+    struct dirent* entry = NULL;
+    char* path = NULL;
+    char* stamp = NULL;
+
+    if ((NULL == database) || (0 != stat(database, &st)))
+    {
+        return NULL;
+    }
+
+    stamp = AppendToPackageDatabaseStamp(NULL, database, &st);
+
+    // For a database directory such as /var/lib/rpm the files in it change while the directory itself may not
+    if ((NULL != stamp) && S_ISDIR(st.st_mode) && (NULL != (directory = opendir(database))))
+    {
+        while ((NULL != stamp) && (NULL != (entry = readdir(directory))))
+        {
+            if (NULL == (path = FormatAllocateString("%s/%s", database, entry->d_name)))
+            {
+                FREE_MEMORY(stamp);
+            }
+            else if ((0 == stat(path, &st)) && S_ISREG(st.st_mode))
+            {
+                stamp = AppendToPackageDatabaseStamp(stamp, path, &st);
+            }
+
+            FREE_MEMORY(path);
+        }
+
+        closedir(directory);
+    }
+
+    if (NULL == stamp)
+    {
+        OsConfigLogError(log, "GetPackageDatabaseStamp: out of memory");
+    }
+
+    return stamp;
 }
 
 int IsPresent(const char* what, OsConfigLogHandle log)
@@ -151,6 +406,69 @@ static int CheckAllPackages(const char* commandTemplate, const char* packageMana
     return status;
 }
 
+static void AddDpkgInstalledPackage(const char* name, const char* architecture, const char* version, void* context)
+{
+    InstalledPackage** buckets = (InstalledPackage**)context;
+    char* qualifiedName = NULL;
+
+    UNUSED(version);
+
+    AddInstalledPackage(buckets, name);
+
+    // Multi-arch packages are also known by their architecture qualified names, as reported by dpkg-query
+    if ((NULL != architecture) && (NULL != (qualifiedName = FormatAllocateString("%s:%s", name, architecture))))
+    {
+        AddInstalledPackage(buckets, qualifiedName);
+        FREE_MEMORY(qualifiedName);
+    }
+}
+
+static int AddInstalledPackagesFromList(InstalledPackage** buckets, char* list, bool zypperTable)
+{
+    char* line = NULL;
+    char* context = NULL;
+    char* name = NULL;
+    int status = 0;
+
+    for (line = strtok_r(list, "\n", &context); (NULL != line) && (0 == status); line = strtok_r(NULL, "\n", &context))
+    {
+        if (zypperTable)
+        {
+            // Table rows look like 'i+ | name | summary | type', the name is the second column
+            if (NULL == (name = strchr(line, '|')))
+            {
+                continue;
+            }
+            name += 1 + strspn(name + 1, " \t");
+            name[strcspn(name, "|")] = 0;
+        }
+        else
+        {
+            name = line + strspn(line, " \t");
+            name[strcspn(name, " \t\r")] = 0;
+        }
+
+        RemoveTrailingBlanks(name);
+        status = AddInstalledPackage(buckets, name);
+    }
+
+    return status;
+}
+
+static const char* GetPackageDatabase(void)
+{
+    if (g_aptGetIsPresent || g_dpkgIsPresent)
+    {
+        return g_dpkgStatusFile;
+    }
+    else if (g_rpmIsPresent || g_tdnfIsPresent || g_dnfIsPresent || g_yumIsPresent || g_zypperIsPresent)
+    {
+        return g_rpmDatabase;
+    }
+
+    return NULL;
+}
+
 static int UpdateInstalledPackagesCache(OsConfigLogHandle log)
 {
     const char* commandTemplateDpkg = "%s-query -W -f='${binary:Package}\n'";
@@ -158,15 +476,28 @@ static int UpdateInstalledPackagesCache(OsConfigLogHandle log)
     const char* commandTemplateYumDnf = "%s list installed --cacheonly | awk '{print $1}'";
     const char* commandTmeplateZypper = "%s search -i";
 
+    InstalledPackage** buckets = NULL;
     char* results = NULL;
-    char* buffer = NULL;
+    bool zypperTable = false;
     int status = ENOENT;
 
     CheckPackageManagersPresence(log);
 
+    if (NULL == (buckets = (InstalledPackage**)calloc(INSTALLED_PACKAGES_BUCKETS, sizeof(InstalledPackage*))))
+    {
+        OsConfigLogError(log, "UpdateInstalledPackagesCache: out of memory");
+        OSConfigTelemetryStatusTrace("calloc", ENOMEM);
+        return ENOMEM;
+    }
+
     if (g_aptGetIsPresent || g_dpkgIsPresent)
     {
-        status = CheckAllPackages(commandTemplateDpkg, g_dpkg, &results, log);
+        // Read the dpkg database directly, falling back to dpkg-query only when it cannot be opened
+        status = EnumerateDpkgInstalledPackages(g_dpkgStatusFile, AddDpkgInstalledPackage, buckets, log);
+        if ((0 != status) && (ENOMEM != status))
+        {
+            status = CheckAllPackages(commandTemplateDpkg, g_dpkg, &results, log);
+        }
     }
     else if (g_rpmIsPresent)
     {
@@ -187,27 +518,23 @@ static int UpdateInstalledPackagesCache(OsConfigLogHandle log)
     else if (g_zypperIsPresent)
     {
         status = CheckAllPackages(commandTmeplateZypper, g_zypper, &results, log);
+        zypperTable = true;
     }
 
     if ((0 == status) && (NULL != results))
     {
-        if (NULL != (buffer = FormatAllocateString("\n%s", results)))
-        {
-            FREE_MEMORY(g_installedPackagesCache);
-            g_installedPackagesCache = buffer;
-        }
-        else
-        {
-            // Leave the cache as-is, just log the error
-            OsConfigLogError(log, "UpdateInstalledPackagesCache: out of memory");
-            OSConfigTelemetryStatusTrace("DuplicateString", ENOMEM);
-            status = ENOMEM;
-        }
+        status = AddInstalledPackagesFromList(buckets, results, zypperTable);
+    }
+
+    if (0 == status)
+    {
+        FreeInstalledPackages(g_installedPackages);
+        g_installedPackages = buckets;
     }
     else
     {
         // Leave the cache as-is, we can still use it even if it's stale
-        status = status ? status : ENOENT;
+        FreeInstalledPackages(buckets);
         OsConfigLogInfo(log, "UpdateInstalledPackagesCache: enumerating all packages failed with %d", status);
     }
 
@@ -218,11 +545,11 @@ static int UpdateInstalledPackagesCache(OsConfigLogHandle log)
 
 int IsPackageInstalled(const char* packageName, OsConfigLogHandle log)
 {
-    const char* searchTemplateDpkgRpm = "\n%s\n";
-    const char* searchTemplateYumDnf = "\n%s.x86_64\n";
-    const char* searchTemplateZypper = "| %s ";
+    const char* searchTemplateYumDnf = "%s.x86_64";
 
+    char* databaseStamp = NULL;
     char* searchTarget = NULL;
+    bool databaseChanged = false;
     int status = 0;
 
     if ((NULL == packageName) || (0 == strlen(packageName)))
@@ -234,7 +561,11 @@ int IsPackageInstalled(const char* packageName, OsConfigLogHandle log)
 
     CheckPackageManagersPresence(log);
 
-    if ((0 != g_updateInstalledPackagesCache) || (NULL == g_installedPackagesCache))
+    // Any change to the package database invalidates the cache, including changes made by other processes
+    databaseStamp = GetPackageDatabaseStamp(GetPackageDatabase(), log);
+    databaseChanged = ((NULL != databaseStamp) && ((NULL == g_packageDatabaseStamp) || (0 != strcmp(databaseStamp, g_packageDatabaseStamp)))) ? true : false;
+
+    if ((0 != g_updateInstalledPackagesCache) || (NULL == g_installedPackages) || databaseChanged)
     {
         g_updateInstalledPackagesCache = 0;
 
@@ -242,26 +573,30 @@ int IsPackageInstalled(const char* packageName, OsConfigLogHandle log)
         {
             OsConfigLogInfo(log, "IsPackageInstalled(%s) failed (UpdateInstalledPackagesCache failed)", packageName);
         }
+        else
+        {
+            FREE_MEMORY(g_packageDatabaseStamp);
+            g_packageDatabaseStamp = databaseStamp;
+            databaseStamp = NULL;
+        }
     }
 
-    if (NULL == g_installedPackagesCache)
+    FREE_MEMORY(databaseStamp);
+
+    if (NULL == g_installedPackages)
     {
         OsConfigLogError(log, "IsPackageInstalled: cannot check for '%s' presence without cache", packageName);
         status = ENOENT;
     }
     else if (0 == status)
     {
-        if (g_aptGetIsPresent || g_dpkgIsPresent || g_rpmIsPresent)
-        {
-            searchTarget = FormatAllocateString(searchTemplateDpkgRpm, packageName);
-        }
-        else if (g_tdnfIsPresent || g_dnfIsPresent || g_yumIsPresent)
+        if ((g_tdnfIsPresent || g_dnfIsPresent || g_yumIsPresent) && !(g_aptGetIsPresent || g_dpkgIsPresent || g_rpmIsPresent))
         {
             searchTarget = FormatAllocateString(searchTemplateYumDnf, packageName);
         }
-        else //if (g_zypperIsPresent)
+        else
         {
-            searchTarget = FormatAllocateString(searchTemplateZypper, packageName);
+            searchTarget = DuplicateString(packageName);
         }
 
         if (NULL == searchTarget)
@@ -272,7 +607,7 @@ int IsPackageInstalled(const char* packageName, OsConfigLogHandle log)
         }
         else
         {
-            if (NULL != strstr(g_installedPackagesCache, searchTarget))
+            if (FindInstalledPackage(g_installedPackages, searchTarget))
             {
                 OsConfigLogInfo(log, "IsPackageInstalled: '%s' is installed", packageName);
             }
@@ -3,13 +3,37 @@
 
 #include "Internal.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
 #define MAX_MPI_URI_LENGTH 32
 
+// Headers are pulled in chunks of this size, larger headers grow the buffer up to the limit
+#define HTTP_HEADER_CHUNK_SIZE 1024
+#define MAX_HTTP_HEADER_SIZE 65536
+
+#define MAX_CONTENT_HEADERS_LENGTH 128
+
+// A body passed as a memfd cannot change or be resized once sent
+#if defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+#define HTTP_MEMFD_BODY_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
+static const char* g_memfdBodyHeader = "OSConfig-Body: memfd\r\n";
+
+// Reads one byte at a time so that nothing past the marker is consumed, which also works on descriptors
+// that are not sockets. Only the tail that can complete the marker is compared after each byte.
 static char* ReadUntilStringFound(int socketHandle, const char* what, OsConfigLogHandle log)
 {
-    char* found = NULL;
     char* buffer = NULL;
-    int size = 1;
+    char* newBuffer = NULL;
+    size_t whatLength = 0;
+    size_t capacity = 64;
+    size_t size = 0;
+    bool found = false;
 
     if ((NULL == what) || (socketHandle < 0))
     {
@@ -18,7 +42,9 @@ static char* ReadUntilStringFound(int socketHandle, const char* what, OsConfigLo
         return NULL;
     }
 
-    buffer = (char*)malloc(size + 1);
+    whatLength = strlen(what);
+
+    buffer = (char*)malloc(capacity + 1);
     if (NULL == buffer)
     {
         OsConfigLogError(log, "ReadUntilStringFound: out of memory allocating initial buffer");
@@ -26,33 +52,34 @@ static char* ReadUntilStringFound(int socketHandle, const char* what, OsConfigLo
         return NULL;
     }
 
-    memset(buffer, 0, size + 1);
+    memset(buffer, 0, capacity + 1);
 
-    while (1 == read(socketHandle, &(buffer[size - 1]), 1))
+    while (1 == read(socketHandle, &(buffer[size]), 1))
     {
-        if (NULL != (found = strstr(buffer, what)))
+        size += 1;
+
+        if ((size >= whatLength) && (0 == memcmp(&(buffer[size - whatLength]), what, whatLength)))
         {
-            buffer[size] = 0;
+            found = true;
             break;
         }
-        else
+
+        if (size == capacity)
         {
-            size += 1;
-            buffer = (char*)realloc(buffer, size + 1);
-            if (NULL == buffer)
+            capacity *= 2;
+            if (NULL == (newBuffer = (char*)realloc(buffer, capacity + 1)))
             {
                 OsConfigLogError(log, "ReadUntilStringFound: out of memory reallocating buffer");
                 OSConfigTelemetryStatusTrace("realloc", ENOMEM);
                 break;
             }
-            else
-            {
-                buffer[size] = 0;
-            }
+
+            buffer = newBuffer;
+            memset(&(buffer[size]), 0, capacity + 1 - size);
         }
     }
 
-    if (NULL == found)
+    if (!found)
     {
         FREE_MEMORY(buffer);
     }
@@ -155,9 +182,10 @@ int ReadHttpStatusFromSocket(int socketHandle, OsConfigLogHandle log)
     return httpStatus;
 }
 
-int ReadHttpContentLengthFromSocket(int socketHandle, OsConfigLogHandle log)
+int ReadHttpHeadersFromSocket(int socketHandle, bool* keepAlive, OsConfigLogHandle log)
 {
     const char* contentLengthLabel = "Content-Length: ";
+    const char* connectionCloseLabel = "Connection: close";
     const char* doubleTerminator = "\r\n\r\n";
 
     int httpContentLength = 0;
@@ -166,9 +194,14 @@ int ReadHttpContentLengthFromSocket(int socketHandle, OsConfigLogHandle log)
     char isolatedContentLength[64] = {0};
     size_t i = 0;
 
+    if (NULL != keepAlive)
+    {
+        *keepAlive = false;
+    }
+
     if (socketHandle < 0)
     {
-        OsConfigLogError(log, "ReadHttpContentLengthFromSocket: invalid socket (%d)", socketHandle);
+        OsConfigLogError(log, "ReadHttpHeadersFromSocket: invalid socket (%d)", socketHandle);
         OSConfigTelemetryStatusTrace("socketHandle", EINVAL);
         return httpContentLength;
     }
@@ -196,12 +229,489 @@ int ReadHttpContentLengthFromSocket(int socketHandle, OsConfigLogHandle log)
             if (isdigit(isolatedContentLength[0]))
             {
                 httpContentLength = atoi(isolatedContentLength);
-                OsConfigLogDebug(log, "ReadHttpContentLengthFromSocket: %d ('%s')", httpContentLength, isolatedContentLength);
+                OsConfigLogDebug(log, "ReadHttpHeadersFromSocket: %d ('%s')", httpContentLength, isolatedContentLength);
             }
         }
 
+        // HTTP/1.1 connections are persistent unless either side asks to close
+        if (NULL != keepAlive)
+        {
+            *keepAlive = (NULL == strstr(buffer, connectionCloseLabel));
+        }
+
         FREE_MEMORY(buffer);
     }
 
     return httpContentLength;
 }
+
+int ReadHttpContentLengthFromSocket(int socketHandle, OsConfigLogHandle log)
+{
+    return ReadHttpHeadersFromSocket(socketHandle, NULL, log);
+}
+
+static char* FindHeaderTerminator(char* buffer, size_t from, size_t to)
+{
+    const char* doubleTerminator = "\r\n\r\n";
+    const size_t terminatorLength = 4;
+    size_t i = 0;
+
+    // Only the bytes received since the last scan, plus the tail of a terminator split across two receives
+    i = (from >= terminatorLength - 1) ? (from - (terminatorLength - 1)) : 0;
+
+    for (; (i + terminatorLength) <= to; i++)
+    {
+        if (0 == memcmp(&(buffer[i]), doubleTerminator, terminatorLength))
+        {
+            return &(buffer[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static int ParseHttpHeaders(HttpMessage* message, OsConfigLogHandle log)
+{
+    const char* httpPrefix = "HTTP/";
+    const char* contentLengthLabel = "Content-Length:";
+    const char* connectionLabel = "Connection:";
+    const char* bodyLabel = "OSConfig-Body:";
+    const char* acceptBodyLabel = "OSConfig-Accept-Body:";
+    const char* memfd = "memfd";
+
+    char* line = message->header;
+    char* next = NULL;
+    char* value = NULL;
+    char* end = NULL;
+    bool startLine = true;
+    long contentLength = 0;
+
+    // HTTP/1.1 connections are persistent unless either side asks to close
+    message->keepAlive = true;
+
+    while ((NULL != line) && (0 != *line))
+    {
+        if (NULL != (next = strstr(line, "\r\n")))
+        {
+            *next = 0;
+            next += 2;
+        }
+
+        if (startLine)
+        {
+            startLine = false;
+
+            if (0 == strncmp(line, httpPrefix, strlen(httpPrefix)))
+            {
+                // Response: HTTP/1.1 <status> <reason>
+                if ((NULL == (value = strchr(line, ' '))) || (0 >= (message->status = (int)strtol(value + 1, &end, 10))) || ((' ' != *end) && (0 != *end)))
+                {
+                    OsConfigLogError(log, "ReadHttpMessageFromSocket: invalid status line '%s'", line);
+                    return EINVAL;
+                }
+            }
+            else
+            {
+                // Request: <method> /<uri>/ HTTP/1.1
+                message->method = line;
+                if ((NULL == (value = strchr(line, ' '))) || ('/' != value[1]))
+                {
+                    OsConfigLogError(log, "ReadHttpMessageFromSocket: invalid request line '%s'", line);
+                    return EINVAL;
+                }
+
+                *value = 0;
+                message->uri = value + 2;
+                message->uri[strcspn(message->uri, "/ ")] = 0;
+            }
+        }
+        else if (0 == strncasecmp(line, contentLengthLabel, strlen(contentLengthLabel)))
+        {
+            value = line + strlen(contentLengthLabel);
+            contentLength = strtol(value, &end, 10);
+            if ((end == value) || (contentLength < 0) || (contentLength > INT_MAX))
+            {
+                OsConfigLogError(log, "ReadHttpMessageFromSocket: invalid Content-Length '%s'", value);
+                return EINVAL;
+            }
+            message->contentLength = (int)contentLength;
+        }
+        else if (0 == strncasecmp(line, connectionLabel, strlen(connectionLabel)))
+        {
+            value = line + strlen(connectionLabel);
+            value += strspn(value, " \t");
+            message->keepAlive = (0 != strncasecmp(value, "close", strlen("close")));
+        }
+        else if (0 == strncasecmp(line, bodyLabel, strlen(bodyLabel)))
+        {
+            value = line + strlen(bodyLabel);
+            value += strspn(value, " \t");
+            message->memfdBody = (0 == strncasecmp(value, memfd, strlen(memfd)));
+        }
+        else if (0 == strncasecmp(line, acceptBodyLabel, strlen(acceptBodyLabel)))
+        {
+            value = line + strlen(acceptBodyLabel);
+            value += strspn(value, " \t");
+            message->acceptsMemfdBody = (0 == strncasecmp(value, memfd, strlen(memfd)));
+        }
+
+        line = next;
+    }
+
+    return 0;
+}
+
+// Receives like recv, also taking a descriptor passed along with the bytes. A descriptor received earlier is closed.
+static ssize_t ReceiveWithDescriptor(int socketHandle, char* buffer, size_t size, int* descriptor)
+{
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec part = {0};
+    struct msghdr message = {0};
+    struct cmsghdr* controlMessage = NULL;
+    ssize_t bytes = 0;
+
+    memset(&control, 0, sizeof(control));
+    part.iov_base = buffer;
+    part.iov_len = size;
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    if ((0 < (bytes = recvmsg(socketHandle, &message, MSG_CMSG_CLOEXEC))) && (NULL != (controlMessage = CMSG_FIRSTHDR(&message))) &&
+        (SOL_SOCKET == controlMessage->cmsg_level) && (SCM_RIGHTS == controlMessage->cmsg_type) && (CMSG_LEN(sizeof(int)) == controlMessage->cmsg_len))
+    {
+        if (0 <= *descriptor)
+        {
+            close(*descriptor);
+        }
+
+        memcpy(descriptor, CMSG_DATA(controlMessage), sizeof(int));
+    }
+
+    return bytes;
+}
+
+// Maps a body passed as a sealed memfd, which has to hold exactly the body followed by the null terminator.
+// The seals guarantee that the mapped body cannot change or go away under the receiver.
+static int MapBodyFromMemfd(int descriptor, HttpMessage* message, OsConfigLogHandle log)
+{
+#ifdef HTTP_MEMFD_BODY_SEALS
+    struct stat fileStat = {0};
+    size_t size = (size_t)message->contentLength + 1;
+    char* body = NULL;
+    int seals = 0;
+
+    if ((0 > (seals = fcntl(descriptor, F_GET_SEALS))) || (HTTP_MEMFD_BODY_SEALS != (seals & HTTP_MEMFD_BODY_SEALS)))
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: the body is not passed as a sealed memfd");
+        return EPROTO;
+    }
+
+    if ((0 != fstat(descriptor, &fileStat)) || ((off_t)size != fileStat.st_size))
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: the memfd holds %ld bytes instead of the Content-Length %d", (long)fileStat.st_size, message->contentLength);
+        return EPROTO;
+    }
+
+    if (MAP_FAILED == (body = (char*)mmap(NULL, size, PROT_READ, MAP_SHARED | MAP_POPULATE, descriptor, 0)))
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: failed to map the memfd of %d bytes (%d)", message->contentLength, errno);
+        return errno ? errno : EIO;
+    }
+
+    if (0 != body[message->contentLength])
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: the body passed as memfd is not null-terminated");
+        munmap(body, size);
+        return EPROTO;
+    }
+
+    message->body = body;
+    message->mappedBodySize = size;
+
+    return 0;
+#else
+    UNUSED(descriptor);
+    UNUSED(message);
+    OsConfigLogError(log, "ReadHttpMessageFromSocket: bodies passed as memfd are not supported");
+    return EPROTO;
+#endif
+}
+
+int ReadHttpMessageFromSocket(int socketHandle, HttpMessage* message, OsConfigLogHandle log)
+{
+    char* newHeader = NULL;
+    char* terminator = NULL;
+    size_t capacity = HTTP_HEADER_CHUNK_SIZE;
+    size_t length = 0;
+    size_t consume = 0;
+    ssize_t bytes = 0;
+    int bodyDescriptor = -1;
+    int status = 0;
+
+    if ((socketHandle < 0) || (NULL == message))
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: invalid arguments");
+        OSConfigTelemetryStatusTrace("socketHandle", EINVAL);
+        return EINVAL;
+    }
+
+    memset(message, 0, sizeof(HttpMessage));
+
+    if (NULL == (message->header = (char*)malloc(capacity + 1)))
+    {
+        OsConfigLogError(log, "ReadHttpMessageFromSocket: out of memory");
+        OSConfigTelemetryStatusTrace("malloc", ENOMEM);
+        return ENOMEM;
+    }
+
+    // The headers are peeked in chunks and only the bytes up to the end of the headers are consumed,
+    // leaving the body and anything after it (the next request of a persistent connection) in the socket
+    while (NULL == terminator)
+    {
+        if (length == capacity)
+        {
+            if ((capacity >= MAX_HTTP_HEADER_SIZE) || (NULL == (newHeader = (char*)realloc(message->header, (capacity * 2) + 1))))
+            {
+                OsConfigLogError(log, "ReadHttpMessageFromSocket: headers larger than %u bytes", (unsigned int)capacity);
+                status = EMSGSIZE;
+                break;
+            }
+
+            message->header = newHeader;
+            capacity *= 2;
+        }
+
+        message->reads += 1;
+        if (0 >= (bytes = recv(socketHandle, &(message->header[length]), capacity - length, MSG_PEEK)))
+        {
+            status = (0 == bytes) ? ECONNRESET : (errno ? errno : EIO);
+            break;
+        }
+
+        if (NULL != (terminator = FindHeaderTerminator(message->header, length, length + bytes)))
+        {
+            consume = (size_t)(terminator - message->header) + 4 - length;
+        }
+        else
+        {
+            consume = (size_t)bytes;
+        }
+
+        // A body passed as a memfd comes as a descriptor along with the headers
+        message->reads += 1;
+        if ((ssize_t)consume != ReceiveWithDescriptor(socketHandle, &(message->header[length]), consume, &bodyDescriptor))
+        {
+            status = errno ? errno : EIO;
+            break;
+        }
+
+        length += consume;
+    }
+
+    if (0 == status)
+    {
+        // Terminates the headers right after the last header line
+        message->header[length - 2] = 0;
+        status = ParseHttpHeaders(message, log);
+    }
+
+    if ((0 == status) && message->memfdBody)
+    {
+        // A body passed as a memfd is mapped instead of copied
+        if (0 > bodyDescriptor)
+        {
+            OsConfigLogError(log, "ReadHttpMessageFromSocket: the memfd of the body is missing");
+            status = EPROTO;
+        }
+        else
+        {
+            status = MapBodyFromMemfd(bodyDescriptor, message, log);
+        }
+    }
+    else if (0 == status)
+    {
+        // The body is received straight into its own buffer that callers can take over
+        if (NULL == (message->body = (char*)malloc(message->contentLength + 1)))
+        {
+            OsConfigLogError(log, "ReadHttpMessageFromSocket: out of memory for body of %d bytes", message->contentLength);
+            OSConfigTelemetryStatusTrace("malloc", ENOMEM);
+            status = ENOMEM;
+        }
+        else
+        {
+            message->body[message->contentLength] = 0;
+
+            if (message->contentLength > 0)
+            {
+                message->reads += 1;
+                if (message->contentLength != (int)(bytes = recv(socketHandle, message->body, message->contentLength, MSG_WAITALL)))
+                {
+                    OsConfigLogError(log, "ReadHttpMessageFromSocket: failed to read complete body, Content-Length %d, bytes read %d", message->contentLength, (int)bytes);
+                    status = (bytes < 0) ? (errno ? errno : EIO) : ECONNRESET;
+                }
+            }
+        }
+    }
+
+    if (0 <= bodyDescriptor)
+    {
+        close(bodyDescriptor);
+    }
+
+    if (0 != status)
+    {
+        FreeHttpMessage(message);
+    }
+
+    return status;
+}
+
+// Returns a sealed memfd holding the body, or -1 when it cannot be created and the body has to be sent inline
+static int CreateBodyMemfd(const char* body, int bodySize, OsConfigLogHandle log)
+{
+#ifdef HTTP_MEMFD_BODY_SEALS
+    ssize_t bytes = 0;
+    int descriptor = -1;
+    int length = 0;
+
+    if (0 > (descriptor = memfd_create("osconfig-http-body", MFD_CLOEXEC | MFD_ALLOW_SEALING)))
+    {
+        OsConfigLogDebug(log, "SendHttpMessageToSocket: memfd_create failed (%d), sending the body inline", errno);
+        return -1;
+    }
+
+    // The null terminator goes along so that the receiver can use the mapped body as a string
+    while ((length < bodySize) && (0 < (bytes = write(descriptor, &(body[length]), bodySize - length))))
+    {
+        length += (int)bytes;
+    }
+
+    if ((length != bodySize) || (1 != write(descriptor, "", 1)) || (0 != fcntl(descriptor, F_ADD_SEALS, HTTP_MEMFD_BODY_SEALS | F_SEAL_SEAL)))
+    {
+        OsConfigLogDebug(log, "SendHttpMessageToSocket: failed to fill and seal the memfd (%d), sending the body inline", errno);
+        close(descriptor);
+        descriptor = -1;
+    }
+
+    return descriptor;
+#else
+    UNUSED(body);
+    UNUSED(bodySize);
+    UNUSED(log);
+    return -1;
+#endif
+}
+
+int SendHttpMessageToSocket(int socketHandle, const char* headers, const char* body, int bodySize, bool memfdBody, OsConfigLogHandle log)
+{
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    char contentHeaders[MAX_CONTENT_HEADERS_LENGTH] = {0};
+    struct iovec parts[3] = {{0}};
+    struct msghdr message = {0};
+    struct cmsghdr* controlMessage = NULL;
+    int bodyDescriptor = -1;
+    ssize_t bytes = 0;
+    int status = 0;
+
+    if ((socketHandle < 0) || (NULL == headers) || ((NULL == body) && (0 != bodySize)) || (bodySize < 0))
+    {
+        OsConfigLogError(log, "SendHttpMessageToSocket: invalid arguments");
+        OSConfigTelemetryStatusTrace("socketHandle", EINVAL);
+        return EINVAL;
+    }
+
+    if (memfdBody && (bodySize >= HTTP_MEMFD_BODY_THRESHOLD))
+    {
+        bodyDescriptor = CreateBodyMemfd(body, bodySize, log);
+    }
+
+    snprintf(contentHeaders, sizeof(contentHeaders), "Content-Length: %d\r\n%s\r\n", bodySize, (0 <= bodyDescriptor) ? g_memfdBodyHeader : "");
+
+    // The headers and the body go out together without being copied into one buffer first
+    parts[0].iov_base = (void*)headers;
+    parts[0].iov_len = strlen(headers);
+    parts[1].iov_base = contentHeaders;
+    parts[1].iov_len = strlen(contentHeaders);
+    parts[2].iov_base = (void*)body;
+    parts[2].iov_len = (0 <= bodyDescriptor) ? 0 : (size_t)bodySize;
+    message.msg_iov = parts;
+    message.msg_iovlen = ARRAY_SIZE(parts);
+
+    if (0 <= bodyDescriptor)
+    {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        controlMessage = CMSG_FIRSTHDR(&message);
+        controlMessage->cmsg_level = SOL_SOCKET;
+        controlMessage->cmsg_type = SCM_RIGHTS;
+        controlMessage->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(controlMessage), &bodyDescriptor, sizeof(int));
+    }
+
+    while (message.msg_iovlen > 0)
+    {
+        if (0 > (bytes = sendmsg(socketHandle, &message, MSG_NOSIGNAL)))
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            status = errno ? errno : EIO;
+            OsConfigLogError(log, "SendHttpMessageToSocket: failed to send the message (%d)", status);
+            break;
+        }
+
+        // The descriptor goes with the first bytes only, what a partial send left out is sent next
+        message.msg_control = NULL;
+        message.msg_controllen = 0;
+
+        while ((message.msg_iovlen > 0) && ((size_t)bytes >= message.msg_iov[0].iov_len))
+        {
+            bytes -= (ssize_t)message.msg_iov[0].iov_len;
+            message.msg_iov += 1;
+            message.msg_iovlen -= 1;
+        }
+
+        if (message.msg_iovlen > 0)
+        {
+            message.msg_iov[0].iov_base = (char*)message.msg_iov[0].iov_base + bytes;
+            message.msg_iov[0].iov_len -= (size_t)bytes;
+        }
+    }
+
+    if (0 <= bodyDescriptor)
+    {
+        close(bodyDescriptor);
+    }
+
+    return status;
+}
+
+void FreeHttpMessage(HttpMessage* message)
+{
+    if (NULL != message)
+    {
+        FREE_MEMORY(message->header);
+
+        if (message->mappedBodySize > 0)
+        {
+            munmap(message->body, message->mappedBodySize);
+            message->body = NULL;
+        }
+
+        FREE_MEMORY(message->body);
+        memset(message, 0, sizeof(HttpMessage));
+    }
+}
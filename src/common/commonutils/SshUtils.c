@@ -3,6 +3,8 @@
 
 #include "Internal.h"
 #include "SshUtils.h"
+#include <glob.h>
+#include <strings.h>
 
 static const char* g_sshServerService = "sshd";
 static const char* g_sshServerConfiguration = "/etc/ssh/sshd_config";
@@ -139,46 +141,238 @@ static char* g_desiredAppropriateCiphersForSsh = NULL;
 
 static bool g_auditOnlySession = true;
 
-static char* GetSshServerState(const char* name, OsConfigLogHandle log)
+// Effective configuration reported by 'sshd -T', reused for as long as the configuration stamp does not change
+static char* g_sshdSnapshot = NULL;
+static char* g_sshdSnapshotStamp = NULL;
+
+#define MAX_SSHD_INCLUDE_DEPTH 16
+
+static void AppendToSshdConfigurationStamp(const char* path, const struct stat* st, char** stamp)
+{
+    char* newStamp = NULL;
+
+    if (NULL == *stamp)
+    {
+        return;
+    }
+
+    if (NULL == st)
+    {
+        newStamp = FormatAllocateString("%s%s:-;", *stamp, path);
+    }
+    else
+    {
+        newStamp = FormatAllocateString("%s%s:%lu:%ld:%ld.%09ld;", *stamp, path, (unsigned long)st->st_ino, (long)st->st_size, (long)st->st_mtim.tv_sec,
+            (long)st->st_mtim.tv_nsec);
+    }
+
+    FREE_MEMORY(*stamp);
+    *stamp = newStamp;
+}
+
+static void StampSshdConfigurationFile(const char* fileName, const char* baseDirectory, unsigned int depth, char** stamp, OsConfigLogHandle log);
+
+static void StampSshdConfigurationInclude(const char* include, const char* baseDirectory, unsigned int depth, char** stamp, OsConfigLogHandle log)
+{
+    char* pattern = NULL;
+    char* directory = NULL;
+    struct stat st = {0};
+    glob_t matches = {0};
+    size_t i = 0;
+
+    // Relative includes are resolved against the directory of the main configuration file, as sshd does for /etc/ssh
+    if (NULL == (pattern = ('/' == include[0]) ? DuplicateString(include) : FormatAllocateString("%s/%s", baseDirectory, include)))
+    {
+        FREE_MEMORY(*stamp);
+        return;
+    }
+
+    // The directory holding the included files is part of the stamp so that adding or removing a file is detected
+    if (NULL != (directory = DuplicateString(pattern)))
+    {
+        dirname(directory);
+        AppendToSshdConfigurationStamp(directory, (0 == stat(directory, &st)) ? &st : NULL, stamp);
+        FREE_MEMORY(directory);
+    }
+
+    if (0 == glob(pattern, 0, NULL, &matches))
+    {
+        for (i = 0; i < matches.gl_pathc; i++)
+        {
+            StampSshdConfigurationFile(matches.gl_pathv[i], baseDirectory, depth + 1, stamp, log);
+        }
+    }
+
+    globfree(&matches);
+    FREE_MEMORY(pattern);
+}
+
+static void StampSshdConfigurationFile(const char* fileName, const char* baseDirectory, unsigned int depth, char** stamp, OsConfigLogHandle log)
+{
+    const char* includeKeyword = "Include";
+    const size_t includeKeywordLength = strlen(includeKeyword);
+    struct stat st = {0};
+    char* contents = NULL;
+    char* line = NULL;
+    char* lineContext = NULL;
+    char* argument = NULL;
+    char* argumentContext = NULL;
+
+    if (0 != stat(fileName, &st))
+    {
+        AppendToSshdConfigurationStamp(fileName, NULL, stamp);
+        return;
+    }
+
+    AppendToSshdConfigurationStamp(fileName, &st, stamp);
+
+    if (depth >= MAX_SSHD_INCLUDE_DEPTH)
+    {
+        OsConfigLogInfo(log, "StampSshdConfigurationFile: too many nested includes at '%s'", fileName);
+        return;
+    }
+
+    if (NULL == (contents = LoadStringFromFile(fileName, false, log)))
+    {
+        return;
+    }
+
+    for (line = strtok_r(contents, "\n", &lineContext); (NULL != line) && (NULL != *stamp); line = strtok_r(NULL, "\n", &lineContext))
+    {
+        line += strspn(line, " \t");
+        if ((0 != strncasecmp(line, includeKeyword, includeKeywordLength)) || (0 == line[includeKeywordLength]) ||
+            (NULL == strchr(" \t=", line[includeKeywordLength])))
+        {
+            continue;
+        }
+
+        for (argument = strtok_r(line + includeKeywordLength, " \t=\r", &argumentContext); (NULL != argument) && (NULL != *stamp);
+             argument = strtok_r(NULL, " \t\r", &argumentContext))
+        {
+            StampSshdConfigurationInclude(argument, baseDirectory, depth, stamp, log);
+        }
+    }
+
+    FREE_MEMORY(contents);
+}
+
+char* GetSshdConfigurationStamp(const char* configuration, OsConfigLogHandle log)
+{
+    char* baseDirectory = NULL;
+    char* stamp = NULL;
+
+    if (NULL == configuration)
+    {
+        OsConfigLogError(log, "GetSshdConfigurationStamp: invalid argument");
+        return NULL;
+    }
+
+    if ((NULL == (baseDirectory = DuplicateString(configuration))) || (NULL == (stamp = DuplicateString(""))))
+    {
+        OsConfigLogError(log, "GetSshdConfigurationStamp: out of memory");
+        FREE_MEMORY(baseDirectory);
+        return NULL;
+    }
+
+    StampSshdConfigurationFile(configuration, dirname(baseDirectory), 0, &stamp, log);
+
+    if (NULL == stamp)
+    {
+        OsConfigLogError(log, "GetSshdConfigurationStamp: out of memory");
+    }
+
+    FREE_MEMORY(baseDirectory);
+    return stamp;
+}
+
+static void ClearSshdSnapshot(void)
+{
+    FREE_MEMORY(g_sshdSnapshot);
+    FREE_MEMORY(g_sshdSnapshotStamp);
+}
+
+static const char* GetSshdSnapshot(OsConfigLogHandle log)
 {
     const char* sshdDashTCommand = "sshd -T";
-    const char* commandTemplateForOne = "%s | grep  -m 1 -w %s";
-    char* command = NULL;
+    char* stamp = GetSshdConfigurationStamp(g_sshServerConfiguration, log);
     char* textResult = NULL;
     int status = 0;
 
-    if (NULL == name)
+    if ((NULL != g_sshdSnapshot) && (NULL != stamp) && (NULL != g_sshdSnapshotStamp) && (0 == strcmp(stamp, g_sshdSnapshotStamp)))
     {
-        if (0 != (status = ExecuteCommand(NULL, sshdDashTCommand, true, false, 0, 0, &textResult, NULL, NULL)))
-        {
-            OsConfigLogInfo(log, "GetSshServerState: '%s' failed with %d and '%s'", sshdDashTCommand, status, textResult);
-            FREE_MEMORY(textResult);
-        }
+        FREE_MEMORY(stamp);
+        return g_sshdSnapshot;
     }
-    else
+
+    ClearSshdSnapshot();
+
+    if (0 != (status = ExecuteCommand(NULL, sshdDashTCommand, true, false, 0, 0, &textResult, NULL, NULL)))
+    {
+        OsConfigLogInfo(log, "GetSshdSnapshot: '%s' failed with %d and '%s'", sshdDashTCommand, status, textResult);
+        FREE_MEMORY(textResult);
+        FREE_MEMORY(stamp);
+        return NULL;
+    }
+
+    g_sshdSnapshot = textResult;
+    g_sshdSnapshotStamp = stamp;
+
+    return g_sshdSnapshot;
+}
+
+static char* FindSshServerOption(const char* snapshot, const char* name)
+{
+    size_t nameLength = strlen(name);
+    const char* line = snapshot;
+    const char* value = NULL;
+    char* result = NULL;
+
+    while ((NULL != line) && (0 != line[0]))
     {
-        if (NULL != (command = FormatAllocateString(commandTemplateForOne, sshdDashTCommand, name)))
+        if ((0 == strncasecmp(line, name, nameLength)) && ((' ' == line[nameLength]) || ('\t' == line[nameLength])))
         {
-            if (0 != (status = ExecuteCommand(NULL, command, true, false, 0, 0, &textResult, NULL, NULL)))
+            value = line + nameLength + strspn(line + nameLength, " \t");
+            if (NULL != (result = DuplicateString(value)))
             {
-                OsConfigLogInfo(log, "GetSshServerState: '%s' failed with %d and '%s'", command, status, textResult);
-                FREE_MEMORY(textResult);
-            }
-            else if ((NULL != textResult) && (NULL != strstr(textResult, name)))
-            {
-                RemovePrefixUpToString(textResult, name);
-                RemovePrefixUpTo(textResult, ' ');
-                RemovePrefixBlanks(textResult);
-                RemoveTrailingBlanks(textResult);
+                result[strcspn(result, "\n")] = 0;
+                RemoveTrailingBlanks(result);
             }
+            break;
         }
-        else
+
+        if (NULL != (line = strchr(line, '\n')))
         {
-            OsConfigLogError(log, "GetSshServerState: FormatAllocateString failed");
-            OSConfigTelemetryStatusTrace("FormatAllocateString", ENOMEM);
+            line++;
         }
+    }
+
+    return result;
+}
+
+static char* GetSshServerState(const char* name, OsConfigLogHandle log)
+{
+    const char* snapshot = NULL;
+    char* textResult = NULL;
+
+    // 'sshd -T' reports the whole effective configuration at once, so it runs once and is parsed here for each option
+    if (NULL == (snapshot = GetSshdSnapshot(log)))
+    {
+        return NULL;
+    }
+
+    if (NULL == name)
+    {
+        textResult = DuplicateString(snapshot);
+    }
+    else
+    {
+        textResult = FindSshServerOption(snapshot, name);
+    }
 
-        FREE_MEMORY(command);
+    // Without a stamp there is no way to tell when the snapshot becomes stale, so it is only kept for this call
+    if (NULL == g_sshdSnapshotStamp)
+    {
+        ClearSshdSnapshot();
     }
 
     return textResult;
@@ -1238,6 +1432,8 @@ void SshAuditCleanup(OsConfigLogHandle log)
     FREE_MEMORY(g_desiredUsersCannotSetSshEnvironmentOptions);
     FREE_MEMORY(g_desiredAppropriateCiphersForSsh);
 
+    ClearSshdSnapshot();
+
     g_auditOnlySession = true;
 }
 
@@ -14,6 +14,10 @@ int InitializeSshAuditCheck(const char* name, char* value, OsConfigLogHandle log
 int ProcessSshAuditCheck(const char* name, char* value, char** reason, OsConfigLogHandle log);
 void SshAuditCleanup(OsConfigLogHandle log);
 
+// Returns a stamp made of the identity, size and modification time of the sshd configuration file and of all the files
+// it includes, which changes whenever the effective configuration reported by 'sshd -T' may have changed. Caller frees.
+char* GetSshdConfigurationStamp(const char* configuration, OsConfigLogHandle log);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,67 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "Logging.h"
+
+// Decodes structured logs (such as /var/log/osconfig_platform.log.bin) to standard output:
+//   osconfig-log-decoder [--json] [file...]
+// Reads standard input when no file is given. Text lines match the text log, --json writes one JSON object per line.
+int main(int argc, char* argv[])
+{
+    FILE* input = NULL;
+    bool jsonLines = false;
+    bool anyFile = false;
+    int status = 0;
+    int result = 0;
+    int i = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--json"))
+        {
+            jsonLines = true;
+        }
+        else if ((0 == strcmp(argv[i], "--help")) || (0 == strcmp(argv[i], "-h")))
+        {
+            printf("Usage: %s [--json] [file...]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if ('-' == argv[i][0])
+        {
+            continue;
+        }
+
+        anyFile = true;
+
+        if (NULL == (input = fopen(argv[i], "rb")))
+        {
+            fprintf(stderr, "Cannot open '%s' (%d)\n", argv[i], errno);
+            result = 1;
+            continue;
+        }
+
+        if (0 != (status = DecodeStructuredLog(input, stdout, jsonLines)))
+        {
+            fprintf(stderr, "'%s' is not a structured log or is damaged (%d)\n", argv[i], status);
+            result = 1;
+        }
+
+        fclose(input);
+    }
+
+    if (!anyFile && (0 != (status = DecodeStructuredLog(stdin, stdout, jsonLines))))
+    {
+        fprintf(stderr, "The input is not a structured log or is damaged (%d)\n", status);
+        result = 1;
+    }
+
+    return result;
+}
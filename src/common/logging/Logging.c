@@ -11,18 +11,83 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include "Logging.h"
+#include "StructuredLog.h"
 
 #define TIME_FORMAT_STRING_LENGTH 64
 
+// Lines are formatted by the thread that logs them and queued in a ring of LOG_RING_SLOTS (a power of two) for the writer
+// thread. Lines longer than LOG_LINE_INLINE_SIZE are copied to the heap, lines longer than LOG_LINE_SIZE formatted there.
+#define LOG_RING_SLOTS 1024
+#define LOG_LINE_INLINE_SIZE 256
+#define LOG_LINE_SIZE 4096
+#define LOG_BATCH_SIZE 65536
+#define LOG_WRITER_WAIT_MILLISECONDS 100
+
+// Until this many lines are queued the writer is left to wake on its own, errors wake it right away
+#define LOG_WRITER_WAKE_DEPTH (LOG_RING_SLOTS / 8)
+#define LOG_FLUSH_TIMEOUT_MILLISECONDS 2000
+
+// Structured logs are written next to the text logs, with a time anchor at least this often for the decoder to place events in time
+#define STRUCTURED_LOG_FILE_SUFFIX ".bin"
+#define STRUCTURED_LOG_ANCHOR_NANOSECONDS (60LL * 1000000000LL)
+
 struct OsConfigLog
 {
     FILE* log;
     const char* logFileName;
     const char* backLogFileName;
-    unsigned int trimLogCount;
+    long size;
+
+    // Set once opened, log is reopened by the writer thread as the log rotates
+    bool hasFile;
+
+    // Lines dropped since the writer last noted it in this log
+    atomic_uint droppedLines;
+
+    // Opened on the first structured event, sites are defined once per file
+    FILE* structured;
+    char* structuredFileName;
+    char* backStructuredFileName;
+    long structuredSize;
+    long long anchorTime;
+    unsigned char definedSites[STRUCTURED_LOG_SITES / 8];
 };
 
+typedef struct LOG_RECORD
+{
+    atomic_size_t sequence;
+    OsConfigLog* log;
+
+    // The call site of a structured event, -1 for a text line
+    int site;
+    size_t length;
+    char* overflow;
+    char text[LOG_LINE_INLINE_SIZE];
+} LOG_RECORD;
+
+typedef enum LOG_WRITER_STATE
+{
+    LogWriterNotStarted = 0,
+    LogWriterRunning = 1,
+    LogWriterSynchronous = 2
+} LOG_WRITER_STATE;
+
+// Producers claim slots by advancing tail, only the writer thread advances head.
+// A slot is free for the producer at position p when its sequence is p, and holds a line for the writer when it is p + 1.
+typedef struct LOG_RING
+{
+    LOG_RECORD records[LOG_RING_SLOTS];
+    atomic_size_t tail;
+    size_t head;
+    atomic_size_t written;
+} LOG_RING;
+
 static LoggingLevel g_loggingLevel = LoggingLevelInformational;
 
 // Default maximum log size (1,048,576 is 1024 * 1024 aka 1MB)
@@ -39,6 +104,29 @@ static const char* g_info = "INFO";
 static const char* g_debug = "DEBUG";
 
 static bool g_consoleLoggingEnabled = true;
+static bool g_structuredLoggingEnabled = false;
+
+static LOG_RING g_logRing = {0};
+static atomic_int g_logWriterState = LogWriterNotStarted;
+static atomic_bool g_logWriterWaiting = false;
+static atomic_bool g_logWriterStopping = false;
+static atomic_ulong g_droppedLogLines = 0;
+static pthread_t g_logWriter;
+
+// Set while the writer thread exists and can still read the handles of queued lines, used with g_logWriterLock held
+static bool g_logWriterAlive = false;
+static bool g_logAtForkRegistered = false;
+
+// Serializes writes and rotation, held by the writer thread only while writing a batch
+static pthread_mutex_t g_logLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The anchor and definition written ahead of a structured event, used with g_logLock held
+static char g_structuredLogPrefix[LOG_LINE_SIZE] = {0};
+
+// For starting, waking and flushing the writer thread
+static pthread_mutex_t g_logWriterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_logWriterWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_logWritten = PTHREAD_COND_INITIALIZER;
 
 bool IsConsoleLoggingEnabled(void)
 {
@@ -50,6 +138,16 @@ void SetConsoleLoggingEnabled(bool enabledOrDisabled)
     g_consoleLoggingEnabled = enabledOrDisabled;
 }
 
+bool IsStructuredLoggingEnabled(void)
+{
+    return g_structuredLoggingEnabled;
+}
+
+void SetStructuredLoggingEnabled(bool enabledOrDisabled)
+{
+    g_structuredLoggingEnabled = enabledOrDisabled;
+}
+
 const char* GetLoggingLevelName(LoggingLevel level)
 {
     const char* result = g_debug;
@@ -138,8 +236,57 @@ static int RestrictLogFileAccess(const char* fileName)
     return chmod(fileName, S_IRUSR | S_IWUSR | S_IRGRP);
 }
 
+// Returns the name with the structured log suffix, for the caller to free
+static char* GetStructuredLogFileName(const char* fileName)
+{
+    size_t length = strlen(fileName);
+    char* name = (char*)malloc(length + sizeof(STRUCTURED_LOG_FILE_SUFFIX));
+
+    if (NULL != name)
+    {
+        memcpy(name, fileName, length);
+        memcpy(name + length, STRUCTURED_LOG_FILE_SUFFIX, sizeof(STRUCTURED_LOG_FILE_SUFFIX));
+    }
+
+    return name;
+}
+
+static void AddLogMilliseconds(struct timespec* time, long milliseconds)
+{
+    time->tv_sec += milliseconds / 1000;
+    time->tv_nsec += (milliseconds % 1000) * 1000000;
+
+    if (time->tv_nsec >= 1000000000)
+    {
+        time->tv_sec += 1;
+        time->tv_nsec -= 1000000000;
+    }
+}
+
+// Waits for the writer thread to write the lines queued before target, or to exit, giving up at the deadline if there is one
+static void WaitForLogWritten(size_t target, const struct timespec* deadline)
+{
+    pthread_mutex_lock(&g_logWriterLock);
+    pthread_cond_signal(&g_logWriterWake);
+
+    while ((atomic_load(&g_logRing.written) < target) && g_logWriterAlive)
+    {
+        if (NULL == deadline)
+        {
+            pthread_cond_wait(&g_logWritten, &g_logWriterLock);
+        }
+        else if (ETIMEDOUT == pthread_cond_timedwait(&g_logWritten, &g_logWriterLock, deadline))
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_logWriterLock);
+}
+
 OsConfigLogHandle OpenLog(const char* logFileName, const char* bakLogFileName)
 {
+    struct stat fileStat = {0};
     OsConfigLog* newLog = (OsConfigLog*)malloc(sizeof(OsConfigLog));
     if (NULL == newLog)
     {
@@ -155,11 +302,20 @@ OsConfigLogHandle OpenLog(const char* logFileName, const char* bakLogFileName)
     {
         newLog->log = fopen(newLog->logFileName, "a");
         RestrictLogFileAccess(newLog->logFileName);
+
+        if ((NULL != newLog->log) && (0 == fstat(fileno(newLog->log), &fileStat)))
+        {
+            newLog->size = (long)fileStat.st_size;
+        }
+
+        newLog->hasFile = (NULL != newLog->log);
+        newLog->structuredFileName = GetStructuredLogFileName(newLog->logFileName);
     }
 
     if (NULL != newLog->backLogFileName)
     {
         RestrictLogFileAccess(newLog->backLogFileName);
+        newLog->backStructuredFileName = GetStructuredLogFileName(newLog->backLogFileName);
     }
 
     return newLog;
@@ -174,10 +330,22 @@ void CloseLog(OsConfigLogHandle* log)
 
     OsConfigLog* logToClose = *log;
 
+    // Lines queued for this log are written before it goes, with no time limit as the writer reads the handle until then
+    WaitForLogWritten(atomic_load(&g_logRing.tail), NULL);
+
+    pthread_mutex_lock(&g_logLock);
     if (NULL != logToClose->log)
     {
         fclose(logToClose->log);
     }
+    if (NULL != logToClose->structured)
+    {
+        fclose(logToClose->structured);
+    }
+    pthread_mutex_unlock(&g_logLock);
+
+    free(logToClose->structuredFileName);
+    free(logToClose->backStructuredFileName);
 
     memset(logToClose, 0, sizeof(OsConfigLog));
 
@@ -190,7 +358,9 @@ FILE* GetLogFile(OsConfigLogHandle log)
     return log ? log->log : NULL;
 }
 
-static char g_logTime[TIME_FORMAT_STRING_LENGTH] = {0};
+// Cached per thread, so that the time is formatted once a second at most and threads do not share the buffer
+static __thread time_t g_logTimeSecond = 0;
+static __thread char g_logTime[TIME_FORMAT_STRING_LENGTH] = {0};
 
 // Returns the local date/time with GMT offset, formatted as YYYY-MM-DD HH:MM:SS-GGGG (for example: 2025-09-26 15:49:55-0700)
 const char* GetFormattedTime(void)
@@ -199,56 +369,716 @@ const char* GetFormattedTime(void)
     struct tm* timeInfo = NULL;
     struct tm result = {0};
     time(&rawTime);
-    timeInfo = localtime_r(&rawTime, &result);
-    strftime(g_logTime, ARRAY_SIZE(g_logTime), "%Y-%m-%d %H:%M:%S%z", timeInfo);
+
+    if ((rawTime != g_logTimeSecond) || (0 == g_logTime[0]))
+    {
+        timeInfo = localtime_r(&rawTime, &result);
+        strftime(g_logTime, ARRAY_SIZE(g_logTime), "%Y-%m-%d %H:%M:%S%z", timeInfo);
+        g_logTimeSecond = rawTime;
+    }
+
     return g_logTime;
 }
 
+static unsigned int GetRotationLogSize(void)
+{
+    return IsDebugLoggingEnabled() ? ((g_maxLogSize < (UINT_MAX / 5)) ? (g_maxLogSize * 5) : UINT_MAX) : g_maxLogSize;
+}
+
+// Rolls the log over if larger than maximum size, called with g_logLock held
+static void RotateLog(OsConfigLogHandle log)
+{
+    unsigned int maxLogSize = GetRotationLogSize();
+    int savedErrno = errno;
+
+    if ((NULL == log) || (NULL == log->log) || (log->size < (long)maxLogSize))
+    {
+        return;
+    }
+
+    fclose(log->log);
+
+    // Rename the log in place to make a backup copy, overwriting previous copy if any:
+    if ((NULL == log->backLogFileName) || (0 != rename(log->logFileName, log->backLogFileName)))
+    {
+        // If the log could not be renamed, empty it:
+        log->log = fopen(log->logFileName, "w");
+        fclose(log->log);
+    }
+
+    // Reopen the log in append mode:
+    log->log = fopen(log->logFileName, "a");
+    log->size = 0;
+
+    // Reapply restrictions once the file is recreated (also for backup, if any):
+    RestrictLogFileAccess(log->logFileName);
+    if (NULL != log->backLogFileName)
+    {
+        // Reapply restrictions to the backup file:
+        RestrictLogFileAccess(log->backLogFileName);
+    }
+
+    errno = savedErrno;
+}
+
 // Checks and rolls the log over if larger than maximum size
 void TrimLog(OsConfigLogHandle log)
 {
-    unsigned int maxLogSize = IsDebugLoggingEnabled() ? ((g_maxLogSize < (UINT_MAX / 5)) ? (g_maxLogSize * 5) : UINT_MAX) : g_maxLogSize;
-    unsigned int maxLogTrim = 1000;
-    long fileSize = 0;
+    pthread_mutex_lock(&g_logLock);
+    RotateLog(log);
+    pthread_mutex_unlock(&g_logLock);
+}
+
+static void WriteAll(int descriptor, const char* text, size_t length)
+{
+    ssize_t written = 0;
+
+    while (length > 0)
+    {
+        if ((written = write(descriptor, text, length)) < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            break;
+        }
+
+        text += written;
+        length -= (size_t)written;
+    }
+}
+
+// Formats the note on lines dropped from the log since the last one, if any
+static int GetDroppedLogLinesNote(OsConfigLogHandle log, char* note, size_t size)
+{
+    unsigned int dropped = 0;
+
+    if ((NULL != log) && (0 < (dropped = atomic_exchange(&log->droppedLines, 0))))
+    {
+        return snprintf(note, size, __PREFIX_TEMPLATE__ "%u lines were dropped, logging could not keep up\n", GetFormattedTime(), g_warning, __SHORT_FILE__, __LINE__, dropped);
+    }
+
+    return 0;
+}
+
+// Writes whole lines to the log and the console, called with g_logLock held
+static void WriteLogLines(OsConfigLogHandle log, const char* text, size_t length, bool console)
+{
+    char note[LOG_LINE_INLINE_SIZE] = {0};
+    int noteLength = GetDroppedLogLinesNote(log, note, sizeof(note));
+
+    if ((NULL != log) && (NULL != log->log))
+    {
+        if (noteLength > 0)
+        {
+            WriteAll(fileno(log->log), note, (size_t)noteLength);
+            log->size += noteLength;
+        }
+
+        WriteAll(fileno(log->log), text, length);
+        log->size += (long)length;
+        RotateLog(log);
+    }
+
+    if (console)
+    {
+        if (noteLength > 0)
+        {
+            WriteAll(STDOUT_FILENO, note, (size_t)noteLength);
+        }
+
+        WriteAll(STDOUT_FILENO, text, length);
+    }
+}
+
+// Starts a structured log with its header, or with an anchor when appending to an existing one, called with g_logLock held
+static void OpenStructuredLog(OsConfigLogHandle log)
+{
+    struct stat fileStat = {0};
+    char start[64] = {0};
+    size_t length = 0;
+
+    if ((NULL == log->structuredFileName) || (NULL == (log->structured = fopen(log->structuredFileName, "a"))))
+    {
+        return;
+    }
+
+    RestrictLogFileAccess(log->structuredFileName);
+    log->structuredSize = (0 == fstat(fileno(log->structured), &fileStat)) ? (long)fileStat.st_size : 0;
+
+    if (0 == log->structuredSize)
+    {
+        length = EncodeStructuredLogHeader(start, sizeof(start));
+    }
+    length += EncodeStructuredLogAnchor(start + length, sizeof(start) - length);
+
+    WriteAll(fileno(log->structured), start, length);
+    log->structuredSize += (long)length;
+    log->anchorTime = GetStructuredLogMonotonicTime();
+    memset(log->definedSites, 0, sizeof(log->definedSites));
+}
+
+// Rolls the structured log over along with the text log, the new file is started right away, called with g_logLock held
+static void RotateStructuredLog(OsConfigLogHandle log)
+{
     int savedErrno = errno;
 
-    if (NULL == log)
+    if ((NULL == log->structured) || (log->structuredSize < (long)GetRotationLogSize()))
     {
         return;
     }
 
-    // Loop incrementing the trim log counter from 0 to maxLogTrim
-    log->trimLogCount = (log->trimLogCount < maxLogTrim) ? (log->trimLogCount + 1) : 1;
+    fclose(log->structured);
+    log->structured = NULL;
+
+    if ((NULL == log->backStructuredFileName) || (0 != rename(log->structuredFileName, log->backStructuredFileName)))
+    {
+        unlink(log->structuredFileName);
+    }
+    else
+    {
+        RestrictLogFileAccess(log->backStructuredFileName);
+    }
+
+    OpenStructuredLog(log);
+
+    errno = savedErrno;
+}
+
+// Returns in prefix the records an event needs ahead of it: the time anchor when due and the definition of its site when new to the file.
+// The prefix is at most LOG_LINE_SIZE, called with g_logLock held.
+static size_t PrepareStructuredLogEvent(OsConfigLogHandle log, int site, char* prefix)
+{
+    size_t length = 0;
+
+    if (NULL == log->structured)
+    {
+        OpenStructuredLog(log);
+    }
+
+    if ((GetStructuredLogMonotonicTime() - log->anchorTime) >= STRUCTURED_LOG_ANCHOR_NANOSECONDS)
+    {
+        length = EncodeStructuredLogAnchor(prefix, LOG_LINE_SIZE);
+        log->anchorTime = GetStructuredLogMonotonicTime();
+    }
+
+    if (0 == (log->definedSites[site / 8] & (1 << (site % 8))))
+    {
+        length += EncodeStructuredLogDefinition(prefix + length, LOG_LINE_SIZE - length, site);
+        log->definedSites[site / 8] |= (unsigned char)(1 << (site % 8));
+    }
+
+    return length;
+}
+
+// Writes prepared records and the events that follow them to the structured log, called with g_logLock held
+static void WriteStructuredLogRecords(OsConfigLogHandle log, const char* prefix, size_t prefixLength, const char* records, size_t length)
+{
+    char note[LOG_LINE_INLINE_SIZE] = {0};
+    int noteLength = GetDroppedLogLinesNote(log, note, sizeof(note));
+
+    // Dropped lines are noted in the text log, which stays the place to look for trouble with logging
+    if ((noteLength > 0) && (NULL != log->log))
+    {
+        WriteAll(fileno(log->log), note, (size_t)noteLength);
+        log->size += noteLength;
+    }
+
+    if (NULL != log->structured)
+    {
+        WriteAll(fileno(log->structured), prefix, prefixLength);
+        WriteAll(fileno(log->structured), records, length);
+        log->structuredSize += (long)(prefixLength + length);
+        RotateStructuredLog(log);
+    }
+}
+
+static void WriteLogRecords(OsConfigLogHandle log, bool structured, const char* records, size_t length, bool console)
+{
+    if (structured)
+    {
+        WriteStructuredLogRecords(log, NULL, 0, records, length);
+    }
+    else
+    {
+        WriteLogLines(log, records, length, console);
+    }
+}
+
+static void WakeLogWriter(void)
+{
+    pthread_mutex_lock(&g_logWriterLock);
+    pthread_cond_signal(&g_logWriterWake);
+    pthread_mutex_unlock(&g_logWriterLock);
+}
+
+static bool PushLogLine(OsConfigLogHandle log, LoggingLevel level, int site, const char* text, size_t length)
+{
+    LOG_RECORD* record = NULL;
+    size_t position = atomic_load_explicit(&g_logRing.tail, memory_order_relaxed);
+    size_t sequence = 0;
+    char* overflow = NULL;
+    bool yielded = false;
+
+    if ((length > LOG_LINE_INLINE_SIZE) && (NULL == (overflow = (char*)malloc(length))))
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        record = &g_logRing.records[position & (LOG_RING_SLOTS - 1)];
+        sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+
+        if (sequence == position)
+        {
+            if (atomic_compare_exchange_weak_explicit(&g_logRing.tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (sequence < position)
+        {
+            // Full, the writer gets one chance to catch up (it may not have run at all on a single processor)
+            if (yielded)
+            {
+                free(overflow);
+                return false;
+            }
+
+            WakeLogWriter();
+            sched_yield();
+            yielded = true;
+            position = atomic_load_explicit(&g_logRing.tail, memory_order_relaxed);
+        }
+        else
+        {
+            position = atomic_load_explicit(&g_logRing.tail, memory_order_relaxed);
+        }
+    }
+
+    record->log = log;
+    record->site = site;
+    record->length = length;
+    record->overflow = overflow;
+    memcpy((NULL != overflow) ? overflow : record->text, text, length);
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+
+    // Pairs with the writer setting g_logWriterWaiting before it checks the ring a last time, only one producer wakes it
+    atomic_thread_fence(memory_order_seq_cst);
+    if (((level <= LoggingLevelError) || ((position + 1 - atomic_load(&g_logRing.written)) >= LOG_WRITER_WAKE_DEPTH)) &&
+        atomic_load(&g_logWriterWaiting) && atomic_exchange(&g_logWriterWaiting, false))
+    {
+        WakeLogWriter();
+    }
+
+    return true;
+}
+
+static bool IsLogLineQueued(size_t position)
+{
+    return (position + 1) == atomic_load_explicit(&g_logRing.records[position & (LOG_RING_SLOTS - 1)].sequence, memory_order_acquire);
+}
+
+// Writes the queued lines in batches, one write per log and batch, structured events batched apart from text lines
+static size_t DrainLogRing(char* batch)
+{
+    char* prefix = g_structuredLogPrefix;
+    LOG_RECORD* record = NULL;
+    OsConfigLog* batchLog = NULL;
+    const char* text = NULL;
+    size_t prefixLength = 0;
+    size_t batchSize = 0;
+    size_t drained = 0;
+    bool batchStructured = false;
+    bool structured = false;
+    bool console = IsConsoleLoggingEnabled();
+
+    pthread_mutex_lock(&g_logLock);
+
+    while ((drained < LOG_RING_SLOTS) && IsLogLineQueued(g_logRing.head))
+    {
+        record = &g_logRing.records[g_logRing.head & (LOG_RING_SLOTS - 1)];
+        text = (NULL != record->overflow) ? record->overflow : record->text;
+        structured = (record->site >= 0);
+        prefixLength = structured ? PrepareStructuredLogEvent(record->log, record->site, prefix) : 0;
+
+        if ((batchSize > 0) && ((record->log != batchLog) || (structured != batchStructured) || ((batchSize + prefixLength + record->length) > LOG_BATCH_SIZE)))
+        {
+            WriteLogRecords(batchLog, batchStructured, batch, batchSize, console);
+            batchSize = 0;
+        }
+
+        batchLog = record->log;
+        batchStructured = structured;
+
+        if ((prefixLength + record->length) > LOG_BATCH_SIZE)
+        {
+            if (structured)
+            {
+                WriteStructuredLogRecords(batchLog, prefix, prefixLength, text, record->length);
+            }
+            else
+            {
+                WriteLogLines(batchLog, text, record->length, console);
+            }
+        }
+        else
+        {
+            memcpy(batch + batchSize, prefix, prefixLength);
+            memcpy(batch + batchSize + prefixLength, text, record->length);
+            batchSize += prefixLength + record->length;
+        }
+
+        free(record->overflow);
+        record->overflow = NULL;
+        atomic_store_explicit(&record->sequence, g_logRing.head + LOG_RING_SLOTS, memory_order_release);
+        g_logRing.head += 1;
+        drained += 1;
+    }
+
+    if (batchSize > 0)
+    {
+        WriteLogRecords(batchLog, batchStructured, batch, batchSize, console);
+    }
+
+    pthread_mutex_unlock(&g_logLock);
+
+    if (drained > 0)
+    {
+        pthread_mutex_lock(&g_logWriterLock);
+        atomic_store(&g_logRing.written, g_logRing.head);
+        pthread_cond_broadcast(&g_logWritten);
+        pthread_mutex_unlock(&g_logWriterLock);
+    }
+
+    return drained;
+}
+
+static void* LogWriterThread(void* argument)
+{
+    char* batch = (char*)argument;
+    struct timespec deadline = {0};
+
+    for (;;)
+    {
+        if (0 < DrainLogRing(batch))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&g_logWriterLock);
+        atomic_store(&g_logWriterWaiting, true);
+
+        if (!IsLogLineQueued(g_logRing.head))
+        {
+            if (atomic_load(&g_logWriterStopping))
+            {
+                atomic_store(&g_logWriterWaiting, false);
+                pthread_mutex_unlock(&g_logWriterLock);
+                break;
+            }
+
+            // Timed in case a line was published just as the writer went to wait
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            AddLogMilliseconds(&deadline, LOG_WRITER_WAIT_MILLISECONDS);
+            pthread_cond_timedwait(&g_logWriterWake, &g_logWriterLock, &deadline);
+        }
+
+        atomic_store(&g_logWriterWaiting, false);
+        pthread_mutex_unlock(&g_logWriterLock);
+    }
+
+    pthread_mutex_lock(&g_logWriterLock);
+    g_logWriterAlive = false;
+    pthread_cond_broadcast(&g_logWritten);
+    pthread_mutex_unlock(&g_logWriterLock);
+
+    free(batch);
+    return NULL;
+}
+
+static void LockLogBeforeFork(void)
+{
+    pthread_mutex_lock(&g_logLock);
+}
+
+static void UnlockLogAfterFork(void)
+{
+    pthread_mutex_unlock(&g_logLock);
+}
+
+// A forked child does not have the writer thread and often leaves with _exit, it writes its lines as it logs them
+static void UnlockLogInForkedChild(void)
+{
+    atomic_store(&g_logWriterState, LogWriterSynchronous);
+    g_logWriterAlive = false;
+    ResetStructuredLogThread();
+    pthread_mutex_unlock(&g_logLock);
+}
+
+static void StartLogWriter(void)
+{
+    char* batch = NULL;
+    sigset_t blocked;
+    sigset_t previous;
+    size_t i = 0;
+    int state = LogWriterSynchronous;
+
+    pthread_mutex_lock(&g_logWriterLock);
 
-    // Check every 10 calls:
-    if (0 == (log->trimLogCount % 10))
+    if (LogWriterNotStarted == atomic_load(&g_logWriterState))
     {
-        // In append mode the file pointer will always be at end of file:
-        fileSize = ftell(log->log);
+        if (!g_logAtForkRegistered)
+        {
+            g_logAtForkRegistered = (0 == pthread_atfork(LockLogBeforeFork, UnlockLogAfterFork, UnlockLogInForkedChild));
+        }
 
-        if ((fileSize >= (long)maxLogSize) || (-1 == fileSize))
+        if (g_logAtForkRegistered && (NULL != (batch = (char*)malloc(LOG_BATCH_SIZE))))
         {
-            fclose(log->log);
+            for (i = 0; i < LOG_RING_SLOTS; i++)
+            {
+                atomic_init(&g_logRing.records[i].sequence, i);
+            }
+
+            atomic_store(&g_logRing.tail, 0);
+            atomic_store(&g_logRing.written, 0);
+            g_logRing.head = 0;
+            atomic_store(&g_logWriterStopping, false);
 
-            // Rename the log in place to make a backup copy, overwriting previous copy if any:
-            if ((NULL == log->backLogFileName) || (0 != rename(log->logFileName, log->backLogFileName)))
+            // Signals are left to the threads of the process that handle them
+            sigfillset(&blocked);
+            pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+            if (0 == pthread_create(&g_logWriter, NULL, LogWriterThread, batch))
             {
-                // If the log could not be renamed, empty it:
-                log->log = fopen(log->logFileName, "w");
-                fclose(log->log);
+                g_logWriterAlive = true;
+                state = LogWriterRunning;
             }
+            pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        }
+
+        if (LogWriterRunning != state)
+        {
+            free(batch);
+        }
+
+        atomic_store(&g_logWriterState, state);
+    }
+
+    pthread_mutex_unlock(&g_logWriterLock);
+}
+
+// Stopped when the process exits or the module this copy of the library is linked in is unloaded, later lines are written as they are logged
+static void __attribute__((destructor)) StopLogWriter(void)
+{
+    int state = LogWriterRunning;
+
+    if (!atomic_compare_exchange_strong(&g_logWriterState, &state, LogWriterSynchronous))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_logWriterLock);
+    atomic_store(&g_logWriterStopping, true);
+    pthread_cond_signal(&g_logWriterWake);
+    pthread_mutex_unlock(&g_logWriterLock);
+
+    pthread_join(g_logWriter, NULL);
+}
+
+void FlushLog(OsConfigLogHandle log)
+{
+    struct timespec deadline = {0};
+    (void)log;
+
+    if (LogWriterRunning != atomic_load(&g_logWriterState))
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    AddLogMilliseconds(&deadline, LOG_FLUSH_TIMEOUT_MILLISECONDS);
+
+    WaitForLogWritten(atomic_load(&g_logRing.tail), &deadline);
+}
+
+// Takes no lock and calls only async-signal-safe functions. Lines the writer took but did not get to write yet are written
+// again when still whole in their slots, the handler writing a line twice rather than losing it.
+void WriteQueuedLogLines(void)
+{
+    LOG_RECORD* record = NULL;
+    const char* text = NULL;
+    size_t position = 0;
+    size_t tail = atomic_load(&g_logRing.tail);
+    size_t sequence = 0;
+
+    for (position = atomic_load(&g_logRing.written); position != tail; position++)
+    {
+        record = &g_logRing.records[position & (LOG_RING_SLOTS - 1)];
+        sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+
+        if ((sequence == (position + 1)) && (NULL != record->overflow))
+        {
+            text = record->overflow;
+        }
+        else if (((sequence == (position + 1)) || (sequence == (position + LOG_RING_SLOTS))) && (record->length <= LOG_LINE_INLINE_SIZE))
+        {
+            text = record->text;
+        }
+        else
+        {
+            continue;
+        }
+
+        // Structured events need the prefix the writer keeps, only text lines are written here
+        if ((record->site < 0) && (NULL != record->log) && (NULL != record->log->log))
+        {
+            WriteAll(fileno(record->log->log), text, record->length);
+        }
+    }
+}
+
+unsigned long GetDroppedLogLines(void)
+{
+    return atomic_load(&g_droppedLogLines);
+}
+
+// Queues a line or structured event for the writer thread, or writes it right away when the writer is not running
+static void QueueLogRecord(OsConfigLogHandle log, LoggingLevel level, int site, const char* text, size_t length)
+{
+    size_t prefixLength = 0;
+    bool queued = false;
+
+    if (LogWriterNotStarted == atomic_load(&g_logWriterState))
+    {
+        StartLogWriter();
+    }
+
+    if (LogWriterRunning == atomic_load(&g_logWriterState))
+    {
+        queued = PushLogLine(log, level, site, text, length);
+    }
+
+    // Errors and worse are never dropped, when the writer cannot keep up they are written right away
+    if (!queued && (LogWriterRunning == atomic_load(&g_logWriterState)) && (level > LoggingLevelError))
+    {
+        atomic_fetch_add(&g_droppedLogLines, 1);
+        if (NULL != log)
+        {
+            atomic_fetch_add(&log->droppedLines, 1);
+        }
+    }
+    else if (!queued)
+    {
+        pthread_mutex_lock(&g_logLock);
+        if (site >= 0)
+        {
+            prefixLength = PrepareStructuredLogEvent(log, site, g_structuredLogPrefix);
+            WriteStructuredLogRecords(log, g_structuredLogPrefix, prefixLength, text, length);
+        }
+        else
+        {
+            WriteLogLines(log, text, length, IsConsoleLoggingEnabled());
+        }
+        pthread_mutex_unlock(&g_logLock);
+    }
+}
 
-            // Reopen the log in append mode:
-            log->log = fopen(log->logFileName, "a");
+void WriteLog(OsConfigLogHandle log, LoggingLevel level, const char* file, int line, const char* format, ...)
+{
+    static __thread char buffer[LOG_LINE_SIZE];
+    char* text = buffer;
+    va_list arguments;
+    size_t eventLength = 0;
+    int prefixLength = 0;
+    int length = 0;
+    int site = -1;
+    int savedErrno = errno;
 
-            // Reapply restrictions once the file is recreated (also for backup, if any):
-            RestrictLogFileAccess(log->logFileName);
-            if (NULL != log->backLogFileName)
+    if (((NULL == log) || !log->hasFile) && !IsConsoleLoggingEnabled())
+    {
+        return;
+    }
+
+    if (g_structuredLoggingEnabled && (NULL != log) && log->hasFile)
+    {
+        site = GetStructuredLogSite(file, line, format);
+    }
+
+    // The arguments are recorded as they are and the line is formatted when the log is decoded
+    if (site >= 0)
+    {
+        va_start(arguments, format);
+        eventLength = EncodeStructuredLogEvent(buffer, sizeof(buffer), site, level, format, arguments);
+        va_end(arguments);
+
+        if (eventLength > sizeof(buffer))
+        {
+            if (NULL == (text = (char*)malloc(eventLength)))
             {
-                // Reapply restrictions to the backup file:
-                RestrictLogFileAccess(log->backLogFileName);
+                errno = savedErrno;
+                return;
             }
+
+            va_start(arguments, format);
+            EncodeStructuredLogEvent(text, eventLength, site, level, format, arguments);
+            va_end(arguments);
+        }
+
+        QueueLogRecord(log, level, site, text, eventLength);
+
+        if (text != buffer)
+        {
+            free(text);
+            text = buffer;
+        }
+
+        // The console still shows text
+        if (!IsConsoleLoggingEnabled())
+        {
+            errno = savedErrno;
+            return;
         }
+
+        log = NULL;
+    }
+
+    prefixLength = snprintf(buffer, sizeof(buffer), __PREFIX_TEMPLATE__, GetFormattedTime(), GetLoggingLevelName(level), file, line);
+    va_start(arguments, format);
+    length = vsnprintf(buffer + prefixLength, sizeof(buffer) - prefixLength, format, arguments);
+    va_end(arguments);
+
+    if (length < 0)
+    {
+        errno = savedErrno;
+        return;
+    }
+
+    length += prefixLength;
+
+    // One more for the newline, longer lines are formatted again on the heap
+    if ((size_t)(length + 1) >= sizeof(buffer))
+    {
+        if (NULL == (text = (char*)malloc(length + 2)))
+        {
+            errno = savedErrno;
+            return;
+        }
+
+        memcpy(text, buffer, prefixLength);
+        va_start(arguments, format);
+        vsnprintf(text + prefixLength, length + 2 - prefixLength, format, arguments);
+        va_end(arguments);
+    }
+
+    text[length++] = '\n';
+
+    QueueLogRecord(log, level, -1, text, length);
+
+    if (text != buffer)
+    {
+        free(text);
     }
 
     errno = savedErrno;
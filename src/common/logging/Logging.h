@@ -53,32 +53,38 @@ unsigned int GetMaxLogSizeDebugMultiplier(void);
 void SetMaxLogSizeDebugMultiplier(unsigned int value);
 bool IsConsoleLoggingEnabled(void);
 void SetConsoleLoggingEnabled(bool enabledOrDisabled);
+
+// When enabled, logs with a file write events in a compact binary form to <log>.bin instead of text lines to the log:
+// the call site is recorded once per file and each event carries its arguments, formatted only when decoded.
+// Lines from call sites past the few thousand tracked are still logged as text, formats that cannot be deferred are recorded formatted.
+bool IsStructuredLoggingEnabled(void);
+void SetStructuredLoggingEnabled(bool enabledOrDisabled);
+
+// Decodes a structured log into text lines as the text log would have them, or into JSON lines, returns 0 or an errno
+int DecodeStructuredLog(FILE* input, FILE* output, bool jsonLines);
 FILE* GetLogFile(OsConfigLogHandle log);
 const char* GetFormattedTime(void);
 void TrimLog(OsConfigLogHandle log);
 bool IsDaemon(void);
 
+// Lines are formatted by the calling thread and written to the log and the console by a writer thread, in batches.
+// When the writer cannot keep up, lines below LoggingLevelError are dropped and counted, errors are written right away.
+void WriteLog(OsConfigLogHandle log, LoggingLevel level, const char* file, int line, const char* format, ...) __attribute__((format(printf, 5, 6)));
+
+// Waits for the lines logged so far to be written
+void FlushLog(OsConfigLogHandle log);
+
+// For crash signal handlers, writes the lines still queued for the writer thread straight to their logs
+void WriteQueuedLogLines(void);
+unsigned long GetDroppedLogLines(void);
+
 #define __PREFIX_TEMPLATE__ "[%s][%s][%s:%d] "
 #define __SHORT_FILE__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
-#define __LOG__(log, label, format, ...) printf(__PREFIX_TEMPLATE__ format "\n", GetFormattedTime(), label, __SHORT_FILE__, __LINE__, ## __VA_ARGS__)
-#define __LOG_TO_FILE__(log, label, format, ...) {\
-    TrimLog(log);\
-    fprintf(GetLogFile(log), __PREFIX_TEMPLATE__ format "\n", GetFormattedTime(), label, __SHORT_FILE__, __LINE__, ## __VA_ARGS__);\
-}\
-
-#define OSCONFIG_LOG(log, level, format, ...) __LOG__(log, GetLoggingLevelName(level), format, ## __VA_ARGS__)
-#define OSCONFIG_LOG_TO_FILE(log, level, format, ...) __LOG_TO_FILE__(log, GetLoggingLevelName(level), format, ## __VA_ARGS__)
 
 // Universal macro that can log at any of the 7 levels:
 #define OsConfigLog(log, level, FORMAT, ...) {\
     if (level <= GetLoggingLevel()) {\
-        if (NULL != GetLogFile(log)) {\
-            OSCONFIG_LOG_TO_FILE(log, level, FORMAT, ##__VA_ARGS__);\
-            fflush(GetLogFile(log));\
-        }\
-        if (IsConsoleLoggingEnabled()) {\
-            OSCONFIG_LOG(log, level, FORMAT, ##__VA_ARGS__);\
-        }\
+        WriteLog(log, level, __SHORT_FILE__, __LINE__, FORMAT, ##__VA_ARGS__);\
     }\
 }\
 
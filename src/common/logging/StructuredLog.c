@@ -0,0 +1,902 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "StructuredLog.h"
+
+// The precision of a "%.*s" argument is the argument before it
+#define PRECISION_NONE -1
+#define PRECISION_ARGUMENT -2
+
+typedef enum LOG_SITE_STATE
+{
+    LogSiteEmpty = 0,
+    LogSiteRegistering = 1,
+    LogSiteReady = 2
+} LOG_SITE_STATE;
+
+// How each argument is taken from the va_list, the conversion itself is left to the decoder
+typedef struct LOG_ARGUMENT
+{
+    char type;
+    short precision;
+} LOG_ARGUMENT;
+
+typedef struct LOG_SITE
+{
+    atomic_int state;
+    const char* file;
+    const char* format;
+    int line;
+    int count;
+    bool deferred;
+    bool text;
+    LOG_ARGUMENT arguments[STRUCTURED_LOG_MAX_ARGUMENTS];
+} LOG_SITE;
+
+typedef struct LOG_DEFINITION
+{
+    char* file;
+    char* format;
+    unsigned int line;
+} LOG_DEFINITION;
+
+static LOG_SITE g_logSites[STRUCTURED_LOG_SITES];
+
+static __thread unsigned int g_logThreadId = 0;
+
+long long GetStructuredLogMonotonicTime(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+void ResetStructuredLogThread(void)
+{
+    g_logThreadId = 0;
+}
+
+static unsigned int GetLogThreadId(void)
+{
+    if (0 == g_logThreadId)
+    {
+        g_logThreadId = (unsigned int)syscall(SYS_gettid);
+    }
+
+    return g_logThreadId;
+}
+
+// Returns the next conversion in format after position, NULL when there is none
+static const char* FindConversion(const char* format)
+{
+    while (NULL != (format = strchr(format, '%')))
+    {
+        if ('%' != format[1])
+        {
+            return format;
+        }
+
+        format += 2;
+    }
+
+    return NULL;
+}
+
+// Parses the conversion at format into its arguments, returns the end of the conversion or NULL if it cannot be deferred
+static const char* ParseConversion(const char* format, LOG_ARGUMENT* arguments, int* count)
+{
+    const char* spec = format + 1;
+    char length[3] = {0};
+    int precision = PRECISION_NONE;
+    char type = 0;
+
+    spec += strspn(spec, "-+ #0'I");
+
+    if ('*' == *spec)
+    {
+        if (*count >= STRUCTURED_LOG_MAX_ARGUMENTS)
+        {
+            return NULL;
+        }
+        arguments[(*count)++].type = 'i';
+        spec++;
+    }
+    spec += strspn(spec, "0123456789");
+
+    if ('.' == *spec)
+    {
+        spec++;
+        if ('*' == *spec)
+        {
+            if (*count >= STRUCTURED_LOG_MAX_ARGUMENTS)
+            {
+                return NULL;
+            }
+            arguments[(*count)++].type = 'i';
+            precision = PRECISION_ARGUMENT;
+            spec++;
+        }
+        else
+        {
+            precision = atoi(spec);
+            spec += strspn(spec, "0123456789");
+        }
+    }
+
+    if (NULL != strchr("hlLqjzZt", *spec))
+    {
+        length[0] = *spec++;
+        if ((('h' == length[0]) || ('l' == length[0])) && (length[0] == *spec))
+        {
+            length[1] = *spec++;
+        }
+    }
+
+    switch (*spec)
+    {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            // Sizes as taken from the va_list, the decoder casts the value back for the conversion
+            switch (length[0])
+            {
+                case 0:
+                case 'h':
+                    type = 'i';
+                    break;
+                case 'l':
+                    type = length[1] ? 'L' : 'l';
+                    break;
+                case 'q':
+                    type = 'L';
+                    break;
+                case 'j':
+                    type = 'j';
+                    break;
+                case 'z':
+                case 'Z':
+                    type = 'z';
+                    break;
+                case 't':
+                    type = 't';
+                    break;
+                default:
+                    return NULL;
+            }
+            break;
+
+        case 'c':
+            type = (0 == length[0]) ? 'i' : 0;
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            type = ((0 == length[0]) || ('l' == length[0])) ? 'd' : 0;
+            break;
+
+        case 's':
+            type = (0 == length[0]) ? 's' : 0;
+            break;
+
+        case 'p':
+            type = (0 == length[0]) ? 'p' : 0;
+            break;
+
+        default:
+            // Including %n and %m, which depend on the state of the process as it logs
+            type = 0;
+    }
+
+    if ((0 == type) || (*count >= STRUCTURED_LOG_MAX_ARGUMENTS))
+    {
+        return NULL;
+    }
+
+    arguments[*count].type = type;
+    arguments[*count].precision = (short)((precision > SHRT_MAX) ? SHRT_MAX : precision);
+    (*count)++;
+
+    return spec + 1;
+}
+
+static void RegisterLogSite(LOG_SITE* site, const char* file, int line, const char* format)
+{
+    const char* conversion = format;
+
+    site->file = file;
+    site->format = format;
+    site->line = line;
+    site->count = 0;
+    site->deferred = true;
+    site->text = ((strlen(file) + strlen(format)) > STRUCTURED_LOG_MAX_DEFINITION_SIZE);
+
+    while (site->deferred && (NULL != (conversion = FindConversion(conversion))))
+    {
+        site->deferred = (NULL != (conversion = ParseConversion(conversion, site->arguments, &site->count)));
+    }
+}
+
+int GetStructuredLogSite(const char* file, int line, const char* format)
+{
+    size_t hash = (((uintptr_t)format >> 3) ^ ((size_t)line * 2654435761U)) & (STRUCTURED_LOG_SITES - 1);
+    LOG_SITE* site = NULL;
+    int state = LogSiteEmpty;
+    size_t i = 0;
+
+    for (i = 0; i < STRUCTURED_LOG_SITES;)
+    {
+        site = &g_logSites[(hash + i) & (STRUCTURED_LOG_SITES - 1)];
+        state = atomic_load_explicit(&site->state, memory_order_acquire);
+
+        if (LogSiteReady == state)
+        {
+            if ((site->format == format) && (site->line == line) && (site->file == file))
+            {
+                return site->text ? -1 : (int)((hash + i) & (STRUCTURED_LOG_SITES - 1));
+            }
+            i++;
+        }
+        else if (LogSiteRegistering == state)
+        {
+            sched_yield();
+        }
+        else if (atomic_compare_exchange_strong(&site->state, &state, LogSiteRegistering))
+        {
+            RegisterLogSite(site, file, line, format);
+            atomic_store_explicit(&site->state, LogSiteReady, memory_order_release);
+            return site->text ? -1 : (int)((hash + i) & (STRUCTURED_LOG_SITES - 1));
+        }
+    }
+
+    return -1;
+}
+
+static void AppendRecordBytes(char* buffer, size_t size, size_t* length, const void* bytes, size_t count)
+{
+    if ((*length + count) <= size)
+    {
+        memcpy(buffer + *length, bytes, count);
+    }
+
+    *length += count;
+}
+
+static void AppendRecordNumber(char* buffer, size_t size, size_t* length, unsigned long long value, size_t count)
+{
+    uint8_t byte = 0;
+    uint32_t word = 0;
+    uint64_t quad = 0;
+
+    switch (count)
+    {
+        case 1:
+            byte = (uint8_t)value;
+            AppendRecordBytes(buffer, size, length, &byte, 1);
+            break;
+        case 4:
+            word = (uint32_t)value;
+            AppendRecordBytes(buffer, size, length, &word, 4);
+            break;
+        default:
+            quad = (uint64_t)value;
+            AppendRecordBytes(buffer, size, length, &quad, 8);
+    }
+}
+
+size_t EncodeStructuredLogHeader(char* buffer, size_t size)
+{
+    size_t length = 0;
+
+    AppendRecordBytes(buffer, size, &length, STRUCTURED_LOG_MAGIC, strlen(STRUCTURED_LOG_MAGIC));
+    AppendRecordNumber(buffer, size, &length, STRUCTURED_LOG_BYTE_ORDER, 4);
+
+    return length;
+}
+
+size_t EncodeStructuredLogAnchor(char* buffer, size_t size)
+{
+    struct timespec now = {0};
+    struct tm local = {0};
+    long long monotonic = GetStructuredLogMonotonicTime();
+    size_t length = 0;
+    time_t seconds = 0;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    seconds = now.tv_sec;
+    localtime_r(&seconds, &local);
+
+    AppendRecordNumber(buffer, size, &length, STRUCTURED_LOG_ANCHOR, 1);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)(((long long)now.tv_sec * 1000000000LL) + now.tv_nsec), 8);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)monotonic, 8);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)(long long)local.tm_gmtoff, 4);
+
+    return length;
+}
+
+size_t EncodeStructuredLogDefinition(char* buffer, size_t size, int site)
+{
+    const LOG_SITE* logSite = &g_logSites[site];
+    size_t fileLength = strlen(logSite->file);
+    size_t formatLength = strlen(logSite->format);
+    size_t length = 0;
+
+    AppendRecordNumber(buffer, size, &length, STRUCTURED_LOG_DEFINITION, 1);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)site, 4);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)logSite->line, 4);
+    AppendRecordNumber(buffer, size, &length, fileLength, 4);
+    AppendRecordBytes(buffer, size, &length, logSite->file, fileLength);
+    AppendRecordNumber(buffer, size, &length, formatLength, 4);
+    AppendRecordBytes(buffer, size, &length, logSite->format, formatLength);
+
+    return length;
+}
+
+size_t EncodeStructuredLogEvent(char* buffer, size_t size, int site, LoggingLevel level, const char* format, va_list arguments)
+{
+    const LOG_SITE* logSite = &g_logSites[site];
+    const char* string = NULL;
+    long long precision = PRECISION_NONE;
+    long long value = 0;
+    size_t argumentsStart = 0;
+    size_t stringLength = 0;
+    size_t length = 0;
+    uint32_t argumentsLength = 0;
+    double number = 0;
+    int written = 0;
+    int i = 0;
+
+    AppendRecordNumber(buffer, size, &length, logSite->deferred ? STRUCTURED_LOG_EVENT : STRUCTURED_LOG_MESSAGE, 1);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)site, 4);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)level, 1);
+    AppendRecordNumber(buffer, size, &length, GetLogThreadId(), 4);
+    AppendRecordNumber(buffer, size, &length, (unsigned long long)GetStructuredLogMonotonicTime(), 8);
+
+    // Filled in once the arguments are known
+    argumentsStart = length;
+    AppendRecordNumber(buffer, size, &length, 0, 4);
+
+    if (!logSite->deferred)
+    {
+        written = vsnprintf((length < size) ? (buffer + length) : NULL, (length < size) ? (size - length) : 0, format, arguments);
+        length += (written > 0) ? (size_t)written : 0;
+    }
+    else
+    {
+        for (i = 0; i < logSite->count; i++)
+        {
+            switch (logSite->arguments[i].type)
+            {
+                case 'i':
+                    value = va_arg(arguments, int);
+                    break;
+                case 'l':
+                    value = va_arg(arguments, long);
+                    break;
+                case 'L':
+                    value = va_arg(arguments, long long);
+                    break;
+                case 'j':
+                    value = (long long)va_arg(arguments, intmax_t);
+                    break;
+                case 'z':
+                    value = (long long)va_arg(arguments, size_t);
+                    break;
+                case 't':
+                    value = (long long)va_arg(arguments, ptrdiff_t);
+                    break;
+                case 'p':
+                    value = (long long)(uintptr_t)va_arg(arguments, void*);
+                    break;
+                case 'd':
+                    number = va_arg(arguments, double);
+                    AppendRecordBytes(buffer, size, &length, &number, sizeof(number));
+                    continue;
+                case 's':
+                    // Only as much of the string as the precision lets through is read, it may not be terminated
+                    string = va_arg(arguments, const char*);
+                    string = (NULL != string) ? string : "(null)";
+                    precision = (PRECISION_ARGUMENT == logSite->arguments[i].precision) ? precision : logSite->arguments[i].precision;
+                    stringLength = (precision >= 0) ? strnlen(string, (size_t)precision) : strlen(string);
+                    AppendRecordNumber(buffer, size, &length, stringLength, 4);
+                    AppendRecordBytes(buffer, size, &length, string, stringLength);
+                    continue;
+                default:
+                    value = 0;
+            }
+
+            // The last integer is the precision of a "%.*s" that follows it
+            precision = value;
+            AppendRecordNumber(buffer, size, &length, (unsigned long long)value, 8);
+        }
+    }
+
+    argumentsLength = (uint32_t)(length - argumentsStart - 4);
+    if ((argumentsStart + 4) <= size)
+    {
+        memcpy(buffer + argumentsStart, &argumentsLength, 4);
+    }
+
+    return length;
+}
+
+static bool ReadRecordBytes(FILE* input, void* bytes, size_t count)
+{
+    return (count == fread(bytes, 1, count, input));
+}
+
+static bool ReadRecordNumber(FILE* input, unsigned long long* value, size_t count)
+{
+    uint8_t byte = 0;
+    uint32_t word = 0;
+    uint64_t quad = 0;
+    bool result = false;
+
+    switch (count)
+    {
+        case 1:
+            result = ReadRecordBytes(input, &byte, 1);
+            *value = byte;
+            break;
+        case 4:
+            result = ReadRecordBytes(input, &word, 4);
+            *value = word;
+            break;
+        default:
+            result = ReadRecordBytes(input, &quad, 8);
+            *value = quad;
+    }
+
+    return result;
+}
+
+static char* ReadRecordString(FILE* input)
+{
+    unsigned long long length = 0;
+    char* string = NULL;
+
+    if (ReadRecordNumber(input, &length, 4) && (NULL != (string = (char*)malloc(length + 1))))
+    {
+        if (ReadRecordBytes(input, string, length))
+        {
+            string[length] = 0;
+        }
+        else
+        {
+            free(string);
+            string = NULL;
+        }
+    }
+
+    return string;
+}
+
+// Appends text to a growing message
+static bool AppendMessage(char** message, size_t* length, size_t* capacity, const char* text, size_t count)
+{
+    char* grown = NULL;
+
+    if ((*length + count + 1) > *capacity)
+    {
+        *capacity = ((*length + count + 1) > (*capacity * 2)) ? (*length + count + 1) : (*capacity * 2);
+        if (NULL == (grown = (char*)realloc(*message, *capacity)))
+        {
+            return false;
+        }
+        *message = grown;
+    }
+
+    memcpy(*message + *length, text, count);
+    *length += count;
+    (*message)[*length] = 0;
+
+    return true;
+}
+
+static const char* TakeArgument(const char** arguments, const char* end, size_t count)
+{
+    const char* argument = *arguments;
+
+    if ((size_t)(end - argument) < count)
+    {
+        return NULL;
+    }
+
+    *arguments += count;
+    return argument;
+}
+
+// Formats one conversion with the original specification, with star arguments in stars
+static int FormatConversion(char* buffer, size_t size, const char* spec, int starCount, const int* stars, char conversion, const char* length, long long value, double number, const char* string)
+{
+    switch (conversion)
+    {
+        case 's':
+            return (0 == starCount) ? snprintf(buffer, size, spec, string) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], string) : snprintf(buffer, size, spec, stars[0], stars[1], string));
+
+        case 'p':
+            return (0 == starCount) ? snprintf(buffer, size, spec, (void*)(uintptr_t)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (void*)(uintptr_t)value) : snprintf(buffer, size, spec, stars[0], stars[1], (void*)(uintptr_t)value));
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            return (0 == starCount) ? snprintf(buffer, size, spec, number) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], number) : snprintf(buffer, size, spec, stars[0], stars[1], number));
+
+        default:
+            // Integers are passed at the size the length modifier calls for
+            if ((0 == length[0]) || ('h' == length[0]) || ('c' == conversion))
+            {
+                return (0 == starCount) ? snprintf(buffer, size, spec, (int)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (int)value) : snprintf(buffer, size, spec, stars[0], stars[1], (int)value));
+            }
+            else if (('l' == length[0]) && (0 == length[1]))
+            {
+                return (0 == starCount) ? snprintf(buffer, size, spec, (long)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (long)value) : snprintf(buffer, size, spec, stars[0], stars[1], (long)value));
+            }
+            else if ('z' == length[0] || 'Z' == length[0])
+            {
+                return (0 == starCount) ? snprintf(buffer, size, spec, (size_t)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (size_t)value) : snprintf(buffer, size, spec, stars[0], stars[1], (size_t)value));
+            }
+            else if ('t' == length[0])
+            {
+                return (0 == starCount) ? snprintf(buffer, size, spec, (ptrdiff_t)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (ptrdiff_t)value) : snprintf(buffer, size, spec, stars[0], stars[1], (ptrdiff_t)value));
+            }
+            else if ('j' == length[0])
+            {
+                return (0 == starCount) ? snprintf(buffer, size, spec, (intmax_t)value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], (intmax_t)value) : snprintf(buffer, size, spec, stars[0], stars[1], (intmax_t)value));
+            }
+            return (0 == starCount) ? snprintf(buffer, size, spec, value) : ((1 == starCount) ? snprintf(buffer, size, spec, stars[0], value) : snprintf(buffer, size, spec, stars[0], stars[1], value));
+    }
+}
+
+// Formats the message of an event from its format and the arguments recorded with it, NULL if they do not match
+static char* FormatStructuredLogMessage(const char* format, const char* arguments, size_t argumentsLength)
+{
+    const char* end = arguments + argumentsLength;
+    const char* conversion = NULL;
+    const char* next = NULL;
+    const char* argument = NULL;
+    LOG_ARGUMENT types[STRUCTURED_LOG_MAX_ARGUMENTS] = {{0}};
+    char spec[64] = {0};
+    char length[3] = {0};
+    char formatted[512] = {0};
+    char* message = NULL;
+    char* string = NULL;
+    size_t messageLength = 0;
+    size_t capacity = 0;
+    size_t specLength = 0;
+    long long value = 0;
+    double number = 0;
+    uint32_t stringLength = 0;
+    int stars[2] = {0};
+    int starCount = 0;
+    int count = 0;
+    int written = 0;
+    int i = 0;
+    bool result = true;
+
+    while (result && (NULL != (conversion = FindConversion(format))))
+    {
+        // The text before the conversion, with "%%" as '%'
+        for (; result && (format < conversion); format++)
+        {
+            result = AppendMessage(&message, &messageLength, &capacity, format, 1);
+            format += (('%' == format[0]) && ('%' == format[1])) ? 1 : 0;
+        }
+
+        count = 0;
+        if (!result || (NULL == (next = ParseConversion(conversion, types, &count))) || ((specLength = (size_t)(next - conversion)) >= sizeof(spec)))
+        {
+            result = false;
+            break;
+        }
+
+        memcpy(spec, conversion, specLength);
+        spec[specLength] = 0;
+
+        memset(length, 0, sizeof(length));
+        for (i = 1; (size_t)i < specLength - 1; i++)
+        {
+            if (NULL != strchr("hlLqjzZt", spec[i]))
+            {
+                length[0] = spec[i];
+                length[1] = (spec[i] == spec[i + 1]) ? spec[i + 1] : 0;
+                break;
+            }
+        }
+
+        for (i = 0, starCount = 0, string = NULL; result && (i < count); i++)
+        {
+            if ('s' == types[i].type)
+            {
+                result = (NULL != (argument = TakeArgument(&arguments, end, 4)));
+                if (result)
+                {
+                    memcpy(&stringLength, argument, 4);
+                    result = (NULL != (argument = TakeArgument(&arguments, end, stringLength))) && (NULL != (string = (char*)malloc(stringLength + 1)));
+                }
+                if (result)
+                {
+                    memcpy(string, argument, stringLength);
+                    string[stringLength] = 0;
+                }
+            }
+            else if (NULL == (argument = TakeArgument(&arguments, end, 8)))
+            {
+                result = false;
+            }
+            else if ('d' == types[i].type)
+            {
+                memcpy(&number, argument, 8);
+            }
+            else
+            {
+                memcpy(&value, argument, 8);
+                if ((i < (count - 1)) && (starCount < 2))
+                {
+                    stars[starCount++] = (int)value;
+                }
+            }
+        }
+
+        if (result)
+        {
+            written = FormatConversion(formatted, sizeof(formatted), spec, starCount, stars, next[-1], length, value, number, string);
+
+            if ((written >= 0) && ((size_t)written >= sizeof(formatted)))
+            {
+                // Longer than most, formatted again on the heap
+                char* large = (char*)malloc((size_t)written + 1);
+                if (NULL != large)
+                {
+                    FormatConversion(large, (size_t)written + 1, spec, starCount, stars, next[-1], length, value, number, string);
+                    result = AppendMessage(&message, &messageLength, &capacity, large, (size_t)written);
+                    free(large);
+                }
+                else
+                {
+                    result = false;
+                }
+            }
+            else if (written > 0)
+            {
+                result = AppendMessage(&message, &messageLength, &capacity, formatted, (size_t)written);
+            }
+        }
+
+        free(string);
+        format = next;
+    }
+
+    for (; result && (0 != *format); format++)
+    {
+        result = AppendMessage(&message, &messageLength, &capacity, format, 1);
+        format += (('%' == format[0]) && ('%' == format[1])) ? 1 : 0;
+    }
+
+    if (result && (NULL == message))
+    {
+        result = AppendMessage(&message, &messageLength, &capacity, "", 0);
+    }
+
+    if (!result)
+    {
+        free(message);
+        message = NULL;
+    }
+
+    return message;
+}
+
+static void WriteLogJsonString(FILE* output, const char* string)
+{
+    fputc('"', output);
+
+    for (; 0 != *string; string++)
+    {
+        switch (*string)
+        {
+            case '"':
+                fputs("\\\"", output);
+                break;
+            case '\\':
+                fputs("\\\\", output);
+                break;
+            case '\n':
+                fputs("\\n", output);
+                break;
+            case '\r':
+                fputs("\\r", output);
+                break;
+            case '\t':
+                fputs("\\t", output);
+                break;
+            default:
+                if ((unsigned char)*string < 0x20)
+                {
+                    fprintf(output, "\\u%04x", (unsigned char)*string);
+                }
+                else
+                {
+                    fputc(*string, output);
+                }
+        }
+    }
+
+    fputc('"', output);
+}
+
+int DecodeStructuredLog(FILE* input, FILE* output, bool jsonLines)
+{
+    LOG_DEFINITION* definitions = NULL;
+    LOG_DEFINITION* definition = NULL;
+    char magic[sizeof(STRUCTURED_LOG_MAGIC) - 1] = {0};
+    char timeText[64] = {0};
+    char* arguments = NULL;
+    char* message = NULL;
+    char* file = NULL;
+    char* format = NULL;
+    unsigned long long type = 0;
+    unsigned long long site = 0;
+    unsigned long long level = 0;
+    unsigned long long thread = 0;
+    unsigned long long monotonic = 0;
+    unsigned long long argumentsLength = 0;
+    unsigned long long line = 0;
+    unsigned long long anchorRealtime = 0;
+    unsigned long long anchorMonotonic = 0;
+    unsigned long long anchorOffset = 0;
+    long long realtime = 0;
+    long offset = 0;
+    time_t seconds = 0;
+    struct tm utc = {0};
+    int status = 0;
+
+    if ((NULL == input) || (NULL == output))
+    {
+        return EINVAL;
+    }
+
+    if (!ReadRecordBytes(input, magic, sizeof(magic)) || (0 != memcmp(magic, STRUCTURED_LOG_MAGIC, sizeof(magic))) ||
+        !ReadRecordNumber(input, &type, 4) || (STRUCTURED_LOG_BYTE_ORDER != type))
+    {
+        return EINVAL;
+    }
+
+    if (NULL == (definitions = (LOG_DEFINITION*)calloc(STRUCTURED_LOG_SITES, sizeof(LOG_DEFINITION))))
+    {
+        return ENOMEM;
+    }
+
+    // A log cut short, by a crash or as it rotated, ends at its last whole record
+    while ((0 == status) && ReadRecordNumber(input, &type, 1))
+    {
+        switch (type)
+        {
+            case STRUCTURED_LOG_ANCHOR:
+                if (!ReadRecordNumber(input, &anchorRealtime, 8) || !ReadRecordNumber(input, &anchorMonotonic, 8) || !ReadRecordNumber(input, &anchorOffset, 4))
+                {
+                    status = ENODATA;
+                }
+                break;
+
+            case STRUCTURED_LOG_DEFINITION:
+                if (!ReadRecordNumber(input, &site, 4) || !ReadRecordNumber(input, &line, 4) || (site >= STRUCTURED_LOG_SITES) ||
+                    (NULL == (file = ReadRecordString(input))) || (NULL == (format = ReadRecordString(input))))
+                {
+                    free(file);
+                    status = (site >= STRUCTURED_LOG_SITES) ? EINVAL : ENODATA;
+                }
+                else
+                {
+                    definition = &definitions[site];
+                    free(definition->file);
+                    free(definition->format);
+                    definition->file = file;
+                    definition->format = format;
+                    definition->line = (unsigned int)line;
+                }
+                file = NULL;
+                format = NULL;
+                break;
+
+            case STRUCTURED_LOG_EVENT:
+            case STRUCTURED_LOG_MESSAGE:
+                if (!ReadRecordNumber(input, &site, 4) || !ReadRecordNumber(input, &level, 1) || !ReadRecordNumber(input, &thread, 4) ||
+                    !ReadRecordNumber(input, &monotonic, 8) || !ReadRecordNumber(input, &argumentsLength, 4) ||
+                    (NULL == (arguments = (char*)malloc(argumentsLength + 1))) || !ReadRecordBytes(input, arguments, argumentsLength))
+                {
+                    status = ENODATA;
+                    break;
+                }
+
+                arguments[argumentsLength] = 0;
+
+                if ((site >= STRUCTURED_LOG_SITES) || (NULL == definitions[site].format))
+                {
+                    status = EINVAL;
+                    break;
+                }
+
+                definition = &definitions[site];
+
+                if (STRUCTURED_LOG_MESSAGE == type)
+                {
+                    message = arguments;
+                    arguments = NULL;
+                }
+                else if (NULL == (message = FormatStructuredLogMessage(definition->format, arguments, argumentsLength)))
+                {
+                    status = EINVAL;
+                    break;
+                }
+
+                // As the text log shows it, in the local time of the device that logged it
+                offset = (long)(int32_t)anchorOffset;
+                realtime = (long long)anchorRealtime + ((long long)monotonic - (long long)anchorMonotonic);
+                seconds = (time_t)(realtime / 1000000000LL) + offset;
+                gmtime_r(&seconds, &utc);
+                strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &utc);
+                snprintf(timeText + strlen(timeText), sizeof(timeText) - strlen(timeText), "%c%02ld%02ld", (offset < 0) ? '-' : '+', labs(offset) / 3600, (labs(offset) % 3600) / 60);
+
+                if (jsonLines)
+                {
+                    fprintf(output, "{\"Time\":\"%s\",\"Nanoseconds\":%lld,\"Level\":\"%s\",\"File\":", timeText, realtime, GetLoggingLevelName((LoggingLevel)level));
+                    WriteLogJsonString(output, definition->file);
+                    fprintf(output, ",\"Line\":%u,\"Thread\":%llu,\"Format\":", definition->line, thread);
+                    WriteLogJsonString(output, definition->format);
+                    fputs(",\"Message\":", output);
+                    WriteLogJsonString(output, message);
+                    fputs("}\n", output);
+                }
+                else
+                {
+                    fprintf(output, __PREFIX_TEMPLATE__ "%s\n", timeText, GetLoggingLevelName((LoggingLevel)level), definition->file, definition->line, message);
+                }
+
+                free(message);
+                message = NULL;
+                break;
+
+            default:
+                status = EINVAL;
+        }
+
+        free(arguments);
+        arguments = NULL;
+    }
+
+    for (site = 0; site < STRUCTURED_LOG_SITES; site++)
+    {
+        free(definitions[site].file);
+        free(definitions[site].format);
+    }
+    free(definitions);
+
+    // A record cut short at the end is not an error
+    return (ENODATA == status) ? 0 : status;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef STRUCTUREDLOG_H
+#define STRUCTUREDLOG_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include "Logging.h"
+
+// Structured logs are written in native byte order, as a header followed by records that each start with their type:
+//   'T' time anchor: realtime and monotonic nanoseconds (8 bytes each), offset from UTC in seconds (4)
+//   'D' call site definition: site (4), line (4), file length (4), file, format length (4), format
+//   'E' event: site (4), level (1), thread (4), monotonic nanoseconds (8), arguments length (4), arguments
+//   'M' message: as an event, with the message formatted instead of the arguments, for formats that cannot be deferred
+// Arguments are 8 bytes each, strings are a length (4) followed by the characters.
+#define STRUCTURED_LOG_MAGIC "OSCLOGB1"
+#define STRUCTURED_LOG_BYTE_ORDER 0x01020304
+#define STRUCTURED_LOG_ANCHOR 'T'
+#define STRUCTURED_LOG_DEFINITION 'D'
+#define STRUCTURED_LOG_EVENT 'E'
+#define STRUCTURED_LOG_MESSAGE 'M'
+
+// Call sites tracked, a power of two, lines from sites past that are logged as text
+#define STRUCTURED_LOG_SITES 4096
+#define STRUCTURED_LOG_MAX_ARGUMENTS 16
+
+// Sites whose file and format together are longer than this are logged as text, so that a definition always fits a line
+#define STRUCTURED_LOG_MAX_DEFINITION_SIZE 2048
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Returns the site of the call, registered on first use, or -1 when there is no room left.
+// Sites are told apart by the addresses of file and format, which are expected to be string literals.
+int GetStructuredLogSite(const char* file, int line, const char* format);
+
+// Each returns the size of the record and writes it when it fits the buffer, like snprintf
+size_t EncodeStructuredLogHeader(char* buffer, size_t size);
+size_t EncodeStructuredLogAnchor(char* buffer, size_t size);
+size_t EncodeStructuredLogDefinition(char* buffer, size_t size, int site);
+size_t EncodeStructuredLogEvent(char* buffer, size_t size, int site, LoggingLevel level, const char* format, va_list arguments);
+
+long long GetStructuredLogMonotonicTime(void);
+
+// For a forked child, whose thread ids differ from the parent
+void ResetStructuredLogThread(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STRUCTUREDLOG_H
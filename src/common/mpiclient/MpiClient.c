@@ -6,6 +6,9 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <parson.h>
@@ -20,23 +23,178 @@
 
 #define HTTP_INTERNAL_SERVER_ERROR 500
 
+// Below the idle timeout of the server, so that a kept connection is seldom closed by the server as it is being reused
+#define MPI_CONNECTION_IDLE_TIMEOUT 20000
+
 extern MPI_HANDLE g_mpiHandle;
 
-static int CallMpi(const char* name, const char* request, char** response, int* responseSize, OsConfigLogHandle log)
+// Connection kept alive between calls of the current session, guarded by g_connectionLock
+static int g_connection = -1;
+static long g_connectionLastUsed = 0;
+static pthread_mutex_t g_connectionLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set once the server said it accepts bodies passed as memfd, guarded by g_connectionLock
+static bool g_serverAcceptsMemfdBody = false;
+
+static long GetMonotonicMilliseconds(void)
 {
-    const char* mpiSocket = "/run/osconfig/mpid.sock";
-    const char* dataFormat = "POST /%s/ HTTP/1.1\r\nHost: OSConfig\r\nUser-Agent: OSConfig\r\nAccept: */*\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s";
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
+// Takes the kept connection, if there is one still usable. Concurrent callers that find none open their own.
+static int TakeConnection(void)
+{
+    struct pollfd pollDescriptor = {0};
     int socketHandle = -1;
-    char* data = {0};
-    int estimatedDataSize = 0;
-    int actualDataSize = 0;
-    char contentLengthString[MPI_MAX_CONTENT_LENGTH] = {0};
+
+    pthread_mutex_lock(&g_connectionLock);
+    socketHandle = g_connection;
+    g_connection = -1;
+
+    if ((socketHandle >= 0) && ((GetMonotonicMilliseconds() - g_connectionLastUsed) > MPI_CONNECTION_IDLE_TIMEOUT))
+    {
+        close(socketHandle);
+        socketHandle = -1;
+    }
+    pthread_mutex_unlock(&g_connectionLock);
+
+    if (socketHandle >= 0)
+    {
+        // An idle connection has nothing to read, unless the server closed it
+        pollDescriptor.fd = socketHandle;
+        pollDescriptor.events = POLLIN;
+
+        if (0 != poll(&pollDescriptor, 1, 0))
+        {
+            close(socketHandle);
+            socketHandle = -1;
+        }
+    }
+
+    return socketHandle;
+}
+
+static void KeepConnection(int socketHandle)
+{
+    pthread_mutex_lock(&g_connectionLock);
+
+    if (g_connection < 0)
+    {
+        g_connection = socketHandle;
+        g_connectionLastUsed = GetMonotonicMilliseconds();
+        socketHandle = -1;
+    }
+
+    pthread_mutex_unlock(&g_connectionLock);
+
+    if (socketHandle >= 0)
+    {
+        close(socketHandle);
+    }
+}
+
+static bool ServerAcceptsMemfdBody(void)
+{
+    bool accepts = false;
+
+    pthread_mutex_lock(&g_connectionLock);
+    accepts = g_serverAcceptsMemfdBody;
+    pthread_mutex_unlock(&g_connectionLock);
+
+    return accepts;
+}
+
+static void SetServerAcceptsMemfdBody(bool accepts)
+{
+    pthread_mutex_lock(&g_connectionLock);
+    g_serverAcceptsMemfdBody = accepts;
+    pthread_mutex_unlock(&g_connectionLock);
+}
+
+// Opens a new connection to the server and sends the request over it
+static int ConnectAndSend(const char* name, const char* mpiSocket, const char* headers, const char* request, int requestSize, bool memfdBody, int* socketHandle, OsConfigLogHandle log)
+{
     struct sockaddr_un socketAddress = {0};
     socklen_t socketLength = 0;
+    int status = MPI_OK;
+
+    *socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (0 > *socketHandle)
+    {
+        status = errno ? errno : EIO;
+        OsConfigLogError(log, "CallMpi(%s): failed to open socket '%s' (%d)", name, mpiSocket, status);
+        OSConfigTelemetryStatusTrace("socket", status);
+    }
+    else
+    {
+        memset(&socketAddress, 0, sizeof(socketAddress));
+        socketAddress.sun_family = AF_UNIX;
+        strncpy(socketAddress.sun_path, mpiSocket, sizeof(socketAddress.sun_path) - 1);
+        socketLength = sizeof(socketAddress);
+    }
+
+    if ((MPI_OK == status) && (0 != connect(*socketHandle, (struct sockaddr*)&socketAddress, socketLength)))
+    {
+        status = errno ? errno : EIO;
+        OsConfigLogError(log, "CallMpi(%s): failed to connect to socket '%s' (%d)", name, mpiSocket, status);
+        OSConfigTelemetryStatusTrace("connect", errno);
+    }
+
+    if (MPI_OK == status)
+    {
+        if (0 != (status = SendHttpMessageToSocket(*socketHandle, headers, request, requestSize, memfdBody, log)))
+        {
+            if (IsDebugLoggingEnabled())
+            {
+                OsConfigLogError(log, "CallMpi(%s): failed to send request '%s' (%d bytes) to socket '%s' (%d)", name, request, requestSize, mpiSocket, status);
+                OSConfigTelemetryStatusTrace("SendHttpMessageToSocket", status);
+            }
+            else
+            {
+                OsConfigLogError(log, "CallMpi(%s): failed to send request to socket '%s' of %d bytes (%d)", name, mpiSocket, requestSize, status);
+                OSConfigTelemetryStatusTrace("SendHttpMessageToSocket", status);
+            }
+        }
+        else
+        {
+            OsConfigLogDebug(log, "CallMpi(%s): sent to '%s' '%s' (%d bytes)", name, mpiSocket, request, requestSize);
+        }
+    }
+
+    return status;
+}
+
+// Waits for the response to start, true when the connection was closed before any of it arrived
+static bool IsClosedBeforeResponse(int socketHandle)
+{
+    char byte = 0;
     ssize_t bytes = 0;
+
+    while ((0 > (bytes = recv(socketHandle, &byte, 1, MSG_PEEK))) && (EINTR == errno))
+    {
+    }
+
+    return ((0 == bytes) || ((bytes < 0) && ((ECONNRESET == errno) || (EPIPE == errno)))) ? true : false;
+}
+
+static int CallMpi(const char* name, const char* request, bool keepAlive, char** response, int* responseSize, OsConfigLogHandle log)
+{
+    const char* mpiSocket = "/run/osconfig/mpid.sock";
+    const char* headersFormat = "POST /%s/ HTTP/1.1\r\nHost: OSConfig\r\nUser-Agent: OSConfig\r\nAccept: */*\r\nConnection: %s\r\nContent-Type: application/json\r\n" HTTP_ACCEPT_MEMFD_BODY_HEADER;
+    const char* connectionKeepAlive = "keep-alive";
+    const char* connectionClose = "close";
+
+    int socketHandle = -1;
+    char* headers = NULL;
+    int requestSize = 0;
     int status = MPI_OK;
     int httpStatus = -1;
+    bool reused = false;
+    bool serverKeepAlive = false;
+    bool memfdBody = false;
+    HttpMessage httpResponse = {0};
 
     if ((NULL == name) || (NULL == request) || (NULL == response) || (NULL == responseSize))
     {
@@ -59,108 +217,105 @@ static int CallMpi(const char* name, const char* request, char** response, int*
         }
     }
 
-    snprintf(contentLengthString, sizeof(contentLengthString), "%d", (int)strlen(request));
-    estimatedDataSize = strlen(name) + strlen(dataFormat) + strlen(request) + strlen(contentLengthString) + 1;
-
-    data = (char*)malloc(estimatedDataSize);
-    if (NULL == data)
+    if (NULL == (headers = FormatAllocateString(headersFormat, name, keepAlive ? connectionKeepAlive : connectionClose)))
     {
         status = ENOMEM;
         OsConfigLogError(log, "CallMpi(%s): failed to allocate memory for request (%d)", name, status);
-        OSConfigTelemetryStatusTrace("malloc", status);
+        OSConfigTelemetryStatusTrace("FormatAllocateString", status);
         return status;
     }
 
-    memset(data, 0, estimatedDataSize);
+    // Large bodies are passed as a memfd once the server said it accepts these
+    requestSize = (int)strlen(request);
+    memfdBody = ServerAcceptsMemfdBody();
 
-    socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (0 > socketHandle)
+    // A kept connection the server closed in the meantime is replaced by a new one
+    if (0 <= (socketHandle = TakeConnection()))
     {
-        status = errno ? errno : EIO;
-        OsConfigLogError(log, "CallMpi(%s): failed to open socket '%s' (%d)", name, mpiSocket, status);
-        OSConfigTelemetryStatusTrace("socket", status);
-    }
-    else
-    {
-        memset(&socketAddress, 0, sizeof(socketAddress));
-        socketAddress.sun_family = AF_UNIX;
-        strncpy(socketAddress.sun_path, mpiSocket, sizeof(socketAddress.sun_path) - 1);
-        socketLength = sizeof(socketAddress);
-    }
-
-    if (MPI_OK == status)
-    {
-        if (0 == connect(socketHandle, (struct sockaddr*)&socketAddress, socketLength))
+        if (0 == SendHttpMessageToSocket(socketHandle, headers, request, requestSize, memfdBody, IsDebugLoggingEnabled() ? log : NULL))
         {
-            snprintf(data, estimatedDataSize, dataFormat, name, strlen(request), request);
-            actualDataSize = (int)strlen(data);
+            reused = true;
         }
         else
         {
-            status = errno ? errno : EIO;
-            OsConfigLogError(log, "CallMpi(%s): failed to connect to socket '%s' (%d)", name, mpiSocket, status);
-            OSConfigTelemetryStatusTrace("connect", errno);
+            close(socketHandle);
+            socketHandle = -1;
         }
     }
 
-    if (MPI_OK == status)
+    if (!reused)
     {
-        bytes = send(socketHandle, data, actualDataSize, 0);
-        if (bytes != actualDataSize)
-        {
-            status = errno ? errno : EIO;
-            if (IsDebugLoggingEnabled())
-            {
-                OsConfigLogError(log, "CallMpi(%s): failed to send request '%s' (%d bytes) to socket '%s' (%d)", name, data, actualDataSize, mpiSocket, status);
-                OSConfigTelemetryStatusTrace("send", errno);
-            }
-            else
-            {
-                OsConfigLogError(log, "CallMpi(%s): failed to send request to socket '%s' of %d bytes (%d)", name, mpiSocket, actualDataSize, status);
-                OSConfigTelemetryStatusTrace("send", errno);
-            }
-        }
-        else
+        status = ConnectAndSend(name, mpiSocket, headers, request, requestSize, memfdBody, &socketHandle, log);
+    }
+    else
+    {
+        OsConfigLogDebug(log, "CallMpi(%s): sent to '%s' over kept connection '%s' (%d bytes)", name, mpiSocket, request, requestSize);
+
+        // The server may close a kept connection for being idle just as the request goes out, it then never saw the request
+        if (IsClosedBeforeResponse(socketHandle))
         {
-            OsConfigLogDebug(log, "CallMpi(%s): sent to '%s' '%s' (%d bytes)", name, mpiSocket, data, actualDataSize);
+            OsConfigLogDebug(log, "CallMpi(%s): kept connection closed by the server, sending again over a new one", name);
+            close(socketHandle);
+            socketHandle = -1;
+            status = ConnectAndSend(name, mpiSocket, headers, request, requestSize, memfdBody, &socketHandle, log);
         }
     }
 
-    FREE_MEMORY(data);
+    FREE_MEMORY(headers);
 
     if (MPI_OK == status)
     {
-        httpStatus = ReadHttpStatusFromSocket(socketHandle, log);
-        status = (200 == httpStatus) ? MPI_OK : httpStatus;
-
-        *responseSize = ReadHttpContentLengthFromSocket(socketHandle, log);
-        *response = (char*)malloc(*responseSize + 1);
-        if (NULL != *response)
+        if (0 == (status = ReadHttpMessageFromSocket(socketHandle, &httpResponse, log)))
         {
-            memset(*response, 0, *responseSize + 1);
+            httpStatus = httpResponse.status;
+            status = (200 == httpStatus) ? MPI_OK : httpStatus;
+            serverKeepAlive = httpResponse.keepAlive;
+
+            if (httpResponse.acceptsMemfdBody != memfdBody)
+            {
+                SetServerAcceptsMemfdBody(httpResponse.acceptsMemfdBody);
+            }
 
-            if (*responseSize != read(socketHandle, *response, *responseSize))
+            // The response body is handed over as is, unless it is mapped from a memfd and has to be copied for the caller to free
+            if (httpResponse.mappedBodySize > 0)
             {
-                if ((MPI_OK == status) || IsDebugLoggingEnabled())
+                if (NULL != (*response = (char*)malloc(httpResponse.contentLength + 1)))
                 {
-                    OsConfigLogError(log, "CallMpi(%s): failed to read %d bytes response from socket '%s' (%d)", name, *responseSize, mpiSocket, status);
-                    OSConfigTelemetryStatusTrace("read", errno);
+                    memcpy(*response, httpResponse.body, httpResponse.contentLength + 1);
+                    *responseSize = httpResponse.contentLength;
                 }
-                status = errno ? errno : EIO;
+                else
+                {
+                    status = ENOMEM;
+                    OsConfigLogError(log, "CallMpi(%s): failed to allocate memory for response of %d bytes (%d)", name, httpResponse.contentLength, status);
+                }
+            }
+            else
+            {
+                *response = httpResponse.body;
+                *responseSize = httpResponse.contentLength;
+                httpResponse.body = NULL;
             }
+
+            FreeHttpMessage(&httpResponse);
         }
         else
         {
-            status = ENOMEM;
-            *responseSize = 0;
-            OsConfigLogError(log, "CallMpi(%s): failed to allocate memory for response (%d)", name, status);
-            OSConfigTelemetryStatusTrace("malloc", status);
+            OsConfigLogError(log, "CallMpi(%s): failed to read response from socket '%s' (%d)", name, mpiSocket, status);
+            OSConfigTelemetryStatusTrace("ReadHttpMessageFromSocket", status);
         }
     }
 
     if (0 <= socketHandle)
     {
-        close(socketHandle);
+        if (keepAlive && serverKeepAlive)
+        {
+            KeepConnection(socketHandle);
+        }
+        else
+        {
+            close(socketHandle);
+        }
     }
 
     OsConfigLogDebug(log, "CallMpi(name: '%s', request: '%s', response: '%s', response size: %d bytes) to socket '%s' returned %d", name, request, *response, *responseSize, mpiSocket, status);
@@ -234,7 +389,7 @@ MPI_HANDLE CallMpiOpen(const char* clientName, const unsigned int maxPayloadSize
 
     snprintf(request, requestSize, requestBodyFormat, clientName, maxPayloadSizeBytes);
 
-    status = CallMpi(name, request, &response, &responseSize, log);
+    status = CallMpi(name, request, true, &response, &responseSize, log);
 
     FREE_MEMORY(request);
 
@@ -292,7 +447,8 @@ void CallMpiClose(MPI_HANDLE clientSession, OsConfigLogHandle log)
 
     snprintf(request, requestSize, requestBodyFormat, (char*)clientSession);
 
-    CallMpi(name, request, &response, &responseSize, log);
+    // The connection kept for the session is closed together with it
+    CallMpi(name, request, false, &response, &responseSize, log);
 
     FREE_MEMORY(request);
     FREE_MEMORY(response);
@@ -342,7 +498,7 @@ int CallMpiSet(const char* componentName, const char* propertyName, const MPI_JS
 
     snprintf(request, requestSize, requestBodyFormat, (char*)g_mpiHandle, componentName, propertyName, payload);
 
-    status = CallMpi(name, request, &response, &responseSize, log);
+    status = CallMpi(name, request, true, &response, &responseSize, log);
 
     FREE_MEMORY(request);
 
@@ -407,7 +563,7 @@ int CallMpiGet(const char* componentName, const char* propertyName, MPI_JSON_STR
 
     snprintf(request, requestSize, requestBodyFormat, (char*)g_mpiHandle, componentName, propertyName);
 
-    status = CallMpi(name, request, payload, payloadSizeBytes, log);
+    status = CallMpi(name, request, true, payload, payloadSizeBytes, log);
 
     FREE_MEMORY(request);
 
@@ -485,7 +641,7 @@ int CallMpiSetDesired(const MPI_JSON_STRING payload, const int payloadSizeBytes,
 
     snprintf(request, requestSize, requestBodyFormat, (char*)g_mpiHandle, payload);
 
-    status = CallMpi(name, request, &response, &responseSize, log);
+    status = CallMpi(name, request, true, &response, &responseSize, log);
 
     FREE_MEMORY(request);
 
@@ -550,7 +706,7 @@ int CallMpiGetReported(MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfig
 
     snprintf(request, requestSize, requestBodyFormat, (char*)g_mpiHandle);
 
-    status = CallMpi(name, request, payload, payloadSizeBytes, log);
+    status = CallMpi(name, request, true, payload, payloadSizeBytes, log);
 
     FREE_MEMORY(request);
 
@@ -588,6 +744,106 @@ int CallMpiGetReported(MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfig
     return status;
 }
 
+// The generation is the one last applied, 0 for none, and is replaced with the one of the returned payload
+int CallMpiGetReportedDelta(unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfigLogHandle log)
+{
+    const char *name = "MpiGetReportedDelta";
+    static const char *requestBodyFormat = "{ \"ClientSession\": %s, \"Generation\": %u }";
+
+    char* request = NULL;
+    char* response = NULL;
+    int requestSize = 0;
+    int responseSize = 0;
+    int status = MPI_OK;
+    char* statusFromResponse = NULL;
+    JSON_Value* responseValue = NULL;
+    JSON_Object* responseObject = NULL;
+    JSON_Value* reportedValue = NULL;
+
+    if ((NULL == g_mpiHandle) || (0 == strlen((char*)g_mpiHandle)))
+    {
+        status = EPERM;
+        OsConfigLogError(log, "CallMpiGetReportedDelta: called without a valid MPI handle (%d)", status);
+        OSConfigTelemetryStatusTrace("g_mpiHandle", status);
+        return status;
+    }
+
+    if ((NULL == generation) || (NULL == payload) || (NULL == payloadSizeBytes))
+    {
+        status = EINVAL;
+        OsConfigLogError(log, "CallMpiGetReportedDelta: called with invalid arguments (%d)", status);
+        OSConfigTelemetryStatusTrace("payload", status);
+        return status;
+    }
+
+    *payload = NULL;
+    *payloadSizeBytes = 0;
+
+    requestSize = strlen(requestBodyFormat) + strlen((char*)g_mpiHandle) + MPI_MAX_CONTENT_LENGTH + 1;
+
+    request = (char*)malloc(requestSize);
+    if (NULL == request)
+    {
+        status = ENOMEM;
+        OsConfigLogError(log, "CallMpiGetReportedDelta: failed to allocate memory for request (%d)", status);
+        OSConfigTelemetryStatusTrace("malloc", status);
+        return status;
+    }
+
+    snprintf(request, requestSize, requestBodyFormat, (char*)g_mpiHandle, *generation);
+
+    status = CallMpi(name, request, true, &response, &responseSize, log);
+
+    FREE_MEMORY(request);
+
+    if (HTTP_INTERNAL_SERVER_ERROR == status)
+    {
+        if ((NULL != response) && (responseSize > 0))
+        {
+            statusFromResponse = ParseString(log, response);
+            status = (NULL == statusFromResponse) ? EINVAL : atoi(statusFromResponse);
+            FREE_MEMORY(statusFromResponse);
+        }
+        else
+        {
+            OsConfigLogError(log, "CallMpiGetReportedDelta: invalid response for HTTP internal server error (500)");
+            OSConfigTelemetryStatusTrace("CallMpi", EINVAL);
+            status = EINVAL;
+        }
+    }
+    else if (MPI_OK == status)
+    {
+        if ((NULL == response) || (NULL == (responseValue = json_parse_string(response))) ||
+            (NULL == (responseObject = json_value_get_object(responseValue))) ||
+            (JSONNumber != json_value_get_type(json_object_get_value(responseObject, "Generation"))) ||
+            (NULL == (reportedValue = json_object_get_value(responseObject, "Reported"))))
+        {
+            OsConfigLogError(log, "CallMpiGetReportedDelta: invalid response (%p, %d)", response, responseSize);
+            OSConfigTelemetryStatusTrace("CallMpi", EINVAL);
+            status = EINVAL;
+        }
+        else if (NULL == (*payload = json_serialize_to_string(reportedValue)))
+        {
+            status = ENOMEM;
+            OsConfigLogError(log, "CallMpiGetReportedDelta: failed to serialize the reported objects (%d)", status);
+            OSConfigTelemetryStatusTrace("json_serialize_to_string", status);
+        }
+        else
+        {
+            *generation = (unsigned int)json_object_get_number(responseObject, "Generation");
+            *payloadSizeBytes = (int)strlen(*payload);
+        }
+
+        json_value_free(responseValue);
+    }
+
+    FREE_MEMORY(response);
+
+    OsConfigLogDebug(log, "CallMpiGetReportedDelta(%p, %.*s, %d bytes): %d, generation %u", g_mpiHandle, *payloadSizeBytes, *payload, *payloadSizeBytes, status, *generation);
+
+    return status;
+}
+
 void CallMpiFree(MPI_JSON_STRING payload)
 {
     FREE_MEMORY(payload);
@@ -15,6 +15,7 @@ int CallMpiSet(const char* componentName, const char* propertyName, const MPI_JS
 int CallMpiGet(const char* componentName, const char* propertyName, MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfigLogHandle log);
 int CallMpiSetDesired(const MPI_JSON_STRING payload, const int payloadSizeBytes, OsConfigLogHandle log);
 int CallMpiGetReported(MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfigLogHandle log);
+int CallMpiGetReportedDelta(unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSizeBytes, OsConfigLogHandle log);
 void CallMpiFree(MPI_JSON_STRING payload);
 
 #ifdef __cplusplus
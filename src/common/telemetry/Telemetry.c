@@ -9,16 +9,78 @@
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+// The writer thread wakes once this much is pending, or every TELEMETRY_WRITER_WAIT_MILLISECONDS
+#define TELEMETRY_BATCH_SIZE 65536
+#define TELEMETRY_MAX_PENDING_SIZE 1048576
+#define TELEMETRY_WRITER_WAIT_MILLISECONDS 1000
+#define TELEMETRY_FLUSH_TIMEOUT_MILLISECONDS 2000
+
+// Distinct kinds of RuleComplete events counted together, a power of two, events of kinds past that are reported as they happen
+#define TELEMETRY_AGGREGATES 1024
+
+// Bucket n counts times from 2^(n-1) to 2^n - 1 microseconds, the last one all longer times
+#define TELEMETRY_HISTOGRAM_BUCKETS 32
+
+typedef struct TELEMETRY_BUFFER
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+} TELEMETRY_BUFFER;
+
+typedef struct TELEMETRY_AGGREGATE
+{
+    char* componentName;
+    char* objectName;
+    int objectResult;
+    size_t hash;
+
+    // Counted in the current window, without the event reported as it happened when the kind was first seen
+    unsigned long count;
+    unsigned long long totalMicroseconds;
+    long minMicroseconds;
+    long maxMicroseconds;
+    unsigned long histogram[TELEMETRY_HISTOGRAM_BUCKETS];
+} TELEMETRY_AGGREGATE;
+
 static FILE* g_tmpFile = NULL;
 static char* g_moduleDirectory = NULL;
 static char* g_distroName = NULL;
 
+static __thread TELEMETRY_CONTEXT g_telemetryContext = {{0}, {0}, 0};
+static pthread_once_t g_correlationIdOnce = PTHREAD_ONCE_INIT;
+static const char* g_correlationId = NULL;
+
+// Events are appended to the pending buffer under the lock, the writer thread swaps it for its own and writes that one without the lock
+static TELEMETRY_BUFFER g_pendingEvents = {0};
+static unsigned long g_appendedEvents = 0;
+static unsigned long g_writtenEvents = 0;
+static unsigned long g_droppedEvents = 0;
+static bool g_telemetryWriterRunning = false;
+static bool g_telemetryWriterStopping = false;
+static bool g_telemetryFlushRequested = false;
+static bool g_telemetryAtForkRegistered = false;
+static pthread_t g_telemetryWriter;
+static pthread_mutex_t g_telemetryLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_telemetryWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_telemetryWritten = PTHREAD_COND_INITIALIZER;
+
+// Open addressing, kinds are kept once seen so that only their first event is reported as it happens, guarded by g_telemetryLock
+static TELEMETRY_AGGREGATE* g_aggregates[TELEMETRY_AGGREGATES];
+static unsigned int g_aggregationSeconds = 0;
+
+// Monotonic seconds when the first event of the current window was counted, 0 when none was
+static long long g_aggregationStart = 0;
+
 char* GetModuleDirectory(void)
 {
     Dl_info dlInfo = {0};
@@ -53,6 +115,437 @@ char* GetCachedDistroName(void)
     return g_distroName;
 }
 
+TELEMETRY_CONTEXT* GetTelemetryContext(void)
+{
+    return &g_telemetryContext;
+}
+
+static void ReadCorrelationId(void)
+{
+    g_correlationId = getenv(TELEMETRY_CORRELATIONID_ENVIRONMENT_VAR);
+}
+
+const char* GetTelemetryCorrelationId(void)
+{
+    pthread_once(&g_correlationIdOnce, ReadCorrelationId);
+    return g_correlationId;
+}
+
+static void AddTelemetryMilliseconds(struct timespec* time, long milliseconds)
+{
+    time->tv_sec += milliseconds / 1000;
+    time->tv_nsec += (milliseconds % 1000) * 1000000;
+
+    if (time->tv_nsec >= 1000000000)
+    {
+        time->tv_sec += 1;
+        time->tv_nsec -= 1000000000;
+    }
+}
+
+static bool ReserveTelemetryBuffer(TELEMETRY_BUFFER* buffer, size_t length)
+{
+    size_t capacity = 0;
+    char* data = NULL;
+
+    if ((buffer->size + length) <= buffer->capacity)
+    {
+        return true;
+    }
+
+    capacity = (buffer->capacity > 0) ? buffer->capacity : TELEMETRY_BATCH_SIZE;
+    while (capacity < (buffer->size + length))
+    {
+        capacity *= 2;
+    }
+
+    if (NULL == (data = (char*)realloc(buffer->data, capacity)))
+    {
+        return false;
+    }
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return true;
+}
+
+// Queues the event for the writer thread, or writes it right away when there is none, called with g_telemetryLock held
+static void AppendTelemetryEvent(const char* jsonString, size_t length)
+{
+    if (g_telemetryWriterRunning)
+    {
+        if (((g_pendingEvents.size + length + 1) > TELEMETRY_MAX_PENDING_SIZE) || !ReserveTelemetryBuffer(&g_pendingEvents, length + 1))
+        {
+            g_droppedEvents += 1;
+        }
+        else
+        {
+            memcpy(g_pendingEvents.data + g_pendingEvents.size, jsonString, length);
+            g_pendingEvents.data[g_pendingEvents.size + length] = '\n';
+            g_pendingEvents.size += length + 1;
+            g_appendedEvents += 1;
+
+            if (g_pendingEvents.size >= TELEMETRY_BATCH_SIZE)
+            {
+                pthread_cond_signal(&g_telemetryWake);
+            }
+        }
+    }
+    else if (NULL != g_tmpFile)
+    {
+        fprintf(g_tmpFile, "%s\n", jsonString);
+        fflush(g_tmpFile);
+    }
+}
+
+static long long GetAggregationTime(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec;
+}
+
+static unsigned int GetHistogramBucket(long microseconds)
+{
+    unsigned int bucket = (microseconds > 0) ? (unsigned int)(64 - __builtin_clzll((unsigned long long)microseconds)) : 0;
+    return (bucket < TELEMETRY_HISTOGRAM_BUCKETS) ? bucket : (TELEMETRY_HISTOGRAM_BUCKETS - 1);
+}
+
+// Returns the aggregate of the kind, added when new, NULL when there is no room left, called with g_telemetryLock held
+static TELEMETRY_AGGREGATE* FindOrAddAggregate(const char* componentName, const char* objectName, int objectResult, bool* added)
+{
+    size_t hash = ((HashString(componentName) * 33) ^ HashString(objectName)) + (size_t)objectResult;
+    TELEMETRY_AGGREGATE* aggregate = NULL;
+    size_t i = 0;
+
+    *added = false;
+
+    for (i = 0; i < TELEMETRY_AGGREGATES; i++)
+    {
+        if (NULL == (aggregate = g_aggregates[(hash + i) & (TELEMETRY_AGGREGATES - 1)]))
+        {
+            if ((NULL == (aggregate = (TELEMETRY_AGGREGATE*)calloc(1, sizeof(TELEMETRY_AGGREGATE)))) ||
+                (NULL == (aggregate->componentName = DuplicateString(componentName))) || (NULL == (aggregate->objectName = DuplicateString(objectName))))
+            {
+                if (NULL != aggregate)
+                {
+                    FREE_MEMORY(aggregate->componentName);
+                    FREE_MEMORY(aggregate);
+                }
+                return NULL;
+            }
+
+            aggregate->objectResult = objectResult;
+            aggregate->hash = hash;
+            g_aggregates[(hash + i) & (TELEMETRY_AGGREGATES - 1)] = aggregate;
+            *added = true;
+            return aggregate;
+        }
+
+        if ((aggregate->hash == hash) && (aggregate->objectResult == objectResult) && (0 == strcmp(aggregate->objectName, objectName)) &&
+            (0 == strcmp(aggregate->componentName, componentName)))
+        {
+            return aggregate;
+        }
+    }
+
+    return NULL;
+}
+
+static void CountAggregate(TELEMETRY_AGGREGATE* aggregate, long microseconds)
+{
+    if ((0 == aggregate->count) || (microseconds < aggregate->minMicroseconds))
+    {
+        aggregate->minMicroseconds = microseconds;
+    }
+    if ((0 == aggregate->count) || (microseconds > aggregate->maxMicroseconds))
+    {
+        aggregate->maxMicroseconds = microseconds;
+    }
+
+    aggregate->count += 1;
+    aggregate->totalMicroseconds += (microseconds > 0) ? (unsigned long long)microseconds : 0;
+    aggregate->histogram[GetHistogramBucket(microseconds)] += 1;
+
+    if (0 == g_aggregationStart)
+    {
+        g_aggregationStart = GetAggregationTime();
+    }
+}
+
+static void ResetAggregate(TELEMETRY_AGGREGATE* aggregate)
+{
+    aggregate->count = 0;
+    aggregate->totalMicroseconds = 0;
+    aggregate->minMicroseconds = 0;
+    aggregate->maxMicroseconds = 0;
+    memset(aggregate->histogram, 0, sizeof(aggregate->histogram));
+}
+
+// Reports a RuleSummary for each kind counted in the window once it is over, or right away when forced, called with g_telemetryLock held
+static void EmitAggregates(bool force)
+{
+    char histogram[TELEMETRY_HISTOGRAM_BUCKETS * 24] = {0};
+    TELEMETRY_AGGREGATE* aggregate = NULL;
+    const char* timestamp = NULL;
+    const char* distroName = NULL;
+    const char* correlationId = NULL;
+    char* json = NULL;
+    long long now = GetAggregationTime();
+    size_t length = 0;
+    size_t i = 0;
+    unsigned int bucket = 0;
+
+    if ((0 == g_aggregationStart) || (!force && ((now - g_aggregationStart) < (long long)g_aggregationSeconds)))
+    {
+        return;
+    }
+
+    timestamp = GetFormattedTime();
+    distroName = GetCachedDistroName();
+    correlationId = GetTelemetryCorrelationId();
+
+    for (i = 0; i < TELEMETRY_AGGREGATES; i++)
+    {
+        if ((NULL == (aggregate = g_aggregates[i])) || (0 == aggregate->count))
+        {
+            continue;
+        }
+
+        // As bucket:count pairs, for the buckets that counted any
+        for (bucket = 0, length = 0, histogram[0] = 0; bucket < TELEMETRY_HISTOGRAM_BUCKETS; bucket++)
+        {
+            if (aggregate->histogram[bucket] > 0)
+            {
+                length += snprintf(histogram + length, sizeof(histogram) - length, "%s%u:%lu", (length > 0) ? "," : "", bucket, aggregate->histogram[bucket]);
+            }
+        }
+
+        json = FormatAllocateString(
+            "{"
+            "\"EventName\":\"RuleSummary\","
+            "\"Timestamp\":\"%s\","
+            "\"ComponentName\":\"%s\","
+            "\"ObjectName\":\"%s\","
+            "\"ObjectResult\":\"%d\","
+            "\"Count\":\"%lu\","
+            "\"TotalMicroseconds\":\"%llu\","
+            "\"MinMicroseconds\":\"%ld\","
+            "\"MaxMicroseconds\":\"%ld\","
+            "\"Histogram\":\"%s\","
+            "\"WindowSeconds\":\"%lld\","
+            "\"DistroName\":\"%s\","
+            "\"CorrelationId\":\"%s\","
+            "\"Version\":\"%s\""
+            "}",
+            timestamp ? timestamp : TELEMETRY_NOTFOUND_STRING, aggregate->componentName, aggregate->objectName, aggregate->objectResult, aggregate->count,
+            aggregate->totalMicroseconds, aggregate->minMicroseconds, aggregate->maxMicroseconds, histogram, now - g_aggregationStart,
+            distroName ? distroName : TELEMETRY_NOTFOUND_STRING, correlationId ? correlationId : TELEMETRY_NOTFOUND_STRING, OSCONFIG_VERSION);
+
+        if (NULL != json)
+        {
+            AppendTelemetryEvent(json, strlen(json));
+            FREE_MEMORY(json);
+        }
+
+        ResetAggregate(aggregate);
+    }
+
+    g_aggregationStart = 0;
+}
+
+static void FreeAggregates(void)
+{
+    size_t i = 0;
+
+    for (i = 0; i < TELEMETRY_AGGREGATES; i++)
+    {
+        if (NULL != g_aggregates[i])
+        {
+            FREE_MEMORY(g_aggregates[i]->componentName);
+            FREE_MEMORY(g_aggregates[i]->objectName);
+            FREE_MEMORY(g_aggregates[i]);
+        }
+    }
+
+    g_aggregationStart = 0;
+}
+
+static void* TelemetryWriterThread(void* argument)
+{
+    TELEMETRY_BUFFER batch = {0};
+    TELEMETRY_BUFFER swap = {0};
+    struct timespec deadline = {0};
+    unsigned long appended = 0;
+    (void)argument;
+
+    pthread_mutex_lock(&g_telemetryLock);
+
+    for (;;)
+    {
+        if ((g_pendingEvents.size < TELEMETRY_BATCH_SIZE) && !g_telemetryFlushRequested && !g_telemetryWriterStopping)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            AddTelemetryMilliseconds(&deadline, TELEMETRY_WRITER_WAIT_MILLISECONDS);
+            pthread_cond_timedwait(&g_telemetryWake, &g_telemetryLock, &deadline);
+        }
+
+        EmitAggregates(g_telemetryWriterStopping);
+
+        if (g_pendingEvents.size > 0)
+        {
+            swap = batch;
+            batch = g_pendingEvents;
+            g_pendingEvents = swap;
+            g_pendingEvents.size = 0;
+            appended = g_appendedEvents;
+
+            pthread_mutex_unlock(&g_telemetryLock);
+            fwrite(batch.data, 1, batch.size, g_tmpFile);
+            fflush(g_tmpFile);
+            batch.size = 0;
+            pthread_mutex_lock(&g_telemetryLock);
+
+            g_writtenEvents = appended;
+            pthread_cond_broadcast(&g_telemetryWritten);
+        }
+        else
+        {
+            g_telemetryFlushRequested = false;
+
+            if (g_telemetryWriterStopping)
+            {
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&g_telemetryLock);
+
+    FREE_MEMORY(batch.data);
+    return NULL;
+}
+
+static void LockTelemetryBeforeFork(void)
+{
+    pthread_mutex_lock(&g_telemetryLock);
+}
+
+static void UnlockTelemetryAfterFork(void)
+{
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+// A forked child does not have the writer thread, it writes its events as it reports them and leaves the pending ones to the parent
+static void UnlockTelemetryInForkedChild(void)
+{
+    size_t i = 0;
+
+    g_telemetryWriterRunning = false;
+    g_pendingEvents.size = 0;
+
+    // As are the events counted so far
+    for (i = 0; i < TELEMETRY_AGGREGATES; i++)
+    {
+        if (NULL != g_aggregates[i])
+        {
+            ResetAggregate(g_aggregates[i]);
+        }
+    }
+    g_aggregationStart = 0;
+
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+static void StartTelemetryWriter(void)
+{
+    sigset_t blocked;
+    sigset_t previous;
+
+    pthread_mutex_lock(&g_telemetryLock);
+
+    if (!g_telemetryAtForkRegistered)
+    {
+        g_telemetryAtForkRegistered = (0 == pthread_atfork(LockTelemetryBeforeFork, UnlockTelemetryAfterFork, UnlockTelemetryInForkedChild));
+    }
+
+    if (g_telemetryAtForkRegistered && !g_telemetryWriterRunning)
+    {
+        g_telemetryWriterStopping = false;
+
+        // Signals are left to the threads of the process that handle them
+        sigfillset(&blocked);
+        pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+        g_telemetryWriterRunning = (0 == pthread_create(&g_telemetryWriter, NULL, TelemetryWriterThread, NULL));
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+// Writes what is pending and stops the writer, at cleanup and when the process exits or the module is unloaded
+static void __attribute__((destructor)) StopTelemetryWriter(void)
+{
+    pthread_mutex_lock(&g_telemetryLock);
+
+    if (!g_telemetryWriterRunning)
+    {
+        EmitAggregates(true);
+        pthread_mutex_unlock(&g_telemetryLock);
+        return;
+    }
+
+    g_telemetryWriterStopping = true;
+    pthread_cond_signal(&g_telemetryWake);
+    pthread_mutex_unlock(&g_telemetryLock);
+
+    pthread_join(g_telemetryWriter, NULL);
+
+    pthread_mutex_lock(&g_telemetryLock);
+    g_telemetryWriterRunning = false;
+    FREE_MEMORY(g_pendingEvents.data);
+    memset(&g_pendingEvents, 0, sizeof(g_pendingEvents));
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+void TelemetryFlush(void)
+{
+    struct timespec deadline = {0};
+    unsigned long target = 0;
+    int status = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    AddTelemetryMilliseconds(&deadline, TELEMETRY_FLUSH_TIMEOUT_MILLISECONDS);
+
+    pthread_mutex_lock(&g_telemetryLock);
+
+    if (g_telemetryWriterRunning)
+    {
+        target = g_appendedEvents;
+        g_telemetryFlushRequested = true;
+        pthread_cond_signal(&g_telemetryWake);
+
+        while ((g_writtenEvents < target) && (ETIMEDOUT != status))
+        {
+            status = pthread_cond_timedwait(&g_telemetryWritten, &g_telemetryLock, &deadline);
+        }
+    }
+
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+unsigned long GetDroppedTelemetryEvents(void)
+{
+    unsigned long dropped = 0;
+
+    pthread_mutex_lock(&g_telemetryLock);
+    dropped = g_droppedEvents;
+    pthread_mutex_unlock(&g_telemetryLock);
+
+    return dropped;
+}
+
 void TelemetryInitialize(const OsConfigLogHandle log)
 {
     if (false == DirectoryExists(OSCONFIG_DIRECTORY_NAME))
@@ -87,6 +580,8 @@ void TelemetryInitialize(const OsConfigLogHandle log)
     {
         OsConfigLogInfo(log, "TelemetryInitialize: Opened file: %s", TELEMETRY_TMP_FILE_NAME);
 
+        StartTelemetryWriter();
+
         g_moduleDirectory = GetModuleDirectory();
 
         if (NULL != g_moduleDirectory)
@@ -108,6 +603,13 @@ void TelemetryInitialize(const OsConfigLogHandle log)
 
 void TelemetryCleanup(const OsConfigLogHandle log)
 {
+    // The events are all in the file before it is handed over, with what was counted so far
+    StopTelemetryWriter();
+
+    pthread_mutex_lock(&g_telemetryLock);
+    FreeAggregates();
+    pthread_mutex_unlock(&g_telemetryLock);
+
     if (NULL != g_tmpFile)
     {
         char* fileName = NULL;
@@ -145,10 +647,106 @@ void TelemetryCleanup(const OsConfigLogHandle log)
 
 void TelemetryAppendPayloadToFile(const char* jsonString)
 {
-    if ((NULL != jsonString) && (NULL != g_tmpFile))
+    size_t length = 0;
+
+    if (NULL == jsonString)
     {
-        fprintf(g_tmpFile, "%s\n", jsonString);
-        fflush(g_tmpFile);
+        return;
+    }
+
+    length = strlen(jsonString);
+
+    pthread_mutex_lock(&g_telemetryLock);
+
+    // Full, the writer gets one chance to catch up (it may not have run at all on a single processor)
+    if (g_telemetryWriterRunning && ((g_pendingEvents.size + length + 1) > TELEMETRY_MAX_PENDING_SIZE))
+    {
+        pthread_cond_signal(&g_telemetryWake);
+        pthread_mutex_unlock(&g_telemetryLock);
+        sched_yield();
+        pthread_mutex_lock(&g_telemetryLock);
+    }
+
+    AppendTelemetryEvent(jsonString, length);
+
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+void SetTelemetryAggregationSeconds(unsigned int seconds)
+{
+    pthread_mutex_lock(&g_telemetryLock);
+
+    // What was counted under the previous window is reported first
+    if (seconds != g_aggregationSeconds)
+    {
+        EmitAggregates(true);
+        g_aggregationSeconds = seconds;
+    }
+
+    pthread_mutex_unlock(&g_telemetryLock);
+}
+
+void TelemetryReportRuleComplete(const char* componentName, const char* objectName, int objectResult, long microseconds)
+{
+    TELEMETRY_AGGREGATE* aggregate = NULL;
+    const char* timestamp = NULL;
+    const char* distroName = NULL;
+    const char* correlationId = NULL;
+    char* json = NULL;
+    bool added = false;
+    bool counted = false;
+
+    componentName = componentName ? componentName : TELEMETRY_NOTFOUND_STRING;
+    objectName = objectName ? objectName : TELEMETRY_NOTFOUND_STRING;
+
+    // Failures are always reported as they happen
+    if (0 == objectResult)
+    {
+        pthread_mutex_lock(&g_telemetryLock);
+
+        if ((g_aggregationSeconds > 0) && (NULL != (aggregate = FindOrAddAggregate(componentName, objectName, objectResult, &added))) && !added)
+        {
+            CountAggregate(aggregate, microseconds);
+            counted = true;
+
+            // Without the writer thread the window is checked as events come
+            if (!g_telemetryWriterRunning)
+            {
+                EmitAggregates(false);
+            }
+        }
+
+        pthread_mutex_unlock(&g_telemetryLock);
+    }
+
+    if (counted)
+    {
+        return;
+    }
+
+    timestamp = GetFormattedTime();
+    distroName = GetCachedDistroName();
+    correlationId = GetTelemetryCorrelationId();
+
+    json = FormatAllocateString(
+        "{"
+        "\"EventName\":\"RuleComplete\","
+        "\"Timestamp\":\"%s\","
+        "\"ComponentName\":\"%s\","
+        "\"ObjectName\":\"%s\","
+        "\"ObjectResult\":\"%d\","
+        "\"Microseconds\":\"%ld\","
+        "\"DistroName\":\"%s\","
+        "\"CorrelationId\":\"%s\","
+        "\"Version\":\"%s\""
+        "}",
+        timestamp ? timestamp : TELEMETRY_NOTFOUND_STRING, componentName, objectName, objectResult, microseconds,
+        distroName ? distroName : TELEMETRY_NOTFOUND_STRING, correlationId ? correlationId : TELEMETRY_NOTFOUND_STRING, OSCONFIG_VERSION);
+
+    if (NULL != json)
+    {
+        TelemetryAppendPayloadToFile(json);
+        FREE_MEMORY(json);
     }
 }
 
@@ -33,10 +33,11 @@
 #define TELEMETRY_TEARDOWN_TIMEOUT_SECONDS 8
 #define TELEMETRY_NOTFOUND_STRING "N/A"
 
+// Read once from the environment the process is started with
 #define TELEMETRY_CORRELATIONID_ENVIRONMENT_VAR "activityId"
-#define TELEMETRY_RULECODENAME_ENVIRONMENT_VAR "_RuleCodename"
-#define TELEMETRY_SCENARIONAME_ENVIRONMENT_VAR "_ScenarioName"
-#define TELEMETRY_MICROSECONDS_ENVIRONMENT_VAR "_Microseconds"
+
+// Longer rule codenames and scenario names are truncated in the events
+#define TELEMETRY_CONTEXT_NAME_SIZE 256
 
 // Buffer sizes for string conversion of numeric values
 #define MAX_NUM_STRING_LENGTH 32 // Accommodates 64-bit int/long values
@@ -49,12 +50,33 @@ extern "C"
 #endif
 
 #ifdef BUILD_TELEMETRY
+// The rule and scenario a thread is working on and when it started, carried into the events that thread reports
+typedef struct TELEMETRY_CONTEXT
+{
+    char ruleCodename[TELEMETRY_CONTEXT_NAME_SIZE];
+    char scenarioName[TELEMETRY_CONTEXT_NAME_SIZE];
+    int64_t startMicroseconds;
+} TELEMETRY_CONTEXT;
+
 char* GetModuleDirectory(void);
 char* GetCachedDistroName(void);
+TELEMETRY_CONTEXT* GetTelemetryContext(void);
+const char* GetTelemetryCorrelationId(void);
 
 void TelemetryInitialize(const OsConfigLogHandle log);
 void TelemetryCleanup(const OsConfigLogHandle log);
+
+// Events are queued and written in batches by a writer thread, when enough are pending, every second, on flush, cleanup and exit.
+// Events past TELEMETRY_MAX_PENDING_SIZE waiting to be written are dropped and counted.
 void TelemetryAppendPayloadToFile(const char* jsonString);
+void TelemetryFlush(void);
+unsigned long GetDroppedTelemetryEvents(void);
+
+// With a window set, successful RuleComplete events of the same component, object and result are counted together and
+// reported once per window as a RuleSummary, with their total, minimum and maximum time and a histogram of it (2^n microseconds
+// buckets). Failures and the first event of each kind are still reported as they happen. 0, the default, reports all as they happen.
+void SetTelemetryAggregationSeconds(unsigned int seconds);
+void TelemetryReportRuleComplete(const char* componentName, const char* objectName, int objectResult, long microseconds);
 #else
 ATTRIB_UNUSED static char* GetModuleDirectory(void)
 {
@@ -80,6 +102,20 @@ ATTRIB_UNUSED static void TelemetryAppendPayloadToFile(const char* jsonString)
 {
     (void)jsonString;
 }
+
+ATTRIB_UNUSED static void TelemetryFlush(void)
+{
+}
+
+ATTRIB_UNUSED static unsigned long GetDroppedTelemetryEvents(void)
+{
+    return 0;
+}
+
+ATTRIB_UNUSED static void SetTelemetryAggregationSeconds(unsigned int seconds)
+{
+    (void)seconds;
+}
 #endif
 
 #ifdef __cplusplus
@@ -98,13 +134,18 @@ static inline int64_t TsToUs(struct timespec ts)
 }
 
 #ifdef BUILD_TELEMETRY
+static inline void OSConfigTelemetrySetContext(const char* ruleCodename, const char* scenarioName)
+{
+    TELEMETRY_CONTEXT* context = GetTelemetryContext();
+    snprintf(context->ruleCodename, sizeof(context->ruleCodename), "%s", ruleCodename ? ruleCodename : "");
+    snprintf(context->scenarioName, sizeof(context->scenarioName), "%s", scenarioName ? scenarioName : "");
+}
+
 static inline void OSConfigTimeStampSave(void)
 {
     struct timespec start;
     clock_gettime(CLOCK_MONOTONIC, &start);
-    char start_str[MAX_NUM_STRING_LENGTH] = {0};
-    snprintf(start_str, sizeof(start_str), "%" PRId64, TsToUs(start));
-    setenv(TELEMETRY_MICROSECONDS_ENVIRONMENT_VAR, start_str, 1);
+    GetTelemetryContext()->startMicroseconds = TsToUs(start);
 }
 
 static inline void OSConfigGetElapsedTime(int64_t* elapsed_us_var)
@@ -115,9 +156,7 @@ static inline void OSConfigGetElapsedTime(int64_t* elapsed_us_var)
     }
 
     struct timespec end;
-    const char* start_str = getenv(TELEMETRY_MICROSECONDS_ENVIRONMENT_VAR);
-    char* end_ptr;
-    int64_t start_us = (start_str != NULL) ? strtoll(start_str, &end_ptr, 10) : 0;
+    int64_t start_us = GetTelemetryContext()->startMicroseconds;
 
     if (start_us == 0)
     {
@@ -137,9 +176,10 @@ static inline void OSConfigGetElapsedTime(int64_t* elapsed_us_var)
 #define OSConfigTelemetryStatusTraceImpl(callingFunctionName, status, line)                                                                            \
     {                                                                                                                                                  \
         char* telemetry_json = NULL;                                                                                                                   \
-        const char* _correlationId = getenv(TELEMETRY_CORRELATIONID_ENVIRONMENT_VAR);                                                                  \
-        const char* _ruleCodename = getenv(TELEMETRY_RULECODENAME_ENVIRONMENT_VAR);                                                                    \
-        const char* _scenarioName = getenv(TELEMETRY_SCENARIONAME_ENVIRONMENT_VAR);                                                                    \
+        const TELEMETRY_CONTEXT* _context = GetTelemetryContext();                                                                                     \
+        const char* _correlationId = GetTelemetryCorrelationId();                                                                                      \
+        const char* _ruleCodename = _context->ruleCodename[0] ? _context->ruleCodename : NULL;                                                         \
+        const char* _scenarioName = _context->scenarioName[0] ? _context->scenarioName : TELEMETRY_NOTFOUND_STRING;                                    \
         const char* _timestamp = GetFormattedTime();                                                                                                   \
         int64_t _elapsed_us = 0;                                                                                                                       \
         const char* _distroName = GetCachedDistroName();                                                                                               \
@@ -176,7 +216,7 @@ static inline void OSConfigGetElapsedTime(int64_t* elapsed_us_var)
 #define OSConfigTelemetryBaselineRun(baselineName, mode, durationSeconds)                                                                              \
     {                                                                                                                                                  \
         char* telemetry_json = NULL;                                                                                                                   \
-        const char* correlationId = getenv(TELEMETRY_CORRELATIONID_ENVIRONMENT_VAR);                                                                   \
+        const char* correlationId = GetTelemetryCorrelationId();                                                                                       \
         const char* timestamp = GetFormattedTime();                                                                                                    \
         const char* distroName = GetCachedDistroName();                                                                                                \
         telemetry_json = FormatAllocateString(                                                                                                         \
@@ -202,34 +242,17 @@ static inline void OSConfigGetElapsedTime(int64_t* elapsed_us_var)
 
 #define OSConfigTelemetryRuleComplete(componentName, objectName, objectResult, microseconds)                                                           \
     {                                                                                                                                                  \
-        char* telemetry_json = NULL;                                                                                                                   \
-        const char* correlationId = getenv(TELEMETRY_CORRELATIONID_ENVIRONMENT_VAR);                                                                   \
-        const char* timestamp = GetFormattedTime();                                                                                                    \
-        const char* distroName = GetCachedDistroName();                                                                                                \
-        telemetry_json = FormatAllocateString(                                                                                                         \
-            "{"                                                                                                                                        \
-            "\"EventName\":\"RuleComplete\","                                                                                                          \
-            "\"Timestamp\":\"%s\","                                                                                                                    \
-            "\"ComponentName\":\"%s\","                                                                                                                \
-            "\"ObjectName\":\"%s\","                                                                                                                   \
-            "\"ObjectResult\":\"%d\","                                                                                                                 \
-            "\"Microseconds\":\"%ld\","                                                                                                                \
-            "\"DistroName\":\"%s\","                                                                                                                   \
-            "\"CorrelationId\":\"%s\","                                                                                                                \
-            "\"Version\":\"%s\""                                                                                                                       \
-            "}",                                                                                                                                       \
-            timestamp ? timestamp : TELEMETRY_NOTFOUND_STRING, (componentName) ? (componentName) : TELEMETRY_NOTFOUND_STRING,                          \
-            (objectName) ? (objectName) : TELEMETRY_NOTFOUND_STRING, objectResult, microseconds, distroName ? distroName : TELEMETRY_NOTFOUND_STRING,  \
-            correlationId ? correlationId : TELEMETRY_NOTFOUND_STRING, OSCONFIG_VERSION);                                                              \
-        if (NULL != telemetry_json)                                                                                                                    \
-        {                                                                                                                                              \
-            TelemetryAppendPayloadToFile(telemetry_json);                                                                                              \
-            FREE_MEMORY(telemetry_json);                                                                                                               \
-        }                                                                                                                                              \
+        TelemetryReportRuleComplete((componentName), (objectName), (objectResult), (long)(microseconds));                                              \
     }
 
 #else // BUILD_TELEMETRY
 
+#define OSConfigTelemetrySetContext(ruleCodename, scenarioName)                                                                                        \
+    do                                                                                                                                                 \
+    {                                                                                                                                                  \
+        (void)(ruleCodename);                                                                                                                          \
+        (void)(scenarioName);                                                                                                                          \
+    } while (0)
 #define OSConfigTimeStampSave()                                                                                                                        \
     do                                                                                                                                                 \
     {                                                                                                                                                  \
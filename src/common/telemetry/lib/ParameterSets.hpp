@@ -32,6 +32,13 @@ const std::set<std::string> RULE_COMPLETE_OPTIONAL_PARAMS = {
     // No optional params for now
 };
 
+// RuleSummary
+const std::set<std::string> RULE_SUMMARY_REQUIRED_PARAMS = {"ComponentName", "ObjectName", "ObjectResult", "Count", "TotalMicroseconds", "MinMicroseconds",
+    "MaxMicroseconds", "Histogram", "WindowSeconds"};
+const std::set<std::string> RULE_SUMMARY_OPTIONAL_PARAMS = {
+    // No optional params for now
+};
+
 // StatusTrace
 const std::set<std::string> STATUS_TRACE_REQUIRED_PARAMS = {
     "FileName", "LineNumber", "ScenarioName", "FunctionName", "RuleCodename", "CallingFunctionName", "Microseconds", "ResultCode", "ResultString"};
@@ -50,6 +57,7 @@ const std::set<std::string> COMMAND_EXECUTED_OPTIONAL_PARAMS = {
 const std::unordered_map<std::string, std::pair<std::set<std::string>, std::set<std::string>>> EVENT_PARAMETER_SETS = {
     {"BaselineRun", {AddCommonParams(BASELINE_RUN_REQUIRED_PARAMS), BASELINE_RUN_OPTIONAL_PARAMS}},
     {"RuleComplete", {AddCommonParams(RULE_COMPLETE_REQUIRED_PARAMS), RULE_COMPLETE_OPTIONAL_PARAMS}},
+    {"RuleSummary", {AddCommonParams(RULE_SUMMARY_REQUIRED_PARAMS), RULE_SUMMARY_OPTIONAL_PARAMS}},
     {"StatusTrace", {AddCommonParams(STATUS_TRACE_REQUIRED_PARAMS), STATUS_TRACE_OPTIONAL_PARAMS}},
     {"CommandExecuted", {AddCommonParams(COMMAND_EXECUTED_REQUIRED_PARAMS), COMMAND_EXECUTED_OPTIONAL_PARAMS}}};
 
@@ -119,6 +119,22 @@ TEST_F(TelemetryTest, ProcessRuleCompleteMissingComponentNameEvent)
     EXPECT_FALSE(telemetryManager.ProcessJsonFile(m_testJsonFile));
 }
 
+TEST_F(TelemetryTest, ProcessRuleSummaryEvent)
+{
+    std::string realEvent = R"({"EventName":"RuleSummary","Timestamp":"2025-10-17 22:52:56+0000","ComponentName":"SecurityBaseline","ObjectName":"auditEnsureAuditdInstalled","ObjectResult":"0","Count":"59","TotalMicroseconds":"1711","MinMicroseconds":"24","MaxMicroseconds":"41","Histogram":"5:52,6:7","WindowSeconds":"3600","DistroName":"CentOS","CorrelationId":"","Version":"1.0.5.20251017-g03b36b7d"})";
+    ASSERT_TRUE(CreateTestJsonFile(realEvent));
+    Telemetry::TelemetryManager telemetryManager(false, std::chrono::seconds(1));
+    EXPECT_TRUE(telemetryManager.ProcessJsonFile(m_testJsonFile));
+}
+
+TEST_F(TelemetryTest, ProcessRuleSummaryMissingHistogramEvent)
+{
+    std::string realEvent = R"({"EventName":"RuleSummary","Timestamp":"2025-10-17 22:52:56+0000","ComponentName":"SecurityBaseline","ObjectName":"auditEnsureAuditdInstalled","ObjectResult":"0","Count":"59","TotalMicroseconds":"1711","MinMicroseconds":"24","MaxMicroseconds":"41","WindowSeconds":"3600","DistroName":"CentOS","CorrelationId":"","Version":"1.0.5.20251017-g03b36b7d"})";
+    ASSERT_TRUE(CreateTestJsonFile(realEvent));
+    Telemetry::TelemetryManager telemetryManager(false, std::chrono::seconds(1));
+    EXPECT_FALSE(telemetryManager.ProcessJsonFile(m_testJsonFile));
+}
+
 TEST_F(TelemetryTest, ProcessBaselineRunEvent)
 {
     std::string realEvent = R"({"EventName":"BaselineRun","Timestamp":"2025-10-17 22:52:56+0000","BaselineName":"Azure Security Baseline for Linux","Mode":"audit-only","DurationSeconds":"8.87","DistroName":"CentOS","CorrelationId":"","Version":"1.0.5.20251017-g03b36b7d"})";
@@ -6,12 +6,18 @@
 #include <cstdio>
 #include <string>
 #include <list>
+#include <sstream>
+#include <thread>
+#include <vector>
 #include <time.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <gtest/gtest.h>
 #include <CommonUtils.h>
+#include <parson.h>
 #include <UserUtils.h>
 #include <SshUtils.h>
 #include <Asb.h>
@@ -693,6 +699,174 @@ TEST_F(CommonUtilsTest, HashString)
     EXPECT_EQ(dataHash, sameDataHash);
 }
 
+TEST_F(CommonUtilsTest, ReadJsonObjectMembers)
+{
+    const char* json = " { \"A\" : {\"x\": [1, {\"y\": \"}\\\"]\"}], \"z\": null} ,\"B\\u0041\":\"text\", \"C\": -1.5e3 , \"D\": {} }\n";
+    JsonMember* members = nullptr;
+    int memberCount = 0;
+
+    EXPECT_EQ(0, ReadJsonObjectMembers(json, (int)strlen(json), &members, &memberCount, nullptr));
+    ASSERT_EQ(4, memberCount);
+    EXPECT_STREQ("A", members[0].name);
+    EXPECT_EQ("{\"x\": [1, {\"y\": \"}\\\"]\"}], \"z\": null}", std::string(members[0].value, members[0].valueSize));
+    EXPECT_STREQ("BA", members[1].name);
+    EXPECT_EQ("\"text\"", std::string(members[1].value, members[1].valueSize));
+    EXPECT_STREQ("C", members[2].name);
+    EXPECT_EQ("-1.5e3", std::string(members[2].value, members[2].valueSize));
+    EXPECT_STREQ("D", members[3].name);
+    EXPECT_EQ("{}", std::string(members[3].value, members[3].valueSize));
+
+    // The slices are members of the original text, not copies
+    EXPECT_TRUE((members[0].value > json) && (members[0].value < (json + strlen(json))));
+
+    JsonMember* nested = nullptr;
+    int nestedCount = 0;
+    EXPECT_EQ(0, ReadJsonObjectMembers(members[0].value, members[0].valueSize, &nested, &nestedCount, nullptr));
+    ASSERT_EQ(2, nestedCount);
+    EXPECT_STREQ("x", nested[0].name);
+    EXPECT_STREQ("z", nested[1].name);
+    EXPECT_EQ("null", std::string(nested[1].value, nested[1].valueSize));
+    FreeJsonMembers(nested, nestedCount);
+
+    // Only the given size is read
+    EXPECT_EQ(0, ReadJsonObjectMembers(members[3].value, members[3].valueSize, &nested, &nestedCount, nullptr));
+    EXPECT_EQ(0, nestedCount);
+    FreeJsonMembers(nested, nestedCount);
+
+    FreeJsonMembers(members, memberCount);
+
+    std::vector<std::string> invalid = {
+        "",
+        "[]",
+        "\"A\"",
+        "{",
+        "{\"A\"}",
+        "{\"A\": }",
+        "{\"A\": 1,}",
+        "{\"A\": [1}",
+        "{\"A\": {\"B\": 1]}",
+        "{\"A\": \"unterminated}",
+        "{A: 1}",
+        "{\"A\": 1} trailing"
+    };
+
+    for (auto& text : invalid)
+    {
+        members = nullptr;
+        memberCount = 0;
+        EXPECT_EQ(EINVAL, ReadJsonObjectMembers(text.c_str(), (int)text.size(), &members, &memberCount, nullptr)) << text;
+        EXPECT_EQ(nullptr, members);
+        EXPECT_EQ(0, memberCount);
+    }
+
+    EXPECT_EQ(EINVAL, ReadJsonObjectMembers(nullptr, 0, &members, &memberCount, nullptr));
+    EXPECT_EQ(EINVAL, ReadJsonObjectMembers("{}", 2, nullptr, &memberCount, nullptr));
+}
+
+TEST_F(CommonUtilsTest, JsonArena)
+{
+    const char* json = "{\"ClientSession\":\"test\",\"Payload\":{\"Component\":{\"Object\":[1,\"two\",{\"three\":3}]}}}";
+
+    JsonArena* arena = nullptr;
+    JsonArena* otherArena = nullptr;
+    JSON_Value* heapValue = nullptr;
+    JSON_Value* rootValue = nullptr;
+    JSON_Value* copiedValue = nullptr;
+    char* serialized = nullptr;
+    unsigned int allocations = 0;
+    unsigned int chunks = 0;
+
+    ASSERT_NE(nullptr, arena = CreateJsonArena());
+    ASSERT_NE(nullptr, otherArena = CreateJsonArena());
+
+    // A value from the heap can still be freed while an arena is used
+    ASSERT_NE(nullptr, heapValue = json_parse_string(json));
+
+    EXPECT_EQ(nullptr, UseJsonArena(arena));
+    ASSERT_NE(nullptr, rootValue = json_parse_string(json));
+    ASSERT_NE(nullptr, serialized = json_serialize_to_string(json_object_get_value(json_value_get_object(rootValue), "Payload")));
+    EXPECT_STREQ("{\"Component\":{\"Object\":[1,\"two\",{\"three\":3}]}}", serialized);
+    json_value_free(heapValue);
+
+    // Arenas nest, the previous one is used again after
+    EXPECT_EQ(arena, UseJsonArena(otherArena));
+    EXPECT_EQ(otherArena, UseJsonArena(arena));
+    EXPECT_EQ(arena, UseJsonArena(nullptr));
+
+    // A copy made outside of the arena outlives it
+    ASSERT_NE(nullptr, copiedValue = json_value_deep_copy(rootValue));
+
+    GetJsonArenaStatistics(arena, &allocations, &chunks);
+    EXPECT_LT(10u, allocations);
+    EXPECT_EQ(1u, chunks);
+
+    FreeJsonArena(arena);
+    FreeJsonArena(otherArena);
+
+    EXPECT_STREQ("test", json_object_get_string(json_value_get_object(copiedValue), "ClientSession"));
+    json_value_free(copiedValue);
+
+    // A reset arena keeps its last chunk for the next use
+    ASSERT_NE(nullptr, arena = CreateJsonArena());
+    EXPECT_EQ(nullptr, UseJsonArena(arena));
+    EXPECT_NE(nullptr, json_parse_string(json));
+    ResetJsonArena(arena);
+    EXPECT_NE(nullptr, json_parse_string(json));
+    EXPECT_EQ(arena, UseJsonArena(nullptr));
+    GetJsonArenaStatistics(arena, &allocations, &chunks);
+    EXPECT_EQ(1u, chunks);
+    FreeJsonArena(arena);
+
+    FreeJsonArena(nullptr);
+    ResetJsonArena(nullptr);
+    GetJsonArenaStatistics(nullptr, &allocations, &chunks);
+    EXPECT_EQ(0u, allocations);
+    EXPECT_EQ(0u, chunks);
+}
+
+// A desired payload of 200 objects parsed and its payload serialized again, as HandleMpiCall does, takes a few arena chunks for all of its allocations
+TEST_F(CommonUtilsTest, JsonArenaAllocations)
+{
+    const int components = 10;
+    const int objects = 20;
+
+    std::string json = "{\"ClientSession\":\"test\",\"Payload\":{";
+    JsonArena* arena = nullptr;
+    JSON_Value* rootValue = nullptr;
+    char* payload = nullptr;
+    unsigned int allocations = 0;
+    unsigned int chunks = 0;
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < components; i++)
+    {
+        json += ((i > 0) ? ",\"Component" : "\"Component") + std::to_string(i) + "\":{";
+
+        for (j = 0; j < objects; j++)
+        {
+            json += ((j > 0) ? ",\"object" : "\"object") + std::to_string(j) + "\":{\"name\":\"value " + std::to_string(j) + "\",\"enabled\":true,\"values\":[1,2,3]}";
+        }
+
+        json += "}";
+    }
+
+    json += "}}";
+
+    ASSERT_NE(nullptr, arena = CreateJsonArena());
+    EXPECT_EQ(nullptr, UseJsonArena(arena));
+    ASSERT_NE(nullptr, rootValue = json_parse_string(json.c_str()));
+    ASSERT_NE(nullptr, payload = json_serialize_to_string(json_object_get_value(json_value_get_object(rootValue), "Payload")));
+    EXPECT_EQ(json.substr(strlen("{\"ClientSession\":\"test\",\"Payload\":"), json.size() - strlen("{\"ClientSession\":\"test\",\"Payload\":") - 1), payload);
+    EXPECT_EQ(arena, UseJsonArena(nullptr));
+
+    GetJsonArenaStatistics(arena, &allocations, &chunks);
+    FreeJsonArena(arena);
+
+    EXPECT_LT(1000u, allocations);
+    EXPECT_LT(100 * chunks, allocations);
+}
+
 TEST_F(CommonUtilsTest, RestrictFileAccess)
 {
     EXPECT_TRUE(CreateTestFile(m_path, m_data));
@@ -1279,6 +1453,338 @@ TEST_F(CommonUtilsTest, ReadtHttpHeaderInfoFromSocket)
     }
 }
 
+TEST_F(CommonUtilsTest, ReadHttpHeadersFromSocket)
+{
+    const char* testPath = "~socket.test";
+
+    struct
+    {
+        const char* httpResponse;
+        int expectedHttpContentLength;
+        bool expectedKeepAlive;
+    } testHttpHeaders[] = {
+        { "HTTP/1.1 200 OK\r\nServer: OSConfig\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: 5\r\n\r\n\"123\"", 5, true },
+        { "HTTP/1.1 200 OK\r\nServer: OSConfig\r\nContent-Type: application/json\r\nConnection: close\r\nContent-Length: 5\r\n\r\n\"123\"", 5, false },
+        { "HTTP/1.1 200 OK\r\nServer: OSConfig\r\nContent-Length: 2\r\n\r\n\"\"", 2, true },
+        { "HTTP/1.1 200 OK\r\nConnection: close\r\n", 0, false }
+    };
+
+    int fileDescriptor = -1;
+    bool keepAlive = false;
+    size_t i = 0;
+
+    for (i = 0; i < ARRAY_SIZE(testHttpHeaders); i++)
+    {
+        EXPECT_TRUE(CreateTestFile(testPath, testHttpHeaders[i].httpResponse));
+        EXPECT_NE(-1, fileDescriptor = open(testPath, O_RDONLY));
+        keepAlive = !testHttpHeaders[i].expectedKeepAlive;
+        EXPECT_EQ(200, ReadHttpStatusFromSocket(fileDescriptor, nullptr));
+        EXPECT_EQ(testHttpHeaders[i].expectedHttpContentLength, ReadHttpHeadersFromSocket(fileDescriptor, &keepAlive, nullptr));
+        EXPECT_EQ(testHttpHeaders[i].expectedKeepAlive, keepAlive);
+        EXPECT_EQ(0, close(fileDescriptor));
+        EXPECT_TRUE(Cleanup(testPath));
+    }
+
+    EXPECT_EQ(0, ReadHttpHeadersFromSocket(-1, &keepAlive, nullptr));
+    EXPECT_FALSE(keepAlive);
+}
+
+TEST_F(CommonUtilsTest, ReadHttpMessageFromSocket)
+{
+    const char* request = "POST /MpiSet/ HTTP/1.1\r\nHost: OSConfig\r\nConnection: keep-alive\r\ncontent-length: 12\r\n\r\n{\"a\": \"123\"}";
+    const char* nextRequest = "POST /MpiClose/ HTTP/1.1\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    const char* response = "HTTP/1.1 500 Internal Server Error\r\nServer: OSConfig\r\nContent-Length: 3\r\n\r\n\"1\"";
+    const char* splitResponse[] = { "HTTP/1.1 200 OK\r\nContent-Le", "ngth: 2\r\n\r", "\n\"\"" };
+
+    int sockets[2] = {-1, -1};
+    HttpMessage message = {};
+    size_t i = 0;
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    // Two requests back to back on the same connection, each read stops at the end of its body
+    EXPECT_EQ((ssize_t)strlen(request), write(sockets[0], request, strlen(request)));
+    EXPECT_EQ((ssize_t)strlen(nextRequest), write(sockets[0], nextRequest, strlen(nextRequest)));
+
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_STREQ("POST", message.method);
+    EXPECT_STREQ("MpiSet", message.uri);
+    EXPECT_EQ(12, message.contentLength);
+    EXPECT_STREQ("{\"a\": \"123\"}", message.body);
+    EXPECT_TRUE(message.keepAlive);
+    EXPECT_EQ(3, message.reads);
+    FreeHttpMessage(&message);
+
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_STREQ("MpiClose", message.uri);
+    EXPECT_EQ(0, message.contentLength);
+    EXPECT_STREQ("", message.body);
+    EXPECT_FALSE(message.keepAlive);
+    FreeHttpMessage(&message);
+
+    EXPECT_EQ((ssize_t)strlen(response), write(sockets[0], response, strlen(response)));
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_EQ(500, message.status);
+    EXPECT_EQ(nullptr, message.uri);
+    EXPECT_STREQ("\"1\"", message.body);
+    EXPECT_TRUE(message.keepAlive);
+    FreeHttpMessage(&message);
+
+    // Headers arriving in pieces, with the terminator split between two of them
+    std::thread writer([&]()
+    {
+        for (i = 0; i < ARRAY_SIZE(splitResponse); i++)
+        {
+            EXPECT_EQ((ssize_t)strlen(splitResponse[i]), write(sockets[0], splitResponse[i], strlen(splitResponse[i])));
+            SleepMilliseconds(10);
+        }
+    });
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_EQ(200, message.status);
+    EXPECT_STREQ("\"\"", message.body);
+    FreeHttpMessage(&message);
+    writer.join();
+
+    EXPECT_EQ(0, close(sockets[0]));
+    EXPECT_EQ(ECONNRESET, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_EQ(nullptr, message.header);
+    EXPECT_EQ(nullptr, message.body);
+    EXPECT_EQ(0, close(sockets[1]));
+
+    EXPECT_EQ(EINVAL, ReadHttpMessageFromSocket(-1, &message, nullptr));
+}
+
+static long GetReadSyscallCount()
+{
+    std::ifstream io("/proc/self/io");
+    std::string label;
+    long value = -1;
+
+    while (io >> label >> value)
+    {
+        if ("syscr:" == label)
+        {
+            return value;
+        }
+    }
+
+    return -1;
+}
+
+// Micro-benchmark: system calls needed to receive one MPI request of typical sizes, with the byte-at-a-time
+// SocketUtils readers (read calls counted by the kernel, which does not count recv) versus ReadHttpMessageFromSocket
+// (receive calls counted by the reader itself)
+TEST_F(CommonUtilsTest, ReadHttpMessageFromSocketSyscalls)
+{
+    const char* requestFormat = "POST /MpiSetDesired/ HTTP/1.1\r\nHost: OSConfig\r\nUser-Agent: OSConfig\r\nAccept: */*\r\nConnection: keep-alive\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s";
+    const int payloadSizes[] = { 64, 1024, 16384, 65536 };
+
+    int sockets[2] = {-1, -1};
+    HttpMessage message = {};
+    char* uri = nullptr;
+    char* body = nullptr;
+    long before = 0;
+    long byteAtATime = 0;
+    unsigned int buffered = 0;
+    size_t i = 0;
+
+    if (0 > GetReadSyscallCount())
+    {
+        GTEST_SKIP() << "/proc/self/io is not available";
+    }
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    for (i = 0; i < ARRAY_SIZE(payloadSizes); i++)
+    {
+        std::string payload(payloadSizes[i], 'x');
+        std::vector<char> request(strlen(requestFormat) + payload.size() + 16);
+        int requestSize = snprintf(request.data(), request.size(), requestFormat, payloadSizes[i], payload.c_str());
+
+        EXPECT_EQ(requestSize, write(sockets[0], request.data(), requestSize));
+        before = GetReadSyscallCount();
+        EXPECT_STREQ("MpiSetDesired", uri = ReadUriFromSocket(sockets[1], nullptr));
+        EXPECT_EQ(payloadSizes[i], ReadHttpContentLengthFromSocket(sockets[1], nullptr));
+        EXPECT_NE(nullptr, body = (char*)malloc(payloadSizes[i]));
+        EXPECT_EQ(payloadSizes[i], read(sockets[1], body, payloadSizes[i]));
+        byteAtATime = GetReadSyscallCount() - before;
+        FREE_MEMORY(uri);
+        FREE_MEMORY(body);
+
+        EXPECT_EQ(requestSize, write(sockets[0], request.data(), requestSize));
+        EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+        buffered = message.reads;
+        EXPECT_STREQ(payload.c_str(), message.body);
+        FreeHttpMessage(&message);
+
+        EXPECT_EQ(3, buffered);
+        EXPECT_LT((long)buffered, byteAtATime);
+    }
+
+    EXPECT_EQ(0, close(sockets[0]));
+    EXPECT_EQ(0, close(sockets[1]));
+}
+
+TEST_F(CommonUtilsTest, SendHttpMessageToSocket)
+{
+    const char* headers = "POST /MpiGet/ HTTP/1.1\r\nConnection: keep-alive\r\n" HTTP_ACCEPT_MEMFD_BODY_HEADER;
+    const char* smallBody = "{\"a\": \"123\"}";
+
+    int sockets[2] = {-1, -1};
+    HttpMessage message = {};
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    // A small body goes inline even when memfd is allowed
+    EXPECT_EQ(0, SendHttpMessageToSocket(sockets[0], headers, smallBody, (int)strlen(smallBody), true, nullptr));
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_STREQ("MpiGet", message.uri);
+    EXPECT_STREQ(smallBody, message.body);
+    EXPECT_TRUE(message.keepAlive);
+    EXPECT_TRUE(message.acceptsMemfdBody);
+    EXPECT_FALSE(message.memfdBody);
+    EXPECT_EQ(3, message.reads);
+    FreeHttpMessage(&message);
+
+    // A body announced as memfd without one attached is rejected
+    const char* missingMemfd = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nOSConfig-Body: memfd\r\n\r\n";
+    EXPECT_EQ((ssize_t)strlen(missingMemfd), write(sockets[0], missingMemfd, strlen(missingMemfd)));
+    EXPECT_EQ(EPROTO, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_EQ(nullptr, message.body);
+
+    EXPECT_EQ(EINVAL, SendHttpMessageToSocket(-1, headers, smallBody, (int)strlen(smallBody), false, nullptr));
+    EXPECT_EQ(EINVAL, SendHttpMessageToSocket(sockets[0], nullptr, smallBody, (int)strlen(smallBody), false, nullptr));
+    EXPECT_EQ(EINVAL, SendHttpMessageToSocket(sockets[0], headers, nullptr, 1, false, nullptr));
+
+    EXPECT_EQ(0, close(sockets[0]));
+    EXPECT_EQ(0, close(sockets[1]));
+}
+
+TEST_F(CommonUtilsTest, SendHttpMessageToSocketPassesSealedMemfd)
+{
+    const char* headers = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\n";
+    const char* unsealed = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nOSConfig-Body: memfd\r\n\r\n";
+    std::string body(HTTP_MEMFD_BODY_THRESHOLD + 1, 0);
+
+    int sockets[2] = {-1, -1};
+    HttpMessage message = {};
+    size_t i = 0;
+
+    for (i = 0; i < body.size(); i++)
+    {
+        body[i] = 'a' + (char)(i % 26);
+    }
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    // Just over the threshold the body is passed as a memfd, followed by a message without a body on the same connection
+    std::thread writer([&]()
+    {
+        EXPECT_EQ(0, SendHttpMessageToSocket(sockets[0], headers, body.c_str(), (int)body.size(), true, nullptr));
+        EXPECT_EQ(0, SendHttpMessageToSocket(sockets[0], "POST /MpiClose/ HTTP/1.1\r\n", nullptr, 0, true, nullptr));
+    });
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_TRUE(message.memfdBody);
+    EXPECT_EQ((int)body.size(), message.contentLength);
+    EXPECT_EQ(0, memcmp(body.c_str(), message.body, body.size() + 1));
+    FreeHttpMessage(&message);
+    EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_STREQ("MpiClose", message.uri);
+    EXPECT_EQ(0, message.contentLength);
+    EXPECT_FALSE(message.memfdBody);
+    FreeHttpMessage(&message);
+    writer.join();
+
+    // A memfd that is not sealed could change under the receiver and is rejected
+    int descriptor = memfd_create("body", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    ASSERT_LE(0, descriptor);
+    EXPECT_EQ(3, write(descriptor, "{}", 3));
+
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec part = {(void*)unsealed, strlen(unsealed)};
+    struct msghdr sent = {};
+    memset(&control, 0, sizeof(control));
+    sent.msg_iov = &part;
+    sent.msg_iovlen = 1;
+    sent.msg_control = control.buffer;
+    sent.msg_controllen = sizeof(control.buffer);
+    CMSG_FIRSTHDR(&sent)->cmsg_level = SOL_SOCKET;
+    CMSG_FIRSTHDR(&sent)->cmsg_type = SCM_RIGHTS;
+    CMSG_FIRSTHDR(&sent)->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(CMSG_FIRSTHDR(&sent)), &descriptor, sizeof(int));
+    EXPECT_EQ((ssize_t)strlen(unsealed), sendmsg(sockets[0], &sent, 0));
+    EXPECT_EQ(EPROTO, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+    EXPECT_EQ(nullptr, message.body);
+
+    EXPECT_EQ(0, close(descriptor));
+    EXPECT_EQ(0, close(sockets[0]));
+    EXPECT_EQ(0, close(sockets[1]));
+}
+
+// Micro-benchmark: time to pass MPI bodies at and above HTTP_MEMFD_BODY_THRESHOLD over a connection inline versus as a memfd.
+// Takes seconds and only prints its results, run it with --gtest_also_run_disabled_tests when tuning the threshold.
+TEST_F(CommonUtilsTest, DISABLED_SendHttpMessageToSocketMemfdBenchmark)
+{
+    const char* headers = "HTTP/1.1 200 OK\r\nServer: OSConfig\r\nContent-Type: application/json\r\nConnection: keep-alive\r\n";
+    const int payloadSizes[] = { HTTP_MEMFD_BODY_THRESHOLD, 2 * HTTP_MEMFD_BODY_THRESHOLD };
+    const int iterations = 10;
+
+    int sockets[2] = {-1, -1};
+    HttpMessage message = {};
+    PerfClock clock = {{0, 0}, {0, 0}};
+    long microseconds[2] = {0, 0};
+    size_t i = 0;
+    int j = 0;
+    int k = 0;
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    printf("%10s %12s %12s\n", "payload", "inline (us)", "memfd (us)");
+
+    for (i = 0; i < ARRAY_SIZE(payloadSizes); i++)
+    {
+        std::string payload(payloadSizes[i], 'x');
+
+        for (k = 0; k < 2; k++)
+        {
+            // One more message than timed, the first one warms up both sides
+            std::thread writer([&]()
+            {
+                for (j = 0; j <= iterations; j++)
+                {
+                    EXPECT_EQ(0, SendHttpMessageToSocket(sockets[0], headers, payload.c_str(), payloadSizes[i], (1 == k), nullptr));
+                }
+            });
+
+            for (int n = 0; n <= iterations; n++)
+            {
+                if (1 == n)
+                {
+                    EXPECT_EQ(0, StartPerfClock(&clock, nullptr));
+                }
+
+                EXPECT_EQ(0, ReadHttpMessageFromSocket(sockets[1], &message, nullptr));
+                EXPECT_EQ((1 == k), message.memfdBody);
+                EXPECT_EQ((size_t)payloadSizes[i], strlen(message.body));
+                FreeHttpMessage(&message);
+            }
+            EXPECT_EQ(0, StopPerfClock(&clock, nullptr));
+            writer.join();
+
+            microseconds[k] = GetPerfClockTime(&clock, nullptr) / iterations;
+        }
+
+        printf("%10d %12ld %12ld\n", payloadSizes[i], microseconds[0], microseconds[1]);
+    }
+
+    EXPECT_EQ(0, close(sockets[0]));
+    EXPECT_EQ(0, close(sockets[1]));
+}
+
 TEST_F(CommonUtilsTest, MillisecondsSleep)
 {
     long validValue = 100;
@@ -1301,6 +1807,8 @@ TEST_F(CommonUtilsTest, LoadConfiguration)
           "\"LoggingLevel\": 6,"
           "\"MaxLogSize\": 1073741825,"
           "\"MaxLogSizeDebugMultiplier\": 0,"
+          "\"MetricsIntervalSeconds\": 300,"
+          "\"TelemetryAggregationSeconds\": 100000,"
           "\"ModelVersion\": 11,"
           "\"IotHubProtocol\": 2,"
           "\"Reported\": ["
@@ -1321,6 +1829,10 @@ TEST_F(CommonUtilsTest, LoadConfiguration)
     char* value = nullptr;
 
     EXPECT_EQ(30, GetReportingIntervalFromJsonConfig(configuration, nullptr));
+    EXPECT_EQ(300, GetMetricsIntervalFromJsonConfig(configuration, nullptr));
+    EXPECT_EQ(0, GetMetricsIntervalFromJsonConfig("{}", nullptr));
+    EXPECT_EQ(86400, GetTelemetryAggregationFromJsonConfig(configuration, nullptr));
+    EXPECT_EQ(0, GetTelemetryAggregationFromJsonConfig("{}", nullptr));
     EXPECT_EQ(11, GetModelVersionFromJsonConfig(configuration, nullptr));
     EXPECT_EQ(2, GetIotHubProtocolFromJsonConfig(configuration, nullptr));
 
@@ -2475,6 +2987,85 @@ TEST_F(CommonUtilsTest, CheckInstallUninstallPackage)
     }
 }
 
+static void CollectDpkgPackage(const char* name, const char* architecture, const char* version, void* context)
+{
+    std::string entry = std::string(name) + ":" + (architecture ? architecture : "") + "=" + (version ? version : "");
+    static_cast<std::vector<std::string>*>(context)->push_back(entry);
+}
+
+TEST_F(CommonUtilsTest, EnumerateDpkgInstalledPackages)
+{
+    const char* status =
+        "Package: adduser\n"
+        "Status: install ok installed\n"
+        "Priority: important\n"
+        "Architecture: all\n"
+        "Version: 3.118\n"
+        "Description: add and remove users and groups\n"
+        " This package includes the 'adduser' and 'deluser' commands.\n"
+        "\n"
+        "Package: removed-package\n"
+        "Status: deinstall ok config-files\n"
+        "Architecture: amd64\n"
+        "Version: 1.0-1\n"
+        "\n"
+        "Package: libc6\n"
+        "Status: install ok installed\n"
+        "Multi-Arch: same\n"
+        "Architecture: amd64\n"
+        "Version: 2.31-13\n"
+        "\n"
+        "Package: half-installed\n"
+        "Status: install reinstreq half-installed\n"
+        "Version: 0.1\n"
+        "\n"
+        "Package: held\n"
+        "Status: hold ok installed\n"
+        "Version: 0.2\n"
+        "\n"
+        "Package: last\n"
+        "Version: 1:2.0\n"
+        "Status: install ok installed";
+    std::vector<std::string> packages;
+
+    EXPECT_EQ(EINVAL, EnumerateDpkgInstalledPackages(nullptr, CollectDpkgPackage, &packages, nullptr));
+    EXPECT_EQ(EINVAL, EnumerateDpkgInstalledPackages(m_path, nullptr, &packages, nullptr));
+    EXPECT_NE(0, EnumerateDpkgInstalledPackages("/~does_not_exist/status", CollectDpkgPackage, &packages, nullptr));
+
+    EXPECT_TRUE(CreateTestFile(m_path, status));
+    EXPECT_EQ(0, EnumerateDpkgInstalledPackages(m_path, CollectDpkgPackage, &packages, nullptr));
+    EXPECT_TRUE(Cleanup(m_path));
+
+    ASSERT_EQ((size_t)3, packages.size());
+    EXPECT_EQ("adduser:all=3.118", packages[0]);
+    EXPECT_EQ("libc6:amd64=2.31-13", packages[1]);
+    EXPECT_EQ("last:=1:2.0", packages[2]);
+}
+
+TEST_F(CommonUtilsTest, GetPackageDatabaseStamp)
+{
+    char* stamp = nullptr;
+    char* sameStamp = nullptr;
+    char* changedStamp = nullptr;
+
+    EXPECT_EQ(nullptr, GetPackageDatabaseStamp(nullptr, nullptr));
+    EXPECT_EQ(nullptr, GetPackageDatabaseStamp("/~does_not_exist/status", nullptr));
+
+    EXPECT_TRUE(CreateTestFile(m_path, "Package: one\n"));
+    EXPECT_NE(nullptr, stamp = GetPackageDatabaseStamp(m_path, nullptr));
+    EXPECT_NE(nullptr, sameStamp = GetPackageDatabaseStamp(m_path, nullptr));
+    EXPECT_STREQ(stamp, sameStamp);
+
+    EXPECT_TRUE(CreateTestFile(m_path, "Package: one\n\nPackage: two\n"));
+    EXPECT_NE(nullptr, changedStamp = GetPackageDatabaseStamp(m_path, nullptr));
+    EXPECT_STRNE(stamp, changedStamp);
+    EXPECT_TRUE(Cleanup(m_path));
+
+    FREE_MEMORY(stamp);
+    FREE_MEMORY(sameStamp);
+    FREE_MEMORY(changedStamp);
+}
+
 TEST_F(CommonUtilsTest, CheckPackageManagerNotThrottling)
 {
     for (int i = 0; i < 100; i++)
@@ -3523,3 +4114,341 @@ TEST_F(CommonUtilsTest, LoggingOptions)
 
     EXPECT_FALSE(IsDaemon());
 }
+
+TEST_F(CommonUtilsTest, AsyncLogging)
+{
+    const int threadCount = 8;
+    const int lineCount = 1000;
+    const char* logPath = m_path;
+    const char* backupPath = m_path2;
+    OsConfigLogHandle log = nullptr;
+    std::vector<std::thread> threads;
+    unsigned long dropped = GetDroppedLogLines();
+    char* contents = nullptr;
+    std::string line;
+    int lines = 0;
+
+    remove(logPath);
+    remove(backupPath);
+    SetLoggingLevel(LoggingLevelInformational);
+    SetMaxLogSize(1048576);
+    SetConsoleLoggingEnabled(false);
+
+    ASSERT_NE(nullptr, log = OpenLog(logPath, backupPath));
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([log, i, lineCount]()
+        {
+            for (int j = 0; j < lineCount; j++)
+            {
+                OsConfigLogInfo(log, "thread %d line %d", i, j);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Logging leaves errno as it was
+    errno = EPERM;
+    OsConfigLogError(log, "error %s", "line");
+    EXPECT_EQ(EPERM, errno);
+
+    FlushLog(log);
+
+    ASSERT_NE(nullptr, contents = LoadStringFromFile(logPath, false, nullptr));
+    std::istringstream stream(contents);
+    while (std::getline(stream, line))
+    {
+        EXPECT_EQ('[', line[0]);
+        if (std::string::npos == line.find("lines were dropped"))
+        {
+            EXPECT_TRUE((std::string::npos != line.find("][INFO][CommonUtilsUT.cpp:")) || (std::string::npos != line.find("][ERROR][CommonUtilsUT.cpp:")));
+            lines++;
+        }
+    }
+    FREE_MEMORY(contents);
+
+    // Lines are only dropped when the writer cannot keep up, they are counted then
+    EXPECT_EQ((threadCount * lineCount) + 1, lines + (int)(GetDroppedLogLines() - dropped));
+
+    CloseLog(&log);
+    EXPECT_EQ(nullptr, log);
+    remove(logPath);
+    remove(backupPath);
+}
+
+TEST_F(CommonUtilsTest, AsyncLoggingRotation)
+{
+    const char* logPath = m_path;
+    const char* backupPath = m_path2;
+    OsConfigLogHandle log = nullptr;
+    struct stat fileStat = {};
+
+    remove(logPath);
+    remove(backupPath);
+    SetLoggingLevel(LoggingLevelInformational);
+    SetMaxLogSize(4096);
+    SetConsoleLoggingEnabled(false);
+
+    ASSERT_NE(nullptr, log = OpenLog(logPath, backupPath));
+
+    for (int i = 0; i < 200; i++)
+    {
+        OsConfigLogInfo(log, "rotation line %d", i);
+        FlushLog(log);
+    }
+
+    EXPECT_EQ(0, stat(backupPath, &fileStat));
+    EXPECT_LE(4096, fileStat.st_size);
+    EXPECT_EQ(0, stat(logPath, &fileStat));
+    EXPECT_GT(4096, fileStat.st_size);
+
+    CloseLog(&log);
+    SetMaxLogSize(1048576);
+    remove(logPath);
+    remove(backupPath);
+}
+
+// Logs the same lines as text and as structured events, the decoded events read as the text lines did
+static void LogStructuredLoggingLines(OsConfigLogHandle log)
+{
+    const char* nothing = nullptr;
+    char unterminated[4] = {'a', 'b', 'c', 'd'};
+    size_t size = 42;
+    long double precise = 2.5;
+
+    OsConfigLogInfo(log, "integers %d %i %u %x %X %o %5d|%-5d| %hhd %hd %ld %lld %lu %zu %jd %td", -1, 2, 3u, 255, 255, 8, 42, 42, (char)-3, (short)-4, -5L, -6LL, 7UL, size, (intmax_t)-8, (ptrdiff_t)9);
+    OsConfigLogInfo(log, "doubles %f %.2f %e %g %10.3f %*.*f", 1.5, 3.14159, 12345.678, 0.0001, -2.25, 8, 1, 7.75);
+    OsConfigLogInfo(log, "strings '%s' '%10s' '%-6s|' '%.2s' '%.*s' '%s'", "text", "right", "left", "truncated", 3, unterminated, nothing);
+    OsConfigLogInfo(log, "others %c %p %% 100%%", 'z', (void*)0x1234);
+    OsConfigLogError(log, "formatted as logged %Lf", precise);
+    OsConfigLogInfo(log, "no arguments");
+}
+
+static std::vector<std::string> GetLoggedMessages(const char* contents)
+{
+    std::vector<std::string> messages;
+    std::istringstream stream(contents);
+    std::string line;
+
+    // Past the time, which can differ between the two logs
+    while (std::getline(stream, line))
+    {
+        messages.push_back(line.substr(line.find(']')));
+    }
+
+    return messages;
+}
+
+TEST_F(CommonUtilsTest, StructuredLogging)
+{
+    const char* logPath = m_path;
+    const char* decodedPath = m_path2;
+    std::string structuredPath = std::string(m_path) + ".bin";
+    OsConfigLogHandle log = nullptr;
+    FILE* input = nullptr;
+    FILE* output = nullptr;
+    char* textLog = nullptr;
+    char* decodedLog = nullptr;
+    char* jsonLines = nullptr;
+    JSON_Value* value = nullptr;
+    struct stat fileStat = {};
+
+    remove(logPath);
+    remove(decodedPath);
+    remove(structuredPath.c_str());
+    SetLoggingLevel(LoggingLevelInformational);
+    SetMaxLogSize(1048576);
+    SetConsoleLoggingEnabled(false);
+
+    ASSERT_NE(nullptr, log = OpenLog(logPath, nullptr));
+    LogStructuredLoggingLines(log);
+    CloseLog(&log);
+    ASSERT_NE(nullptr, textLog = LoadStringFromFile(logPath, false, nullptr));
+    remove(logPath);
+
+    SetStructuredLoggingEnabled(true);
+    ASSERT_NE(nullptr, log = OpenLog(logPath, nullptr));
+    LogStructuredLoggingLines(log);
+    CloseLog(&log);
+
+    // Reopened, the log continues with a new time anchor and the sites defined again
+    ASSERT_NE(nullptr, log = OpenLog(logPath, nullptr));
+    OsConfigLogInfo(log, "reopened %d", 1);
+    CloseLog(&log);
+    SetStructuredLoggingEnabled(false);
+
+    EXPECT_EQ(0, stat(logPath, &fileStat));
+    EXPECT_EQ(0, fileStat.st_size);
+
+    ASSERT_NE(nullptr, input = fopen(structuredPath.c_str(), "rb"));
+    ASSERT_NE(nullptr, output = fopen(decodedPath, "w"));
+    EXPECT_EQ(0, DecodeStructuredLog(input, output, false));
+    fclose(output);
+    ASSERT_NE(nullptr, decodedLog = LoadStringFromFile(decodedPath, false, nullptr));
+
+    std::vector<std::string> expected = GetLoggedMessages(textLog);
+    std::vector<std::string> decoded = GetLoggedMessages(decodedLog);
+    ASSERT_EQ(expected.size() + 1, decoded.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_STREQ(expected[i].c_str(), decoded[i].c_str());
+    }
+    EXPECT_NE(std::string::npos, decoded.back().find("reopened 1"));
+
+    // The time is that of the text log, to the second or so
+    EXPECT_EQ(0, strncmp(textLog, decodedLog, strlen("[YYYY-MM-DD HH")));
+
+    rewind(input);
+    ASSERT_NE(nullptr, output = fopen(decodedPath, "w"));
+    EXPECT_EQ(0, DecodeStructuredLog(input, output, true));
+    fclose(output);
+    ASSERT_NE(nullptr, jsonLines = LoadStringFromFile(decodedPath, false, nullptr));
+
+    std::istringstream stream(jsonLines);
+    std::string line;
+    std::getline(stream, line);
+    ASSERT_NE(nullptr, value = json_parse_string(line.c_str()));
+    EXPECT_STREQ("INFO", json_object_get_string(json_value_get_object(value), "Level"));
+    EXPECT_STREQ("CommonUtilsUT.cpp", json_object_get_string(json_value_get_object(value), "File"));
+    EXPECT_EQ(0, strncmp("integers -1 2 3 ff FF 10", json_object_get_string(json_value_get_object(value), "Message"), strlen("integers -1 2 3 ff FF 10")));
+    json_value_free(value);
+
+    // Cut short, the log decodes up to its last whole record
+    ASSERT_EQ(0, stat(structuredPath.c_str(), &fileStat));
+    ASSERT_EQ(0, truncate(structuredPath.c_str(), fileStat.st_size - 3));
+    fclose(input);
+    ASSERT_NE(nullptr, input = fopen(structuredPath.c_str(), "rb"));
+    ASSERT_NE(nullptr, output = fopen(decodedPath, "w"));
+    EXPECT_EQ(0, DecodeStructuredLog(input, output, false));
+    fclose(output);
+    fclose(input);
+
+    // Not a structured log
+    ASSERT_NE(nullptr, input = fopen(decodedPath, "rb"));
+    ASSERT_NE(nullptr, output = fopen("/dev/null", "w"));
+    EXPECT_EQ(EINVAL, DecodeStructuredLog(input, output, false));
+    fclose(output);
+    fclose(input);
+
+    FREE_MEMORY(textLog);
+    FREE_MEMORY(decodedLog);
+    FREE_MEMORY(jsonLines);
+    remove(logPath);
+    remove(decodedPath);
+    remove(structuredPath.c_str());
+}
+
+TEST_F(CommonUtilsTest, StructuredLoggingSize)
+{
+    const int lineCount = 1000;
+    const char* logPath = m_path;
+    std::string structuredPath = std::string(m_path) + ".bin";
+    OsConfigLogHandle log = nullptr;
+    struct stat fileStat = {};
+    long textSize = 0;
+    long structuredSize = 0;
+
+    remove(logPath);
+    remove(structuredPath.c_str());
+    SetLoggingLevel(LoggingLevelInformational);
+    SetMaxLogSize(UINT_MAX / 5);
+    SetConsoleLoggingEnabled(false);
+
+    for (int structured = 0; structured < 2; structured++)
+    {
+        SetStructuredLoggingEnabled(1 == structured);
+        ASSERT_NE(nullptr, log = OpenLog(logPath, nullptr));
+        for (int i = 0; i < lineCount; i++)
+        {
+            OsConfigLogInfo(log, "Evaluated procedure %d for '%s' in %ld microseconds, result: %s", i, "/etc/ssh/sshd_config", 1000L + i, (0 == (i % 3)) ? "compliant" : "not compliant");
+            if (0 == ((i + 1) % 500))
+            {
+                FlushLog(log);
+            }
+        }
+        CloseLog(&log);
+
+        ASSERT_EQ(0, stat(structured ? structuredPath.c_str() : logPath, &fileStat));
+        if (structured)
+        {
+            structuredSize = (long)fileStat.st_size;
+        }
+        else
+        {
+            textSize = (long)fileStat.st_size;
+        }
+        remove(logPath);
+        remove(structuredPath.c_str());
+    }
+    SetStructuredLoggingEnabled(false);
+
+    EXPECT_LT(structuredSize, textSize);
+
+    SetMaxLogSize(1048576);
+}
+
+TEST_F(CommonUtilsTest, AsyncLoggingInOrder)
+{
+    // Flushed well before the ring of 1024 lines fills, none are dropped
+    const int lineCount = 10000;
+    const int flushEvery = 500;
+    const int closedLineCount = 500;
+    const char* logPath = m_path;
+    OsConfigLogHandle log = nullptr;
+    char* contents = nullptr;
+    std::string line;
+    int next = 0;
+
+    remove(logPath);
+    SetLoggingLevel(LoggingLevelInformational);
+    SetMaxLogSize(UINT_MAX / 5);
+    SetConsoleLoggingEnabled(false);
+
+    ASSERT_NE(nullptr, log = OpenLog(logPath, nullptr));
+    for (int i = 0; i < lineCount; i++)
+    {
+        OsConfigLogInfo(log, "ordered line %d", i);
+        if (0 == ((i + 1) % flushEvery))
+        {
+            FlushLog(log);
+        }
+    }
+    FlushLog(log);
+
+    ASSERT_NE(nullptr, contents = LoadStringFromFile(logPath, false, nullptr));
+    std::istringstream stream(contents);
+    while (std::getline(stream, line))
+    {
+        EXPECT_NE(std::string::npos, line.find("][INFO][CommonUtilsUT.cpp:"));
+        EXPECT_EQ(std::to_string(next), line.substr(line.find("ordered line ") + strlen("ordered line ")));
+        next++;
+    }
+    FREE_MEMORY(contents);
+    EXPECT_EQ(lineCount, next);
+
+    // Closed with lines still queued, they are written before the log goes
+    for (int i = 0; i < closedLineCount; i++)
+    {
+        OsConfigLogInfo(log, "ordered line %d", lineCount + i);
+    }
+    CloseLog(&log);
+
+    ASSERT_NE(nullptr, contents = LoadStringFromFile(logPath, false, nullptr));
+    std::istringstream closedStream(contents);
+    next = 0;
+    while (std::getline(closedStream, line))
+    {
+        EXPECT_EQ(std::to_string(next), line.substr(line.find("ordered line ") + strlen("ordered line ")));
+        next++;
+    }
+    FREE_MEMORY(contents);
+    EXPECT_EQ(lineCount + closedLineCount, next);
+
+    SetMaxLogSize(1048576);
+    remove(logPath);
+}
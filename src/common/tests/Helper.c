@@ -17,3 +17,8 @@ void SwapGlobalSshServerConfigs(const char** config, const char** backup, const
     g_osconfigRemediationConf = *remediation;
     *remediation = temp;
 }
+
+char* FindSshServerOptionTest(const char* snapshot, const char* name)
+{
+    return FindSshServerOption(snapshot, name);
+}
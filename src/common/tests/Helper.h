@@ -7,6 +7,7 @@ extern "C"
 #endif // __cplusplus
 int BackupSshdConfigTest(char const* c);
 void SwapGlobalSshServerConfigs(const char** config, const char** backup, const char** remediation);
+char* FindSshServerOptionTest(const char* snapshot, const char* name);
 #ifdef __cplusplus
 }
 #endif // __cplusplus
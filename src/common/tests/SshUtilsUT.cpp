@@ -5,6 +5,8 @@
 #include <fstream>
 #include <system_error>
 #include <gtest/gtest.h>
+#include <CommonUtils.h>
+#include <SshUtils.h>
 #include "Helper.h"
 
 class SshTest : public testing::Test
@@ -63,6 +65,12 @@ static std::string getFileContents(const std::string& filename)
     return ss.str();
 }
 
+static void writeFileContents(const std::string& filename, const std::string& contents)
+{
+    std::ofstream file(filename);
+    file << contents;
+}
+
 TEST_F(SshTest, BackupSshdSuccess)
 {
     std::string success = "success\n";
@@ -80,3 +88,74 @@ TEST_F(SshTest, BackupSshdFail)
 
     EXPECT_NE(0, result);
 }
+
+TEST_F(SshTest, SshdConfigurationStampTracksIncludes)
+{
+    std::string includeDir = sshdir + "/sshd_config.d";
+    std::string firstInclude = includeDir + "/10-first.conf";
+    std::string secondInclude = includeDir + "/20-second.conf";
+    char* stamp = NULL;
+    char* unchangedStamp = NULL;
+    char* modifiedStamp = NULL;
+    char* addedStamp = NULL;
+
+    ASSERT_EQ(0, ::mkdir(includeDir.c_str(), 0755));
+    writeFileContents(sshd_config, "Port 22\n  include sshd_config.d/*.conf\n");
+    writeFileContents(firstInclude, "PermitRootLogin no\n");
+
+    EXPECT_NE(nullptr, stamp = GetSshdConfigurationStamp(sshd_config.c_str(), NULL));
+    EXPECT_NE(nullptr, unchangedStamp = GetSshdConfigurationStamp(sshd_config.c_str(), NULL));
+    EXPECT_STREQ(stamp, unchangedStamp);
+    EXPECT_NE(nullptr, strstr(stamp, firstInclude.c_str()));
+
+    writeFileContents(firstInclude, "PermitRootLogin yes\n");
+    EXPECT_NE(nullptr, modifiedStamp = GetSshdConfigurationStamp(sshd_config.c_str(), NULL));
+    EXPECT_STRNE(unchangedStamp, modifiedStamp);
+
+    writeFileContents(secondInclude, "Port 2222\n");
+    EXPECT_NE(nullptr, addedStamp = GetSshdConfigurationStamp(sshd_config.c_str(), NULL));
+    EXPECT_STRNE(modifiedStamp, addedStamp);
+    EXPECT_NE(nullptr, strstr(addedStamp, secondInclude.c_str()));
+
+    FREE_MEMORY(stamp);
+    FREE_MEMORY(unchangedStamp);
+    FREE_MEMORY(modifiedStamp);
+    FREE_MEMORY(addedStamp);
+    ::remove(firstInclude.c_str());
+    ::remove(secondInclude.c_str());
+    ::rmdir(includeDir.c_str());
+}
+
+TEST_F(SshTest, SshdConfigurationStampMissingFile)
+{
+    char* stamp = NULL;
+
+    EXPECT_NE(nullptr, stamp = GetSshdConfigurationStamp(sshd_config.c_str(), NULL));
+    EXPECT_NE(nullptr, strstr(stamp, ":-;"));
+    FREE_MEMORY(stamp);
+
+    EXPECT_EQ(nullptr, GetSshdConfigurationStamp(NULL, NULL));
+}
+
+TEST_F(SshTest, FindSshServerOption)
+{
+    const char* snapshot =
+        "port 22\n"
+        "portfoo 23\n"
+        "permitrootlogin without-password  \n"
+        "macs hmac-sha2-256,hmac-sha2-512\n"
+        "banner /etc/azsec/banner.txt\n"
+        "port 2222\n";
+    char* value = NULL;
+
+    EXPECT_STREQ("22", value = FindSshServerOptionTest(snapshot, "Port"));
+    FREE_MEMORY(value);
+    EXPECT_STREQ("without-password", value = FindSshServerOptionTest(snapshot, "PermitRootLogin"));
+    FREE_MEMORY(value);
+    EXPECT_STREQ("hmac-sha2-256,hmac-sha2-512", value = FindSshServerOptionTest(snapshot, "MACs"));
+    FREE_MEMORY(value);
+    EXPECT_STREQ("/etc/azsec/banner.txt", value = FindSshServerOptionTest(snapshot, "Banner"));
+    FREE_MEMORY(value);
+    EXPECT_EQ(nullptr, FindSshServerOptionTest(snapshot, "Ciphers"));
+    EXPECT_EQ(nullptr, FindSshServerOptionTest(snapshot, "por"));
+}
@@ -8,6 +8,8 @@
 #include <cstdio>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include <sys/stat.h>
 
 #ifdef BUILD_TELEMETRY
@@ -54,6 +56,7 @@ TEST_F(TelemetryTest, AppendJsonWritesSingleLine)
 
     TelemetryInitialize(NULL);
     TelemetryAppendPayloadToFile(sampleJson);
+    TelemetryFlush();
 
     std::ifstream input(TELEMETRY_TMP_FILE_NAME);
     ASSERT_TRUE(input.is_open());
@@ -72,4 +75,156 @@ TEST_F(TelemetryTest, CleanupResetsTelemetryState)
     EXPECT_EQ(0, stat(TELEMETRY_TMP_FILE_NAME, &fileInfo));
     EXPECT_EQ(0, remove(TELEMETRY_TMP_FILE_NAME));
 }
+TEST_F(TelemetryTest, CleanupWritesPendingEvents)
+{
+    const char* sampleJson = "{\"EventName\":\"UnitTest\"}";
+
+    TelemetryInitialize(NULL);
+    TelemetryAppendPayloadToFile(sampleJson);
+    TelemetryCleanup(NULL);
+
+    std::ifstream input(TELEMETRY_TMP_FILE_NAME);
+    ASSERT_TRUE(input.is_open());
+
+    std::string line;
+    ASSERT_TRUE(static_cast<bool>(std::getline(input, line)));
+    EXPECT_EQ(std::string(sampleJson), line);
+}
+
+TEST_F(TelemetryTest, ContextIsPerThread)
+{
+    int64_t elapsed = 0;
+
+    OSConfigTelemetrySetContext("ruleOnMainThread", "scenario");
+    OSConfigTimeStampSave();
+
+    std::thread other([]()
+    {
+        int64_t otherElapsed = -1;
+
+        EXPECT_STREQ("", GetTelemetryContext()->ruleCodename);
+        OSConfigGetElapsedTime(&otherElapsed);
+        EXPECT_EQ(0, otherElapsed);
+
+        OSConfigTelemetrySetContext("ruleOnOtherThread", nullptr);
+        EXPECT_STREQ("ruleOnOtherThread", GetTelemetryContext()->ruleCodename);
+        EXPECT_STREQ("", GetTelemetryContext()->scenarioName);
+    });
+    other.join();
+
+    EXPECT_STREQ("ruleOnMainThread", GetTelemetryContext()->ruleCodename);
+    EXPECT_STREQ("scenario", GetTelemetryContext()->scenarioName);
+    OSConfigGetElapsedTime(&elapsed);
+    EXPECT_LE(0, elapsed);
+
+    OSConfigTelemetrySetContext(nullptr, nullptr);
+    GetTelemetryContext()->startMicroseconds = 0;
+}
+
+TEST_F(TelemetryTest, EventsFromThreadsAreAllWritten)
+{
+    const int threadCount = 4;
+    const int eventCount = 5000;
+    std::vector<std::thread> threads;
+    unsigned long dropped = GetDroppedTelemetryEvents();
+    int lines = 0;
+
+    TelemetryInitialize(NULL);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([i, eventCount]()
+        {
+            std::string rule = "rule" + std::to_string(i);
+            OSConfigTelemetrySetContext(rule.c_str(), "scenario");
+            for (int j = 0; j < eventCount; j++)
+            {
+                OSConfigTelemetryStatusTrace("UnitTest", j % 2);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    TelemetryFlush();
+
+    std::ifstream input(TELEMETRY_TMP_FILE_NAME);
+    ASSERT_TRUE(input.is_open());
+
+    std::string line;
+    while (std::getline(input, line))
+    {
+        EXPECT_EQ('{', line.front());
+        EXPECT_EQ('}', line.back());
+        EXPECT_NE(std::string::npos, line.find("\"RuleCodename\":\"rule"));
+        lines++;
+    }
+
+    // Events are only dropped when more are pending than the writer is allowed to hold
+    EXPECT_EQ(threadCount * eventCount, lines + (int)(GetDroppedTelemetryEvents() - dropped));
+}
+
+TEST_F(TelemetryTest, RuleCompleteIsForwardedWithoutAggregation)
+{
+    std::string line;
+    int lines = 0;
+
+    TelemetryInitialize(NULL);
+    for (int i = 0; i < 3; i++)
+    {
+        OSConfigTelemetryRuleComplete("UnitTest", "rule", 0, 100);
+    }
+    TelemetryCleanup(NULL);
+
+    std::ifstream input(TELEMETRY_TMP_FILE_NAME);
+    ASSERT_TRUE(input.is_open());
+    while (std::getline(input, line))
+    {
+        EXPECT_NE(std::string::npos, line.find("\"EventName\":\"RuleComplete\""));
+        EXPECT_NE(std::string::npos, line.find("\"Microseconds\":\"100\""));
+        lines++;
+    }
+    EXPECT_EQ(3, lines);
+}
+
+TEST_F(TelemetryTest, RuleCompleteIsAggregated)
+{
+    std::vector<std::string> lines;
+    std::string line;
+
+    SetTelemetryAggregationSeconds(3600);
+    TelemetryInitialize(NULL);
+
+    // The first success is forwarded, the next ones counted, failures always forwarded
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 0, 1);
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 0, 3);
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 0, 1000);
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 0, 1000);
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 22, 5);
+    OSConfigTelemetryRuleComplete("UnitTest", "rule", 22, 5);
+    OSConfigTelemetryRuleComplete("UnitTest", "other", 0, 7);
+
+    TelemetryCleanup(NULL);
+    SetTelemetryAggregationSeconds(0);
+
+    std::ifstream input(TELEMETRY_TMP_FILE_NAME);
+    ASSERT_TRUE(input.is_open());
+    while (std::getline(input, line))
+    {
+        lines.push_back(line);
+    }
+
+    ASSERT_EQ(5, (int)lines.size());
+    EXPECT_NE(std::string::npos, lines[0].find("\"ObjectName\":\"rule\",\"ObjectResult\":\"0\",\"Microseconds\":\"1\""));
+    EXPECT_NE(std::string::npos, lines[1].find("\"ObjectResult\":\"22\""));
+    EXPECT_NE(std::string::npos, lines[2].find("\"ObjectResult\":\"22\""));
+    EXPECT_NE(std::string::npos, lines[3].find("\"ObjectName\":\"other\""));
+    EXPECT_NE(std::string::npos, lines[4].find("\"EventName\":\"RuleSummary\""));
+    EXPECT_NE(std::string::npos, lines[4].find("\"ObjectName\":\"rule\""));
+    EXPECT_NE(std::string::npos, lines[4].find("\"Count\":\"3\",\"TotalMicroseconds\":\"2003\",\"MinMicroseconds\":\"3\",\"MaxMicroseconds\":\"1000\""));
+    EXPECT_NE(std::string::npos, lines[4].find("\"Histogram\":\"2:1,10:2\""));
+}
 #endif
@@ -59,6 +59,8 @@ void ComplianceEngineInitialize(OsConfigLogHandle log)
             SetLoggingLevel(GetLoggingLevelFromJsonConfig(jsonConfiguration.c_str(), log));
             SetMaxLogSize(GetMaxLogSizeFromJsonConfig(jsonConfiguration.c_str(), log));
             SetMaxLogSizeDebugMultiplier(GetMaxLogSizeDebugMultiplierFromJsonConfig(jsonConfiguration.c_str(), log));
+            SetStructuredLoggingEnabled(IsStructuredLoggingEnabledInJsonConfig(jsonConfiguration.c_str()));
+            SetTelemetryAggregationSeconds(static_cast<unsigned int>(GetTelemetryAggregationFromJsonConfig(jsonConfiguration.c_str(), log)));
             OsConfigLogInfo(g_log, "Configuration file loaded successfully: %s", g_configurationFile);
         }
     }
@@ -241,7 +243,7 @@ int ComplianceEngineMmiSet(MMI_HANDLE clientSession, const char* componentName,
     try
     {
         std::string payloadStr(payload, payloadSizeBytes);
-        auto json = JsonWrapper::FromString(payloadStr.c_str());
+        auto json = JsonWrapper::FromStringInArena(payloadStr);
         if (!json.HasValue())
         {
             OsConfigLogError(engine.Log(), "ComplianceEngineMmiSet failed: Failed to parse JSON string");
@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <ConfigDirectories.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <dirent.h>
+#include <memory>
+#include <unistd.h>
+
+namespace ComplianceEngine
+{
+namespace
+{
+const char cConfExtension[] = ".conf";
+
+bool HasConfExtension(const std::string& name)
+{
+    const size_t extensionLength = sizeof(cConfExtension) - 1;
+    return name.size() > extensionLength && 0 == name.compare(name.size() - extensionLength, extensionLength, cConfExtension);
+}
+} // anonymous namespace
+
+void AppendFileStamp(std::string& stamp, const std::string& path, const struct stat& st)
+{
+    stamp += path + ':' + std::to_string(st.st_ino) + ':' + std::to_string(st.st_size) + ':' + std::to_string(st.st_mtim.tv_sec) + '.' +
+             std::to_string(st.st_mtim.tv_nsec) + ';';
+}
+
+std::map<std::string, ConfigFile> ListConfigFiles(const std::vector<std::string>& directories, ContextInterface& context, std::string& stamp)
+{
+    std::map<std::string, ConfigFile> files;
+    for (const auto& directory : directories)
+    {
+        const std::string directoryPath = context.GetSpecialFilePath(directory);
+        struct stat st;
+        if (0 != stat(directoryPath.c_str(), &st) || !S_ISDIR(st.st_mode))
+        {
+            stamp += directoryPath + ":-;";
+            continue;
+        }
+        AppendFileStamp(stamp, directoryPath, st);
+
+        DIR* dir = opendir(directoryPath.c_str());
+        if (nullptr == dir)
+        {
+            OsConfigLogWarning(context.GetLogHandle(), "Failed to open directory '%s': %s", directoryPath.c_str(), strerror(errno));
+            continue;
+        }
+        auto dirDeleter = std::unique_ptr<DIR, int (*)(DIR*)>(dir, closedir);
+
+        for (struct dirent* entry = readdir(dir); nullptr != entry; entry = readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            if (!HasConfExtension(name) || files.find(name) != files.end())
+            {
+                continue;
+            }
+
+            ConfigFile file;
+            file.source = directory + "/" + name;
+            file.path = directoryPath + "/" + name;
+
+            char target[PATH_MAX];
+            ssize_t length = readlink(file.path.c_str(), target, sizeof(target) - 1);
+            if (length > 0)
+            {
+                target[length] = '\0';
+                file.masked = (0 == strcmp(target, "/dev/null"));
+            }
+
+            if (!file.masked)
+            {
+                if (0 != stat(file.path.c_str(), &st) || !S_ISREG(st.st_mode))
+                {
+                    continue;
+                }
+                AppendFileStamp(stamp, file.path, st);
+            }
+
+            files.emplace(name, std::move(file));
+        }
+    }
+
+    return files;
+}
+} // namespace ComplianceEngine
@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef COMPLIANCEENGINE_CONFIG_DIRECTORIES_H
+#define COMPLIANCEENGINE_CONFIG_DIRECTORIES_H
+
+#include <ContextInterface.h>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace ComplianceEngine
+{
+struct ConfigFile
+{
+    // Path as reported to the user, e.g. /etc/sysctl.d/99-foo.conf
+    std::string source;
+
+    // Path to read from, differs from source only when redirected by GetSpecialFilePath
+    std::string path;
+
+    // File is masked by a symlink to /dev/null
+    bool masked = false;
+};
+
+// Lists the *.conf files of systemd-style configuration directories given in order of precedence,
+// highest first. A file overrides files with the same basename in lower priority directories, and
+// the result is keyed and therefore ordered by basename, which is the order files are applied in.
+// The state of every directory and file looked at is appended to stamp, so that callers can cheaply
+// detect whether anything changed since the configuration was last parsed.
+std::map<std::string, ConfigFile> ListConfigFiles(const std::vector<std::string>& directories, ContextInterface& context, std::string& stamp);
+
+// Appends the identity, size and modification time of a file to a change detection stamp
+void AppendFileStamp(std::string& stamp, const std::string& path, const struct stat& st);
+} // namespace ComplianceEngine
+
+#endif // COMPLIANCEENGINE_CONFIG_DIRECTORIES_H
@@ -32,7 +32,8 @@ static constexpr const char* cModuleInfo =
     "\"VersionInfo\": \"\","
     "\"Components\": [\"ComplianceEngine\"],"
     "\"Lifetime\": 2,"
-    "\"UserAccount\": 0}";
+    "\"UserAccount\": 0,"
+    "\"RawPayloads\": true}";
 
 Engine::Engine(std::unique_ptr<ContextInterface> context, std::unique_ptr<PayloadFormatter> payloadFormatter) noexcept
     : mContext{std::move(context)},
@@ -153,11 +154,12 @@ Optional<Error> Engine::SetProcedure(const std::string& ruleName, const std::str
     }
 
     mDatabase.erase(ruleName);
-    auto ruleJSON = JsonWrapper::FromBase64(payload);
+    // The rule is only read, the parts kept by the procedure are copied out of the arena
+    auto ruleJSON = JsonWrapper::FromBase64InArena(payload);
     if (!ruleJSON.HasValue())
     {
         // Fall back to plain JSON, both formats are supported
-        ruleJSON = JsonWrapper::FromString(payload);
+        ruleJSON = JsonWrapper::FromStringInArena(payload);
         if (!ruleJSON.HasValue())
         {
             OsConfigLogError(Log(), "Failed to parse JSON: %s", ruleJSON.Error().message.c_str());
@@ -602,8 +602,8 @@ Result<std::string> JsonFormatter::Format(const IndicatorsTree& indicators) cons
         return error.Value();
     }
 
-    // Convert the JSON value to a string
-    char* jsonString = json_serialize_to_string_pretty(json);
+    // Compact, the string is returned by MmiGet and sent as is
+    char* jsonString = json_serialize_to_string(json);
     json_value_free(json);
     auto result = std::string(jsonString);
     json_free_serialized_string(jsonString);
@@ -4,10 +4,19 @@
 #include "JsonWrapper.h"
 
 #include <Base64.h>
+#include <CommonUtils.h>
 #include <parson.h>
 
 namespace ComplianceEngine
 {
+namespace
+{
+// Values in an arena are released with the arena
+void KeepArenaValue(json_value_t*)
+{
+}
+} // anonymous namespace
+
 Result<JsonWrapper> JsonWrapper::FromString(const char* input)
 {
     auto result = JsonWrapperPointerType(json_parse_string(input), &json_value_free);
@@ -35,6 +44,40 @@ Result<JsonWrapper> JsonWrapper::FromBase64(const std::string& input)
     return FromString(decodedString.Value());
 }
 
+Result<JsonWrapper> JsonWrapper::FromStringInArena(const std::string& input)
+{
+    auto arena = JsonArenaPointerType(CreateJsonArena(), &FreeJsonArena);
+    if (nullptr == arena)
+    {
+        // Without an arena the value is parsed on the heap
+        return FromString(input);
+    }
+
+    auto* previousArena = UseJsonArena(arena.get());
+    auto* value = json_parse_string(input.c_str());
+    UseJsonArena(previousArena);
+
+    if (nullptr == value)
+    {
+        return Error("Failed to parse JSON", EINVAL);
+    }
+
+    auto result = JsonWrapper(JsonWrapperPointerType(value, &KeepArenaValue));
+    result.mArena = std::move(arena);
+    return result;
+}
+
+Result<JsonWrapper> JsonWrapper::FromBase64InArena(const std::string& input)
+{
+    const auto decodedString = Base64Decode(input);
+    if (!decodedString.HasValue())
+    {
+        return decodedString.Error();
+    }
+
+    return FromStringInArena(decodedString.Value());
+}
+
 Result<JsonWrapper> JsonWrapper::FromJsonString(const std::string& input)
 {
     auto result = JsonWrapperPointerType(json_value_init_string(input.c_str()), &json_value_free);
@@ -70,12 +113,14 @@ Result<JsonWrapper> JsonWrapper::MakeObject()
 }
 
 JsonWrapper::JsonWrapper()
-    : JsonWrapperPointerType(nullptr, &json_value_free)
+    : JsonWrapperPointerType(nullptr, &json_value_free),
+      mArena(nullptr, &FreeJsonArena)
 {
 }
 
 JsonWrapper::JsonWrapper(JsonWrapperPointerType&& value)
-    : JsonWrapperPointerType(std::move(value))
+    : JsonWrapperPointerType(std::move(value)),
+      mArena(nullptr, &FreeJsonArena)
 {
 }
 } // namespace ComplianceEngine
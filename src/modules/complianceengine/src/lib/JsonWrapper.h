@@ -8,9 +8,12 @@
 #include <memory>
 #include <parson.h>
 
+struct JsonArena;
+
 namespace ComplianceEngine
 {
 using JsonWrapperPointerType = std::unique_ptr<json_value_t, void (*)(json_value_t*)>;
+using JsonArenaPointerType = std::unique_ptr<JsonArena, void (*)(JsonArena*)>;
 struct JsonWrapper : public JsonWrapperPointerType
 {
     // Parse a string-encoded JSON
@@ -22,6 +25,14 @@ struct JsonWrapper : public JsonWrapperPointerType
     // Parse a base64-encoded JSON
     static Result<JsonWrapper> FromBase64(const std::string& input);
 
+    // Parse a string-encoded JSON into an arena that is released at once with the wrapper.
+    // The stored JSON value is read-only: it must not be modified nor released from the wrapper,
+    // copies made from it (json_value_deep_copy, json_serialize_to_string) are regular values.
+    static Result<JsonWrapper> FromStringInArena(const std::string& input);
+
+    // Parse a base64-encoded JSON into an arena, as FromStringInArena
+    static Result<JsonWrapper> FromBase64InArena(const std::string& input);
+
     // Parse a JSON string as input (a JSON-encoded string)
     // The function guarantees that after successful parsing
     // the stored JSON value is a JSON string.
@@ -44,6 +55,9 @@ private:
 
     // Construct the wrapper from an existing json_value_t pointer
     explicit JsonWrapper(JsonWrapperPointerType&& value);
+
+    // The arena holding the value, if any
+    JsonArenaPointerType mArena;
 };
 } // namespace ComplianceEngine
 
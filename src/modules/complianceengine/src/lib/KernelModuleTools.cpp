@@ -1,33 +1,95 @@
 #include <CommonUtils.h>
+#include <ConfigDirectories.h>
 #include <Evaluator.h>
 #include <KernelModuleTools.h>
-#include <Regex.h>
+#include <StringTools.h>
 #include <Telemetry.h>
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <dirent.h>
+#include <fstream>
 #include <fts.h>
-#include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <sys/stat.h>
 
 namespace ComplianceEngine
 {
-// TODO(wpk) std::regex::multiline is only supported in C++17.
-static bool MultilineRegexSearch(const std::string& str, const regex& pattern)
+namespace
 {
-    std::istringstream oss(str);
-    std::string line;
-    while (std::getline(oss, line))
+// Directories in order of precedence, highest first
+const std::vector<std::string> cModprobeDirectories = {
+    "/etc/modprobe.d", "/run/modprobe.d", "/usr/local/lib/modprobe.d", "/usr/lib/modprobe.d", "/lib/modprobe.d"};
+const char* const cModprobeLocations[] = {"/usr/sbin/modprobe", "/sbin/modprobe", "/usr/bin/modprobe", "/bin/modprobe"};
+const char cKernelCommandLineBlacklist[] = "modprobe.blacklist=";
+
+std::mutex gModuleIndexMutex;
+std::string gModuleIndexStamp;
+std::shared_ptr<const KernelModuleIndex> gModuleIndex;
+
+std::mutex gModprobeConfigMutex;
+std::string gModprobeConfigStamp;
+std::shared_ptr<const ModprobeConfig> gModprobeConfig;
+
+// Linux kernel uses underscores in module names, but module names may be given with dashes
+// (e.g., "firewire-core" module is stored as "firewire_core.ko")
+std::string NormalizeModuleName(std::string moduleName)
+{
+    std::replace(moduleName.begin(), moduleName.end(), '-', '_');
+    return moduleName;
+}
+
+// Extracts the module name from a path like kernel/fs/cramfs/cramfs.ko or cramfs.ko.zst
+bool ModuleNameFromPath(const std::string& path, std::string& moduleName)
+{
+    auto slash = path.rfind('/');
+    auto baseName = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    auto extension = baseName.find(".ko");
+    if (extension == std::string::npos || extension == 0)
+    {
+        return false;
+    }
+    if (extension + 3 != baseName.size() && baseName[extension + 3] != '.')
+    {
+        return false;
+    }
+
+    moduleName = NormalizeModuleName(baseName.substr(0, extension));
+    return true;
+}
+
+bool IsModprobeAvailable(ContextInterface& context)
+{
+    for (const char* location : cModprobeLocations)
     {
-        if (regex_search(line, pattern))
+        struct stat st;
+        if (0 == stat(context.GetSpecialFilePath(location).c_str(), &st))
         {
             return true;
         }
     }
     return false;
 }
-// Searches /lib/modules for moduleName, including overlay.ko modules and returns true if found
-Result<bool> SearchFilesystemForModuleName(std::string& moduleName, ContextInterface& context)
+
+bool IsDisablingInstallCommand(const std::string& command)
+{
+    static const char* const disablingCommands[] = {"/bin/true", "/bin/false", "/usr/bin/true", "/usr/bin/false"};
+    for (const char* disabling : disablingCommands)
+    {
+        // The whole command word, so that a wrapper such as /bin/true_wrapper does not count
+        const size_t length = strlen(disabling);
+        if ((0 == command.compare(0, length, disabling)) && ((command.size() == length) || isspace(static_cast<unsigned char>(command[length]))))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+} // anonymous namespace
+
+Result<std::shared_ptr<const KernelModuleIndex>> KernelModuleIndex::Get(ContextInterface& context)
 {
     std::string modulesDirPath = context.GetSpecialFilePath("/lib/modules");
     DIR* modulesDir = opendir(modulesDirPath.c_str());
@@ -37,24 +99,70 @@ Result<bool> SearchFilesystemForModuleName(std::string& moduleName, ContextInter
     }
     auto modulesDirDeleter = std::unique_ptr<DIR, int (*)(DIR*)>(modulesDir, closedir);
 
-    std::vector<std::string> kernelModuleFileBasenames; // Collected file basenames (no directory prefix)
-    bool moduleFound = false;
+    // Prefer modules.dep of each installed kernel, it lists every module modprobe is able to load
+    std::vector<std::string> depFiles;
+    std::vector<std::string> kernelDirs;
+    std::string stamp;
+    struct stat st;
+    if (0 == stat(modulesDirPath.c_str(), &st))
+    {
+        AppendFileStamp(stamp, modulesDirPath, st);
+    }
 
     struct dirent* entry = nullptr;
-    while ((entry = readdir(modulesDir)) != nullptr && !moduleFound)
+    while ((entry = readdir(modulesDir)) != nullptr)
     {
-        if (entry->d_type != DT_DIR)
+        if (entry->d_type != DT_DIR || 0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, ".."))
         {
             continue;
         }
 
+        std::string depFile = modulesDirPath + "/" + entry->d_name + "/modules.dep";
+        if (stat(depFile.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            AppendFileStamp(stamp, depFile, st);
+            depFiles.push_back(std::move(depFile));
+            continue;
+        }
+
         std::string modulesVersionDir = modulesDirPath + "/" + entry->d_name + "/kernel";
-        struct stat st;
-        if (stat(modulesVersionDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        if (stat(modulesVersionDir.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            AppendFileStamp(stamp, modulesVersionDir, st);
+            kernelDirs.push_back(std::move(modulesVersionDir));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(gModuleIndexMutex);
+    if (gModuleIndex && gModuleIndexStamp == stamp)
+    {
+        return gModuleIndex;
+    }
+
+    auto index = std::make_shared<KernelModuleIndex>();
+    std::string moduleName;
+    for (const auto& depFile : depFiles)
+    {
+        std::ifstream file(depFile);
+        if (!file)
         {
+            OsConfigLogError(context.GetLogHandle(), "Failed to open %s", depFile.c_str());
             continue;
         }
 
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (ModuleNameFromPath(line.substr(0, line.find(':')), moduleName))
+            {
+                index->mModules.insert(moduleName);
+            }
+        }
+    }
+
+    // Kernels without modules.dep need a single walk of their module tree
+    for (const auto& modulesVersionDir : kernelDirs)
+    {
         char* paths[] = {const_cast<char*>(modulesVersionDir.c_str()), nullptr};
         // Use FTS_PHYSICAL to avoid following symlinks; omit FTS_NOCHDIR for portability.
         FTS* fts = fts_open(paths, FTS_PHYSICAL, nullptr);
@@ -67,114 +175,199 @@ Result<bool> SearchFilesystemForModuleName(std::string& moduleName, ContextInter
         auto ftspDeleter = std::unique_ptr<FTS, int (*)(FTS*)>(fts, fts_close);
 
         FTSENT* node = nullptr;
-        while (!moduleFound && (node = fts_read(fts)) != nullptr)
+        while ((node = fts_read(fts)) != nullptr)
         {
-            if (node->fts_info == FTS_F)
+            if (node->fts_info == FTS_F && ModuleNameFromPath(node->fts_name, moduleName))
             {
-                std::string baseName = node->fts_name;
-
-                std::string target = moduleName + ".ko";
-                std::string overlayTarget = moduleName + "_overlay.ko";
-
-                // Linux kernel uses underscores in .ko filenames, but module names may use dashes
-                // (e.g., "firewire-core" module is stored as "firewire_core.ko")
-                std::string targetUnderscore = target;
-                std::replace(targetUnderscore.begin(), targetUnderscore.end(), '-', '_');
-                std::string overlayTargetUnderscore = overlayTarget;
-                std::replace(overlayTargetUnderscore.begin(), overlayTargetUnderscore.end(), '-', '_');
-
-                if (baseName.find(target) == 0 || baseName.find(targetUnderscore) == 0)
-                {
-                    moduleFound = true;
-                    break;
-                }
-                if (baseName.find(overlayTarget) == 0 || baseName.find(overlayTargetUnderscore) == 0)
-                {
-                    moduleFound = true;
-                    moduleName += "_overlay"; // preserve original behavior of tracking overlay variant
-                    break;
-                }
+                index->mModules.insert(moduleName);
             }
         }
     }
-    return moduleFound;
+
+    OsConfigLogDebug(context.GetLogHandle(), "Indexed %d kernel modules from %d modules.dep files and %d module trees",
+        static_cast<int>(index->mModules.size()), static_cast<int>(depFiles.size()), static_cast<int>(kernelDirs.size()));
+    gModuleIndexStamp = std::move(stamp);
+    gModuleIndex = index;
+    return gModuleIndex;
+}
+
+bool KernelModuleIndex::Contains(const std::string& moduleName) const
+{
+    return mModules.find(NormalizeModuleName(moduleName)) != mModules.end();
 }
 
-static std::string UnderscoreForRegex(std::string input)
+Result<std::shared_ptr<const ModprobeConfig>> ModprobeConfig::Get(ContextInterface& context)
 {
-    std::string result = input;
-    size_t pos = 0;
-    while ((pos = result.find('-', pos)) != std::string::npos)
+    std::string stamp = context.GetSpecialFilePath("/proc/cmdline") + ";";
+    const auto files = ListConfigFiles(cModprobeDirectories, context, stamp);
+
+    std::lock_guard<std::mutex> lock(gModprobeConfigMutex);
+    if (gModprobeConfig && gModprobeConfigStamp == stamp)
     {
-        result.replace(pos, 1, "[-_]");
-        pos += 4;
+        return gModprobeConfig;
     }
-    return result;
+
+    auto config = std::make_shared<ModprobeConfig>();
+    for (const auto& file : files)
+    {
+        if (!file.second.masked)
+        {
+            config->ParseFile(file.second.path, context);
+        }
+    }
+    config->ParseKernelCommandLine(context);
+
+    gModprobeConfigStamp = std::move(stamp);
+    gModprobeConfig = config;
+    return gModprobeConfig;
 }
 
-Result<bool> IsKernelModuleLoaded(std::string moduleName, ContextInterface& context)
+void ModprobeConfig::ParseFile(const std::string& path, ContextInterface& context)
 {
-    Result<std::string> procModules = context.GetFileContents("/proc/modules");
+    std::ifstream file(path);
+    if (!file)
+    {
+        OsConfigLogWarning(context.GetLogHandle(), "Failed to open modprobe configuration file: %s", path.c_str());
+        return;
+    }
 
-    if (!procModules.HasValue())
+    std::string line;
+    std::string directive;
+    while (std::getline(file, line))
     {
-        return procModules.Error();
+        // A trailing backslash continues the directive on the next line
+        if (!line.empty() && line.back() == '\\')
+        {
+            directive += line.substr(0, line.size() - 1) + " ";
+            continue;
+        }
+        directive += line;
+
+        std::istringstream tokens(directive);
+        directive.clear();
+
+        std::string command;
+        std::string moduleName;
+        if (!(tokens >> command) || command[0] == '#' || !(tokens >> moduleName))
+        {
+            continue;
+        }
+
+        if (command == "blacklist")
+        {
+            mBlacklist.insert(NormalizeModuleName(moduleName));
+        }
+        else if (command == "install")
+        {
+            std::string installCommand;
+            std::getline(tokens, installCommand);
+            mInstallCommands[NormalizeModuleName(moduleName)].push_back(TrimWhiteSpaces(installCommand));
+        }
     }
-    regex procModulesRegex;
-    try
+}
+
+void ModprobeConfig::ParseKernelCommandLine(ContextInterface& context)
+{
+    std::ifstream file(context.GetSpecialFilePath("/proc/cmdline"));
+    std::string parameter;
+    while (file >> parameter)
     {
-        procModulesRegex = regex("^" + UnderscoreForRegex(moduleName) + "\\s+");
+        if (0 != parameter.compare(0, sizeof(cKernelCommandLineBlacklist) - 1, cKernelCommandLineBlacklist))
+        {
+            continue;
+        }
+
+        std::istringstream modules(parameter.substr(sizeof(cKernelCommandLineBlacklist) - 1));
+        std::string moduleName;
+        while (std::getline(modules, moduleName, ','))
+        {
+            if (!moduleName.empty())
+            {
+                mBlacklist.insert(NormalizeModuleName(moduleName));
+            }
+        }
     }
-    catch (regex_error& e)
+}
+
+bool ModprobeConfig::IsBlacklisted(const std::string& moduleName) const
+{
+    return mBlacklist.find(NormalizeModuleName(moduleName)) != mBlacklist.end();
+}
+
+const std::vector<std::string>* ModprobeConfig::GetInstallCommands(const std::string& moduleName) const
+{
+    auto it = mInstallCommands.find(NormalizeModuleName(moduleName));
+    return it == mInstallCommands.end() ? nullptr : &it->second;
+}
+
+// Looks moduleName up in the kernel module index, including overlay.ko modules, and returns true if found
+Result<bool> SearchFilesystemForModuleName(std::string& moduleName, ContextInterface& context)
+{
+    auto index = KernelModuleIndex::Get(context);
+    if (!index.HasValue())
     {
-        return Error(e.what());
+        return index.Error();
     }
 
-    if (MultilineRegexSearch(procModules.Value(), procModulesRegex))
+    if (index.Value()->Contains(moduleName))
+    {
+        return true;
+    }
+    if (index.Value()->Contains(moduleName + "_overlay"))
     {
+        moduleName += "_overlay"; // preserve original behavior of tracking overlay variant
         return true;
     }
     return false;
 }
 
-Result<Status> IsKernelModuleBlocked(std::string moduleName, IndicatorsTree& indicators, ContextInterface& context)
+Result<bool> IsKernelModuleLoaded(std::string moduleName, ContextInterface& context)
 {
-    Result<std::string> modprobeOutput = context.ExecuteCommand("modprobe --showconfig");
-    if (modprobeOutput.HasValue())
+    Result<std::string> procModules = context.GetFileContents("/proc/modules");
+
+    if (!procModules.HasValue())
     {
+        return procModules.Error();
+    }
 
-        regex modprobeBlacklistRegex;
-        try
+    // The first column of /proc/modules is the module name, which always uses underscores
+    moduleName = NormalizeModuleName(moduleName);
+    std::istringstream lines(procModules.Value());
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.compare(0, line.find_first_of(" \t"), moduleName) == 0)
         {
-            modprobeBlacklistRegex = regex("^blacklist\\s+" + UnderscoreForRegex(moduleName) + "$");
+            return true;
         }
-        catch (std::exception& e)
+    }
+    return false;
+}
+
+Result<Status> IsKernelModuleBlocked(std::string moduleName, IndicatorsTree& indicators, ContextInterface& context)
+{
+    if (IsModprobeAvailable(context))
+    {
+        auto modprobeConfig = ModprobeConfig::Get(context);
+        if (!modprobeConfig.HasValue())
         {
-            return Error(e.what());
+            return modprobeConfig.Error();
         }
 
-        if (!MultilineRegexSearch(modprobeOutput.Value(), modprobeBlacklistRegex))
+        if (!modprobeConfig.Value()->IsBlacklisted(moduleName))
         {
             return indicators.NonCompliant("Module " + moduleName + " is not blacklisted in modprobe configuration");
         }
 
-        regex modprobeInstallRegex;
-        try
-        {
-            modprobeInstallRegex = regex("^install\\s+" + UnderscoreForRegex(moduleName) + "\\s+(/usr)?/bin/(true|false)");
-        }
-        catch (std::exception& e)
-        {
-            return Error(e.what());
-        }
-        if (!MultilineRegexSearch(modprobeOutput.Value(), modprobeInstallRegex))
+        const auto* installCommands = modprobeConfig.Value()->GetInstallCommands(moduleName);
+        if (nullptr == installCommands || std::none_of(installCommands->begin(), installCommands->end(), IsDisablingInstallCommand))
         {
             return indicators.NonCompliant("Module " + moduleName + " is not masked in modprobe configuration");
         }
     }
     else
     {
-        indicators.Compliant("Failed to execute modprobe: " + modprobeOutput.Error().message + ", ignoring modprobe output");
+        indicators.Compliant("modprobe is not available, ignoring modprobe configuration");
     }
 
     return indicators.Compliant("Module " + moduleName + " is disabled");
@@ -1,4 +1,3 @@
-
 #ifndef KERNELMODULETOOLS_H
 #define KERNELMODULETOOLS_H
 
@@ -6,11 +5,51 @@
 #include "Indicators.h"
 #include "Result.h"
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace ComplianceEngine
 {
 
+// Set of kernel modules available under /lib/modules for all installed kernels, keyed by the
+// module name with dashes replaced by underscores, as the kernel treats both the same way.
+// Built from modules.dep where available, falling back to a walk of the kernel/ tree otherwise.
+class KernelModuleIndex
+{
+public:
+    // Returns the index, rebuilding it only when /lib/modules or any modules.dep changed
+    static Result<std::shared_ptr<const KernelModuleIndex>> Get(ContextInterface& context);
+
+    bool Contains(const std::string& moduleName) const;
+
+private:
+    std::unordered_set<std::string> mModules;
+};
+
+// Native equivalent of the blacklist and install directives reported by 'modprobe --showconfig',
+// read from the modprobe.d directories and the modprobe.blacklist kernel command line option.
+class ModprobeConfig
+{
+public:
+    // Returns the configuration, re-parsing it only when one of the modprobe.d files changed
+    static Result<std::shared_ptr<const ModprobeConfig>> Get(ContextInterface& context);
+
+    bool IsBlacklisted(const std::string& moduleName) const;
+
+    // Returns the commands of all install directives for the module, or nullptr if there are none
+    const std::vector<std::string>* GetInstallCommands(const std::string& moduleName) const;
+
+private:
+    void ParseFile(const std::string& path, ContextInterface& context);
+    void ParseKernelCommandLine(ContextInterface& context);
+
+    std::unordered_set<std::string> mBlacklist;
+    std::unordered_map<std::string, std::vector<std::string>> mInstallCommands;
+};
+
 Result<bool> SearchFilesystemForModuleName(std::string& moduleName, ContextInterface& context);
 Result<bool> IsKernelModuleLoaded(std::string moduleName, ContextInterface& context);
 Result<Status> IsKernelModuleBlocked(std::string moduleName, IndicatorsTree& indicators, ContextInterface& context);
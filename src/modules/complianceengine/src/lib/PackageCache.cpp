@@ -0,0 +1,206 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <CommonUtils.h>
+#include <PackageCache.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <linux/limits.h>
+#include <unistd.h>
+
+namespace ComplianceEngine
+{
+namespace
+{
+// "OSCPKG" followed by the format version, bump the version whenever the layout below changes:
+// magic, uint32 package manager, int64 last update time, string database stamp, uint32 package
+// count and then the name and version strings of each package, all strings prefixed by a uint32 size
+const char cPackageCacheMagic[8] = {'O', 'S', 'C', 'P', 'K', 'G', '0', '1'};
+
+// Protects against allocating huge buffers when reading a corrupted file
+const uint32_t cMaxStringSize = 64 * 1024;
+
+const char cDpkgStatus[] = "/var/lib/dpkg/status";
+const char cRpmDatabase[] = "/var/lib/rpm";
+
+class ScopeGuard
+{
+public:
+    template <class Callable>
+    ScopeGuard(Callable&& f)
+        : f(std::forward<Callable>(f)){};
+    void Deactivate()
+    {
+        active = false;
+    }
+    ~ScopeGuard()
+    {
+        if (active)
+        {
+            f();
+        }
+    }
+
+private:
+    std::function<void()> f;
+    bool active{true};
+};
+
+template <typename T>
+bool ReadValue(std::istream& stream, T& value)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+bool ReadString(std::istream& stream, std::string& value)
+{
+    uint32_t size = 0;
+    if (!ReadValue(stream, size) || size > cMaxStringSize)
+    {
+        return false;
+    }
+    value.resize(size);
+    return (0 == size) || static_cast<bool>(stream.read(&value[0], size));
+}
+
+template <typename T>
+void WriteValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void WriteString(std::ostream& stream, const std::string& value)
+{
+    WriteValue(stream, static_cast<uint32_t>(value.size()));
+    stream.write(value.data(), value.size());
+}
+} // anonymous namespace
+
+Result<PackageCache> LoadPackageCache(const std::string& path)
+{
+    PackageCache cache;
+    std::ifstream cacheFile(path, std::ios::in | std::ios::binary);
+    if (!cacheFile.is_open())
+    {
+        return Error("Failed to open cache file: " + path);
+    }
+
+    char magic[sizeof(cPackageCacheMagic)] = {0};
+    if (!cacheFile.read(magic, sizeof(magic)) || (0 != memcmp(magic, cPackageCacheMagic, sizeof(magic))))
+    {
+        return Error("Invalid cache file format");
+    }
+
+    uint32_t packageManager = 0;
+    int64_t lastUpdateTime = 0;
+    uint32_t count = 0;
+    if (!ReadValue(cacheFile, packageManager) || !ReadValue(cacheFile, lastUpdateTime) || !ReadString(cacheFile, cache.databaseStamp) ||
+        !ReadValue(cacheFile, count))
+    {
+        return Error("Error reading cache file header");
+    }
+
+    if (packageManager == static_cast<uint32_t>(PackageManagerType::DPKG))
+    {
+        cache.packageManager = PackageManagerType::DPKG;
+    }
+    else if (packageManager == static_cast<uint32_t>(PackageManagerType::RPM))
+    {
+        cache.packageManager = PackageManagerType::RPM;
+    }
+    else
+    {
+        return Error("Invalid package manager type");
+    }
+    cache.lastUpdateTime = static_cast<time_t>(lastUpdateTime);
+
+    cache.packages.reserve(count);
+    std::string packageName;
+    std::string packageVersion;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!ReadString(cacheFile, packageName) || !ReadString(cacheFile, packageVersion))
+        {
+            return Error("Error reading cache file");
+        }
+        cache.packages[packageName] = packageVersion;
+    }
+
+    return cache;
+}
+
+Result<int> SavePackageCache(const PackageCache& cache, const std::string& path)
+{
+    std::string tempPath = path + ".tmp.XXXXXX";
+    char pathTemplate[PATH_MAX];
+    snprintf(pathTemplate, sizeof(pathTemplate), "%s", tempPath.c_str());
+    int fd = mkstemp(pathTemplate);
+    if (fd == -1)
+    {
+        return Error("Failed to create temporary file");
+    }
+    tempPath = pathTemplate;
+    ScopeGuard tempFileRemover([tempPath] { std::remove(tempPath.c_str()); });
+    std::ofstream tempFile(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+    close(fd);
+
+    if (!tempFile.is_open())
+    {
+        return Error("Failed to open temporary file for writing: " + tempPath);
+    }
+
+    tempFile.write(cPackageCacheMagic, sizeof(cPackageCacheMagic));
+    WriteValue(tempFile, static_cast<uint32_t>(cache.packageManager));
+    WriteValue(tempFile, static_cast<int64_t>(cache.lastUpdateTime));
+    WriteString(tempFile, cache.databaseStamp);
+    WriteValue(tempFile, static_cast<uint32_t>(cache.packages.size()));
+    if (!tempFile)
+    {
+        return Error("Failed to write header to temporary file");
+    }
+
+    for (const auto& package : cache.packages)
+    {
+        WriteString(tempFile, package.first);
+        WriteString(tempFile, package.second);
+        if (!tempFile)
+        {
+            return Error("Failed to write package name to temporary file");
+        }
+    }
+
+    tempFile.close();
+    if (!tempFile)
+    {
+        return Error("Failed to close temporary file");
+    }
+    if (0 != std::rename(tempPath.c_str(), path.c_str()))
+    {
+        return Error("Failed to rename temporary file to target path: " + tempPath + "->" + path);
+    }
+    tempFileRemover.Deactivate();
+    return 0;
+}
+
+std::string GetPackageDatabaseStamp(PackageManagerType packageManager, ContextInterface& context)
+{
+    std::string result;
+    if ((PackageManagerType::DPKG != packageManager) && (PackageManagerType::RPM != packageManager))
+    {
+        return result;
+    }
+
+    const auto database = context.GetSpecialFilePath((PackageManagerType::DPKG == packageManager) ? cDpkgStatus : cRpmDatabase);
+    char* stamp = ::GetPackageDatabaseStamp(database.c_str(), context.GetLogHandle());
+    if (nullptr != stamp)
+    {
+        result = stamp;
+        free(stamp);
+    }
+    return result;
+}
+} // namespace ComplianceEngine
@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef COMPLIANCEENGINE_PACKAGE_CACHE_H
+#define COMPLIANCEENGINE_PACKAGE_CACHE_H
+
+#include <ContextInterface.h>
+#include <PackageInstalled.h>
+#include <Result.h>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+
+namespace ComplianceEngine
+{
+// Inventory of installed packages, mapping package names to their versions
+struct PackageCache
+{
+    time_t lastUpdateTime = 0;
+    PackageManagerType packageManager = PackageManagerType::Autodetect;
+
+    // Identity of the package database the inventory was built from, empty when it could not be determined
+    std::string databaseStamp;
+
+    std::unordered_map<std::string, std::string> packages;
+};
+
+// Reads and writes the inventory in a compact binary format. Saving is atomic, the file is replaced
+// by rename, and loading rejects files that are truncated or were written in a different format.
+Result<PackageCache> LoadPackageCache(const std::string& path);
+Result<int> SavePackageCache(const PackageCache& cache, const std::string& path);
+
+// Returns the identity, size and modification time of /var/lib/dpkg/status or of the files in /var/lib/rpm,
+// which changes whenever packages are installed or removed, or an empty string when the database is not found
+std::string GetPackageDatabaseStamp(PackageManagerType packageManager, ContextInterface& context);
+} // namespace ComplianceEngine
+
+#endif // COMPLIANCEENGINE_PACKAGE_CACHE_H
@@ -202,7 +202,7 @@ void Procedure::SetParameters(ProcedureParameters value)
 Optional<Error> Procedure::UpdateUserParameters(const std::string& userParameters)
 {
     // Attempt to parse the input as stringified JSON first
-    auto json = JsonWrapper::FromString(userParameters);
+    auto json = JsonWrapper::FromStringInArena(userParameters);
     if (json.HasValue())
     {
         const auto* object = json_value_get_object(json->get());
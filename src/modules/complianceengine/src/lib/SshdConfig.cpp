@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <CommonUtils.h>
+#include <SshUtils.h>
+#include <SshdConfig.h>
+#include <StringTools.h>
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+
+namespace ComplianceEngine
+{
+namespace
+{
+const char cSshdConfig[] = "/etc/ssh/sshd_config";
+
+std::mutex gCacheMutex;
+std::string gCacheStamp;
+std::map<std::string, std::shared_ptr<const SshdConfig>> gCache;
+
+std::string ToLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return value;
+}
+} // anonymous namespace
+
+const std::string* SshdConfig::Find(const std::string& option) const
+{
+    auto it = mOptions.find(ToLower(option));
+    if (it == mOptions.end())
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+Result<std::shared_ptr<const SshdConfig>> SshdConfig::Load(const std::string& extraConfig, const std::string& matchContext, ContextInterface& context)
+{
+    std::string sshdCommand = "sshd -T";
+    if (!extraConfig.empty())
+    {
+        sshdCommand = sshdCommand + " " + extraConfig;
+    }
+
+    if (!matchContext.empty())
+    {
+        sshdCommand = sshdCommand + " -C " + matchContext;
+    }
+    else
+    {
+        auto sshdTestOutput = context.ExecuteCommand(sshdCommand + " 2>&1");
+        if (!sshdTestOutput.HasValue())
+        {
+            return Error("Failed to execute sshd -T command: " + sshdTestOutput.Error().message, sshdTestOutput.Error().code);
+        }
+        if (sshdTestOutput.Value().find("match group") != std::string::npos || sshdTestOutput.Value().find("Match group") != std::string::npos)
+        {
+            auto hostname = context.ExecuteCommand("hostname");
+            if (!hostname.HasValue())
+            {
+                return Error("Failed to execute hostname command: " + hostname.Error().message, hostname.Error().code);
+            }
+
+            auto hostAddress = context.ExecuteCommand("hostname -I | cut -d ' ' -f1");
+            if (!hostAddress.HasValue())
+            {
+                return Error("Failed to get host address: " + hostAddress.Error().message, hostAddress.Error().code);
+            }
+            auto hostnameStr = hostname.Value();
+            auto hostAddrStr = hostAddress.Value();
+            hostnameStr.erase(hostnameStr.find_last_not_of(" \n\r\t") + 1);
+            hostAddrStr.erase(hostAddrStr.find_last_not_of(" \n\r\t") + 1);
+
+            sshdCommand = sshdCommand + " -C user=root -C host=" + EscapeForShell(hostnameStr) + " -C addr=" + EscapeForShell(hostAddrStr);
+        }
+    }
+
+    auto output = context.ExecuteCommand(sshdCommand);
+    if (!output.HasValue())
+    {
+        return Error("Failed to execute " + sshdCommand + ": " + output.Error().message, output.Error().code);
+    }
+
+    auto config = std::make_shared<SshdConfig>();
+    std::istringstream configStream(output.Value());
+    std::string line;
+    while (std::getline(configStream, line))
+    {
+        std::istringstream lineStream(line);
+        std::string currentOption;
+
+        if (lineStream >> currentOption)
+        {
+            std::string optionValue;
+            std::getline(lineStream, optionValue);
+            optionValue.erase(0, optionValue.find_first_not_of(" \t"));
+            config->mOptions[ToLower(currentOption)] = ToLower(optionValue);
+        }
+    }
+    return std::shared_ptr<const SshdConfig>(config);
+}
+
+Result<std::shared_ptr<const SshdConfig>> SshdConfig::Get(const std::string& extraConfig, const std::string& matchContext, ContextInterface& context)
+{
+    auto log = context.GetLogHandle();
+    const std::string sshdConfigPath = context.GetSpecialFilePath(cSshdConfig);
+    char* rawStamp = GetSshdConfigurationStamp(sshdConfigPath.c_str(), log);
+    if (nullptr == rawStamp)
+    {
+        // Without a stamp there is no way to tell when a snapshot becomes stale, so nothing is cached
+        return Load(extraConfig, matchContext, context);
+    }
+    std::string stamp = rawStamp;
+    free(rawStamp);
+
+    const std::string key = extraConfig + '\n' + matchContext;
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    if (gCacheStamp != stamp)
+    {
+        gCache.clear();
+        gCacheStamp = std::move(stamp);
+    }
+
+    auto it = gCache.find(key);
+    if (it != gCache.end())
+    {
+        return it->second;
+    }
+
+    auto config = Load(extraConfig, matchContext, context);
+    if (!config.HasValue())
+    {
+        return config.Error();
+    }
+
+    OsConfigLogDebug(log, "Loaded %d sshd options for match context '%s'", static_cast<int>(config.Value()->mOptions.size()),
+        matchContext.empty() ? "default" : matchContext.c_str());
+    gCache[key] = config.Value();
+    return config;
+}
+} // namespace ComplianceEngine
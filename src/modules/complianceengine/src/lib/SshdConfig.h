@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef COMPLIANCEENGINE_SSHD_CONFIG_H
+#define COMPLIANCEENGINE_SSHD_CONFIG_H
+
+#include <ContextInterface.h>
+#include <Result.h>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ComplianceEngine
+{
+// Effective SSH daemon configuration as reported by 'sshd -T' for one set of extra command line
+// options and one match context, with option names and values lowercased.
+class SshdConfig
+{
+public:
+    // Returns the configuration for the given extra options and match context, where an empty match
+    // context selects the connection of root to this host. Snapshots are cached per extra options and
+    // match context, and all of them are dropped as soon as sshd_config or any file it includes changed,
+    // so that a sweep over many sshd rules runs sshd once per match context.
+    static Result<std::shared_ptr<const SshdConfig>> Get(const std::string& extraConfig, const std::string& matchContext, ContextInterface& context);
+
+    // Returns the value of the option, which is looked up case-insensitively, or nullptr when sshd does not report it
+    const std::string* Find(const std::string& option) const;
+
+private:
+    static Result<std::shared_ptr<const SshdConfig>> Load(const std::string& extraConfig, const std::string& matchContext, ContextInterface& context);
+
+    std::map<std::string, std::string> mOptions;
+};
+} // namespace ComplianceEngine
+
+#endif // COMPLIANCEENGINE_SSHD_CONFIG_H
@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <ConfigDirectories.h>
+#include <StringTools.h>
+#include <SysctlConfig.h>
+#include <fnmatch.h>
+#include <fstream>
+#include <mutex>
+#include <sys/stat.h>
+
+namespace ComplianceEngine
+{
+namespace
+{
+// Directories in order of precedence, highest first
+const std::vector<std::string> cSysctlDirectories = {"/etc/sysctl.d", "/run/sysctl.d", "/usr/local/lib/sysctl.d", "/usr/lib/sysctl.d", "/lib/sysctl.d"};
+const char cSysctlConf[] = "/etc/sysctl.conf";
+
+std::mutex gCacheMutex;
+std::string gCacheStamp;
+std::shared_ptr<const SysctlConfig> gCache;
+
+bool IsGlob(const std::string& name)
+{
+    return name.find_first_of("*?[") != std::string::npos;
+}
+} // anonymous namespace
+
+std::string SysctlConfig::Normalize(const std::string& name)
+{
+    std::string result = name;
+    auto separator = result.find_first_of("./");
+    if (separator == std::string::npos || result[separator] == '/')
+    {
+        return result;
+    }
+
+    for (auto& c : result)
+    {
+        if (c == '.')
+        {
+            c = '/';
+        }
+        else if (c == '/')
+        {
+            c = '.';
+        }
+    }
+    return result;
+}
+
+void SysctlConfig::ParseFile(const std::string& path, const std::string& source, ContextInterface& context)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        OsConfigLogWarning(context.GetLogHandle(), "Failed to open sysctl configuration file: %s", path.c_str());
+        return;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = TrimWhiteSpaces(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+        {
+            continue;
+        }
+
+        auto eqPos = line.find('=');
+        if (eqPos == std::string::npos)
+        {
+            continue;
+        }
+
+        auto name = TrimWhiteSpaces(line.substr(0, eqPos));
+        // A leading '-' only tells systemd-sysctl to ignore failures when applying the value
+        if (!name.empty() && name[0] == '-')
+        {
+            name = TrimWhiteSpaces(name.substr(1));
+        }
+        if (name.empty())
+        {
+            continue;
+        }
+
+        SysctlConfigEntry entry;
+        entry.value = TrimWhiteSpaces(line.substr(eqPos + 1));
+        entry.source = source;
+
+        name = Normalize(name);
+        if (IsGlob(name))
+        {
+            mGlobEntries.emplace_back(std::move(name), std::move(entry));
+        }
+        else
+        {
+            mEntries[name] = std::move(entry);
+        }
+    }
+}
+
+const SysctlConfigEntry* SysctlConfig::Find(const std::string& name) const
+{
+    const auto normalized = Normalize(name);
+    auto it = mEntries.find(normalized);
+    if (it != mEntries.end())
+    {
+        return &it->second;
+    }
+
+    for (auto glob = mGlobEntries.rbegin(); glob != mGlobEntries.rend(); ++glob)
+    {
+        if (0 == fnmatch(glob->first.c_str(), normalized.c_str(), FNM_PATHNAME))
+        {
+            return &glob->second;
+        }
+    }
+
+    return nullptr;
+}
+
+Result<std::shared_ptr<const SysctlConfig>> SysctlConfig::Get(ContextInterface& context)
+{
+    std::string stamp;
+    const auto files = ListConfigFiles(cSysctlDirectories, context, stamp);
+
+    const std::string sysctlConfPath = context.GetSpecialFilePath(cSysctlConf);
+    struct stat st;
+    bool hasSysctlConf = (0 == stat(sysctlConfPath.c_str(), &st) && S_ISREG(st.st_mode));
+    if (hasSysctlConf)
+    {
+        AppendFileStamp(stamp, sysctlConfPath, st);
+    }
+
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    if (gCache && gCacheStamp == stamp)
+    {
+        return gCache;
+    }
+
+    auto config = std::make_shared<SysctlConfig>();
+    for (const auto& file : files)
+    {
+        if (!file.second.masked)
+        {
+            config->ParseFile(file.second.path, file.second.source, context);
+        }
+    }
+    if (hasSysctlConf)
+    {
+        config->ParseFile(sysctlConfPath, cSysctlConf, context);
+    }
+
+    OsConfigLogDebug(context.GetLogHandle(), "Loaded %d sysctl settings from %d configuration files",
+        static_cast<int>(config->mEntries.size() + config->mGlobEntries.size()), static_cast<int>(files.size() + (hasSysctlConf ? 1 : 0)));
+    gCacheStamp = std::move(stamp);
+    gCache = config;
+    return gCache;
+}
+} // namespace ComplianceEngine
@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef COMPLIANCEENGINE_SYSCTL_CONFIG_H
+#define COMPLIANCEENGINE_SYSCTL_CONFIG_H
+
+#include <ContextInterface.h>
+#include <Result.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ComplianceEngine
+{
+struct SysctlConfigEntry
+{
+    std::string value;
+
+    // Configuration file that provided the effective value
+    std::string source;
+};
+
+// Native equivalent of 'systemd-sysctl --cat-config': resolves the sysctl.d precedence order
+// (/etc, /run, /usr/local/lib, /usr/lib, /lib, then /etc/sysctl.conf) where a file in a higher
+// priority directory overrides files with the same basename in lower priority directories, and
+// files are applied in lexicographic order of their basenames so that later assignments win.
+class SysctlConfig
+{
+public:
+    // Returns the effective stored configuration. The result is cached and only rebuilt when one
+    // of the configuration directories or files changed since the previous call, so a sweep over
+    // many sysctl rules parses the configuration once.
+    static Result<std::shared_ptr<const SysctlConfig>> Get(ContextInterface& context);
+
+    // Returns the effective entry for the sysctl name in either dotted or slashed notation,
+    // or nullptr when the name is not set by any configuration file. Explicit assignments take
+    // precedence over glob assignments, as in systemd-sysctl.
+    const SysctlConfigEntry* Find(const std::string& name) const;
+
+    // Converts a sysctl name to the slashed /proc/sys notation, e.g. net.ipv4.ip_forward becomes
+    // net/ipv4/ip_forward and fs.binfmt_misc.python3/10 becomes fs/binfmt_misc/python3.10
+    static std::string Normalize(const std::string& name);
+
+private:
+    void ParseFile(const std::string& path, const std::string& source, ContextInterface& context);
+
+    std::map<std::string, SysctlConfigEntry> mEntries;
+    std::vector<std::pair<std::string, SysctlConfigEntry>> mGlobEntries;
+};
+} // namespace ComplianceEngine
+
+#endif // COMPLIANCEENGINE_SYSCTL_CONFIG_H
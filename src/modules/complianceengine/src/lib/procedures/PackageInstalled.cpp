@@ -2,57 +2,36 @@
 // Licensed under the MIT License.
 
 #include <Bindings.h>
+#include <CommonUtils.h>
+#include <PackageCache.h>
 #include <PackageInstalled.h>
 #include <ProcedureMap.h>
 #include <Result.h>
 #include <Telemetry.h>
-#include <cstdio>
-#include <fstream>
-#include <functional>
-#include <linux/limits.h>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
-#include <unistd.h>
 
 namespace
 {
 
 using ComplianceEngine::ContextInterface;
 using ComplianceEngine::Error;
+using ComplianceEngine::PackageCache;
 using ComplianceEngine::PackageManagerType;
 using ComplianceEngine::Result;
 
-struct PackageCache
-{
-    time_t lastUpdateTime;
-    PackageManagerType packageManager = PackageManagerType::Autodetect;
-    std::map<std::string, std::string> packages;
-};
-
 static constexpr long PACKAGELIST_TTL = 3000L;        // just shy of an hours
 static constexpr long PACKAGELIST_STALE_TTL = 12600L; // 3.5 hours
 
-class ScopeGuard
-{
-public:
-    template <class Callable>
-    ScopeGuard(Callable&& f)
-        : f(std::forward<Callable>(f)){};
-    void Deactivate()
-    {
-        active = false;
-    }
-    ~ScopeGuard()
-    {
-        if (active)
-        {
-            f();
-        }
-    }
+static const char cPackageCachePath[] = "/var/lib/GuestConfig/ComplianceEnginePackageCache";
+static const char cDpkgStatus[] = "/var/lib/dpkg/status";
 
-private:
-    std::function<void()> f;
-    bool active{true};
-};
+// Inventory last used by this process, reused without touching the on-disk cache while the package database is unchanged
+std::mutex gCacheMutex;
+std::string gCachePath;
+std::shared_ptr<const PackageCache> gCache;
 
 Result<PackageManagerType> DetectPackageManager(ContextInterface& context)
 {
@@ -76,121 +55,6 @@ Result<PackageManagerType> DetectPackageManager(ContextInterface& context)
     return Error("No package manager found", ENOENT);
 }
 
-Result<PackageCache> LoadPackageCache(const std::string& path)
-{
-    PackageCache cache;
-    const std::string pkgCacheHeader = "# PackageCache "; // "# PackageCache <packageManager>@<timestamp>\n"
-    cache.lastUpdateTime = 0;
-    cache.packageManager = PackageManagerType::Autodetect;
-    cache.packages.clear();
-    std::ifstream cacheFile(path);
-    if (!cacheFile.is_open())
-    {
-        return Error("Failed to open cache file: " + path);
-    }
-
-    std::string header;
-    if (!std::getline(cacheFile, header) || (0 != header.find(pkgCacheHeader, 0)))
-    {
-        return Error("Invalid cache file format");
-    }
-
-    auto separatorPos = header.find('@');
-    if (std::string::npos == separatorPos)
-    {
-        return Error("Invalid cache file header format");
-    }
-
-    const auto packageMangerStr = header.substr(pkgCacheHeader.length(), separatorPos - pkgCacheHeader.length());
-    if (packageMangerStr == "dpkg")
-        cache.packageManager = PackageManagerType::DPKG;
-    else if (packageMangerStr == "rpm")
-        cache.packageManager = PackageManagerType::RPM;
-    else
-        return Error("Invalid package manager type");
-    try
-    {
-        cache.lastUpdateTime = std::stol(header.substr(separatorPos + 1));
-    }
-    catch (const std::exception&)
-    {
-        return Error("Invalid timestamp in cache file header");
-    }
-
-    std::string line;
-    while (std::getline(cacheFile, line))
-    {
-        if (!line.empty())
-        {
-            auto sepPos = line.find(' ');
-            if (sepPos == std::string::npos)
-            {
-                continue; // Skip lines without a space
-            }
-            std::string packageName = line.substr(0, sepPos);
-            std::string packageVersion = line.substr(sepPos + 1);
-            cache.packages[packageName] = packageVersion;
-        }
-    }
-
-    if (cacheFile.bad())
-    {
-        return Error("Error reading cache file");
-    }
-
-    return cache;
-}
-
-Result<int> SavePackageCache(const PackageCache& cache, const std::string& path)
-{
-    std::string tempPath = path + ".tmp.XXXXXX";
-    char pathTemplate[PATH_MAX];
-    snprintf(pathTemplate, sizeof(pathTemplate), "%s", tempPath.c_str());
-    int fd = mkstemp(pathTemplate);
-    if (fd == -1)
-    {
-        return Error("Failed to create temporary file");
-    }
-    tempPath = pathTemplate;
-    ScopeGuard tempFileRemover([tempPath] { std::remove(tempPath.c_str()); });
-    std::ofstream tempFile(tempPath, std::ios::out | std::ios::trunc);
-    close(fd);
-
-    if (!tempFile.is_open())
-    {
-        return Error("Failed to open temporary file for writing: " + tempPath);
-    }
-
-    const std::string pkgCacheHeader = "# PackageCache " + std::to_string(cache.packageManager) + "@" + std::to_string(cache.lastUpdateTime) + "\n";
-    tempFile << pkgCacheHeader;
-
-    if (!tempFile)
-    {
-        return Error("Failed to write header to temporary file");
-    }
-
-    for (const auto& package : cache.packages)
-    {
-        tempFile << package.first << " " << package.second << "\n";
-        if (!tempFile)
-        {
-            return Error("Failed to write package name to temporary file");
-        }
-    }
-
-    tempFile.close();
-    if (!tempFile)
-    {
-        return Error("Failed to close temporary file");
-    }
-    if (0 != std::rename(tempPath.c_str(), path.c_str()))
-    {
-        return Error("Failed to rename temporary file to target path: " + tempPath + "->" + path);
-    }
-    tempFileRemover.Deactivate();
-    return 0;
-}
-
 Result<PackageCache> GetInstalledPackagesRpm(ContextInterface& context)
 {
     PackageCache cache;
@@ -225,12 +89,31 @@ Result<PackageCache> GetInstalledPackagesRpm(ContextInterface& context)
     return cache;
 }
 
+void AddDpkgPackage(const char* name, const char* architecture, const char* version, void* context)
+{
+    (void)architecture;
+    static_cast<PackageCache*>(context)->packages[name] = (nullptr != version) ? version : "";
+}
+
 Result<PackageCache> GetInstalledPackagesDpkg(ContextInterface& context)
 {
     PackageCache cache;
     cache.packageManager = PackageManagerType::DPKG;
     cache.lastUpdateTime = time(NULL);
 
+    // Read the dpkg database directly, 'dpkg -l' is only a fallback for when it cannot be opened
+    const auto statusPath = context.GetSpecialFilePath(cDpkgStatus);
+    int readStatus = EnumerateDpkgInstalledPackages(statusPath.c_str(), AddDpkgPackage, &cache, context.GetLogHandle());
+    if (0 == readStatus)
+    {
+        return cache;
+    }
+    if (ENOMEM == readStatus)
+    {
+        return Error("Failed to read " + statusPath, readStatus);
+    }
+    OsConfigLogInfo(context.GetLogHandle(), "Failed to read %s (%d), falling back to dpkg -l", statusPath.c_str(), readStatus);
+
     const std::string cmd = "dpkg -l";
 
     auto dpkgl = context.ExecuteCommand(cmd);
@@ -447,18 +330,60 @@ Result<PackageCache> GetInstalledPackages(PackageManagerType packageManager, Con
 
 namespace ComplianceEngine
 {
+namespace
+{
+Result<Status> CheckPackage(const PackageInstalledParams& params, const PackageCache& cache, IndicatorsTree& indicators, OsConfigLogHandle log)
+{
+    auto packageIt = cache.packages.find(params.packageName);
+    if (packageIt == cache.packages.end())
+    {
+        OsConfigLogInfo(log, "Package %s is not installed", params.packageName.c_str());
+        return indicators.NonCompliant("Package " + params.packageName + " is not installed");
+    }
+    if (params.minPackageVersion.HasValue())
+    {
+        auto installedVersion = packageIt->second;
+        if (VersionCompare(installedVersion, params.minPackageVersion.Value()) < 0)
+        {
+            OsConfigLogInfo(log, "Package %s is installed but version %s is less than minimum required version %s", params.packageName.c_str(),
+                installedVersion.c_str(), params.minPackageVersion->c_str());
+            return indicators.NonCompliant("Package " + params.packageName + " is installed but version " + installedVersion +
+                                           " is less than minimum required version " + params.minPackageVersion.Value());
+        }
+        else
+        {
+            OsConfigLogInfo(log, "Package %s is installed with version %s, which meets or exceeds the minimum required version %s",
+                params.packageName.c_str(), installedVersion.c_str(), params.minPackageVersion->c_str());
+            return indicators.Compliant("Package " + params.packageName + " is installed with version " + installedVersion +
+                                        ", which meets or exceeds the minimum required version " + params.minPackageVersion.Value());
+        }
+    }
+    return indicators.Compliant("Package " + params.packageName + " is installed");
+}
+} // namespace
+
 Result<Status> AuditPackageInstalled(const PackageInstalledParams& params, IndicatorsTree& indicators, ContextInterface& context)
 {
     assert(params.packageManager.HasValue());
     auto log = context.GetLogHandle();
+    const auto cachePath = context.GetSpecialFilePath(cPackageCachePath);
+    auto packageManager = params.packageManager.Value();
+
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    if (gCache && (gCachePath == cachePath) && ((packageManager == PackageManagerType::Autodetect) || (packageManager == gCache->packageManager)) &&
+        (gCache->databaseStamp == GetPackageDatabaseStamp(gCache->packageManager, context)))
+    {
+        OsConfigLogDebug(log, "Package database unchanged, reusing %d packages already loaded", static_cast<int>(gCache->packages.size()));
+        return CheckPackage(params, *gCache, indicators, log);
+    }
 
     PackageCache cache;
-    auto cacheResult = LoadPackageCache(context.GetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache"));
+    auto cacheResult = LoadPackageCache(cachePath);
     bool cacheValid = true;
     bool cacheStale = false;
     if (cacheResult.HasValue())
     {
-        cache = cacheResult.Value();
+        cache = std::move(cacheResult.Value());
     }
     else
     {
@@ -466,7 +391,6 @@ Result<Status> AuditPackageInstalled(const PackageInstalledParams& params, Indic
         OsConfigLogInfo(log, "Failed to load package cache: %s", cacheResult.Error().message.c_str());
     }
 
-    auto packageManager = params.packageManager.Value();
     if (cacheValid)
     {
         if (packageManager == PackageManagerType::Autodetect)
@@ -501,7 +425,18 @@ Result<Status> AuditPackageInstalled(const PackageInstalledParams& params, Indic
         OsConfigLogInfo(log, "Checking if package %s is installed using package manager %s", params.packageName.c_str(), std::to_string(packageManager).c_str());
     }
 
-    if (cacheValid)
+    // Taken before enumerating packages so that changes made while enumerating are picked up next time
+    const auto databaseStamp = GetPackageDatabaseStamp(packageManager, context);
+    if (cacheValid && !databaseStamp.empty() && !cache.databaseStamp.empty())
+    {
+        // The database tells exactly whether the cache is current, regardless of its age
+        if (databaseStamp != cache.databaseStamp)
+        {
+            cacheValid = false;
+            OsConfigLogInfo(log, "Package database changed since the package cache was saved");
+        }
+    }
+    else if (cacheValid)
     {
         auto cacheAge = time(NULL) - cache.lastUpdateTime;
         if (PACKAGELIST_STALE_TTL < cacheAge)
@@ -521,11 +456,12 @@ Result<Status> AuditPackageInstalled(const PackageInstalledParams& params, Indic
 
         if (cacheResult.HasValue())
         {
-            cache = cacheResult.Value();
-            auto saveResult = SavePackageCache(cache, context.GetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache"));
+            cache = std::move(cacheResult.Value());
+            cache.databaseStamp = databaseStamp;
+            auto saveResult = SavePackageCache(cache, cachePath);
             if (saveResult.HasValue())
             {
-                OsConfigLogInfo(log, "Saved package cache to %s", context.GetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache").c_str());
+                OsConfigLogInfo(log, "Saved package cache to %s", cachePath.c_str());
             }
             else
             {
@@ -549,30 +485,13 @@ Result<Status> AuditPackageInstalled(const PackageInstalledParams& params, Indic
         }
     }
 
-    auto packageIt = cache.packages.find(params.packageName);
-    if (packageIt == cache.packages.end())
-    {
-        OsConfigLogInfo(log, "Package %s is not installed", params.packageName.c_str());
-        return indicators.NonCompliant("Package " + params.packageName + " is not installed");
-    }
-    if (params.minPackageVersion.HasValue())
+    auto current = std::make_shared<const PackageCache>(std::move(cache));
+    if (!current->databaseStamp.empty() && (current->databaseStamp == databaseStamp))
     {
-        auto installedVersion = packageIt->second;
-        if (VersionCompare(installedVersion, params.minPackageVersion.Value()) < 0)
-        {
-            OsConfigLogInfo(log, "Package %s is installed but version %s is less than minimum required version %s", params.packageName.c_str(),
-                installedVersion.c_str(), params.minPackageVersion->c_str());
-            return indicators.NonCompliant("Package " + params.packageName + " is installed but version " + installedVersion +
-                                           " is less than minimum required version " + params.minPackageVersion.Value());
-        }
-        else
-        {
-            OsConfigLogInfo(log, "Package %s is installed with version %s, which meets or exceeds the minimum required version %s",
-                params.packageName.c_str(), installedVersion.c_str(), params.minPackageVersion->c_str());
-            return indicators.Compliant("Package " + params.packageName + " is installed with version " + installedVersion +
-                                        ", which meets or exceeds the minimum required version " + params.minPackageVersion.Value());
-        }
+        gCachePath = cachePath;
+        gCache = current;
     }
-    return indicators.Compliant("Package " + params.packageName + " is installed");
+
+    return CheckPackage(params, *current, indicators, log);
 }
 } // namespace ComplianceEngine
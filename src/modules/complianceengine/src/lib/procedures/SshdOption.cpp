@@ -5,6 +5,7 @@
 
 #include <ProcedureMap.h> // Adds std::to_string() for enum classes
 #include <Regex.h>
+#include <SshdConfig.h>
 #include <SshdOption.h>
 #include <Telemetry.h>
 #include <fnmatch.h>
@@ -106,76 +107,6 @@ Result<std::vector<std::string>> GetAllMatches(ContextInterface& context)
 
     return allMatches;
 }
-Result<std::map<std::string, std::string>> GetSshdOptions(ContextInterface& context, const std::string& extraConfig, const std::string& matchContext)
-{
-    std::string sshdCommand = "sshd -T";
-    if (!extraConfig.empty())
-    {
-        sshdCommand = sshdCommand + " " + extraConfig;
-    }
-
-    if (!matchContext.empty())
-    {
-        sshdCommand = sshdCommand + " -C " + matchContext;
-    }
-    else
-    {
-        auto sshdTestOutput = context.ExecuteCommand(sshdCommand + " 2>&1");
-        if (!sshdTestOutput.HasValue())
-        {
-            return Error("Failed to execute sshd -T command: " + sshdTestOutput.Error().message, sshdTestOutput.Error().code);
-        }
-        if (sshdTestOutput.Value().find("match group") != std::string::npos || sshdTestOutput.Value().find("Match group") != std::string::npos)
-        {
-            auto hostname = context.ExecuteCommand("hostname");
-            if (!hostname.HasValue())
-            {
-                return Error("Failed to execute hostname command: " + hostname.Error().message, hostname.Error().code);
-            }
-
-            auto hostAddress = context.ExecuteCommand("hostname -I | cut -d ' ' -f1");
-            if (!hostAddress.HasValue())
-            {
-                return Error("Failed to get host address: " + hostAddress.Error().message, hostAddress.Error().code);
-            }
-            auto hostnameStr = hostname.Value();
-            auto hostAddrStr = hostAddress.Value();
-            hostnameStr.erase(hostnameStr.find_last_not_of(" \n\r\t") + 1);
-            hostAddrStr.erase(hostAddrStr.find_last_not_of(" \n\r\t") + 1);
-
-            sshdCommand = sshdCommand + " -C user=root -C host=" + EscapeForShell(hostnameStr) + " -C addr=" + EscapeForShell(hostAddrStr);
-        }
-    }
-
-    auto output = context.ExecuteCommand(sshdCommand);
-    if (!output.HasValue())
-    {
-        return Error("Failed to execute " + sshdCommand + ": " + output.Error().message, output.Error().code);
-    }
-
-    auto configOutput = output.Value();
-    std::istringstream configStream(configOutput);
-    std::string line;
-    std::map<std::string, std::string> options;
-
-    while (std::getline(configStream, line))
-    {
-        std::istringstream lineStream(line);
-        std::string currentOption;
-
-        if (lineStream >> currentOption)
-        {
-            std::string optionValue;
-            std::getline(lineStream, optionValue);
-            optionValue.erase(0, optionValue.find_first_not_of(" \t"));
-            std::transform(currentOption.begin(), currentOption.end(), currentOption.begin(), ::tolower);
-            std::transform(optionValue.begin(), optionValue.end(), optionValue.begin(), ::tolower);
-            options[currentOption] = optionValue;
-        }
-    }
-    return options;
-}
-
 // Helper for evaluating delimited numeric limits such as MaxStartups style values.
 static Result<Status> EvaluateDelimitedNumericLimits(const std::string& option, const std::string& value, const std::string& realValue,
     const char delimiter, size_t numFields, IndicatorsTree& indicators)
@@ -234,11 +165,11 @@ static Result<Status> EvaluateDelimitedNumericLimits(const std::string& option,
 
 // Helper that evaluates a single sshd option against the provided operation/value.
 // valueRegexes are only used (and must be valid) when op is regex, match, or not_match.
-static Result<Status> EvaluateSshdOption(const std::map<std::string, std::string>& sshdConfig, const std::string& option, const std::string& value,
-    const std::string& op, const std::vector<regex>& valueRegexes, IndicatorsTree& indicators)
+static Result<Status> EvaluateSshdOption(const SshdConfig& sshdConfig, const std::string& option, const std::string& value, const std::string& op,
+    const std::vector<regex>& valueRegexes, IndicatorsTree& indicators)
 {
-    auto itOptions = sshdConfig.find(option);
-    if (itOptions == sshdConfig.end())
+    const auto* configValue = sshdConfig.Find(option);
+    if (nullptr == configValue)
     {
         // For not_match semantics, absence means the forbidden pattern is not present -> compliant
         if (op == "not_match")
@@ -248,7 +179,7 @@ static Result<Status> EvaluateSshdOption(const std::map<std::string, std::string
         return indicators.NonCompliant("Option '" + option + "' not found in SSH daemon configuration");
     }
 
-    auto realValue = itOptions->second;
+    const auto& realValue = *configValue;
 
     if (("maxstartups" == option) && ("match" == op))
     {
@@ -362,7 +293,7 @@ Result<Status> AuditSshdOption(const SshdOptionParams& params, IndicatorsTree& i
     {
         try
         {
-            // Use case-insensitive matching because GetSshdOptions() lowercases all values from sshd -T output
+            // Use case-insensitive matching because SshdConfig lowercases all values from sshd -T output
             // Use extended to ensure POSIX ERE mode (grouping, alternation) in the regex fallback
             valueRegexes.push_back(regex(params.value, std::regex_constants::icase | std::regex_constants::extended));
         }
@@ -429,7 +360,7 @@ Result<Status> AuditSshdOption(const SshdOptionParams& params, IndicatorsTree& i
 
     for (auto const& matchMode : matchModes)
     {
-        auto sshdConfig = GetSshdOptions(context, extraConfig, matchMode);
+        auto sshdConfig = SshdConfig::Get(extraConfig, matchMode, context);
         if (!sshdConfig.HasValue())
         {
             return indicators.NonCompliant("Failed to get sshd options: " + sshdConfig.Error().message);
@@ -438,7 +369,7 @@ Result<Status> AuditSshdOption(const SshdOptionParams& params, IndicatorsTree& i
         {
             OsConfigLogInfo(log, "Evaluating SSH daemon option '%s' in mode '%s' with op '%s' against value '%s'", option.c_str(),
                 matchMode.empty() ? "regular" : matchMode.c_str(), std::to_string(op).c_str(), params.value.c_str());
-            auto result = EvaluateSshdOption(sshdConfig.Value(), option, params.value, std::to_string(op), valueRegexes, indicators);
+            auto result = EvaluateSshdOption(*sshdConfig.Value(), option, params.value, std::to_string(op), valueRegexes, indicators);
             if (!result.HasValue())
             {
                 return result.Error();
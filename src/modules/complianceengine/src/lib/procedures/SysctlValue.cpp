@@ -3,6 +3,7 @@
 
 #include <Regex.h>
 #include <StringTools.h>
+#include <SysctlConfig.h>
 #include <SysctlValue.h>
 #include <Telemetry.h>
 #include <algorithm>
@@ -99,126 +100,29 @@ Result<Status> AuditSysctlValue(const SysctlValueParams& params, IndicatorsTree&
         indicators.Compliant("Correct value for '" + params.sysctlName + "' in runtime configuration");
     }
 
-    // systemd-sysctl can be in different places on different OSes, we need to do some heuristics.
-    std::string systemdSysctl;
-    std::vector<std::string> systemdSysctlLocations = {"/lib/systemd/systemd-sysctl", "/usr/lib/systemd/systemd-sysctl"};
-    const std::string argVersion = " --version";
-    const std::string argCatConfig = " --cat-config";
-    for (auto& cmd : systemdSysctlLocations)
+    // Stored configuration is resolved natively following the systemd-sysctl precedence rules
+    auto config = SysctlConfig::Get(context);
+    if (!config.HasValue())
     {
-        auto result = context.ExecuteCommand(cmd + argVersion);
-        if (result.HasValue())
-        {
-            systemdSysctl = cmd + argCatConfig;
-            break;
-        }
-    }
-    if (systemdSysctl.empty())
-    {
-        return Error("Cannot find systemd-sysctl command", ENOENT);
-    }
-    // systemd-sysctl shows all configs used by system that have sysctl's
-    auto execResult = context.ExecuteCommand(systemdSysctl);
-    if (!execResult.HasValue())
-    {
-        OsConfigLogError(log, "Failed to execute systemd-sysctl command");
-        OSConfigTelemetryStatusTrace("ExecuteCommand", execResult.Error().code);
-        return execResult.Error();
-    }
-
-    std::istringstream configurations(execResult.Value());
-    std::string line;
-    std::string runSysctlValue;
-    std::vector<std::string> sysctlConfigLines;
-
-    // Reverse order of output, to check sysctls from most important till less important
-    while (std::getline(configurations, line))
-    {
-        sysctlConfigLines.push_back(line);
+        OsConfigLogError(log, "Failed to load sysctl configuration: %s", config.Error().message.c_str());
+        OSConfigTelemetryStatusTrace("SysctlConfig", config.Error().code);
+        return config.Error();
     }
 
-    bool found = false;
-    bool invalid = false;
-    auto lines = sysctlConfigLines.rbegin();
-    // Iterate sysctlConfigLines backwards, when last value matches expected valueRegex
-    // we are done.
-    for (; !found && lines != sysctlConfigLines.rend(); ++lines)
+    const auto* entry = config.Value()->Find(params.sysctlName);
+    if (nullptr != entry)
     {
-        line = *lines;
-        size_t comment = line.find('#');
-        if (comment != std::string::npos)
-        {
-            line = line.substr(0, comment);
-        }
-        if (line == "")
-        {
-            continue;
-        }
-
-        // TODO(kkanas) consider using regex_match when we have all platforms with up to date support
-        auto nameValuePattern = regex("\\s*([a-zA-Z0-9_]+[\\.a-zA-Z0-9_-]+)\\s*=\\s*(.*)");
-        if (regex_search(line, nameValuePattern))
+        if (regex_search(entry->value, params.value.GetRegex()))
         {
-            size_t eqPos = line.find('=');
-            if (eqPos == std::string::npos)
-            {
-                continue;
-            }
-
-            std::string name = line.substr(0, eqPos);
-            name = TrimWhiteSpaces(name);
-            runSysctlValue = line.substr(eqPos + 1, line.size() - eqPos);
-            runSysctlValue = TrimWhiteSpaces(runSysctlValue);
-
-            if (name == params.sysctlName)
-            {
-                found = true;
-                if (not regex_search(runSysctlValue, params.value.GetRegex()))
-                {
-                    invalid = true;
-                }
-            }
+            return indicators.Compliant("Correct value for '" + params.sysctlName + "' in stored configuration");
         }
-    }
-    // we found a match with correct value
-    if (found && !invalid)
-    {
-        return indicators.Compliant("Correct value for '" + params.sysctlName + "' in stored configuration");
-    }
 
-    // lines are iterated backwards so filename is before last value marked by lines
-    std::string fileName;
-    for (; lines != sysctlConfigLines.rend(); ++lines)
-    {
-        line = *lines;
-        // TODO(kkanas) consider using regex_match when we have all platforms with up to date support
-        regex fileNamePattern("^\\s*#\\s*(\\/.*\\.conf)$");
-        if (regex_search(line, fileNamePattern))
-        {
-            size_t comment = line.find('#');
-            if (comment == std::string::npos)
-            {
-                continue;
-            }
-            size_t slash = line.find_first_of('/', comment + 1);
-            if (slash == std::string::npos)
-            {
-                continue;
-            }
-            fileName = line.substr(slash, line.size() - slash + 1);
-            break;
-        }
+        return indicators.NonCompliant("Expected '" + params.sysctlName + "' got '" + entry->value + "' found in: '" + entry->source + "'");
     }
 
-    if (found && invalid)
-    {
-        return indicators.NonCompliant("Expected '" + params.sysctlName + "' got '" + runSysctlValue + "' found in: '" + fileName + "'");
-    }
-    else
-    {
-        indicators.NonCompliant("Expected '" + params.sysctlName + "' not found in stored sysctl configuration");
-    }
+    indicators.NonCompliant("Expected '" + params.sysctlName + "' not found in stored sysctl configuration");
 
+    std::string line;
     auto ufwDefaults = context.GetFileContents("/etc/default/ufw");
     if (!ufwDefaults.HasValue())
     {
@@ -47,6 +47,12 @@ int MmiSet(MMI_HANDLE clientSession, const char* componentName, const char* obje
     return ComplianceEngineMmiSet(clientSession, componentName, objectName, payload, payloadSizeBytes);
 }
 
+// Payloads are copied by their size and parsed by the engine, the unparsed slice of the desired document serves the same
+int MmiSetRaw(MMI_HANDLE clientSession, const char* componentName, const char* objectName, const MMI_JSON_STRING payload, const int payloadSizeBytes)
+{
+    return ComplianceEngineMmiSet(clientSession, componentName, objectName, payload, payloadSizeBytes);
+}
+
 int MmiGet(MMI_HANDLE clientSession, const char* componentName, const char* objectName, MMI_JSON_STRING* payload, int* payloadSizeBytes)
 {
     return ComplianceEngineMmiGet(clientSession, componentName, objectName, payload, payloadSizeBytes);
@@ -33,12 +33,11 @@ static const char procModulesNegativeOutput[] =
     "curve25519_x86_64 36864 1 rotah, Live 0xffffffffc12f7000\n"
     "libcurve25519_generic 49152 2 rotah,curve25519_x86_64, Live 0xffffffffc12e6000\n";
 
-static const char modprobeCommand[] = "modprobe";
-static const char modprobeNothingOutput[] = "blacklist neofb\nalias net_pf_3 off\n";
-static const char modprobeBlacklistOutput[] = "blacklist usb_storage\nalias net_pf_3 off\n";
-static const char modprobeAliasOutput[] = "blacklist neofb\ninstall usb-storage /usr/bin/true\n";
-static const char modprobeBlockedOutput[] = "blacklist usb_storage\ninstall usb-storage /usr/bin/true\n";
-static const char modprobeBlockedOverlayOutput[] = "blacklist usb-storage_overlay\ninstall usb_storage_overlay /usr/bin/true\n";
+static const char modprobeNothingConfig[] = "blacklist neofb\nalias net_pf_3 off\n";
+static const char modprobeBlacklistConfig[] = "blacklist usb_storage\nalias net_pf_3 off\n";
+static const char modprobeAliasConfig[] = "blacklist neofb\ninstall usb-storage /usr/bin/true\n";
+static const char modprobeBlockedConfig[] = "blacklist usb_storage\ninstall usb-storage /usr/bin/true\n";
+static const char modprobeBlockedOverlayConfig[] = "blacklist usb-storage_overlay\ninstall usb_storage_overlay /usr/bin/true\n";
 
 class EnsureKernelModuleTest : public ::testing::Test
 {
@@ -49,6 +48,28 @@ protected:
     void SetUp() override
     {
         indicators.Push("EnsureKernelModule");
+
+        // Keep the host modprobe configuration out of the tests
+        const std::string root = mContext.GetTempdirPath() + "/modprobeRoot";
+        for (const auto& path : {"/etc/modprobe.d", "/run/modprobe.d", "/usr/local/lib/modprobe.d", "/usr/lib/modprobe.d", "/lib/modprobe.d", "/proc/cmdline",
+                 "/sbin/modprobe", "/usr/bin/modprobe", "/bin/modprobe"})
+        {
+            mContext.SetSpecialFilePath(path, root + path);
+        }
+        mContext.SetSpecialFilePath("/usr/sbin/modprobe", mContext.MakeTempfile(""));
+    }
+
+    void SetModprobeConfig(const std::string& content)
+    {
+        const std::string directory = mContext.GetTempdirPath() + "/modprobe.d";
+        ::mkdir(directory.c_str(), 0755);
+        std::ofstream(directory + "/test.conf") << content;
+        mContext.SetSpecialFilePath("/etc/modprobe.d", directory);
+    }
+
+    void SetModprobeUnavailable()
+    {
+        mContext.SetSpecialFilePath("/usr/sbin/modprobe", mContext.GetTempdirPath() + "/missing");
     }
 
     void TearDown() override
@@ -97,8 +118,8 @@ TEST_F(EnsureKernelModuleTest, FailedLsmodExecution)
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath)))
         .WillRepeatedly(::testing::Return(Result<std::string>(Error("Failed to read /proc/modules", -1))));
 
-    // Set up the expectation for the modprobe command
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    // Set up the modprobe configuration
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -108,16 +129,15 @@ TEST_F(EnsureKernelModuleTest, FailedLsmodExecution)
     ASSERT_EQ(result.Error().message, "Failed to read /proc/modules");
 }
 
-TEST_F(EnsureKernelModuleTest, FailedModprobeExecution)
+TEST_F(EnsureKernelModuleTest, ModprobeNotAvailable)
 {
     CreateModulesTree(mContext, {"usb-storage.ko"});
 
     // Set up the expectation for the /proc/modules read to succeed
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-    // Set up the expectation for the modprobe command to fail
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand)))
-        .WillRepeatedly(::testing::Return(Result<std::string>(Error("Failed to execute modprobe", -1))));
+    // modprobe is not installed
+    SetModprobeUnavailable();
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -134,8 +154,8 @@ TEST_F(EnsureKernelModuleTest, ModuleNotFoundInFilesystem)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesPositiveOutput)));
 
-    // Set up the expectation for the modprobe command
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    // Set up the modprobe configuration
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -152,8 +172,8 @@ TEST_F(EnsureKernelModuleTest, ModuleFoundInProcModules)
     // Set up the expectation for the proc modules read showing the module is loaded
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesPositiveOutput)));
 
-    // Set up the expectation for the modprobe command
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    // Set up the modprobe configuration
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -170,8 +190,8 @@ TEST_F(EnsureKernelModuleTest, NoAlias)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesPositiveOutput)));
 
-    // Set up the expectation for the modprobe command with blacklist output
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlacklistOutput)));
+    // Set up the modprobe configuration with blacklist entry
+    SetModprobeConfig(modprobeBlacklistConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -188,8 +208,8 @@ TEST_F(EnsureKernelModuleTest, NoBlacklist)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-    // Set up the expectation for the modprobe command with alias output
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeAliasOutput)));
+    // Set up the modprobe configuration with install entry
+    SetModprobeConfig(modprobeAliasConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -206,8 +226,8 @@ TEST_F(EnsureKernelModuleTest, ModuleBlocked)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-    // Set up the expectation for the modprobe command with blocked output
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlockedOutput)));
+    // Set up the modprobe configuration with blocked entries
+    SetModprobeConfig(modprobeBlockedConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -224,8 +244,8 @@ TEST_F(EnsureKernelModuleTest, OverlayedModuleNotBlocked)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-    // Set up the expectation for the modprobe command with blocked output
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlockedOutput)));
+    // Set up the modprobe configuration with blocked entries
+    SetModprobeConfig(modprobeBlockedConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -242,8 +262,8 @@ TEST_F(EnsureKernelModuleTest, OverlayedModuleBlocked)
     // Set up the expectation for the proc modules read
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-    // Set up the expectation for the modprobe command with blocked overlay output
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlockedOverlayOutput)));
+    // Set up the modprobe configuration with blocked overlay entries
+    SetModprobeConfig(modprobeBlockedOverlayConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -259,7 +279,7 @@ TEST_F(EnsureKernelModuleTest, DashModuleNameMatchesUnderscoreFilename)
     CreateModulesTree(mContext, {"firewire_core.ko"});
 
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "firewire-core";
@@ -276,7 +296,7 @@ TEST_F(EnsureKernelModuleTest, DashModuleNameNoMatchWhenFilenameIsDifferent)
     CreateModulesTree(mContext, {"usb_storage.ko"});
 
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "firewire-core";
@@ -293,7 +313,7 @@ TEST_F(EnsureKernelModuleTest, DashOverlayModuleMatchesUnderscoreFilename)
     CreateModulesTree(mContext, {"firewire_core_overlay.ko"});
 
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "firewire-core";
@@ -310,7 +330,7 @@ TEST_F(EnsureKernelModuleTest, UnderscoreModuleNameStillMatchesUnderscoreFilenam
     CreateModulesTree(mContext, {"usb_storage.ko"});
 
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "usb-storage";
@@ -326,7 +346,7 @@ TEST_F(EnsureKernelModuleTest, ExactDashFilenameStillMatches)
     CreateModulesTree(mContext, {"firewire-core.ko"});
 
     EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
-    EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
 
     KernelModuleUnavailableParams params;
     params.moduleName = "firewire-core";
@@ -335,3 +355,102 @@ TEST_F(EnsureKernelModuleTest, ExactDashFilenameStillMatches)
     ASSERT_TRUE(result.HasValue());
     ASSERT_EQ(result.Value(), Status::NonCompliant);
 }
+
+// Helper to create a fake /lib/modules tree indexed by modules.dep only
+static void CreateModulesDep(MockContext& ctx, const std::string& contents)
+{
+    std::string root = ctx.GetTempdirPath() + "/modulesDepRoot";
+    std::string versionDir = root + "/6.8.test";
+    ASSERT_EQ(0, ::mkdir(root.c_str(), 0755));
+    ASSERT_EQ(0, ::mkdir(versionDir.c_str(), 0755));
+    std::ofstream(versionDir + "/modules.dep") << contents;
+    ctx.SetSpecialFilePath("/lib/modules", root);
+}
+
+TEST_F(EnsureKernelModuleTest, ModuleFoundInModulesDep)
+{
+    CreateModulesDep(mContext,
+        "kernel/fs/cramfs/cramfs.ko.zst:\n"
+        "kernel/drivers/usb/storage/usb-storage.ko.xz: kernel/drivers/usb/common/usb-common.ko.xz\n");
+
+    EXPECT_CALL(mContext, ExecuteCommand(::testing::_)).Times(0);
+    EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
+    SetModprobeConfig(modprobeNothingConfig);
+
+    KernelModuleUnavailableParams params;
+    params.moduleName = "usb_storage";
+    auto result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+
+    params.moduleName = "squashfs";
+    result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(EnsureKernelModuleTest, ModuleBlockedAcrossFilesAndContinuationLines)
+{
+    CreateModulesDep(mContext, "kernel/fs/cramfs/cramfs.ko:\n");
+
+    EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
+    SetModprobeConfig("# disable cramfs\nblacklist cramfs\n");
+    const std::string directory = mContext.GetTempdirPath() + "/usrlibmodprobe.d";
+    ASSERT_EQ(0, ::mkdir(directory.c_str(), 0755));
+    std::ofstream(directory + "/cramfs.conf") << "install cramfs \\\n    /bin/false\n";
+    mContext.SetSpecialFilePath("/usr/lib/modprobe.d", directory);
+
+    KernelModuleUnavailableParams params;
+    params.moduleName = "cramfs";
+    auto result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(EnsureKernelModuleTest, HigherPriorityModprobeFileOverridesSameBasename)
+{
+    CreateModulesDep(mContext, "kernel/fs/cramfs/cramfs.ko:\n");
+
+    EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
+    // /etc/modprobe.d/test.conf replaces /usr/lib/modprobe.d/test.conf
+    SetModprobeConfig(modprobeNothingConfig);
+    const std::string directory = mContext.GetTempdirPath() + "/usrlibmodprobe.d";
+    ASSERT_EQ(0, ::mkdir(directory.c_str(), 0755));
+    std::ofstream(directory + "/test.conf") << "blacklist cramfs\ninstall cramfs /bin/true\n";
+    mContext.SetSpecialFilePath("/usr/lib/modprobe.d", directory);
+
+    KernelModuleUnavailableParams params;
+    params.moduleName = "cramfs";
+    auto result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
+
+TEST_F(EnsureKernelModuleTest, KernelCommandLineBlacklist)
+{
+    CreateModulesDep(mContext, "kernel/fs/cramfs/cramfs.ko:\n");
+
+    EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
+    SetModprobeConfig("install cramfs /bin/true\n");
+    mContext.SetSpecialFilePath("/proc/cmdline", mContext.MakeTempfile("BOOT_IMAGE=/vmlinuz ro modprobe.blacklist=udf,cramfs quiet\n"));
+
+    KernelModuleUnavailableParams params;
+    params.moduleName = "cramfs";
+    auto result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(EnsureKernelModuleTest, InstallCommandMustMatchWholeWord)
+{
+    CreateModulesDep(mContext, "kernel/fs/cramfs/cramfs.ko:\n");
+
+    EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
+    SetModprobeConfig("blacklist cramfs\ninstall cramfs /bin/true_wrapper\n");
+
+    KernelModuleUnavailableParams params;
+    params.moduleName = "cramfs";
+    auto result = AuditKernelModuleUnavailable(params, indicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
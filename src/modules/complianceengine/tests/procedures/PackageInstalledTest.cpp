@@ -4,6 +4,7 @@
 #include "CommonUtils.h"
 #include "MockContext.h"
 
+#include <PackageCache.h>
 #include <PackageInstalled.h>
 #include <dirent.h>
 #include <fstream>
@@ -16,9 +17,13 @@ using ComplianceEngine::AuditPackageInstalled;
 using ComplianceEngine::CompactListFormatter;
 using ComplianceEngine::Error;
 using ComplianceEngine::IndicatorsTree;
+using ComplianceEngine::LoadPackageCache;
+using ComplianceEngine::Optional;
+using ComplianceEngine::PackageCache;
 using ComplianceEngine::PackageInstalledParams;
 using ComplianceEngine::PackageManagerType;
 using ComplianceEngine::Result;
+using ComplianceEngine::SavePackageCache;
 using ComplianceEngine::Status;
 
 using testing::HasSubstr;
@@ -70,6 +75,8 @@ protected:
     char dirTemplate[PATH_MAX] = "/tmp/packageCacheTest.XXXXXX";
     std::string dir;
     std::string cacheFile;
+    std::string dpkgStatusFile;
+    std::string rpmDatabase;
     MockContext mContext;
     CompactListFormatter mFormatter;
     IndicatorsTree mIndicators;
@@ -81,6 +88,12 @@ protected:
         dir = tempDir;
         cacheFile = dir + "/packageCache";
         mIndicators.Push("PackageInstalled");
+
+        // Unless a test provides them, the package databases are missing and the package manager commands are used
+        dpkgStatusFile = mContext.GetTempdirPath() + "/dpkg-status";
+        rpmDatabase = mContext.GetTempdirPath() + "/rpm";
+        mContext.SetSpecialFilePath("/var/lib/dpkg/status", dpkgStatusFile);
+        mContext.SetSpecialFilePath("/var/lib/rpm", rpmDatabase);
     }
 
     void TearDown() override
@@ -88,16 +101,25 @@ protected:
         rmdir(dir.c_str());
     }
 
-    void CreateCacheFile(const std::string& packageManager, time_t timestamp, const std::vector<std::pair<std::string, std::string>>& packages)
+    void CreateCacheFile(const std::string& packageManager, time_t timestamp, const std::vector<std::pair<std::string, std::string>>& packages,
+        const std::string& databaseStamp = "")
     {
-        std::ofstream cache(cacheFile);
-        ASSERT_TRUE(cache.is_open());
-        cache << "# PackageCache " << packageManager << "@" << timestamp << std::endl;
+        PackageCache cache;
+        cache.packageManager = (packageManager == "dpkg") ? PackageManagerType::DPKG : PackageManagerType::RPM;
+        cache.lastUpdateTime = timestamp;
+        cache.databaseStamp = databaseStamp;
         for (const auto& pkg : packages)
         {
-            cache << pkg.first << " " << pkg.second << std::endl;
+            cache.packages[pkg.first] = pkg.second;
         }
-        cache.close();
+        ASSERT_TRUE(SavePackageCache(cache, cacheFile).HasValue());
+    }
+
+    void WriteFile(const std::string& path, const std::string& content)
+    {
+        std::ofstream file(path);
+        ASSERT_TRUE(file.is_open());
+        file << content;
     }
 };
 
@@ -703,3 +725,129 @@ TEST_F(PackageInstalledTest, MixedEpochAndNoEpochComparison_Rpm)
     ASSERT_TRUE(result.HasValue());
     ASSERT_EQ(result.Value(), Status::Compliant);
 }
+
+static const std::string dpkgStatusWithPackage =
+    "Package: package1\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Version: 1.2.3-4\n"
+    "\n"
+    "Package: removed-package\n"
+    "Status: deinstall ok config-files\n"
+    "Architecture: amd64\n"
+    "Version: 1.0.0-1\n"
+    "\n"
+    "Package: held-package\n"
+    "Status: hold ok installed\n"
+    "Architecture: amd64\n"
+    "Version: 2.0.0-1\n"
+    "\n"
+    "Package: sample-package\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Version: 3.1.4-2\n"
+    "Description: Sample package description\n"
+    " spanning multiple lines\n";
+
+TEST_F(PackageInstalledTest, DpkgStatusReadNatively)
+{
+    WriteFile(dpkgStatusFile, dpkgStatusWithPackage);
+    EXPECT_CALL(mContext, ExecuteCommand(HasSubstr(dpkgCommand))).Times(0);
+
+    PackageInstalledParams params;
+    params.packageName = "sample-package";
+    params.packageManager = PackageManagerType::DPKG;
+    params.minPackageVersion = "3.1.4-1";
+    mContext.SetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache", cacheFile);
+
+    auto result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    params.packageName = "removed-package";
+    params.minPackageVersion = Optional<std::string>();
+    result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+
+    // As with dpkg -l, only 'ii' counts as installed
+    params.packageName = "held-package";
+    result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
+
+TEST_F(PackageInstalledTest, CacheSavedInBinaryFormat)
+{
+    WriteFile(dpkgStatusFile, dpkgStatusWithPackage);
+
+    PackageInstalledParams params;
+    params.packageName = "package1";
+    params.packageManager = PackageManagerType::DPKG;
+    mContext.SetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache", cacheFile);
+
+    auto result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    auto cache = LoadPackageCache(cacheFile);
+    ASSERT_TRUE(cache.HasValue());
+    EXPECT_EQ(cache.Value().packageManager, PackageManagerType::DPKG);
+    EXPECT_EQ(cache.Value().databaseStamp, ComplianceEngine::GetPackageDatabaseStamp(PackageManagerType::DPKG, mContext));
+    ASSERT_EQ(cache.Value().packages.size(), 2u);
+    EXPECT_EQ(cache.Value().packages.at("package1"), "1.2.3-4");
+    EXPECT_EQ(cache.Value().packages.at("sample-package"), "3.1.4-2");
+}
+
+TEST_F(PackageInstalledTest, CacheUsedRegardlessOfAgeWhileDatabaseUnchanged)
+{
+    ASSERT_EQ(0, mkdir(rpmDatabase.c_str(), 0755));
+    WriteFile(rpmDatabase + "/rpmdb.sqlite", "database");
+    auto stamp = ComplianceEngine::GetPackageDatabaseStamp(PackageManagerType::RPM, mContext);
+    ASSERT_FALSE(stamp.empty());
+
+    time_t veryStaleTime = time(nullptr) - 13000; // Over PACKAGELIST_STALE_TTL (12600)
+    CreateCacheFile("rpm", veryStaleTime, {{"sample-package", "3.1.4-5"}}, stamp);
+    EXPECT_CALL(mContext, ExecuteCommand(HasSubstr(rpmCommand))).Times(0);
+
+    PackageInstalledParams params;
+    params.packageName = "sample-package";
+    params.packageManager = PackageManagerType::RPM;
+    mContext.SetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache", cacheFile);
+
+    auto result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(PackageInstalledTest, CacheInvalidatedByDatabaseChange)
+{
+    ASSERT_EQ(0, mkdir(rpmDatabase.c_str(), 0755));
+    WriteFile(rpmDatabase + "/rpmdb.sqlite", "database");
+
+    EXPECT_CALL(mContext, ExecuteCommand(HasSubstr(rpmCommand)))
+        .WillOnce(Return(Result<std::string>(rpmWithoutPackageOutput)))
+        .WillOnce(Return(Result<std::string>(rpmWithPackageOutput)));
+
+    PackageInstalledParams params;
+    params.packageName = "sample-package";
+    params.packageManager = PackageManagerType::RPM;
+    mContext.SetSpecialFilePath("/var/lib/GuestConfig/ComplianceEnginePackageCache", cacheFile);
+
+    auto result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+
+    // Unchanged database, rpm is not executed again
+    params.packageName = "package1";
+    result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    // Installing a package changes the database
+    WriteFile(rpmDatabase + "/rpmdb.sqlite", "database with sample-package");
+    params.packageName = "sample-package";
+    result = AuditPackageInstalled(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
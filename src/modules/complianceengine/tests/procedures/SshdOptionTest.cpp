@@ -66,10 +66,14 @@ protected:
     MockContext mContext;
     IndicatorsTree mIndicators;
     CompactListFormatter mFormatter;
+    std::string mSshdConfig;
 
     void SetUp() override
     {
         mIndicators.Push("EnsureSshdOption");
+        // Each test gets its own sshd_config so that sshd -T snapshots cached by other tests are not reused
+        mSshdConfig = mContext.MakeTempfile("Port 22\n");
+        mContext.SetSpecialFilePath("/etc/ssh/sshd_config", mSshdConfig);
     }
 };
 
@@ -846,3 +850,62 @@ TEST_F(EnsureSshdOptionTest, CaseInsensitive_NotMatchOp_UpperCaseNonMatchingPatt
     ASSERT_TRUE(result.HasValue());
     ASSERT_EQ(result.Value(), Status::Compliant);
 }
+
+TEST_F(EnsureSshdOptionTest, SnapshotReusedAcrossRules)
+{
+    EXPECT_CALL(mContext, ExecuteCommand(sshdInitialCommand)).WillOnce(Return(Result<std::string>(sshdWithMatchGroupOutput)));
+    EXPECT_CALL(mContext, ExecuteCommand(hostnameCommand)).WillOnce(Return(Result<std::string>("testhost\n")));
+    EXPECT_CALL(mContext, ExecuteCommand(hostAddressCommand)).WillOnce(Return(Result<std::string>("1.2.3.4\n")));
+    EXPECT_CALL(mContext, ExecuteCommand(sshdComplexCommand)).WillOnce(Return(Result<std::string>(sshdWithMatchGroupOutput)));
+
+    SshdOptionParams params;
+    params.option = {{"permitrootlogin"}};
+    params.value = "no";
+    auto result = AuditSshdOption(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    params.option = {{"MaxAuthTries"}};
+    params.value = "4";
+    result = AuditSshdOption(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(EnsureSshdOptionTest, SnapshotInvalidatedByIncludedFileChange)
+{
+    const std::string includeDir = mContext.GetTempdirPath() + "/sshd_config.d";
+    ASSERT_EQ(0, ::mkdir(includeDir.c_str(), 0755));
+    {
+        std::ofstream config(mSshdConfig);
+        config << "Include " << includeDir << "/*.conf\n";
+    }
+
+    EXPECT_CALL(mContext, ExecuteCommand(sshdInitialCommand))
+        .WillOnce(Return(Result<std::string>(sshdWithoutMatchGroupOutput)))
+        .WillOnce(Return(Result<std::string>("permitrootlogin yes\n")));
+    EXPECT_CALL(mContext, ExecuteCommand(sshdSimpleCommand))
+        .WillOnce(Return(Result<std::string>(sshdWithoutMatchGroupOutput)))
+        .WillOnce(Return(Result<std::string>("permitrootlogin yes\n")));
+
+    SshdOptionParams params;
+    params.option = {{"permitrootlogin"}};
+    params.value = "no";
+    auto result = AuditSshdOption(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    // Unchanged configuration, the snapshot is reused
+    result = AuditSshdOption(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    {
+        std::ofstream include(includeDir + "/50-root.conf");
+        include << "PermitRootLogin yes\n";
+    }
+
+    result = AuditSshdOption(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
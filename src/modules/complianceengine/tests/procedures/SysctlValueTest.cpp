@@ -10,6 +10,7 @@
 #include <fstream>
 #include <gtest/gtest.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <string>
 #include <unistd.h>
 #include <vector>
@@ -24,10 +25,7 @@ using ComplianceEngine::Status;
 using ComplianceEngine::SysctlValueParams;
 using ::testing::Return;
 
-static const std::string systemdSysctlCat = "/lib/systemd/systemd-sysctl --cat-config";
-static const std::string systemdSysctlVersion = "/lib/systemd/systemd-sysctl --version";
-static const std::string systemdUsrSysctlCat = "/usr/lib/systemd/systemd-sysctl --cat-config";
-static const std::string systemdUsrSysctlVersion = "/usr/lib/systemd/systemd-sysctl --version";
+static const std::string sysctlTestConf = "/etc/sysctl.d/99-test.conf";
 static const std::string sysctlIpForward0 = "net.ipv4.ip_forward = 0";
 static const std::string sysctlIpForward1 = "net.ipv4.ip_forward = 1";
 static const std::string sysctlIpForward0Comment = "                          # net.ipv4.ip_forward = 0";
@@ -41,13 +39,16 @@ struct SysctlNameValue
           value(a_value)
     {
     }
-    std::string CfgOutput() const
+    std::string CfgFileName() const
     {
         auto fname = name;
-        std::replace(fname.begin(), fname.end(), '.', '/');
-        fname = std::string("# /etc/") + fname + ".conf\n";
-        auto nameEqVal = name + " = " + value + "\n";
-        return fname + nameEqVal;
+        std::replace(fname.begin(), fname.end(), '.', '_');
+        std::replace(fname.begin(), fname.end(), '/', '_');
+        return std::string("/etc/sysctl.d/") + fname + ".conf";
+    }
+    std::string CfgOutput() const
+    {
+        return name + " = " + value + "\n";
     }
 };
 
@@ -104,16 +105,6 @@ static const char sysctlIpForward0FilenameTabs[] =
     " \t net.ipv4.ip_forward    =\t0\t     \n"
     "     \n";
 
-static const char sysctlIpForward1Then0Than1Than0WithFilenames[] =
-    "# /etc/sysctl.d/fwd_1.conf\n"
-    "   net.ipv4.ip_forward = 1\n"
-    "# /etc/sysctl.d/fwd_0.conf\n"
-    "   net.ipv4.ip_forward = 0\n"
-    "# /etc/sysctl.d/fwd_1_v2.conf\n"
-    "   net.ipv4.ip_forward = 1\n"
-    "# /etc/sysctl.d/fwd_0_v2.conf\n"
-    "   net.ipv4.ip_forward = 0\n";
-
 class SysctlValueTest : public ::testing::Test
 {
     struct LengthComparator
@@ -136,6 +127,47 @@ protected:
     void SetUp() override
     {
         mIndicators.Push("SysctlValue");
+
+        // Redirect all sysctl configuration locations into the temporary directory
+        const std::string root = mContext.GetTempdirPath() + "/sysctl";
+        for (const auto& dir : {"/etc/sysctl.d", "/run/sysctl.d", "/usr/local/lib/sysctl.d", "/usr/lib/sysctl.d", "/lib/sysctl.d"})
+        {
+            MakeDirectories(root + dir);
+            mContext.SetSpecialFilePath(dir, root + dir);
+        }
+        mContext.SetSpecialFilePath("/etc/sysctl.conf", root + "/etc/sysctl.conf");
+    }
+
+    static void MakeDirectories(const std::string& path)
+    {
+        for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        {
+            ::mkdir(path.substr(0, pos).c_str(), 0755);
+        }
+        ::mkdir(path.c_str(), 0755);
+    }
+
+    std::string ConfigPath(const std::string& path) const
+    {
+        auto special = mContext.GetSpecialFilePath(path);
+        if (special != path)
+        {
+            return special;
+        }
+
+        auto slash = path.rfind('/');
+        return mContext.GetSpecialFilePath(path.substr(0, slash)) + path.substr(slash);
+    }
+
+    void WriteConfig(const std::string& path, const std::string& content)
+    {
+        std::ofstream file(ConfigPath(path));
+        file << content;
+    }
+
+    void MaskConfig(const std::string& path)
+    {
+        ASSERT_EQ(0, symlink("/dev/null", ConfigPath(path).c_str()));
     }
 };
 
@@ -145,8 +177,7 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueEqualConfigurationNoOverride)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0)));
+    WriteConfig(sysctlTestConf, sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("0").Value();
@@ -156,15 +187,13 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueEqualConfigurationNoOverride)
     ASSERT_EQ(result.Value(), Status::Compliant);
 }
 
-TEST_F(SysctlValueTest, HappyPathAlternativeSystemdSysctlLocation)
+TEST_F(SysctlValueTest, HappyPathSysctlValueInUsrLibSysctlDirectory)
 {
     auto sysctlName = std::string("net.ipv4.ip_forward");
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Error("Missing")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdUsrSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdUsrSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0)));
+    WriteConfig("/usr/lib/sysctl.d/99-test.conf", sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("0").Value();
@@ -180,8 +209,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueConfigurationEqualEmptyOuput)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>(Error("No such file or directory", -1))));
     SysctlValueParams params;
     params.sysctlName = sysctlName;
@@ -198,8 +226,7 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueEqualConfigurationOverrideLastOneWin
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward1Then0Than1Than0)));
+    WriteConfig(sysctlTestConf, sysctlIpForward1Then0Than1Than0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("0").Value();
@@ -215,8 +242,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueEqualConfigurationComment)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0Comment)));
+    WriteConfig(sysctlTestConf, sysctlIpForward0Comment);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>(Error("No such file or directory", -1))));
     SysctlValueParams params;
     params.sysctlName = sysctlName;
@@ -233,8 +259,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueNotEqual)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward1)));
+    WriteConfig(sysctlTestConf, sysctlIpForward1);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("0").Value();
@@ -250,8 +275,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueEqualConfiruationOverride)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward1)));
+    WriteConfig(sysctlTestConf, sysctlIpForward1);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("0").Value();
@@ -268,8 +292,7 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueRegexpDotEqualConfiruationNoOverride
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0)));
+    WriteConfig(sysctlTestConf, sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make(".").Value();
@@ -285,8 +308,7 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueRegexpRangeEqualConfiruationNoOverri
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0)));
+    WriteConfig(sysctlTestConf, sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("[0]").Value();
@@ -302,8 +324,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueRegexpRangeEqualConfiruationNoOver
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward1)));
+    WriteConfig(sysctlTestConf, sysctlIpForward1);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("[0]").Value();
@@ -319,8 +340,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueRegexpRangeNotEqual)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0)));
+    WriteConfig(sysctlTestConf, sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("[0]").Value();
@@ -336,8 +356,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueEqualConfiruationNotEqualTabs)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0FilenameTabs)));
+    WriteConfig("/etc/sysctl.d/foo.conf", sysctlIpForward0FilenameTabs);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("1").Value();
@@ -356,8 +375,7 @@ TEST_F(SysctlValueTest, UnHappyPathSysctlValueEqualConfiruationNotEqualExtraSpac
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward0FilenameExtraSpaces)));
+    WriteConfig("/etc/sysctl.d/foo.conf", sysctlIpForward0FilenameExtraSpaces);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("1").Value();
@@ -376,8 +394,10 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueEqualConfiruationOverrideLastOneWins
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(sysctlIpForward1Then0Than1Than0WithFilenames)));
+    WriteConfig("/etc/sysctl.d/10-fwd_1.conf", sysctlIpForward1);
+    WriteConfig("/run/sysctl.d/20-fwd_0.conf", sysctlIpForward0);
+    WriteConfig("/usr/lib/sysctl.d/30-fwd_1_v2.conf", sysctlIpForward1);
+    WriteConfig("/etc/sysctl.d/40-fwd_0_v2.conf", sysctlIpForward0);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make("1").Value();
@@ -388,7 +408,7 @@ TEST_F(SysctlValueTest, HappyPathSysctlValueEqualConfiruationOverrideLastOneWins
     ASSERT_EQ(result.Value(), Status::NonCompliant);
     ASSERT_EQ(mFormatter.Format(mIndicators).Value(),
         std::string("[Compliant] Correct value for 'net.ipv4.ip_forward' in runtime configuration\n[NonCompliant] Expected 'net.ipv4.ip_forward' got "
-                    "'0' found in: '/etc/sysctl.d/fwd_0_v2.conf'\n"));
+                    "'0' found in: '/etc/sysctl.d/40-fwd_0_v2.conf'\n"));
 }
 
 TEST_F(SysctlValueTest, HappyPathValidateCisSysctls)
@@ -402,8 +422,7 @@ TEST_F(SysctlValueTest, HappyPathValidateCisSysctls)
         auto sysctlSlashedName = sysctlName;
         std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
         EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>(value + "\n")));
-        EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-        EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(cfgOuput.c_str())));
+        WriteConfig(cisSsysctlNames[i].CfgFileName(), cfgOuput);
         SysctlValueParams params;
         params.sysctlName = sysctlName;
         params.value = Pattern::Make(value).Value();
@@ -427,8 +446,7 @@ TEST_F(SysctlValueTest, UnhappyPathSysctlMultilineOutput)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>(value + "\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(cfgOuput.c_str())));
+    WriteConfig(sysctlNameValue.CfgFileName(), cfgOuput);
     SysctlValueParams params;
     params.sysctlName = sysctlName;
     params.value = Pattern::Make(value).Value();
@@ -448,8 +466,7 @@ TEST_F(SysctlValueTest, UfwDefaultsFileMissing)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>(Error("No such file or directory", -1))));
 
     SysctlValueParams params;
@@ -467,8 +484,7 @@ TEST_F(SysctlValueTest, UfwDefaultsFileNoIptSysctl)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("# No IPT_SYSCTL here\nFOO=bar\n")));
 
     SysctlValueParams params;
@@ -486,8 +502,7 @@ TEST_F(SysctlValueTest, UfwSysctlFileMissing)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("IPT_SYSCTL=/tmp/ufw-sysctl.conf\n")));
     EXPECT_CALL(mContext, GetFileContents("/tmp/ufw-sysctl.conf")).WillRepeatedly(Return(Result<std::string>(Error("No such file or directory", -1))));
 
@@ -506,8 +521,7 @@ TEST_F(SysctlValueTest, UfwSysctlFileValueMatches)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("IPT_SYSCTL=/tmp/ufw-sysctl.conf\n")));
     EXPECT_CALL(mContext, GetFileContents("/tmp/ufw-sysctl.conf")).WillRepeatedly(Return(Result<std::string>("net/ipv4/ip_forward=1\n")));
 
@@ -526,8 +540,7 @@ TEST_F(SysctlValueTest, UfwSysctlFileValueDoesNotMatch)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("IPT_SYSCTL=/tmp/ufw-sysctl.conf\n")));
     EXPECT_CALL(mContext, GetFileContents("/tmp/ufw-sysctl.conf")).WillRepeatedly(Return(Result<std::string>("net/ipv4/ip_forward=0\n")));
 
@@ -609,8 +622,7 @@ TEST_F(SysctlValueTest, SecurityRejectsUfwSysctlFileWithPathTraversal)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     // Malicious IPT_SYSCTL value with path traversal
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("IPT_SYSCTL=/../../../etc/shadow\n")));
 
@@ -629,8 +641,7 @@ TEST_F(SysctlValueTest, SecurityRejectsUfwSysctlFileWithRelativePath)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("1\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>(emptyOutput)));
+    WriteConfig(sysctlTestConf, emptyOutput);
     // Relative path instead of absolute
     EXPECT_CALL(mContext, GetFileContents("/etc/default/ufw")).WillRepeatedly(Return(Result<std::string>("IPT_SYSCTL=etc/ufw/sysctl.conf\n")));
 
@@ -650,8 +661,7 @@ TEST_F(SysctlValueTest, SecurityAcceptsValidSysctlName)
     auto sysctlSlashedName = sysctlName;
     std::replace(sysctlSlashedName.begin(), sysctlSlashedName.end(), '.', '/');
     EXPECT_CALL(mContext, GetFileContents("/proc/sys/" + sysctlSlashedName)).WillRepeatedly(Return(Result<std::string>("0\n")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlVersion)).WillRepeatedly(Return(Result<std::string>("")));
-    EXPECT_CALL(mContext, ExecuteCommand(systemdSysctlCat)).WillRepeatedly(Return(Result<std::string>("net.ipv4.conf.eth-0.accept_redirects = 0")));
+    WriteConfig(sysctlTestConf, "net.ipv4.conf.eth-0.accept_redirects = 0");
 
     SysctlValueParams params;
     params.sysctlName = sysctlName;
@@ -661,3 +671,153 @@ TEST_F(SysctlValueTest, SecurityAcceptsValidSysctlName)
     ASSERT_TRUE(result.HasValue());
     ASSERT_EQ(result.Value(), Status::Compliant);
 }
+
+TEST_F(SysctlValueTest, StoredConfigurationDoesNotSpawnProcesses)
+{
+    EXPECT_CALL(mContext, ExecuteCommand(::testing::_)).Times(0);
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig(sysctlTestConf, sysctlIpForward0);
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    for (int i = 0; i < 40; i++)
+    {
+        auto result = AuditSysctlValue(params, mIndicators, mContext);
+        ASSERT_TRUE(result.HasValue());
+        ASSERT_EQ(result.Value(), Status::Compliant);
+    }
+}
+
+TEST_F(SysctlValueTest, HigherPriorityDirectoryOverridesSameBasename)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    // /etc/sysctl.d/50-fwd.conf replaces /usr/lib/sysctl.d/50-fwd.conf even though it would be applied earlier than 60-fwd.conf
+    WriteConfig("/usr/lib/sysctl.d/50-fwd.conf", sysctlIpForward1);
+    WriteConfig("/etc/sysctl.d/50-fwd.conf", sysctlIpForward0);
+    WriteConfig("/lib/sysctl.d/60-other.conf", "kernel.randomize_va_space = 2\n");
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(SysctlValueTest, LaterBasenameWinsAcrossDirectories)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig("/etc/sysctl.d/10-fwd.conf", sysctlIpForward0);
+    WriteConfig("/usr/lib/sysctl.d/90-fwd.conf", sysctlIpForward1);
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+    ASSERT_TRUE(mFormatter.Format(mIndicators).Value().find("found in: '/usr/lib/sysctl.d/90-fwd.conf'") != std::string::npos);
+}
+
+TEST_F(SysctlValueTest, MaskedFileIsIgnored)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig("/etc/sysctl.d/10-fwd.conf", sysctlIpForward0);
+    WriteConfig("/usr/lib/sysctl.d/90-fwd.conf", sysctlIpForward1);
+    MaskConfig("/etc/sysctl.d/90-fwd.conf");
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(SysctlValueTest, NonConfFilesAreIgnored)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig("/etc/sysctl.d/10-fwd.conf", sysctlIpForward0);
+    WriteConfig("/etc/sysctl.d/90-fwd.conf.bak", sysctlIpForward1);
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(SysctlValueTest, SysctlConfIsAppliedLast)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig("/etc/sysctl.d/99-fwd.conf", sysctlIpForward0);
+    WriteConfig("/etc/sysctl.conf", sysctlIpForward1);
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+    ASSERT_TRUE(mFormatter.Format(mIndicators).Value().find("found in: '/etc/sysctl.conf'") != std::string::npos);
+}
+
+TEST_F(SysctlValueTest, SlashedNotationAndIgnoreFailurePrefix)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig(sysctlTestConf, "-net/ipv4/ip_forward = 0\n");
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(SysctlValueTest, GlobKeyMatches)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/conf/eth0/rp_filter")).WillRepeatedly(Return(Result<std::string>("1\n")));
+    WriteConfig(sysctlTestConf, "net.ipv4.conf.*.rp_filter = 1\n");
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.conf.eth0.rp_filter";
+    params.value = Pattern::Make("1").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+}
+
+TEST_F(SysctlValueTest, ExplicitKeyOverridesGlob)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/conf/eth0/rp_filter")).WillRepeatedly(Return(Result<std::string>("1\n")));
+    WriteConfig("/etc/sysctl.d/10-eth0.conf", "net.ipv4.conf.eth0.rp_filter = 2\n");
+    WriteConfig("/etc/sysctl.d/20-all.conf", "net.ipv4.conf.*.rp_filter = 1\n");
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.conf.eth0.rp_filter";
+    params.value = Pattern::Make("1").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
+
+TEST_F(SysctlValueTest, ConfigurationChangeIsPickedUp)
+{
+    EXPECT_CALL(mContext, GetFileContents("/proc/sys/net/ipv4/ip_forward")).WillRepeatedly(Return(Result<std::string>("0\n")));
+    WriteConfig("/etc/sysctl.d/10-fwd.conf", sysctlIpForward0);
+    SysctlValueParams params;
+    params.sysctlName = "net.ipv4.ip_forward";
+    params.value = Pattern::Make("0").Value();
+
+    auto result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::Compliant);
+
+    WriteConfig("/run/sysctl.d/20-fwd.conf", sysctlIpForward1);
+    result = AuditSysctlValue(params, mIndicators, mContext);
+    ASSERT_TRUE(result.HasValue());
+    ASSERT_EQ(result.Value(), Status::NonCompliant);
+}
@@ -71,6 +71,23 @@ protected:
         sysDirs.insert(sysDir);
 
         mIndicators.Push("EnsureWirelessIsDisable");
+
+        // Keep the host modprobe configuration out of the tests
+        const std::string root = mContext.GetTempdirPath() + "/modprobeRoot";
+        for (const auto& path : {"/etc/modprobe.d", "/run/modprobe.d", "/usr/local/lib/modprobe.d", "/usr/lib/modprobe.d", "/lib/modprobe.d", "/proc/cmdline",
+                 "/sbin/modprobe", "/usr/bin/modprobe", "/bin/modprobe"})
+        {
+            mContext.SetSpecialFilePath(path, root + path);
+        }
+        mContext.SetSpecialFilePath("/usr/sbin/modprobe", mContext.MakeTempfile(""));
+    }
+
+    void SetModprobeConfig(const std::string& content)
+    {
+        const std::string directory = mContext.GetTempdirPath() + "/modprobe.d";
+        ::mkdir(directory.c_str(), 0755);
+        std::ofstream(directory + "/test.conf") << content;
+        mContext.SetSpecialFilePath("/etc/modprobe.d", directory);
     }
 
     void CreateSysFile(std::string fileName, std::string data)
@@ -176,25 +193,24 @@ static const char procModulesNegativeOutput[] =
     "curve25519_x86_64 36864 1 rotah, Live 0xffffffffc12f7000\n"
     "libcurve25519_generic 49152 2 rotah,curve25519_x86_64, Live 0xffffffffc12e6000\n";
 
-static const char modprobeCommand[] = "modprobe";
-static const char modprobeNothingOutput[] = "blacklist neofb\nalias net_pf_3 off\n";
-static const char modprobeBlacklistOutput[] = "blacklist iwlwifi\nalias net_pf_3 off\n";
-static const char modprobeBlockedOutput[] = "blacklist iwlwifi\ninstall iwlwifi /usr/bin/true\n";
+static const char modprobeNothingConfig[] = "blacklist neofb\nalias net_pf_3 off\n";
+static const char modprobeBlacklistConfig[] = "blacklist iwlwifi\nalias net_pf_3 off\n";
+static const char modprobeBlockedConfig[] = "blacklist iwlwifi\ninstall iwlwifi /usr/bin/true\n";
 
 TEST_F(EnsureWirelessIsDisabledTest, HappyPathTest)
 {
     mContext.SetSpecialFilePath("/sys/class/net", sysDir);
     CreateWirelessDevice("wlp2s0", "iwlwifi");
     UNUSED(procModulesPositiveOutput);
-    UNUSED(modprobeNothingOutput);
+    UNUSED(modprobeNothingConfig);
 
     // Prime IsModuleBlocked
     {
         // Setup the expectation for the proc modules read
         EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-        // Setup the expectation for the modprobe command
-        EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlockedOutput)));
+        // Set up the modprobe configuration
+        SetModprobeConfig(modprobeBlockedConfig);
     }
 
     auto result = AuditWirelessDisabled(mIndicators, mContext);
@@ -213,8 +229,8 @@ TEST_F(EnsureWirelessIsDisabledTest, UnhappyPathModuleLoaded)
         // Setup the expectation for the proc modules read
         EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesPositiveOutput)));
 
-        // Setup the expectation for the modprobe command
-        EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+        // Set up the modprobe configuration
+        SetModprobeConfig(modprobeNothingConfig);
     }
 
     auto result = AuditWirelessDisabled(mIndicators, mContext);
@@ -233,8 +249,8 @@ TEST_F(EnsureWirelessIsDisabledTest, UnhappyPathModuleNotLoadedNotBlocked)
         // Setup the expectation for the proc modules read
         EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-        // Setup the expectation for the modprobe command
-        EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeNothingOutput)));
+        // Set up the modprobe configuration
+        SetModprobeConfig(modprobeNothingConfig);
     }
 
     auto result = AuditWirelessDisabled(mIndicators, mContext);
@@ -253,8 +269,8 @@ TEST_F(EnsureWirelessIsDisabledTest, UnhappyPathModuleNotLoadedNotBlockedonlyBla
         // Setup the expectation for the proc modules read
         EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-        // Setup the expectation for the modprobe command
-        EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlacklistOutput)));
+        // Set up the modprobe configuration
+        SetModprobeConfig(modprobeBlacklistConfig);
     }
 
     auto result = AuditWirelessDisabled(mIndicators, mContext);
@@ -275,8 +291,8 @@ TEST_F(EnsureWirelessIsDisabledTest, UnhappyPathOnlyOneDriverIsBlocked)
         // Setup the expectation for the proc modules read
         EXPECT_CALL(mContext, GetFileContents(::testing::StrEq(procModulesPath))).WillRepeatedly(::testing::Return(Result<std::string>(procModulesNegativeOutput)));
 
-        // Setup the expectation for the modprobe command
-        EXPECT_CALL(mContext, ExecuteCommand(::testing::HasSubstr(modprobeCommand))).WillRepeatedly(::testing::Return(Result<std::string>(modprobeBlockedOutput)));
+        // Set up the modprobe configuration
+        SetModprobeConfig(modprobeBlockedConfig);
     }
 
     auto result = AuditWirelessDisabled(mIndicators, mContext);
@@ -39,6 +39,15 @@ int MmiGet(
     int* payloadSizeBytes);
 void MmiFree(MMI_JSON_STRING payload);
 
+// Optional, used instead of MmiSet when the module info has "RawPayloads": true. The payload is the value exactly as it
+// appears in the desired document (not re-serialized, may contain whitespace) and only payloadSizeBytes of it may be read.
+int MmiSetRaw(
+    MMI_HANDLE clientSession,
+    const char* componentName,
+    const char* objectName,
+    const MMI_JSON_STRING payload,
+    const int payloadSizeBytes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,672 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <Netlink.h>
+
+static const size_t g_netlinkBufferSize = 32768;
+static const time_t g_netlinkTimeoutSeconds = 5;
+
+static const char* g_sysClassNet = "/sys/class/net/";
+static const char* g_wireless = "/wireless";
+static const char* g_wlan = "wlan";
+static const char* g_ether = "ether";
+
+static const char* g_resolvedServers = "SERVERS";
+static const char* g_networkdDns = "DNS";
+static const char* g_resolvedDns = "DNS";
+static const char* g_dropInDirectorySuffix = ".d";
+static const char* g_confExtension = ".conf";
+
+// Indexed by IF_OPER_*, the names 'ip addr' prints after 'state'
+static const char* g_operationalStates[] = {"UNKNOWN", "NOTPRESENT", "DOWN", "LOWERLAYERDOWN", "TESTING", "DORMANT", "UP"};
+
+// Walks the rtnetlink attributes in data and calls visitor(type, payload, payloadLength) for each well formed one
+template <typename Visitor>
+static void ForEachAttribute(const char* data, size_t length, Visitor visitor)
+{
+    size_t offset = 0;
+    while (offset + sizeof(struct rtattr) <= length)
+    {
+        const struct rtattr* attribute = reinterpret_cast<const struct rtattr*>(data + offset);
+        if ((attribute->rta_len < sizeof(struct rtattr)) || (attribute->rta_len > length - offset))
+        {
+            break;
+        }
+
+        visitor(attribute->rta_type, data + offset + RTA_LENGTH(0), attribute->rta_len - RTA_LENGTH(0));
+        offset += RTA_ALIGN(attribute->rta_len);
+    }
+}
+
+static uint32_t ReadUint32(const char* data)
+{
+    uint32_t value = 0;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static std::string FormatHardwareAddress(const char* address, size_t length)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string result;
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char byte = static_cast<unsigned char>(address[i]);
+        if (i > 0)
+        {
+            result += ':';
+        }
+        result += hexDigits[byte >> 4];
+        result += hexDigits[byte & 0x0F];
+    }
+
+    return result;
+}
+
+static std::string FormatIpAddress(unsigned char family, const char* address, size_t length)
+{
+    char buffer[INET6_ADDRSTRLEN] = {0};
+    size_t expectedLength = (AF_INET == family) ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+    if ((nullptr == address) || (length < expectedLength) || (nullptr == inet_ntop(family, address, buffer, sizeof(buffer))))
+    {
+        return std::string();
+    }
+
+    return std::string(buffer);
+}
+
+// Same names networkctl reports for links that are not of a specific kind
+static std::string GetLinkTypeName(unsigned short type)
+{
+    switch (type)
+    {
+        case ARPHRD_ETHER:
+            return g_ether;
+        case ARPHRD_LOOPBACK:
+            return "loopback";
+        case ARPHRD_NONE:
+            return "none";
+        case ARPHRD_INFINIBAND:
+            return "infiniband";
+        case ARPHRD_PPP:
+            return "ppp";
+        case ARPHRD_TUNNEL:
+            return "ipip";
+        case ARPHRD_TUNNEL6:
+            return "tunnel6";
+        case ARPHRD_SIT:
+            return "sit";
+        case ARPHRD_IPGRE:
+            return "gre";
+        default:
+            return std::string();
+    }
+}
+
+static void ParseLinkMessage(const struct nlmsghdr* header, NetworkInterfaceMap& interfaces)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+    {
+        return;
+    }
+
+    const struct ifinfomsg* link = reinterpret_cast<const struct ifinfomsg*>(NLMSG_DATA(header));
+    NetworkInterface& networkInterface = interfaces[link->ifi_index];
+    networkInterface.connected = (0 != (link->ifi_flags & IFF_LOWER_UP));
+    networkInterface.operationalState = g_operationalStates[IF_OPER_UNKNOWN];
+
+    std::string kind;
+    const char* attributes = reinterpret_cast<const char*>(NLMSG_DATA(header)) + NLMSG_ALIGN(sizeof(struct ifinfomsg));
+    ForEachAttribute(attributes, header->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct ifinfomsg))), [&](unsigned short type, const char* data, size_t length)
+    {
+        switch (type)
+        {
+            case IFLA_IFNAME:
+                networkInterface.name = std::string(data, strnlen(data, length));
+                break;
+            case IFLA_ADDRESS:
+                networkInterface.macAddress = FormatHardwareAddress(data, length);
+                break;
+            case IFLA_OPERSTATE:
+                if ((length >= 1) && (static_cast<unsigned char>(data[0]) < (sizeof(g_operationalStates) / sizeof(g_operationalStates[0]))))
+                {
+                    networkInterface.operationalState = g_operationalStates[static_cast<unsigned char>(data[0])];
+                }
+                break;
+            case IFLA_LINKINFO:
+                ForEachAttribute(data, length, [&](unsigned short infoType, const char* infoData, size_t infoLength)
+                {
+                    if (IFLA_INFO_KIND == infoType)
+                    {
+                        kind = std::string(infoData, strnlen(infoData, infoLength));
+                    }
+                });
+                break;
+            default:
+                break;
+        }
+    });
+
+    networkInterface.type = kind.empty() ? GetLinkTypeName(link->ifi_type) : kind;
+}
+
+static void ParseAddressMessage(const struct nlmsghdr* header, NetworkInterfaceMap& interfaces)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+    {
+        return;
+    }
+
+    const struct ifaddrmsg* address = reinterpret_cast<const struct ifaddrmsg*>(NLMSG_DATA(header));
+    NetworkInterfaceMap::iterator networkInterface = interfaces.find(static_cast<int>(address->ifa_index));
+    if ((networkInterface == interfaces.end()) || ((AF_INET != address->ifa_family) && (AF_INET6 != address->ifa_family)))
+    {
+        return;
+    }
+
+    // Like 'ip addr', show the local address of point-to-point links rather than the peer address
+    std::string ipAddress;
+    std::string localAddress;
+    uint32_t flags = address->ifa_flags;
+    const char* attributes = reinterpret_cast<const char*>(NLMSG_DATA(header)) + NLMSG_ALIGN(sizeof(struct ifaddrmsg));
+    ForEachAttribute(attributes, header->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct ifaddrmsg))), [&](unsigned short type, const char* data, size_t length)
+    {
+        switch (type)
+        {
+            case IFA_ADDRESS:
+                ipAddress = FormatIpAddress(address->ifa_family, data, length);
+                break;
+            case IFA_LOCAL:
+                localAddress = FormatIpAddress(address->ifa_family, data, length);
+                break;
+            case IFA_FLAGS:
+                if (length >= sizeof(uint32_t))
+                {
+                    flags = ReadUint32(data);
+                }
+                break;
+            default:
+                break;
+        }
+    });
+
+    if (!localAddress.empty())
+    {
+        ipAddress = localAddress;
+    }
+
+    if (!ipAddress.empty())
+    {
+        networkInterface->second.ipAddresses.push_back(ipAddress);
+        networkInterface->second.subnetMasks.push_back("/" + std::to_string(address->ifa_prefixlen));
+
+        // 'ip addr' marks such addresses as dynamic
+        if (0 == (flags & IFA_F_PERMANENT))
+        {
+            networkInterface->second.dhcpEnabled = true;
+        }
+    }
+}
+
+static void ParseRouteMessage(const struct nlmsghdr* header, NetworkInterfaceMap& interfaces)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg)))
+    {
+        return;
+    }
+
+    // Only IPv4 default routes of the main table, the ones 'ip route' lists as 'default via'
+    const struct rtmsg* route = reinterpret_cast<const struct rtmsg*>(NLMSG_DATA(header));
+    if ((AF_INET != route->rtm_family) || (0 != route->rtm_dst_len) || (RTN_UNICAST != route->rtm_type))
+    {
+        return;
+    }
+
+    uint32_t table = route->rtm_table;
+    int outputInterface = 0;
+    std::string gateway;
+    const char* attributes = reinterpret_cast<const char*>(NLMSG_DATA(header)) + NLMSG_ALIGN(sizeof(struct rtmsg));
+    ForEachAttribute(attributes, header->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct rtmsg))), [&](unsigned short type, const char* data, size_t length)
+    {
+        switch (type)
+        {
+            case RTA_TABLE:
+                if (length >= sizeof(uint32_t))
+                {
+                    table = ReadUint32(data);
+                }
+                break;
+            case RTA_GATEWAY:
+                gateway = FormatIpAddress(route->rtm_family, data, length);
+                break;
+            case RTA_OIF:
+                if (length >= sizeof(uint32_t))
+                {
+                    outputInterface = static_cast<int>(ReadUint32(data));
+                }
+                break;
+            default:
+                break;
+        }
+    });
+
+    NetworkInterfaceMap::iterator networkInterface = interfaces.find(outputInterface);
+    if ((RT_TABLE_MAIN == table) && (!gateway.empty()) && (networkInterface != interfaces.end()))
+    {
+        networkInterface->second.defaultGateways.push_back(gateway);
+    }
+}
+
+int ParseNetlinkMessages(const char* buffer, size_t length, NetworkInterfaceMap& interfaces, bool& done)
+{
+    int status = 0;
+    size_t offset = 0;
+    while ((0 == status) && (!done) && (offset + sizeof(struct nlmsghdr) <= length))
+    {
+        const struct nlmsghdr* header = reinterpret_cast<const struct nlmsghdr*>(buffer + offset);
+        if ((header->nlmsg_len < sizeof(struct nlmsghdr)) || (header->nlmsg_len > length - offset))
+        {
+            status = EBADMSG;
+            break;
+        }
+
+        switch (header->nlmsg_type)
+        {
+            case NLMSG_DONE:
+                done = true;
+                break;
+            case NLMSG_ERROR:
+                if (header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+                {
+                    const struct nlmsgerr* error = reinterpret_cast<const struct nlmsgerr*>(NLMSG_DATA(header));
+                    status = (0 != error->error) ? -error->error : 0;
+                }
+                else
+                {
+                    status = EBADMSG;
+                }
+                break;
+            case RTM_NEWLINK:
+                ParseLinkMessage(header, interfaces);
+                break;
+            case RTM_NEWADDR:
+                ParseAddressMessage(header, interfaces);
+                break;
+            case RTM_NEWROUTE:
+                ParseRouteMessage(header, interfaces);
+                break;
+            default:
+                break;
+        }
+
+        offset += NLMSG_ALIGN(header->nlmsg_len);
+    }
+
+    return status;
+}
+
+static int SendDumpRequest(int socketDescriptor, unsigned short type, unsigned int sequence)
+{
+    struct
+    {
+        struct nlmsghdr header;
+        union
+        {
+            struct ifinfomsg link;
+            struct ifaddrmsg address;
+            struct rtmsg route;
+        } message;
+    } request;
+
+    std::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = sequence;
+    switch (type)
+    {
+        case RTM_GETLINK:
+            request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+            request.message.link.ifi_family = AF_UNSPEC;
+            break;
+        case RTM_GETADDR:
+            request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+            request.message.address.ifa_family = AF_UNSPEC;
+            break;
+        default:
+            request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+            request.message.route.rtm_family = AF_INET;
+            break;
+    }
+
+    struct sockaddr_nl kernel;
+    std::memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    if (sendto(socketDescriptor, &request, request.header.nlmsg_len, 0, reinterpret_cast<struct sockaddr*>(&kernel), sizeof(kernel)) < 0)
+    {
+        return errno;
+    }
+
+    return 0;
+}
+
+static int Dump(int socketDescriptor, unsigned short type, unsigned int sequence, std::vector<char>& buffer, NetworkInterfaceMap& interfaces)
+{
+    int status = SendDumpRequest(socketDescriptor, type, sequence);
+    bool done = false;
+    while ((0 == status) && (!done))
+    {
+        ssize_t received = recv(socketDescriptor, buffer.data(), buffer.size(), MSG_TRUNC);
+        if (received < 0)
+        {
+            status = (EINTR == errno) ? 0 : errno;
+        }
+        else if (0 == received)
+        {
+            status = ENODATA;
+        }
+        else if (static_cast<size_t>(received) > buffer.size())
+        {
+            status = EMSGSIZE;
+        }
+        else
+        {
+            status = ParseNetlinkMessages(buffer.data(), static_cast<size_t>(received), interfaces, done);
+        }
+    }
+
+    return status;
+}
+
+int ReadNetlinkInterfaces(NetworkInterfaceMap& interfaces)
+{
+    interfaces.clear();
+
+    int socketDescriptor = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (socketDescriptor < 0)
+    {
+        return errno;
+    }
+
+    struct timeval timeout = {g_netlinkTimeoutSeconds, 0};
+    setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Links first, addresses and routes are attached to the links they refer to
+    std::vector<char> buffer(g_netlinkBufferSize);
+    int status = Dump(socketDescriptor, RTM_GETLINK, 1, buffer, interfaces);
+    if (0 == status)
+    {
+        status = Dump(socketDescriptor, RTM_GETADDR, 2, buffer, interfaces);
+    }
+    if (0 == status)
+    {
+        status = Dump(socketDescriptor, RTM_GETROUTE, 3, buffer, interfaces);
+    }
+
+    close(socketDescriptor);
+
+    for (NetworkInterfaceMap::iterator networkInterface = interfaces.begin(); networkInterface != interfaces.end();)
+    {
+        if (networkInterface->second.name.empty())
+        {
+            networkInterface = interfaces.erase(networkInterface);
+            continue;
+        }
+
+        // Wireless links are plain Ethernet links to rtnetlink, networkctl tells them apart the same way
+        struct stat st;
+        std::string wirelessPath = std::string(g_sysClassNet) + networkInterface->second.name + g_wireless;
+        if ((networkInterface->second.type == g_ether) && (0 == stat(wirelessPath.c_str(), &st)))
+        {
+            networkInterface->second.type = g_wlan;
+        }
+        ++networkInterface;
+    }
+
+    if (0 != status)
+    {
+        interfaces.clear();
+    }
+
+    return status;
+}
+
+static void AddDnsServer(const std::string& dnsServer, std::vector<std::string>& dnsServers)
+{
+    if (std::find(dnsServers.begin(), dnsServers.end(), dnsServer) == dnsServers.end())
+    {
+        dnsServers.push_back(dnsServer);
+    }
+}
+
+// Extracts the address from the [address]:port%interface#name forms systemd uses for DNS servers
+static std::string ParseDnsServer(std::string dnsServer)
+{
+    size_t serverNameFront = dnsServer.find('#');
+    if (serverNameFront != std::string::npos)
+    {
+        dnsServer = dnsServer.substr(0, serverNameFront);
+    }
+
+    if ((!dnsServer.empty()) && ('[' == dnsServer[0]))
+    {
+        size_t bracket = dnsServer.find(']');
+        dnsServer = (bracket != std::string::npos) ? dnsServer.substr(1, bracket - 1) : std::string();
+    }
+    else if (std::count(dnsServer.begin(), dnsServer.end(), ':') == 1)
+    {
+        dnsServer = dnsServer.substr(0, dnsServer.find(':'));
+    }
+
+    size_t interfaceFront = dnsServer.find('%');
+    if (interfaceFront != std::string::npos)
+    {
+        dnsServer = dnsServer.substr(0, interfaceFront);
+    }
+
+    struct in6_addr address;
+    if ((1 == inet_pton(AF_INET, dnsServer.c_str(), &address)) || (1 == inet_pton(AF_INET6, dnsServer.c_str(), &address)))
+    {
+        return dnsServer;
+    }
+
+    return std::string();
+}
+
+// Adds the servers of all key= assignments of a systemd environment-style or ini file, an empty assignment resets the list
+static void ReadDnsServersSetting(const std::string& path, const char* key, std::vector<std::string>& dnsServers)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return;
+    }
+
+    std::string prefix = std::string(key) + "=";
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t front = line.find_first_not_of(" \t");
+        if ((front == std::string::npos) || (0 != line.compare(front, prefix.size(), prefix)))
+        {
+            continue;
+        }
+
+        std::stringstream value(line.substr(front + prefix.size()));
+        std::string token;
+        bool empty = true;
+        while (value >> token)
+        {
+            empty = false;
+            std::string dnsServer = ParseDnsServer(token);
+            if (!dnsServer.empty())
+            {
+                AddDnsServer(dnsServer, dnsServers);
+            }
+        }
+
+        if (empty)
+        {
+            dnsServers.clear();
+        }
+    }
+}
+
+static void ReadGlobalDnsServers(const std::string& resolvedConfiguration, std::vector<std::string>& dnsServers)
+{
+    std::vector<std::string> configurationFiles{resolvedConfiguration};
+
+    std::string dropInDirectory = resolvedConfiguration + g_dropInDirectorySuffix;
+    DIR* directory = opendir(dropInDirectory.c_str());
+    if (nullptr != directory)
+    {
+        std::vector<std::string> dropIns;
+        const size_t extensionLength = strlen(g_confExtension);
+        for (struct dirent* entry = readdir(directory); nullptr != entry; entry = readdir(directory))
+        {
+            std::string name = entry->d_name;
+            if ((name.size() > extensionLength) && (0 == name.compare(name.size() - extensionLength, extensionLength, g_confExtension)))
+            {
+                dropIns.push_back(name);
+            }
+        }
+        closedir(directory);
+
+        std::sort(dropIns.begin(), dropIns.end());
+        for (size_t i = 0; i < dropIns.size(); i++)
+        {
+            configurationFiles.push_back(dropInDirectory + "/" + dropIns[i]);
+        }
+    }
+
+    for (size_t i = 0; i < configurationFiles.size(); i++)
+    {
+        ReadDnsServersSetting(configurationFiles[i], g_resolvedDns, dnsServers);
+    }
+}
+
+void ReadResolvedDnsServers(const std::string& resolvedLinksDirectory, const std::string& networkdLinksDirectory, const std::string& resolvedConfiguration, NetworkInterfaceMap& interfaces)
+{
+    std::vector<std::string> globalDnsServers;
+    ReadGlobalDnsServers(resolvedConfiguration, globalDnsServers);
+
+    for (NetworkInterfaceMap::iterator networkInterface = interfaces.begin(); networkInterface != interfaces.end(); ++networkInterface)
+    {
+        std::string linkStateFile = "/" + std::to_string(networkInterface->first);
+        std::vector<std::string> resolvedDnsServers;
+        std::vector<std::string> networkdDnsServers;
+        ReadDnsServersSetting(resolvedLinksDirectory + linkStateFile, g_resolvedServers, resolvedDnsServers);
+        ReadDnsServersSetting(networkdLinksDirectory + linkStateFile, g_networkdDns, networkdDnsServers);
+
+        std::vector<std::string>& dnsServers = networkInterface->second.dnsServers;
+        dnsServers.clear();
+        for (const std::vector<std::string>* source : {&resolvedDnsServers, &networkdDnsServers, &globalDnsServers})
+        {
+            for (size_t i = 0; i < source->size(); i++)
+            {
+                AddDnsServer((*source)[i], dnsServers);
+            }
+        }
+    }
+}
+
+NetlinkMonitor::NetlinkMonitor() : m_socket(-1) {}
+
+NetlinkMonitor::~NetlinkMonitor()
+{
+    Close();
+}
+
+int NetlinkMonitor::Open()
+{
+    Close();
+
+    m_socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (m_socket < 0)
+    {
+        return errno;
+    }
+
+    struct sockaddr_nl local;
+    std::memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE;
+    if (0 != bind(m_socket, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)))
+    {
+        int status = errno;
+        Close();
+        return status;
+    }
+
+    return 0;
+}
+
+void NetlinkMonitor::Close()
+{
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+bool NetlinkMonitor::IsOpen() const
+{
+    return (m_socket >= 0);
+}
+
+bool NetlinkMonitor::HasChanges()
+{
+    if (m_socket < 0)
+    {
+        return true;
+    }
+
+    bool changes = false;
+    char buffer[8192];
+    while (true)
+    {
+        ssize_t received = recv(m_socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0)
+        {
+            changes = true;
+        }
+        else if ((received < 0) && (EINTR == errno))
+        {
+            continue;
+        }
+        else if ((received < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+        {
+            break;
+        }
+        else
+        {
+            // ENOBUFS means notifications were dropped, anything else leaves the subscription unusable
+            changes = true;
+            if ((received == 0) || (ENOBUFS != errno))
+            {
+                Close();
+                break;
+            }
+        }
+    }
+
+    return changes;
+}
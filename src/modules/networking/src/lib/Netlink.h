@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// Networking state of one interface as reported by the kernel over rtnetlink
+struct NetworkInterface
+{
+    std::string name;
+    std::string type;
+    std::string macAddress;
+    std::vector<std::string> ipAddresses;
+    std::vector<std::string> subnetMasks;
+    std::vector<std::string> defaultGateways;
+    std::vector<std::string> dnsServers;
+
+    // Operational state name as printed by 'ip addr', e.g. UP, DOWN or UNKNOWN
+    std::string operationalState;
+
+    // At least one address was not configured permanently, i.e. was leased
+    bool dhcpEnabled = false;
+
+    // Carrier is present (IFF_LOWER_UP)
+    bool connected = false;
+};
+
+// Interfaces keyed by interface index
+typedef std::map<int, NetworkInterface> NetworkInterfaceMap;
+
+// Parses a buffer of RTM_NEWLINK, RTM_NEWADDR and RTM_NEWROUTE messages received in reply to a dump request
+// into the interface model. Sets done when the NLMSG_DONE message terminating the dump was found.
+// Returns 0 on success or the errno value carried by an NLMSG_ERROR message.
+int ParseNetlinkMessages(const char* buffer, size_t length, NetworkInterfaceMap& interfaces, bool& done);
+
+// Builds the interface model from RTM_GETLINK, RTM_GETADDR and RTM_GETROUTE dumps, replacing 'ls /sys/class/net',
+// 'ip addr', 'ip route' and the interface type reported by nmcli or networkctl. Returns 0 on success or an errno value.
+int ReadNetlinkInterfaces(NetworkInterfaceMap& interfaces);
+
+// Adds the DNS servers of each interface from the runtime state of systemd-resolved (SERVERS= in resolvedLinksDirectory/<ifindex>)
+// and systemd-networkd (DNS= in networkdLinksDirectory/<ifindex>), plus the global servers from the DNS= settings of the
+// resolved.conf configuration file and its drop-ins, the same servers 'systemd-resolve --status' reports.
+void ReadResolvedDnsServers(const std::string& resolvedLinksDirectory, const std::string& networkdLinksDirectory, const std::string& resolvedConfiguration, NetworkInterfaceMap& interfaces);
+
+// Subscription to rtnetlink link, address and IPv4 route notifications, lets callers keep the interface model
+// until the kernel reports a change instead of dumping it again on every request
+class NetlinkMonitor
+{
+public:
+    NetlinkMonitor();
+    ~NetlinkMonitor();
+
+    NetlinkMonitor(const NetlinkMonitor&) = delete;
+    NetlinkMonitor& operator=(const NetlinkMonitor&) = delete;
+
+    // Returns 0 on success or an errno value
+    int Open();
+    void Close();
+    bool IsOpen() const;
+
+    // Drains pending notifications. Returns true when any arrived, or when changes may have been missed because
+    // the monitor is not open or the socket receive buffer overflowed.
+    bool HasChanges();
+
+private:
+    int m_socket;
+};
+
+#endif // NETLINK_H
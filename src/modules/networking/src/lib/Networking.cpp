@@ -32,6 +32,11 @@ const char* g_getDefaultGateways = "ip route";
 const char* g_getDnsServers = "systemd-resolve --status";
 
 const char* g_systemdResolvedServiceName = "systemd-resolved.service";
+const char* g_networkManagerServiceName = "NetworkManager.service";
+
+const char* g_resolvedLinksDirectory = "/run/systemd/resolve/netif";
+const char* g_networkdLinksDirectory = "/run/systemd/netif/links";
+const char* g_resolvedConfiguration = "/etc/systemd/resolved.conf";
 
 const char* g_macAddressesPrefix = "link/";
 const char* g_ipAddressesPrefix = "inet";
@@ -48,6 +53,9 @@ const char* g_true = "true";
 const char* g_false = "false";
 const char* g_unknown = "unknown";
 
+// Netlink reports networkctl style link types, NetworkManager hosts report the nmcli device types
+const std::map<std::string, std::string> g_networkManagerInterfaceTypes = {{"ether", "ethernet"}, {"wlan", "wifi"}};
+
 const char* g_emptyString = "";
 const char* g_comma = ",";
 const char* g_colon = ":";
@@ -102,10 +110,71 @@ NetworkingObject::NetworkingObject(unsigned int maxPayloadSizeBytes)
 {
     m_maxPayloadSizeBytes = maxPayloadSizeBytes;
     m_networkManagementService = NetworkManagementService::Unknown;
+    m_hasNetlinkInterfaces = false;
+    m_hasDnsServers = false;
+    m_hasNetworkManagementService = false;
+    m_subscribeFailureLogged = false;
 }
 
 NetworkingObject::~NetworkingObject() {}
 
+bool NetworkingObject::ReadInterfaces(std::map<std::string, NetworkInterface>& interfaces)
+{
+    interfaces.clear();
+
+    // Subscribe before dumping so that a change racing with the dump is not missed
+    if (!m_netlinkMonitor.IsOpen())
+    {
+        int status = m_netlinkMonitor.Open();
+        if ((0 != status) && (!m_subscribeFailureLogged))
+        {
+            OsConfigLogError(NetworkingLog::Get(), "Failed to subscribe to netlink notifications (%d), interfaces will be read on every request", status);
+            m_subscribeFailureLogged = true;
+        }
+    }
+
+    if (!m_hasNetworkManagementService)
+    {
+        if (IsDaemonActive(g_networkManagerServiceName, NetworkingLog::Get()))
+        {
+            m_networkManagementService = NetworkManagementService::NetworkManager;
+        }
+        m_hasNetworkManagementService = true;
+    }
+
+    if ((!m_hasNetlinkInterfaces) || m_netlinkMonitor.HasChanges())
+    {
+        m_hasNetlinkInterfaces = false;
+        int status = ReadNetlinkInterfaces(m_netlinkInterfaces);
+        if (0 != status)
+        {
+            OsConfigLogError(NetworkingLog::Get(), "Failed to read network interfaces over netlink (%d), falling back to commands", status);
+            return false;
+        }
+        m_hasNetlinkInterfaces = true;
+
+        m_hasDnsServers = EnableAndStartDaemon(g_systemdResolvedServiceName, NetworkingLog::Get());
+        if (!m_hasDnsServers)
+        {
+            OsConfigLogError(NetworkingLog::Get(), "Unable to start service %s. DnsServers data will be empty.", g_systemdResolvedServiceName);
+        }
+    }
+
+    // DNS servers change without netlink notifications, the runtime files are cheap to read on every request
+    NetworkInterfaceMap netlinkInterfaces = m_netlinkInterfaces;
+    if (m_hasDnsServers)
+    {
+        ReadResolvedDnsServers(g_resolvedLinksDirectory, g_networkdLinksDirectory, g_resolvedConfiguration, netlinkInterfaces);
+    }
+
+    for (NetworkInterfaceMap::iterator networkInterface = netlinkInterfaces.begin(); networkInterface != netlinkInterfaces.end(); ++networkInterface)
+    {
+        interfaces[networkInterface->second.name] = networkInterface->second;
+    }
+
+    return true;
+}
+
 std::string NetworkingObject::RunCommand(const char* command)
 {
     char* textResult = nullptr;
@@ -302,39 +371,109 @@ void NetworkingObjectBase::GetConnected(const std::string& interfaceName, std::v
     }
 }
 
-void NetworkingObjectBase::GenerateInterfaceSettingsString(const std::string& interfaceName, NetworkingSettingType settingType, std::string& interfaceSettingsString)
+void NetworkingObjectBase::GetInterfaceSettings(const NetworkInterface& networkInterface, NetworkingSettingType settingType, std::vector<std::string>& interfaceSettings)
 {
-    std::vector<std::string> interfaceSettings;
     switch (settingType)
     {
         case NetworkingSettingType::InterfaceTypes:
-            GetInterfaceTypes(interfaceName, interfaceSettings);
+            if (!networkInterface.type.empty())
+            {
+                std::map<std::string, std::string>::const_iterator networkManagerType = g_networkManagerInterfaceTypes.find(networkInterface.type);
+                if ((this->m_networkManagementService == NetworkManagementService::NetworkManager) && (networkManagerType != g_networkManagerInterfaceTypes.end()))
+                {
+                    interfaceSettings.push_back(networkManagerType->second);
+                }
+                else
+                {
+                    interfaceSettings.push_back(networkInterface.type);
+                }
+            }
             break;
         case NetworkingSettingType::MacAddresses:
-            GetMacAddresses(interfaceName, interfaceSettings);
+            if (!networkInterface.macAddress.empty())
+            {
+                interfaceSettings.push_back(networkInterface.macAddress);
+            }
             break;
         case NetworkingSettingType::IpAddresses:
-            GetIpAddresses(interfaceName, interfaceSettings);
+            interfaceSettings = networkInterface.ipAddresses;
             break;
         case NetworkingSettingType::SubnetMasks:
-            GetSubnetMasks(interfaceName, interfaceSettings);
+            interfaceSettings = networkInterface.subnetMasks;
             break;
         case NetworkingSettingType::DefaultGateways:
-            GetDefaultGateways(interfaceName, interfaceSettings);
+            interfaceSettings = networkInterface.defaultGateways;
             break;
         case NetworkingSettingType::DnsServers:
-            GetDnsServers(interfaceName, interfaceSettings);
+            interfaceSettings = networkInterface.dnsServers;
             break;
         case NetworkingSettingType::DhcpEnabled:
-            GetDhcpEnabled(interfaceName, interfaceSettings);
+            interfaceSettings.push_back(networkInterface.dhcpEnabled ? g_true : g_false);
             break;
         case NetworkingSettingType::Enabled:
-            GetEnabled(interfaceName, interfaceSettings);
+            if (networkInterface.operationalState == g_enabledFlag)
+            {
+                interfaceSettings.push_back(g_true);
+            }
+            else if (networkInterface.operationalState == g_disabledFlag)
+            {
+                interfaceSettings.push_back(g_false);
+            }
+            else
+            {
+                interfaceSettings.push_back(g_unknown);
+            }
             break;
         case NetworkingSettingType::Connected:
-            GetConnected(interfaceName, interfaceSettings);
+            interfaceSettings.push_back(networkInterface.connected ? g_true : g_false);
             break;
     }
+}
+
+void NetworkingObjectBase::GenerateInterfaceSettingsString(const std::string& interfaceName, NetworkingSettingType settingType, std::string& interfaceSettingsString)
+{
+    std::vector<std::string> interfaceSettings;
+    if (this->m_hasInterfaces)
+    {
+        std::map<std::string, NetworkInterface>::const_iterator networkInterface = this->m_interfaces.find(interfaceName);
+        if (networkInterface != this->m_interfaces.end())
+        {
+            GetInterfaceSettings(networkInterface->second, settingType, interfaceSettings);
+        }
+    }
+    else
+    {
+        switch (settingType)
+        {
+            case NetworkingSettingType::InterfaceTypes:
+                GetInterfaceTypes(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::MacAddresses:
+                GetMacAddresses(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::IpAddresses:
+                GetIpAddresses(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::SubnetMasks:
+                GetSubnetMasks(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::DefaultGateways:
+                GetDefaultGateways(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::DnsServers:
+                GetDnsServers(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::DhcpEnabled:
+                GetDhcpEnabled(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::Enabled:
+                GetEnabled(interfaceName, interfaceSettings);
+                break;
+            case NetworkingSettingType::Connected:
+                GetConnected(interfaceName, interfaceSettings);
+                break;
+        }
+    }
 
     size_t size = interfaceSettings.size();
     for (size_t i = 0; i < size; i++)
@@ -766,10 +905,27 @@ void NetworkingObjectBase::RefreshInterfaceData()
 
 void NetworkingObjectBase::RefreshSettingsStrings()
 {
-    RefreshInterfaceNames(this->m_interfaceNames);
+    this->m_hasInterfaces = ReadInterfaces(this->m_interfaces);
+    if (this->m_hasInterfaces)
+    {
+        this->m_interfaceNames.clear();
+        for (std::map<std::string, NetworkInterface>::const_iterator networkInterface = this->m_interfaces.begin(); networkInterface != this->m_interfaces.end(); ++networkInterface)
+        {
+            this->m_interfaceNames.push_back(networkInterface->first);
+        }
+    }
+    else
+    {
+        this->m_interfaces.clear();
+        RefreshInterfaceNames(this->m_interfaceNames);
+    }
+
     if (this->m_interfaceNames.size() > 0)
     {
-        RefreshInterfaceData();
+        if (!this->m_hasInterfaces)
+        {
+            RefreshInterfaceData();
+        }
         UpdateSettingsString(NetworkingSettingType::InterfaceTypes, this->m_settings.interfaceTypes);
         UpdateSettingsString(NetworkingSettingType::MacAddresses, this->m_settings.macAddresses);
         UpdateSettingsString(NetworkingSettingType::IpAddresses, this->m_settings.ipAddresses);
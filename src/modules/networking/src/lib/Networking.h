@@ -1,11 +1,13 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <map>
 #include <string>
 #include <vector>
 #include <rapidjson/writer.h>
 #include <Logging.h>
 #include <Mmi.h>
+#include <Netlink.h>
 
 #define NETWORKING_LOGFILE "/var/log/osconfig_networking.log"
 #define NETWORKING_ROLLEDLOGFILE "/var/log/osconfig_networking.bak"
@@ -73,6 +75,14 @@ public:
     virtual ~NetworkingObjectBase() {};
     virtual std::string RunCommand(const char* command) = 0;
 
+    // Fills the interface model keyed by interface name without running commands. Returns false when the
+    // model is not available, in which case the settings are parsed from the output of RunCommand.
+    virtual bool ReadInterfaces(std::map<std::string, NetworkInterface>& interfaces)
+    {
+        (void)interfaces;
+        return false;
+    }
+
     int Get(
         const char* componentName,
         const char* objectName,
@@ -95,6 +105,7 @@ private:
     void GetDhcpEnabled(const std::string& interfaceName, std::vector<std::string>& interfaceSettings);
     void GetEnabled(const std::string& interfaceName, std::vector<std::string>& interfaceSettings);
     void GetConnected(const std::string& interfaceName, std::vector<std::string>& interfaceSettings);
+    void GetInterfaceSettings(const NetworkInterface& networkInterface, NetworkingSettingType settingType, std::vector<std::string>& interfaceSettings);
     void GenerateInterfaceSettingsString(const std::string& interfaceName, NetworkingSettingType settingType, std::string& interfaceSettingsString);
     void UpdateSettingsString(NetworkingSettingType settingType, std::string& settingsString);
     void GenerateInterfaceTypesMap();
@@ -117,6 +128,9 @@ private:
     std::map<std::string, std::string> m_ipSettingsMap;
     std::map<std::string, std::vector<std::string>> m_defaultGatewaysMap;
     std::map<std::string, std::vector<std::string>> m_dnsServersMap;
+
+    std::map<std::string, NetworkInterface> m_interfaces;
+    bool m_hasInterfaces = false;
 };
 
 class NetworkingObject : public NetworkingObjectBase
@@ -124,6 +138,16 @@ class NetworkingObject : public NetworkingObjectBase
 public:
     std::string RunCommand(const char* command) override;
     int WriteJsonElement(rapidjson::Writer<rapidjson::StringBuffer>* writer, const char* key, const char* value) override;
+    bool ReadInterfaces(std::map<std::string, NetworkInterface>& interfaces) override;
     NetworkingObject(unsigned int maxPayloadSizeBytes);
     ~NetworkingObject();
+
+private:
+    // Kept until the netlink subscription reports a link, address or route change
+    NetlinkMonitor m_netlinkMonitor;
+    NetworkInterfaceMap m_netlinkInterfaces;
+    bool m_hasNetlinkInterfaces;
+    bool m_hasDnsServers;
+    bool m_hasNetworkManagementService;
+    bool m_subscribeFailureLogged;
 };
@@ -2,9 +2,18 @@
 // Licensed under the MIT License.
 
 #include <algorithm>
+#include <arpa/inet.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
 #include <string>
+#include <sys/stat.h>
 #include <CommonUtils.h>
 #include <Mmi.h>
 #include <Networking.h>
@@ -20,6 +29,10 @@ public:
     std::string RunCommand(const char* command);
     bool isTestWriteJsonElement = false;
     int WriteJsonElement(rapidjson::Writer<rapidjson::StringBuffer>* writer, const char* key, const char* value);
+    bool hasInterfaces = false;
+    std::map<std::string, NetworkInterface> interfaces;
+    unsigned int readInterfacesCount = 0;
+    bool ReadInterfaces(std::map<std::string, NetworkInterface>& interfaces);
 };
 
 NetworkingObjectTest::NetworkingObjectTest(unsigned int maxPayloadSizeBytes)
@@ -42,6 +55,13 @@ std::string NetworkingObjectTest::RunCommand(const char* command)
     return commandResult;
 }
 
+bool NetworkingObjectTest::ReadInterfaces(std::map<std::string, NetworkInterface>& interfacesToReturn)
+{
+    readInterfacesCount++;
+    interfacesToReturn = interfaces;
+    return hasInterfaces;
+}
+
 int NetworkingObjectTest::WriteJsonElement(rapidjson::Writer<rapidjson::StringBuffer>* writer, const char* key, const char* value)
 {
     int result = MMI_OK;
@@ -928,4 +948,331 @@ namespace OSConfig::Platform::Tests
         EXPECT_NE(payload, nullptr);
         delete payload;
     }
+
+    void AppendAttribute(std::vector<char>& message, unsigned short type, const void* data, size_t length)
+    {
+        struct rtattr attribute;
+        attribute.rta_type = type;
+        attribute.rta_len = RTA_LENGTH(length);
+        size_t offset = message.size();
+        message.resize(offset + RTA_SPACE(length), 0);
+        std::memcpy(message.data() + offset, &attribute, sizeof(attribute));
+        std::memcpy(message.data() + offset + RTA_LENGTH(0), data, length);
+    }
+
+    void AppendStringAttribute(std::vector<char>& message, unsigned short type, const char* value)
+    {
+        AppendAttribute(message, type, value, strlen(value) + 1);
+    }
+
+    void AppendNetlinkMessage(std::vector<char>& buffer, unsigned short type, const void* header, size_t headerSize, const std::vector<char>& attributes)
+    {
+        struct nlmsghdr messageHeader;
+        std::memset(&messageHeader, 0, sizeof(messageHeader));
+        messageHeader.nlmsg_type = type;
+        messageHeader.nlmsg_len = NLMSG_LENGTH(NLMSG_ALIGN(headerSize) + attributes.size());
+        size_t offset = buffer.size();
+        buffer.resize(offset + NLMSG_ALIGN(messageHeader.nlmsg_len), 0);
+        std::memcpy(buffer.data() + offset, &messageHeader, sizeof(messageHeader));
+        if (headerSize > 0)
+        {
+            std::memcpy(buffer.data() + offset + NLMSG_HDRLEN, header, headerSize);
+        }
+        if (!attributes.empty())
+        {
+            std::memcpy(buffer.data() + offset + NLMSG_HDRLEN + NLMSG_ALIGN(headerSize), attributes.data(), attributes.size());
+        }
+    }
+
+    void AppendLink(std::vector<char>& buffer, int index, unsigned short type, unsigned int flags, const char* name, unsigned char operationalState, const char* kind)
+    {
+        struct ifinfomsg link;
+        std::memset(&link, 0, sizeof(link));
+        link.ifi_index = index;
+        link.ifi_type = type;
+        link.ifi_flags = flags;
+
+        const unsigned char macAddress[] = {0x00, 0x15, 0x5d, 0x26, 0xcf, static_cast<unsigned char>(index)};
+        std::vector<char> attributes;
+        AppendStringAttribute(attributes, IFLA_IFNAME, name);
+        AppendAttribute(attributes, IFLA_ADDRESS, macAddress, sizeof(macAddress));
+        AppendAttribute(attributes, IFLA_OPERSTATE, &operationalState, sizeof(operationalState));
+        if (nullptr != kind)
+        {
+            std::vector<char> linkInfo;
+            AppendStringAttribute(linkInfo, IFLA_INFO_KIND, kind);
+            AppendAttribute(attributes, IFLA_LINKINFO, linkInfo.data(), linkInfo.size());
+        }
+
+        AppendNetlinkMessage(buffer, RTM_NEWLINK, &link, sizeof(link), attributes);
+    }
+
+    void AppendAddress(std::vector<char>& buffer, int index, unsigned char family, const char* ipAddress, unsigned char prefixLength, unsigned char flags)
+    {
+        struct ifaddrmsg address;
+        std::memset(&address, 0, sizeof(address));
+        address.ifa_family = family;
+        address.ifa_prefixlen = prefixLength;
+        address.ifa_flags = flags;
+        address.ifa_index = index;
+
+        unsigned char data[sizeof(struct in6_addr)] = {0};
+        size_t length = (AF_INET == family) ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+        inet_pton(family, ipAddress, data);
+
+        std::vector<char> attributes;
+        AppendAttribute(attributes, IFA_ADDRESS, data, length);
+        if (AF_INET == family)
+        {
+            AppendAttribute(attributes, IFA_LOCAL, data, length);
+        }
+
+        AppendNetlinkMessage(buffer, RTM_NEWADDR, &address, sizeof(address), attributes);
+    }
+
+    void AppendDefaultRoute(std::vector<char>& buffer, int index, const char* gateway, unsigned char table)
+    {
+        struct rtmsg route;
+        std::memset(&route, 0, sizeof(route));
+        route.rtm_family = AF_INET;
+        route.rtm_table = table;
+        route.rtm_type = RTN_UNICAST;
+
+        struct in_addr data;
+        inet_pton(AF_INET, gateway, &data);
+        unsigned int outputInterface = index;
+
+        std::vector<char> attributes;
+        AppendAttribute(attributes, RTA_GATEWAY, &data, sizeof(data));
+        AppendAttribute(attributes, RTA_OIF, &outputInterface, sizeof(outputInterface));
+
+        AppendNetlinkMessage(buffer, RTM_NEWROUTE, &route, sizeof(route), attributes);
+    }
+
+    void WriteTestFile(const std::string& path, const std::string& contents)
+    {
+        std::ofstream file(path);
+        file << contents;
+    }
+
+    TEST(NetworkingTests, ParseNetlinkMessages)
+    {
+        std::vector<char> links;
+        AppendLink(links, 1, ARPHRD_LOOPBACK, IFF_UP | IFF_LOWER_UP, "lo", IF_OPER_UNKNOWN, nullptr);
+        AppendLink(links, 2, ARPHRD_ETHER, IFF_UP, "eth0", IF_OPER_DOWN, nullptr);
+        AppendLink(links, 3, ARPHRD_ETHER, IFF_UP | IFF_LOWER_UP, "docker0", IF_OPER_UP, "bridge");
+
+        std::vector<char> addresses;
+        AppendAddress(addresses, 3, AF_INET, "172.32.233.234", 8, 0);
+        AppendAddress(addresses, 2, AF_INET, "10.1.1.2", 16, IFA_F_PERMANENT);
+        AppendAddress(addresses, 9, AF_INET, "10.9.9.9", 24, IFA_F_PERMANENT);
+        AppendAddress(addresses, 2, AF_INET6, "fe80::5e42:4bf7:dddd:9b0f", 64, IFA_F_PERMANENT);
+        AppendNetlinkMessage(addresses, NLMSG_DONE, nullptr, 0, {});
+
+        std::vector<char> routes;
+        AppendDefaultRoute(routes, 2, "172.13.145.1", RT_TABLE_MAIN);
+        AppendDefaultRoute(routes, 3, "172.17.128.1", 200);
+        AppendNetlinkMessage(routes, NLMSG_DONE, nullptr, 0, {});
+
+        NetworkInterfaceMap interfaces;
+        bool done = false;
+        EXPECT_EQ(0, ParseNetlinkMessages(links.data(), links.size(), interfaces, done));
+        EXPECT_FALSE(done);
+        EXPECT_EQ(0, ParseNetlinkMessages(addresses.data(), addresses.size(), interfaces, done));
+        EXPECT_TRUE(done);
+        done = false;
+        EXPECT_EQ(0, ParseNetlinkMessages(routes.data(), routes.size(), interfaces, done));
+        EXPECT_TRUE(done);
+
+        ASSERT_EQ(3, (int)interfaces.size());
+
+        EXPECT_EQ("lo", interfaces[1].name);
+        EXPECT_EQ("loopback", interfaces[1].type);
+        EXPECT_EQ("UNKNOWN", interfaces[1].operationalState);
+        EXPECT_TRUE(interfaces[1].connected);
+        EXPECT_TRUE(interfaces[1].ipAddresses.empty());
+
+        EXPECT_EQ("eth0", interfaces[2].name);
+        EXPECT_EQ("ether", interfaces[2].type);
+        EXPECT_EQ("00:15:5d:26:cf:02", interfaces[2].macAddress);
+        EXPECT_EQ("DOWN", interfaces[2].operationalState);
+        EXPECT_FALSE(interfaces[2].connected);
+        EXPECT_EQ(std::vector<std::string>({"10.1.1.2", "fe80::5e42:4bf7:dddd:9b0f"}), interfaces[2].ipAddresses);
+        EXPECT_EQ(std::vector<std::string>({"/16", "/64"}), interfaces[2].subnetMasks);
+        EXPECT_FALSE(interfaces[2].dhcpEnabled);
+        EXPECT_EQ(std::vector<std::string>({"172.13.145.1"}), interfaces[2].defaultGateways);
+
+        EXPECT_EQ("docker0", interfaces[3].name);
+        EXPECT_EQ("bridge", interfaces[3].type);
+        EXPECT_EQ("UP", interfaces[3].operationalState);
+        EXPECT_TRUE(interfaces[3].connected);
+        EXPECT_EQ(std::vector<std::string>({"172.32.233.234"}), interfaces[3].ipAddresses);
+        EXPECT_EQ(std::vector<std::string>({"/8"}), interfaces[3].subnetMasks);
+        EXPECT_TRUE(interfaces[3].dhcpEnabled);
+        EXPECT_TRUE(interfaces[3].defaultGateways.empty());
+    }
+
+    TEST(NetworkingTests, ParseNetlinkMessagesError)
+    {
+        struct nlmsgerr error;
+        std::memset(&error, 0, sizeof(error));
+        error.error = -EPERM;
+
+        std::vector<char> buffer;
+        AppendNetlinkMessage(buffer, NLMSG_ERROR, &error, sizeof(error), {});
+
+        NetworkInterfaceMap interfaces;
+        bool done = false;
+        EXPECT_EQ(EPERM, ParseNetlinkMessages(buffer.data(), buffer.size(), interfaces, done));
+
+        buffer.resize(buffer.size() - 1);
+        EXPECT_EQ(EBADMSG, ParseNetlinkMessages(buffer.data(), buffer.size(), interfaces, done));
+    }
+
+    TEST(NetworkingTests, ReadNetlinkInterfaces)
+    {
+        NetworkInterfaceMap interfaces;
+        ASSERT_EQ(0, ReadNetlinkInterfaces(interfaces));
+
+        bool hasLoopback = false;
+        for (NetworkInterfaceMap::const_iterator networkInterface = interfaces.begin(); networkInterface != interfaces.end(); ++networkInterface)
+        {
+            EXPECT_FALSE(networkInterface->second.name.empty());
+            hasLoopback = hasLoopback || (networkInterface->second.type == "loopback");
+        }
+        EXPECT_TRUE(hasLoopback);
+    }
+
+    TEST(NetworkingTests, ReadResolvedDnsServers)
+    {
+        char directoryTemplate[] = "/tmp/networkingtestsXXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(directoryTemplate));
+        std::string directory = directoryTemplate;
+        std::string resolvedLinks = directory + "/resolve";
+        std::string networkdLinks = directory + "/links";
+        std::string configuration = directory + "/resolved.conf";
+        ASSERT_EQ(0, mkdir(resolvedLinks.c_str(), 0700));
+        ASSERT_EQ(0, mkdir(networkdLinks.c_str(), 0700));
+        ASSERT_EQ(0, mkdir((configuration + ".d").c_str(), 0700));
+
+        WriteTestFile(resolvedLinks + "/2", "# This is private data. Do not parse.\nSERVERS=172.29.64.1 8.8.8.8:53#dns.google\nDOMAINS=mshome.net\n");
+        WriteTestFile(networkdLinks + "/2", "DNS=172.29.64.1 fe80::1%eth0 invalid\n");
+        WriteTestFile(networkdLinks + "/3", "DNS=10.0.0.1\nDNS=\n");
+        WriteTestFile(configuration, "[Resolve]\n#DNS=9.9.9.9\nDNS=1.1.1.1\n");
+        WriteTestFile(configuration + ".d/10-test.conf", "[Resolve]\nDNS=\nDNS=[2001:db8::1]:53\n");
+        WriteTestFile(configuration + ".d/20-test.conf.bak", "[Resolve]\nDNS=8.8.4.4\n");
+
+        NetworkInterfaceMap interfaces;
+        interfaces[2].name = "eth0";
+        interfaces[3].name = "docker0";
+        ReadResolvedDnsServers(resolvedLinks, networkdLinks, configuration, interfaces);
+
+        EXPECT_EQ(std::vector<std::string>({"172.29.64.1", "8.8.8.8", "fe80::1", "2001:db8::1"}), interfaces[2].dnsServers);
+        EXPECT_EQ(std::vector<std::string>({"2001:db8::1"}), interfaces[3].dnsServers);
+
+        std::string command = "rm -rf " + directory;
+        EXPECT_EQ(0, system(command.c_str()));
+    }
+
+    TEST(NetworkingTests, GetSuccessInterfaceModel)
+    {
+        const char* payloadExpected =
+            "{\"interfaceTypes\":\"docker0=bridge;eth0=ether\","
+            "\"macAddresses\":\"docker0=0a:25:3g:6v:2f:89;eth0=00:15:5d:26:cf:89\","
+            "\"ipAddresses\":\"docker0=172.32.233.234,::1;eth0=172.27.181.213,10.1.1.2,fe80::5e42:4bf7:dddd:9b0f\","
+            "\"subnetMasks\":\"docker0=/8,/128;eth0=/20,/16,/64\","
+            "\"defaultGateways\":\"docker0=172.17.128.1;eth0=172.13.145.1\","
+            "\"dnsServers\":\"docker0=8.8.8.8,172.29.64.1;eth0=172.29.64.1\","
+            "\"dhcpEnabled\":\"docker0=true;eth0=false\","
+            "\"enabled\":\"docker0=true;eth0=false\","
+            "\"connected\":\"docker0=true;eth0=false\"}";
+
+        NetworkInterface docker0;
+        docker0.name = "docker0";
+        docker0.type = "bridge";
+        docker0.macAddress = "0a:25:3g:6v:2f:89";
+        docker0.ipAddresses = {"172.32.233.234", "::1"};
+        docker0.subnetMasks = {"/8", "/128"};
+        docker0.defaultGateways = {"172.17.128.1"};
+        docker0.dnsServers = {"8.8.8.8", "172.29.64.1"};
+        docker0.operationalState = "UP";
+        docker0.dhcpEnabled = true;
+        docker0.connected = true;
+
+        NetworkInterface eth0;
+        eth0.name = "eth0";
+        eth0.type = "ether";
+        eth0.macAddress = "00:15:5d:26:cf:89";
+        eth0.ipAddresses = {"172.27.181.213", "10.1.1.2", "fe80::5e42:4bf7:dddd:9b0f"};
+        eth0.subnetMasks = {"/20", "/16", "/64"};
+        eth0.defaultGateways = {"172.13.145.1"};
+        eth0.dnsServers = {"172.29.64.1"};
+        eth0.operationalState = "DOWN";
+
+        NetworkingObjectTest testModule(g_maxPayloadSizeBytes);
+        testModule.hasInterfaces = true;
+        testModule.interfaces = {{"eth0", eth0}, {"docker0", docker0}};
+        testModule.returnValues = g_returnValues;
+
+        MMI_JSON_STRING payload;
+        int payloadSizeBytes;
+        int result = testModule.Get(NETWORKING, NETWORK_CONFIGURATION, &payload, &payloadSizeBytes);
+
+        EXPECT_EQ(result, MMI_OK);
+        EXPECT_EQ(1, (int)testModule.readInterfacesCount);
+        EXPECT_EQ(0, (int)testModule.runCommandCount);
+
+        std::string resultString(payload, payloadSizeBytes);
+        EXPECT_STREQ(resultString.c_str(), payloadExpected);
+
+        EXPECT_NE(payload, nullptr);
+        delete payload;
+
+        testModule.interfaces["eth0"].operationalState = "UNKNOWN";
+        testModule.interfaces["eth0"].connected = true;
+        result = testModule.Get(NETWORKING, NETWORK_CONFIGURATION, &payload, &payloadSizeBytes);
+
+        EXPECT_EQ(result, MMI_OK);
+        EXPECT_EQ(0, (int)testModule.runCommandCount);
+
+        resultString = std::string(payload, payloadSizeBytes);
+        EXPECT_NE(std::string::npos, resultString.find("\"enabled\":\"docker0=true;eth0=unknown\""));
+        EXPECT_NE(std::string::npos, resultString.find("\"connected\":\"docker0=true;eth0=true\""));
+
+        EXPECT_NE(payload, nullptr);
+        delete payload;
+    }
+
+    TEST(NetworkingTests, GetSuccessInterfaceModelNetworkManagerTypes)
+    {
+        NetworkInterface eth0;
+        eth0.name = "eth0";
+        eth0.type = "ether";
+
+        NetworkInterface wlan0;
+        wlan0.name = "wlan0";
+        wlan0.type = "wlan";
+
+        NetworkInterface docker0;
+        docker0.name = "docker0";
+        docker0.type = "bridge";
+
+        NetworkingObjectTest testModule(g_maxPayloadSizeBytes);
+        testModule.hasInterfaces = true;
+        testModule.interfaces = {{"eth0", eth0}, {"wlan0", wlan0}, {"docker0", docker0}};
+        testModule.m_networkManagementService = NetworkingObjectBase::NetworkManagementService::NetworkManager;
+
+        MMI_JSON_STRING payload;
+        int payloadSizeBytes;
+        int result = testModule.Get(NETWORKING, NETWORK_CONFIGURATION, &payload, &payloadSizeBytes);
+
+        EXPECT_EQ(result, MMI_OK);
+        EXPECT_EQ(0, (int)testModule.runCommandCount);
+
+        std::string resultString(payload, payloadSizeBytes);
+        EXPECT_NE(std::string::npos, resultString.find("\"interfaceTypes\":\"docker0=bridge;eth0=ethernet;wlan0=wifi\""));
+
+        EXPECT_NE(payload, nullptr);
+        delete payload;
+    }
 } // namespace OSConfig::Platform::Tests
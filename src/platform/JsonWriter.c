@@ -0,0 +1,234 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <PlatformCommon.h>
+#include <JsonWriter.h>
+
+#define JSON_WRITER_INITIAL_CAPACITY 4096
+
+// Same as parson, enough for any double printed with "%1.17g"
+#define JSON_NUMBER_FORMAT "%1.17g"
+#define JSON_NUMBER_SIZE 64
+
+static bool ReserveJsonWriter(JSON_WRITER* writer, size_t length)
+{
+    size_t capacity = 0;
+    char* buffer = NULL;
+
+    if (writer->failed)
+    {
+        return false;
+    }
+
+    // One more for the null terminator added when the buffer is taken
+    if ((writer->size + length + 1) <= writer->capacity)
+    {
+        return true;
+    }
+
+    capacity = (writer->capacity > 0) ? writer->capacity : JSON_WRITER_INITIAL_CAPACITY;
+    while (capacity < (writer->size + length + 1))
+    {
+        capacity *= 2;
+    }
+
+    if (NULL == (buffer = (char*)realloc(writer->buffer, capacity)))
+    {
+        writer->failed = true;
+        return false;
+    }
+
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+
+    return true;
+}
+
+void WriteJsonText(JSON_WRITER* writer, const char* text, size_t length)
+{
+    if (ReserveJsonWriter(writer, length))
+    {
+        memcpy(writer->buffer + writer->size, text, length);
+        writer->size += length;
+    }
+}
+
+// Escaped as parson does, including '/'
+static const char* GetJsonEscape(unsigned char c)
+{
+    static const char* controlEscapes[] = {
+        "\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+        "\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+        "\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+        "\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f"};
+
+    if (c < 0x20)
+    {
+        return controlEscapes[c];
+    }
+
+    switch (c)
+    {
+        case '\"':
+            return "\\\"";
+        case '\\':
+            return "\\\\";
+        case '/':
+            return "\\/";
+        default:
+            return NULL;
+    }
+}
+
+void WriteJsonString(JSON_WRITER* writer, const char* string, size_t length)
+{
+    const char* escape = NULL;
+    size_t start = 0;
+    size_t i = 0;
+
+    WriteJsonText(writer, "\"", 1);
+
+    // Runs of characters that need no escaping are copied at once
+    for (i = 0; i < length; i++)
+    {
+        if (NULL != (escape = GetJsonEscape((unsigned char)string[i])))
+        {
+            WriteJsonText(writer, string + start, i - start);
+            WriteJsonText(writer, escape, strlen(escape));
+            start = i + 1;
+        }
+    }
+
+    WriteJsonText(writer, string + start, length - start);
+    WriteJsonText(writer, "\"", 1);
+}
+
+void WriteJsonValue(JSON_WRITER* writer, const JSON_Value* value)
+{
+    JSON_Object* object = NULL;
+    JSON_Array* array = NULL;
+    const char* name = NULL;
+    char number[JSON_NUMBER_SIZE] = {0};
+    int length = 0;
+    size_t count = 0;
+    size_t i = 0;
+
+    if (writer->failed)
+    {
+        return;
+    }
+
+    switch (json_value_get_type(value))
+    {
+        case JSONObject:
+            object = json_value_get_object(value);
+            count = json_object_get_count(object);
+            WriteJsonText(writer, "{", 1);
+
+            // Members are taken by index, parson looks each one up by name
+            for (i = 0; i < count; i++)
+            {
+                name = json_object_get_name(object, i);
+                if (i > 0)
+                {
+                    WriteJsonText(writer, ",", 1);
+                }
+                WriteJsonString(writer, name, strlen(name));
+                WriteJsonText(writer, ":", 1);
+                WriteJsonValue(writer, json_object_get_value_at(object, i));
+            }
+
+            WriteJsonText(writer, "}", 1);
+            break;
+
+        case JSONArray:
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            WriteJsonText(writer, "[", 1);
+
+            for (i = 0; i < count; i++)
+            {
+                if (i > 0)
+                {
+                    WriteJsonText(writer, ",", 1);
+                }
+                WriteJsonValue(writer, json_array_get_value(array, i));
+            }
+
+            WriteJsonText(writer, "]", 1);
+            break;
+
+        case JSONString:
+            WriteJsonString(writer, json_value_get_string(value), json_value_get_string_len(value));
+            break;
+
+        case JSONNumber:
+            if ((length = snprintf(number, sizeof(number), JSON_NUMBER_FORMAT, json_value_get_number(value))) < 0)
+            {
+                writer->failed = true;
+            }
+            else
+            {
+                WriteJsonText(writer, number, (size_t)length);
+            }
+            break;
+
+        case JSONBoolean:
+            if (json_value_get_boolean(value))
+            {
+                WriteJsonText(writer, "true", 4);
+            }
+            else
+            {
+                WriteJsonText(writer, "false", 5);
+            }
+            break;
+
+        case JSONNull:
+            WriteJsonText(writer, "null", 4);
+            break;
+
+        default:
+            writer->failed = true;
+    }
+}
+
+char* TakeJsonWriterBuffer(JSON_WRITER* writer, size_t* size)
+{
+    char* buffer = NULL;
+
+    if (ReserveJsonWriter(writer, 0))
+    {
+        writer->buffer[writer->size] = 0;
+        buffer = writer->buffer;
+
+        if (NULL != size)
+        {
+            *size = writer->size;
+        }
+
+        memset(writer, 0, sizeof(JSON_WRITER));
+    }
+    else
+    {
+        FreeJsonWriter(writer);
+    }
+
+    return buffer;
+}
+
+void FreeJsonWriter(JSON_WRITER* writer)
+{
+    FREE_MEMORY(writer->buffer);
+    memset(writer, 0, sizeof(JSON_WRITER));
+}
+
+char* SerializeJsonValue(const JSON_Value* value, size_t* size)
+{
+    JSON_WRITER writer = {0};
+
+    WriteJsonValue(&writer, value);
+
+    return TakeJsonWriterBuffer(&writer, size);
+}
@@ -23,7 +23,7 @@ static unsigned int g_lastTime = 0;
 
 extern OsConfigLogHandle g_platformLog;
 
-extern char g_mpiCall[MPI_CALL_MESSAGE_LENGTH];
+extern __thread char g_mpiCall[MPI_CALL_MESSAGE_LENGTH];
 
 // All signals on which we want the agent to cleanup before terminating process.
 // SIGKILL is omitted to allow a clean and immediate process kill if needed.
@@ -41,7 +41,7 @@ static int g_stopSignals[] = {
     SIGTSTP  //20
 };
 
-static int g_stopSignal = 0;
+static volatile sig_atomic_t g_stopSignal = 0;
 static int g_refreshSignal = 0;
 
 #define EOL_TERMINATOR "\n"
@@ -81,12 +81,15 @@ static void SignalInterrupt(int signal)
     }
     else
     {
-        OsConfigLogInfo(g_platformLog, "Interrupt signal (%d)", signal);
+        // Logged by the main loop once it stops, logging takes locks and allocates
         g_stopSignal = signal;
     }
 
     if (NULL != errorMessage)
     {
+        // Lines the writer thread did not get to go first, they lead to the crash
+        WriteQueuedLogLines();
+
         if (0 < (logDescriptor = open(LOG_FILE, O_APPEND | O_WRONLY | O_NONBLOCK)))
         {
             if (0 < write(logDescriptor, (const void*)errorMessage, strlen(errorMessage)))
@@ -172,6 +175,7 @@ int main(int argc, char* argv[])
         SetLoggingLevel(GetLoggingLevelFromJsonConfig(jsonConfiguration, GetPlatformLog()));
         SetMaxLogSize(GetMaxLogSizeFromJsonConfig(jsonConfiguration, GetPlatformLog()));
         SetMaxLogSizeDebugMultiplier(GetMaxLogSizeDebugMultiplierFromJsonConfig(jsonConfiguration, GetPlatformLog()));
+        SetStructuredLoggingEnabled(IsStructuredLoggingEnabledInJsonConfig(jsonConfiguration));
         FREE_MEMORY(jsonConfiguration);
     }
 
@@ -208,6 +212,7 @@ int main(int argc, char* argv[])
         }
     }
 
+    OsConfigLogInfo(GetPlatformLog(), "Interrupt signal (%d)", g_stopSignal);
     OsConfigLogInfo(GetPlatformLog(), "OSConfig Platform (PID: %d) exiting with %d", pid, g_stopSignal);
 
     TerminatePlatform();
@@ -0,0 +1,467 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <PlatformCommon.h>
+#include <JsonWriter.h>
+#include <MpiServer.h>
+#include <Metrics.h>
+
+// Distinct module objects tracked, power of two, calls on objects past that are counted together under METRICS_OTHER
+#define METRICS_ENTRIES 1024
+#define METRICS_OTHER "Other"
+
+typedef struct METRICS_HISTOGRAM
+{
+    atomic_uint buckets[METRICS_HISTOGRAM_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong sum;
+    atomic_ullong max;
+} METRICS_HISTOGRAM;
+
+typedef struct METRICS_CALL_COUNTERS
+{
+    atomic_ulong errors;
+    atomic_ulong timeouts;
+
+    // Gets served without calling the module, from the cache or by sharing the result of the same get in flight
+    atomic_ulong cacheHits;
+    atomic_ulong coalesced;
+
+    // In microseconds, its count is the number of calls made
+    METRICS_HISTOGRAM latency;
+
+    // In bytes, the payload handed to MmiSet or returned by MmiGet
+    METRICS_HISTOGRAM payloadSize;
+} METRICS_CALL_COUNTERS;
+
+// One object of a module, never freed once added to g_entries
+typedef struct METRICS_ENTRY
+{
+    char* module;
+    char* component;
+    char* object;
+    size_t hash;
+    METRICS_CALL_COUNTERS calls[METRICS_MMI_CALLS];
+} METRICS_ENTRY;
+
+typedef struct METRICS_REQUEST
+{
+    atomic_ulong errors;
+    METRICS_HISTOGRAM latency;
+    METRICS_HISTOGRAM requestSize;
+    METRICS_HISTOGRAM responseSize;
+} METRICS_REQUEST;
+
+// Open addressing, a slot once set is never changed so lookups need no lock
+static _Atomic(METRICS_ENTRY*) g_entries[METRICS_ENTRIES];
+
+// Counts the calls on objects that did not fit in g_entries, its names are left NULL
+static METRICS_ENTRY g_otherEntry;
+
+// The last one counts requests for unknown URIs
+static const char* g_requestUris[] = {
+    MPI_OPEN_URI,
+    MPI_CLOSE_URI,
+    MPI_SET_URI,
+    MPI_GET_URI,
+    MPI_SET_DESIRED_URI,
+    MPI_GET_REPORTED_URI,
+    MPI_GET_REPORTED_DELTA_URI,
+    MPI_GET_METRICS_URI,
+    METRICS_OTHER
+};
+static METRICS_REQUEST g_requests[ARRAY_SIZE(g_requestUris)];
+
+static METRICS_HISTOGRAM g_queueWait;
+
+static const char* g_metricsCallNames[METRICS_MMI_CALLS] = {"MmiGet", "MmiSet"};
+
+unsigned int GetMetricsBucket(unsigned long long value)
+{
+    unsigned int power = 0;
+
+    if (value > UINT32_MAX)
+    {
+        value = UINT32_MAX;
+    }
+
+    if (value < 4)
+    {
+        return (unsigned int)value;
+    }
+
+    // The power of two selects a group of 4 buckets, the 2 bits below the top one select the bucket within it
+    power = 63 - __builtin_clzll(value);
+    return ((power - 1) * 4) + (unsigned int)((value >> (power - 2)) & 3);
+}
+
+unsigned long long GetMetricsBucketLimit(unsigned int bucket)
+{
+    unsigned int power = 0;
+
+    if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+    {
+        bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    if (bucket < 4)
+    {
+        return bucket;
+    }
+
+    power = (bucket / 4) + 1;
+    return ((5ULL + (bucket % 4)) << (power - 2)) - 1;
+}
+
+static void RecordValue(METRICS_HISTOGRAM* histogram, unsigned long long value)
+{
+    unsigned long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&histogram->buckets[GetMetricsBucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    while ((value > max) && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+    {
+        // max was reloaded by the failed exchange
+    }
+}
+
+static size_t HashEntry(const char* component, const char* object)
+{
+    return (HashString(component) * 33) ^ HashString(object);
+}
+
+static void FreeEntry(METRICS_ENTRY* entry)
+{
+    if (NULL != entry)
+    {
+        FREE_MEMORY(entry->module);
+        FREE_MEMORY(entry->component);
+        FREE_MEMORY(entry->object);
+        FREE_MEMORY(entry);
+    }
+}
+
+static METRICS_ENTRY* CreateEntry(const char* module, const char* component, const char* object, size_t hash)
+{
+    METRICS_ENTRY* entry = NULL;
+
+    if ((NULL == (entry = (METRICS_ENTRY*)calloc(1, sizeof(METRICS_ENTRY)))) ||
+        (NULL == (entry->module = strdup(module))) || (NULL == (entry->component = strdup(component))) || (NULL == (entry->object = strdup(object))))
+    {
+        FreeEntry(entry);
+        return NULL;
+    }
+
+    entry->hash = hash;
+
+    return entry;
+}
+
+static METRICS_ENTRY* FindOrAddEntry(const char* module, const char* component, const char* object)
+{
+    METRICS_ENTRY* entry = NULL;
+    METRICS_ENTRY* created = NULL;
+    size_t hash = 0;
+    size_t i = 0;
+
+    if ((NULL == module) || (NULL == component) || (NULL == object))
+    {
+        return &g_otherEntry;
+    }
+
+    hash = HashEntry(component, object);
+
+    for (i = 0; i < METRICS_ENTRIES; i++)
+    {
+        _Atomic(METRICS_ENTRY*)* slot = &g_entries[(hash + i) & (METRICS_ENTRIES - 1)];
+
+        if (NULL == (entry = atomic_load(slot)))
+        {
+            if ((NULL == created) && (NULL == (created = CreateEntry(module, component, object, hash))))
+            {
+                break;
+            }
+
+            // Another thread may take the slot first, the entry it added is checked below like any other
+            if (atomic_compare_exchange_strong(slot, &entry, created))
+            {
+                return created;
+            }
+        }
+
+        if ((hash == entry->hash) && (0 == strcmp(entry->component, component)) && (0 == strcmp(entry->object, object)))
+        {
+            FreeEntry(created);
+            return entry;
+        }
+    }
+
+    FreeEntry(created);
+
+    return &g_otherEntry;
+}
+
+void RecordModuleCall(const char* module, const char* component, const char* object, METRICS_CALL call, long microseconds, int payloadSizeBytes, int status)
+{
+    METRICS_CALL_COUNTERS* counters = NULL;
+
+    if ((call < 0) || (call >= METRICS_MMI_CALLS))
+    {
+        return;
+    }
+
+    counters = &FindOrAddEntry(module, component, object)->calls[call];
+
+    RecordValue(&counters->latency, (microseconds > 0) ? (unsigned long long)microseconds : 0);
+    RecordValue(&counters->payloadSize, (payloadSizeBytes > 0) ? (unsigned long long)payloadSizeBytes : 0);
+
+    if (MMI_OK != status)
+    {
+        atomic_fetch_add_explicit(&counters->errors, 1, memory_order_relaxed);
+    }
+}
+
+void RecordModuleTimeout(const char* module, const char* component, const char* object, METRICS_CALL call)
+{
+    atomic_fetch_add_explicit(&FindOrAddEntry(module, component, object)->calls[call].timeouts, 1, memory_order_relaxed);
+}
+
+void RecordModuleCacheHit(const char* module, const char* component, const char* object, bool coalesced)
+{
+    METRICS_CALL_COUNTERS* counters = &FindOrAddEntry(module, component, object)->calls[METRICS_MMI_GET];
+
+    atomic_fetch_add_explicit(coalesced ? &counters->coalesced : &counters->cacheHits, 1, memory_order_relaxed);
+}
+
+void RecordMpiRequest(const char* uri, long microseconds, int requestSizeBytes, int responseSizeBytes, int httpStatus)
+{
+    METRICS_REQUEST* request = &g_requests[ARRAY_SIZE(g_requests) - 1];
+    size_t i = 0;
+
+    for (i = 0; (NULL != uri) && (i < ARRAY_SIZE(g_requests) - 1); i++)
+    {
+        if (0 == strcmp(g_requestUris[i], uri))
+        {
+            request = &g_requests[i];
+            break;
+        }
+    }
+
+    RecordValue(&request->latency, (microseconds > 0) ? (unsigned long long)microseconds : 0);
+    RecordValue(&request->requestSize, (requestSizeBytes > 0) ? (unsigned long long)requestSizeBytes : 0);
+    RecordValue(&request->responseSize, (responseSizeBytes > 0) ? (unsigned long long)responseSizeBytes : 0);
+
+    if (HTTP_OK != httpStatus)
+    {
+        atomic_fetch_add_explicit(&request->errors, 1, memory_order_relaxed);
+    }
+}
+
+void RecordQueueWait(long microseconds)
+{
+    RecordValue(&g_queueWait, (microseconds > 0) ? (unsigned long long)microseconds : 0);
+}
+
+static unsigned long long GetPercentile(const unsigned int* buckets, unsigned long long count, unsigned long long max, unsigned int percent)
+{
+    unsigned long long rank = ((count * percent) + 99) / 100;
+    unsigned long long seen = 0;
+    unsigned long long limit = 0;
+    unsigned int i = 0;
+
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        if ((seen += buckets[i]) >= rank)
+        {
+            limit = GetMetricsBucketLimit(i);
+            break;
+        }
+    }
+
+    return (limit < max) ? limit : max;
+}
+
+// Counters keep changing while read, the totals are taken from the buckets read so that they agree with each other
+static JSON_Value* SerializeHistogram(METRICS_HISTOGRAM* histogram)
+{
+    JSON_Value* value = json_value_init_object();
+    JSON_Object* object = json_value_get_object(value);
+    JSON_Value* bucketsValue = json_value_init_array();
+    JSON_Array* bucketsArray = json_value_get_array(bucketsValue);
+    JSON_Value* bucketValue = NULL;
+    unsigned int buckets[METRICS_HISTOGRAM_BUCKETS] = {0};
+    unsigned long long count = 0;
+    unsigned long long sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    unsigned long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    unsigned int i = 0;
+
+    if ((NULL == object) || (NULL == bucketsArray))
+    {
+        json_value_free(bucketsValue);
+        json_value_free(value);
+        return NULL;
+    }
+
+    for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        count += buckets[i];
+
+        if ((0 < buckets[i]) && (NULL != (bucketValue = json_value_init_object())))
+        {
+            json_object_set_number(json_value_get_object(bucketValue), "UpTo", (double)GetMetricsBucketLimit(i));
+            json_object_set_number(json_value_get_object(bucketValue), "Count", (double)buckets[i]);
+            json_array_append_value(bucketsArray, bucketValue);
+        }
+    }
+
+    json_object_set_number(object, "Count", (double)count);
+    json_object_set_number(object, "Mean", count ? (double)(sum / count) : 0);
+    json_object_set_number(object, "P50", (double)GetPercentile(buckets, count, max, 50));
+    json_object_set_number(object, "P90", (double)GetPercentile(buckets, count, max, 90));
+    json_object_set_number(object, "P99", (double)GetPercentile(buckets, count, max, 99));
+    json_object_set_number(object, "Max", (double)max);
+    json_object_set_value(object, "Buckets", bucketsValue);
+
+    return value;
+}
+
+static JSON_Object* GetOrAddObject(JSON_Object* parent, const char* name)
+{
+    JSON_Object* object = NULL;
+    JSON_Value* value = NULL;
+
+    if ((NULL == (object = json_object_get_object(parent, name))) && (NULL != (value = json_value_init_object())))
+    {
+        if (JSONSuccess == json_object_set_value(parent, name, value))
+        {
+            object = json_value_get_object(value);
+        }
+        else
+        {
+            json_value_free(value);
+        }
+    }
+
+    return object;
+}
+
+// Adds the counts of a call to the totals of its module or component
+static void AddCallTotals(JSON_Object* parent, const char* call, unsigned long long count, unsigned long errors, unsigned long timeouts)
+{
+    JSON_Object* totals = GetOrAddObject(parent, call);
+
+    json_object_set_number(totals, "Count", json_object_get_number(totals, "Count") + (double)count);
+    json_object_set_number(totals, "Errors", json_object_get_number(totals, "Errors") + (double)errors);
+    json_object_set_number(totals, "Timeouts", json_object_get_number(totals, "Timeouts") + (double)timeouts);
+}
+
+static void SerializeEntry(JSON_Object* modules, METRICS_ENTRY* entry)
+{
+    METRICS_CALL_COUNTERS* counters = NULL;
+    JSON_Object* module = NULL;
+    JSON_Object* component = NULL;
+    JSON_Object* object = NULL;
+    JSON_Object* call = NULL;
+    unsigned long long count = 0;
+    unsigned long errors = 0;
+    unsigned long timeouts = 0;
+    unsigned long served = 0;
+    int i = 0;
+
+    for (i = 0; i < METRICS_MMI_CALLS; i++)
+    {
+        counters = &entry->calls[i];
+        count = atomic_load_explicit(&counters->latency.count, memory_order_relaxed);
+        errors = atomic_load_explicit(&counters->errors, memory_order_relaxed);
+        timeouts = atomic_load_explicit(&counters->timeouts, memory_order_relaxed);
+        served = atomic_load_explicit(&counters->cacheHits, memory_order_relaxed) + atomic_load_explicit(&counters->coalesced, memory_order_relaxed);
+
+        if ((0 == count) && (0 == timeouts) && (0 == served))
+        {
+            continue;
+        }
+
+        if ((NULL == (module = GetOrAddObject(modules, entry->module ? entry->module : METRICS_OTHER))) ||
+            (NULL == (component = GetOrAddObject(GetOrAddObject(module, "Components"), entry->component ? entry->component : METRICS_OTHER))) ||
+            (NULL == (object = GetOrAddObject(GetOrAddObject(component, "Objects"), entry->object ? entry->object : METRICS_OTHER))) ||
+            (NULL == (call = GetOrAddObject(object, g_metricsCallNames[i]))))
+        {
+            continue;
+        }
+
+        AddCallTotals(module, g_metricsCallNames[i], count, errors, timeouts);
+        AddCallTotals(component, g_metricsCallNames[i], count, errors, timeouts);
+
+        json_object_set_number(call, "Count", (double)count);
+        json_object_set_number(call, "Errors", (double)errors);
+        json_object_set_number(call, "Timeouts", (double)timeouts);
+
+        if (0 < served)
+        {
+            json_object_set_number(call, "CacheHits", (double)atomic_load_explicit(&counters->cacheHits, memory_order_relaxed));
+            json_object_set_number(call, "Coalesced", (double)atomic_load_explicit(&counters->coalesced, memory_order_relaxed));
+            json_object_set_number(call, "HitRate", (double)served / (double)(served + count));
+        }
+        json_object_set_value(call, "Latency", SerializeHistogram(&counters->latency));
+        json_object_set_value(call, "PayloadBytes", SerializeHistogram(&counters->payloadSize));
+    }
+}
+
+char* SerializeMetrics(void)
+{
+    JSON_Value* rootValue = NULL;
+    JSON_Object* rootObject = NULL;
+    JSON_Object* requests = NULL;
+    JSON_Object* request = NULL;
+    JSON_Object* modules = NULL;
+    METRICS_ENTRY* entry = NULL;
+    char* serialized = NULL;
+    size_t i = 0;
+
+    if ((NULL == (rootValue = json_value_init_object())) || (NULL == (rootObject = json_value_get_object(rootValue))) ||
+        (NULL == (requests = GetOrAddObject(rootObject, "Requests"))) || (NULL == (modules = GetOrAddObject(rootObject, "Modules"))))
+    {
+        OsConfigLogError(GetPlatformLog(), "SerializeMetrics: failed to allocate memory for metrics");
+        json_value_free(rootValue);
+        return NULL;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(g_requests); i++)
+    {
+        if ((0 < atomic_load_explicit(&g_requests[i].latency.count, memory_order_relaxed)) && (NULL != (request = GetOrAddObject(requests, g_requestUris[i]))))
+        {
+            json_object_set_number(request, "Count", (double)atomic_load_explicit(&g_requests[i].latency.count, memory_order_relaxed));
+            json_object_set_number(request, "Errors", (double)atomic_load_explicit(&g_requests[i].errors, memory_order_relaxed));
+            json_object_set_value(request, "Latency", SerializeHistogram(&g_requests[i].latency));
+            json_object_set_value(request, "RequestBytes", SerializeHistogram(&g_requests[i].requestSize));
+            json_object_set_value(request, "ResponseBytes", SerializeHistogram(&g_requests[i].responseSize));
+        }
+    }
+
+    json_object_set_value(rootObject, "QueueWait", SerializeHistogram(&g_queueWait));
+
+    for (i = 0; i < METRICS_ENTRIES; i++)
+    {
+        if (NULL != (entry = atomic_load(&g_entries[i])))
+        {
+            SerializeEntry(modules, entry);
+        }
+    }
+
+    SerializeEntry(modules, &g_otherEntry);
+
+    // Allocated here rather than by parson so that the response can be freed like any other
+    if (NULL == (serialized = SerializeJsonValue(rootValue, NULL)))
+    {
+        OsConfigLogError(GetPlatformLog(), "SerializeMetrics: failed to serialize metrics");
+    }
+
+    json_value_free(rootValue);
+
+    return serialized;
+}
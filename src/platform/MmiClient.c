@@ -10,6 +10,7 @@ static const char* g_mmiGetFunction = "MmiGet";
 static const char* g_mmiSetFunction = "MmiSet";
 static const char* g_mmiGetInfoFunction = "MmiGetInfo";
 static const char* g_mmiFreeFunction = "MmiFree";
+static const char* g_mmiSetRawFunction = "MmiSetRaw";
 
 // Required module info fields
 static const char* g_infoName = "Name";
@@ -27,6 +28,14 @@ static const char* g_infoVersionTweak = "VersionTweak";
 static const char* g_infoLicenseUri = "LicenseUri";
 static const char* g_infoProjectUri = "ProjectUri";
 static const char* g_infoUserAccount = "UserAccount";
+static const char* g_infoRawPayloads = "RawPayloads";
+static const char* g_infoCachedObjects = "CachedObjects";
+static const char* g_infoComponentName = "ComponentName";
+static const char* g_infoObjectName = "ObjectName";
+static const char* g_infoCacheSeconds = "CacheSeconds";
+
+// Longest time a module can have a reported object cached for
+#define MAX_CACHE_SECONDS 3600
 
 static void FreeModuleInfo(MODULE_INFO* info)
 {
@@ -54,10 +63,68 @@ static void FreeModuleInfo(MODULE_INFO* info)
             FREE_MEMORY(info->components);
         }
 
+        for (i = 0; i < (int)info->cachedObjectCount; i++)
+        {
+            FREE_MEMORY(info->cachedObjects[i].component);
+            FREE_MEMORY(info->cachedObjects[i].object);
+        }
+
+        FREE_MEMORY(info->cachedObjects);
+
         FREE_MEMORY(info);
     }
 }
 
+// Optional, entries that are not valid are left out rather than failing the module
+static void ParseCachedObjects(const JSON_Object* object, MODULE_INFO* info)
+{
+    JSON_Array* cachedObjects = NULL;
+    JSON_Object* cachedObject = NULL;
+    const char* componentName = NULL;
+    const char* objectName = NULL;
+    CACHED_OBJECT* cached = NULL;
+    int count = 0;
+    int seconds = 0;
+    int i = 0;
+
+    if ((NULL == (cachedObjects = json_object_get_array(object, g_infoCachedObjects))) || (0 == (count = (int)json_array_get_count(cachedObjects))))
+    {
+        return;
+    }
+
+    if (NULL == (info->cachedObjects = (CACHED_OBJECT*)calloc(count, sizeof(CACHED_OBJECT))))
+    {
+        OsConfigLogError(GetPlatformLog(), "ParseModuleInfo: failed to allocate memory for cached objects");
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        cached = &info->cachedObjects[info->cachedObjectCount];
+
+        if ((NULL == (cachedObject = json_array_get_object(cachedObjects, i))) ||
+            (NULL == (componentName = json_object_get_string(cachedObject, g_infoComponentName))) ||
+            (NULL == (objectName = json_object_get_string(cachedObject, g_infoObjectName))))
+        {
+            OsConfigLogError(GetPlatformLog(), "ParseModuleInfo: cached object at index %d is missing '%s' or '%s'", i, g_infoComponentName, g_infoObjectName);
+        }
+        else if ((0 >= (seconds = (int)json_object_get_number(cachedObject, g_infoCacheSeconds))) || (MAX_CACHE_SECONDS < seconds))
+        {
+            OsConfigLogError(GetPlatformLog(), "ParseModuleInfo: cached object '%s.%s' has invalid '%s' (%d)", componentName, objectName, g_infoCacheSeconds, seconds);
+        }
+        else if ((NULL == (cached->component = strdup(componentName))) || (NULL == (cached->object = strdup(objectName))))
+        {
+            OsConfigLogError(GetPlatformLog(), "ParseModuleInfo: failed to allocate memory for cached object '%s.%s'", componentName, objectName);
+            FREE_MEMORY(cached->component);
+        }
+        else
+        {
+            cached->seconds = (unsigned int)seconds;
+            info->cachedObjectCount += 1;
+        }
+    }
+}
+
 static int ParseModuleInfo(const JSON_Value* value, MODULE_INFO** moduleInfo)
 {
     MODULE_INFO* info = NULL;
@@ -151,6 +218,8 @@ static int ParseModuleInfo(const JSON_Value* value, MODULE_INFO** moduleInfo)
             info->version.minor = json_object_get_number(object, g_infoVersionMinor);
             info->version.patch = json_object_get_number(object, g_infoVersionPatch);
             info->version.tweak = json_object_get_number(object, g_infoVersionTweak);
+            info->rawPayloads = (1 == json_object_get_boolean(object, g_infoRawPayloads));
+            ParseCachedObjects(object, info);
 
             if (json_object_has_value_of_type(object, g_infoLifetime, JSONNumber))
             {
@@ -218,6 +287,105 @@ static int ParseModuleInfo(const JSON_Value* value, MODULE_INFO** moduleInfo)
     return status;
 }
 
+static MODULE* CreateModule(const char* path)
+{
+    MODULE* module = NULL;
+
+    if (NULL == (module = (MODULE*)malloc(sizeof(MODULE))))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: failed to allocate memory for module");
+        return NULL;
+    }
+
+    memset(module, 0, sizeof(MODULE));
+    pthread_mutex_init(&module->lock, NULL);
+
+    if (NULL == (module->path = strdup(path)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: failed to allocate memory for module name");
+        UnloadModule(module);
+        module = NULL;
+    }
+
+    return module;
+}
+
+static int OpenModuleLibrary(MODULE* module)
+{
+    const char* path = module->path;
+    int status = 0;
+
+    if (NULL == (module->handle = dlopen(path, RTLD_NOW)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: failed to load module %s: ", dlerror());
+        return ENOENT;
+    }
+
+    if (NULL == (module->getInfo = (MMI_GETINFO)dlsym(module->handle, g_mmiGetInfoFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiGetInfoFunction, path);
+        status = ENOENT;
+    }
+
+    if (NULL == (module->open = (MMI_OPEN)dlsym(module->handle, g_mmiOpenFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiOpenFunction, path);
+        status = ENOENT;
+    }
+
+    if (NULL == (module->close = (MMI_CLOSE)dlsym(module->handle, g_mmiCloseFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiCloseFunction, path);
+        status = ENOENT;
+    }
+
+    if (NULL == (module->get = (MMI_GET)dlsym(module->handle, g_mmiGetFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiGetFunction, path);
+        status = ENOENT;
+    }
+
+    if (NULL == (module->set = (MMI_SET)dlsym(module->handle, g_mmiSetFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiSetFunction, path);
+        status = ENOENT;
+    }
+
+    if (NULL == (module->free = (MMI_FREE)dlsym(module->handle, g_mmiFreeFunction)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiFreeFunction, path);
+        status = ENOENT;
+    }
+
+    return status;
+}
+
+// Optional entry points depend on the module info
+static void OpenOptionalEntryPoints(MODULE* module)
+{
+    if (module->info->rawPayloads && (NULL == (module->setRaw = (MMI_SET)dlsym(module->handle, g_mmiSetRawFunction))))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implemented by '%s', using '%s()'", g_mmiSetRawFunction, module->path, g_mmiSetFunction);
+    }
+}
+
+void UnloadModuleLibrary(MODULE* module)
+{
+    if (NULL != module->handle)
+    {
+        dlclose(module->handle);
+        module->handle = NULL;
+    }
+
+    module->getInfo = NULL;
+    module->open = NULL;
+    module->close = NULL;
+    module->get = NULL;
+    module->set = NULL;
+    module->setRaw = NULL;
+    module->free = NULL;
+}
+
 MODULE* LoadModule(const char* client, const char* path)
 {
     int status = 0;
@@ -232,87 +400,39 @@ MODULE* LoadModule(const char* client, const char* path)
         OsConfigLogError(GetPlatformLog(), "LoadModule(%p, %p) called with invalid arguments", client, path);
         status = EINVAL;
     }
-    else if (NULL == (module = (MODULE*)malloc(sizeof(MODULE))))
+    else if (NULL == (module = CreateModule(path)))
     {
-        OsConfigLogError(GetPlatformLog(), "LoadModule: failed to allocate memory for module");
         status = ENOMEM;
     }
     else
     {
         OsConfigLogInfo(GetPlatformLog(), "Loading module '%s'", path);
 
-        memset(module, 0, sizeof(MODULE));
-
-        if (NULL == (module->path = strdup(path)))
-        {
-            OsConfigLogError(GetPlatformLog(), "LoadModule: failed to allocate memory for module name");
-            status = errno;
-        }
-        else if (NULL == (module->handle = dlopen(path, RTLD_NOW)))
-        {
-            OsConfigLogError(GetPlatformLog(), "LoadModule: failed to load module %s: ", dlerror());
-            status = ENOENT;
-        }
-        else
+        if (0 == (status = OpenModuleLibrary(module)))
         {
-            if (NULL == (module->getInfo = (MMI_GETINFO)dlsym(module->handle, g_mmiGetInfoFunction)))
-            {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiGetInfoFunction, path);
-                status = ENOENT;
-            }
-
-            if (NULL == (module->open = (MMI_OPEN)dlsym(module->handle, g_mmiOpenFunction)))
+            if (MMI_OK != (module->getInfo(client, &payload, &payloadSize)))
             {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiOpenFunction, path);
+                OsConfigLogError(GetPlatformLog(), "LoadModule: failed to get module info '%s'", path);
                 status = ENOENT;
             }
-
-            if (NULL == (module->close = (MMI_CLOSE)dlsym(module->handle, g_mmiCloseFunction)))
+            else if (NULL == (value = json_parse_string(payload)))
             {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiCloseFunction, path);
+                OsConfigLogError(GetPlatformLog(), "LoadModule: failed to parse module info '%s'", path);
                 status = ENOENT;
             }
-
-            if (NULL == (module->get = (MMI_GET)dlsym(module->handle, g_mmiGetFunction)))
+            else if (0 != (status = ParseModuleInfo(value, &info)))
             {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiGetFunction, path);
+                OsConfigLogError(GetPlatformLog(), "LoadModule: failed to parse module info '%s'", path);
                 status = ENOENT;
             }
-
-            if (NULL == (module->set = (MMI_SET)dlsym(module->handle, g_mmiSetFunction)))
-            {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiSetFunction, path);
-                status = ENOENT;
-            }
-
-            if (NULL == (module->free = (MMI_FREE)dlsym(module->handle, g_mmiFreeFunction)))
+            else
             {
-                OsConfigLogError(GetPlatformLog(), "LoadModule: function '%s()' not implmenented by '%s'", g_mmiFreeFunction, path);
-                status = ENOENT;
-            }
+                OsConfigLogInfo(GetPlatformLog(), "Module loaded '%s' (v%d.%d.%d)", info->name, info->version.major, info->version.minor, info->version.patch);
+                module->info = info;
+                module->infoValue = value;
+                value = NULL;
 
-            if (0 == status)
-            {
-                if (MMI_OK != (module->getInfo(client, &payload, &payloadSize)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "LoadModule: failed to get module info '%s'", path);
-                    status = ENOENT;
-                }
-                else if (NULL == (value = json_parse_string(payload)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "LoadModule: failed to parse module info '%s'", path);
-                    status = ENOENT;
-                }
-                else if (0 != (status = ParseModuleInfo(value, &info)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "LoadModule: failed to parse module info '%s'", path);
-                    status = ENOENT;
-                }
-                else
-                {
-                    OsConfigLogInfo(GetPlatformLog(), "Module loaded '%s' (v%d.%d.%d)", info->name, info->version.major, info->version.minor, info->version.patch);
-                    module->info = info;
-                }
+                OpenOptionalEntryPoints(module);
             }
         }
     }
@@ -334,27 +454,76 @@ MODULE* LoadModule(const char* client, const char* path)
     return module;
 }
 
-void UnloadModule(MODULE* module)
+MODULE* LoadIndexedModule(const char* path, const JSON_Value* infoValue)
 {
-    if (module)
+    MODULE* module = NULL;
+    MODULE_INFO* info = NULL;
+
+    if ((NULL == path) || (NULL == infoValue))
     {
-        OsConfigLogInfo(GetPlatformLog(), "Unloading module (%p)", module);
+        OsConfigLogError(GetPlatformLog(), "LoadIndexedModule(%p, %p) called with invalid arguments", path, infoValue);
+    }
+    else if (0 != ParseModuleInfo(infoValue, &info))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadIndexedModule: failed to parse indexed module info for '%s'", path);
+    }
+    else if (NULL == (module = CreateModule(path)))
+    {
+        FreeModuleInfo(info);
+    }
+    else if (NULL == (module->infoValue = json_value_deep_copy(infoValue)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadIndexedModule: failed to allocate memory for module info");
+        FreeModuleInfo(info);
+        UnloadModule(module);
+        module = NULL;
+    }
+    else
+    {
+        module->info = info;
+        OsConfigLogDebug(GetPlatformLog(), "Module indexed '%s' from '%s', loading it on first use", info->name, path);
+    }
+
+    return module;
+}
+
+int EnsureModuleLoaded(MODULE* module)
+{
+    int status = 0;
+
+    if (NULL == module)
+    {
+        status = EINVAL;
+    }
+    else if (NULL == module->handle)
+    {
+        OsConfigLogInfo(GetPlatformLog(), "Loading module '%s' on first use", module->path);
 
-        if (NULL != module->handle)
+        if (0 == (status = OpenModuleLibrary(module)))
         {
-            dlclose(module->handle);
-            module->handle = NULL;
+            OpenOptionalEntryPoints(module);
         }
+        else
+        {
+            UnloadModuleLibrary(module);
+        }
+    }
+
+    return status;
+}
+
+void UnloadModule(MODULE* module)
+{
+    if (module)
+    {
+        OsConfigLogInfo(GetPlatformLog(), "Unloading module (%p)", module);
 
-        module->getInfo = NULL;
-        module->open = NULL;
-        module->close = NULL;
-        module->get = NULL;
-        module->set = NULL;
-        module->free = NULL;
+        UnloadModuleLibrary(module);
 
         FreeModuleInfo(module->info);
+        json_value_free(module->infoValue);
 
+        pthread_mutex_destroy(&module->lock);
         FREE_MEMORY(module->path);
         FREE_MEMORY(module);
     }
@@ -1,16 +1,45 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <stdatomic.h>
 #include <PlatformCommon.h>
+#include <JsonWriter.h>
 #include <MmiClient.h>
+#include <Metrics.h>
 
 #define AZURE_OSCONFIG "Azure OSConfig"
 #define MODULE_EXT ".so"
 
+// Time given to each module to return all its reported objects, modules still busy after that are left out of the report
+#define MODULE_REPORTED_TIMEOUT 20000
+
+// Time given to a module to complete a call made on behalf of a client, unless set for the module in osconfig.json
+#define MODULE_CALL_TIMEOUT 300000
+#define MAX_MODULE_CALL_TIMEOUT_SECONDS 86400
+
+// Most threads applying a desired payload at once, one module is applied by only one of them at a time
+#define MODULE_DESIRED_THREADS 4
+
+// Most threads indexing or loading modules at once during startup
+#define MODULE_LOAD_THREADS 8
+
+// Initial number of buckets of the session table, doubled whenever there are more sessions than buckets
+#define SESSION_BUCKETS 64
+
 static const char* g_modelVersion = "ModelVersion";
 static const char* g_reportedObjectType = "Reported";
 static const char* g_componentName = "ComponentName";
 static const char* g_objectName = "ObjectName";
+static const char* g_moduleCallTimeouts = "ModuleCallTimeoutSeconds";
+
+// Module index fields
+static const char* g_indexClientName = "ClientName";
+static const char* g_indexModules = "Modules";
+static const char* g_indexPath = "Path";
+static const char* g_indexModifiedSeconds = "ModifiedSeconds";
+static const char* g_indexModifiedNanoseconds = "ModifiedNanoseconds";
+static const char* g_indexSize = "Size";
+static const char* g_indexInfo = "Info";
 
 typedef struct MODULE_SESSION
 {
@@ -24,22 +53,231 @@ typedef struct SESSION
 {
     char* uuid;
     char* client;
+    unsigned int maxPayloadSizeBytes;
+
+    // Opened on the first call for one of the components of the module
     MODULE_SESSION* modules;
 
+    // Serializes the calls made on the session, calls on different sessions run concurrently
+    pthread_mutex_t lock;
+
+    // Calls in flight, a closed session is freed once the last of them completes
+    int references;
+    bool closed;
+
+    // Hash of the reported objects last returned by MpiGetReportedDelta, in the order of g_reported
+    size_t* reportedHashes;
+    unsigned int reportedGeneration;
+
+    // Monotonic time in seconds of the last call made on the session, see CloseIdleSessions
+    time_t lastUsed;
+
+    // Next session in the same bucket of g_sessions
     struct SESSION* next;
 } SESSION;
 
+typedef enum MODULE_CALL_TYPE
+{
+    MODULE_CALL_OPEN = 0,
+    MODULE_CALL_CLOSE = 1,
+    MODULE_CALL_GET = 2,
+    MODULE_CALL_SET = 3
+} MODULE_CALL_TYPE;
+
+// A call queued to the dispatcher of a module, freed by whichever of the caller and the dispatcher is done with it last
+typedef struct MODULE_CALL
+{
+    MODULE_CALL_TYPE type;
+    MMI_HANDLE handle;
+    char* client;
+    unsigned int maxPayloadSizeBytes;
+    char* component;
+    char* object;
+    MMI_SET set;
+
+    // Copied for a set, a copy of what the module returned for a get, freed with FREE_MEMORY either way
+    MMI_JSON_STRING payload;
+    int payloadSizeBytes;
+
+    int status;
+    bool started;
+    bool finished;
+    struct timespec startTime;
+    int references;
+
+    struct MODULE_CALL* next;
+} MODULE_CALL;
+
+// The payload last returned by MmiGet for an object the module allows to cache
+// Kept per payload size limit, a module may return a different payload, or none, under a smaller limit
+typedef struct CACHED_PAYLOAD
+{
+    const CACHED_OBJECT* object;
+    unsigned int maxPayloadSizeBytes;
+    MMI_JSON_STRING payload;
+    int payloadSizeBytes;
+    struct timespec cached;
+    struct CACHED_PAYLOAD* next;
+} CACHED_PAYLOAD;
+
+// Makes the calls into one module, one after the other on a thread of its own, so that a module that hangs holds up only its callers
+typedef struct MODULE_DISPATCHER
+{
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t finished;
+    MODULE_CALL* head;
+    MODULE_CALL* running;
+    bool stopping;
+
+    // Set when the running call timed out, until it completes
+    bool stuck;
+
+    // Emptied whenever a set is made into the module
+    CACHED_PAYLOAD* cache;
+
+    pthread_t thread;
+} MODULE_DISPATCHER;
+
+// A module file found in the modules directory, indexed or loaded by one of the loader threads
+typedef struct MODULE_PROBE
+{
+    char* path;
+    MODULE* module;
+    bool indexed;
+
+    // In microseconds, from when LoadModules started to look at the modules, for the startup timeline
+    long started;
+    long duration;
+} MODULE_PROBE;
+
+typedef struct MODULE_LOADING
+{
+    pthread_mutex_t lock;
+    MODULE_PROBE* probes;
+    int count;
+    int next;
+    const char* clientName;
+    JSON_Array* indexedModules;
+    struct timespec started;
+} MODULE_LOADING;
+
+// Routes a component to the module that implements it
+typedef struct COMPONENT_ROUTE
+{
+    const char* component;
+    MODULE* module;
+    struct COMPONENT_ROUTE* next;
+} COMPONENT_ROUTE;
+
 typedef struct REPORTED_OBJECT
 {
     char* component;
     char* object;
+
+    // Linked when loaded so that reports are written in one pass: the next object of the same component and
+    // the next one with the same name, -1 for none. Objects without a name are neither first nor written.
+    int nextInComponent;
+    int nextDuplicate;
+    bool firstInComponent;
+    bool duplicate;
 } REPORTED_OBJECT;
 
-static SESSION* g_sessions = NULL;
+typedef struct REPORTED_RESULT
+{
+    bool collected;
+    JSON_Value* value;
+    size_t hash;
+} REPORTED_RESULT;
+
+// State shared between MpiGetReported and its collector threads, each of which fills in the results of its own objects
+typedef struct REPORTED_COLLECTION
+{
+    // One per reported object, in the order of g_reported
+    REPORTED_RESULT* results;
+    int count;
+
+    // Hashes of the values the client already has, objects whose value hashes the same are not parsed (optional)
+    const size_t* previousHashes;
+
+    // Monotonic, the collectors give up on their modules past it
+    struct timespec expires;
+} REPORTED_COLLECTION;
+
+// Collects the reported objects of one module, one after the other
+typedef struct REPORTED_COLLECTOR
+{
+    REPORTED_COLLECTION* collection;
+    MODULE* module;
+    MMI_HANDLE handle;
+    unsigned int maxPayloadSizeBytes;
+    int* indexes;
+    int count;
+    pthread_t thread;
+    bool started;
+} REPORTED_COLLECTOR;
+
+// One object of a desired payload, its value is a slice of the payload
+typedef struct DESIRED_OBJECT
+{
+    const char* component;
+    char* object;
+    const char* value;
+    int valueSize;
+    int module;
+    int status;
+} DESIRED_OBJECT;
+
+// The desired objects of one module, applied one after the other in the order of the payload
+typedef struct DESIRED_MODULE
+{
+    MODULE_SESSION* moduleSession;
+    int* indexes;
+    int count;
+} DESIRED_MODULE;
+
+// Shared by the threads applying a desired payload, each takes the next module not taken yet
+typedef struct DESIRED_APPLICATION
+{
+    pthread_mutex_t lock;
+    JsonMember* components;
+    int componentCount;
+    DESIRED_OBJECT* objects;
+    int objectCount;
+    DESIRED_MODULE* modules;
+    int moduleCount;
+    int next;
+} DESIRED_APPLICATION;
+
+// Hash table of the open sessions keyed by UUID
+static SESSION** g_sessions = NULL;
+static size_t g_sessionBuckets = 0;
+static size_t g_sessionCount = 0;
+
 static MODULE* g_modules = NULL;
+
+// Hash table of the components of g_modules, built when the modules are indexed
+static COMPONENT_ROUTE** g_components = NULL;
+static COMPONENT_ROUTE* g_componentRoutes = NULL;
+static size_t g_componentBuckets = 0;
+
 static REPORTED_OBJECT* g_reported = NULL;
 static int g_reportedTotal = 0;
 
+// Guards the session table and the session reference counts
+static pthread_mutex_t g_sessionsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Guards loading and unloading of the modules
+static pthread_mutex_t g_modulesLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set once the modules are indexed, so that checking for it on every request takes no lock
+static atomic_bool g_modulesLoaded = false;
+
+static pthread_once_t g_uuidSeeded = PTHREAD_ONCE_INIT;
+
+// Guards MODULE.dispatcher
+static pthread_mutex_t g_dispatchersLock = PTHREAD_MUTEX_INITIALIZER;
+
 OsConfigLogHandle g_platformLog = NULL;
 
 OsConfigLogHandle GetPlatformLog(void)
@@ -47,7 +285,334 @@ OsConfigLogHandle GetPlatformLog(void)
     return g_platformLog;
 }
 
-static void LoadModules(const char* directory, const char* configJson)
+// Returns the indexed modules when the index was written for the same client, otherwise NULL
+static JSON_Array* ReadModuleIndex(JSON_Value* indexValue, const char* clientName)
+{
+    JSON_Object* indexObject = json_value_get_object(indexValue);
+    const char* indexClientName = json_object_get_string(indexObject, g_indexClientName);
+
+    if ((NULL == indexClientName) || (NULL == clientName) || (0 != strcmp(indexClientName, clientName)))
+    {
+        OsConfigLogInfo(GetPlatformLog(), "LoadModules: the module index is missing or was written for another client, all modules are loaded");
+        return NULL;
+    }
+
+    return json_object_get_array(indexObject, g_indexModules);
+}
+
+// Creates the module from the index when its file did not change since it was indexed, otherwise loads it
+static MODULE* IndexOrLoadModule(const char* clientName, const char* path, JSON_Array* indexedModules, bool* indexed)
+{
+    MODULE* module = NULL;
+    JSON_Object* entry = NULL;
+    struct stat fileStat = {0};
+    int count = (int)json_array_get_count(indexedModules);
+    int i = 0;
+
+    *indexed = false;
+
+    if (0 != stat(path, &fileStat))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to get the status of '%s' (%d)", path, errno);
+        return NULL;
+    }
+
+    for (i = 0; (i < count) && (NULL == module); i++)
+    {
+        if ((NULL != (entry = json_array_get_object(indexedModules, i))) &&
+            (NULL != json_object_get_string(entry, g_indexPath)) && (0 == strcmp(json_object_get_string(entry, g_indexPath), path)) &&
+            ((double)fileStat.st_mtim.tv_sec == json_object_get_number(entry, g_indexModifiedSeconds)) &&
+            ((double)fileStat.st_mtim.tv_nsec == json_object_get_number(entry, g_indexModifiedNanoseconds)) &&
+            ((double)fileStat.st_size == json_object_get_number(entry, g_indexSize)))
+        {
+            *indexed = (NULL != (module = LoadIndexedModule(path, json_object_get_value(entry, g_indexInfo))));
+        }
+    }
+
+    if ((NULL == module) && (NULL != (module = LoadModule(clientName, path))))
+    {
+        // No longer needed once the module info is indexed, the module is loaded again on first use
+        pthread_mutex_lock(&module->lock);
+        UnloadModuleLibrary(module);
+        pthread_mutex_unlock(&module->lock);
+    }
+
+    if (NULL != module)
+    {
+        module->modified = fileStat.st_mtim;
+        module->size = fileStat.st_size;
+    }
+
+    return module;
+}
+
+static long GetMicrosecondsSince(const struct timespec* since)
+{
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - since->tv_sec) * 1000000) + ((now.tv_nsec - since->tv_nsec) / 1000);
+}
+
+static void* ModuleLoaderThread(void* argument)
+{
+    MODULE_LOADING* loading = (MODULE_LOADING*)argument;
+    MODULE_PROBE* probe = NULL;
+
+    while (true)
+    {
+        pthread_mutex_lock(&loading->lock);
+        probe = (loading->next < loading->count) ? &loading->probes[loading->next++] : NULL;
+        pthread_mutex_unlock(&loading->lock);
+
+        if (NULL == probe)
+        {
+            break;
+        }
+
+        probe->started = GetMicrosecondsSince(&loading->started);
+        probe->module = IndexOrLoadModule(loading->clientName, probe->path, loading->indexedModules, &probe->indexed);
+        probe->duration = GetMicrosecondsSince(&loading->started) - probe->started;
+    }
+
+    return NULL;
+}
+
+// Indexes or loads the modules concurrently, the calling thread takes part as one of the loaders. Note that the loader
+// runs module constructors holding a process-wide lock, so only the rest of the loading (mostly MmiGetInfo) overlaps.
+static void ProbeModules(MODULE_LOADING* loading)
+{
+    pthread_t threads[MODULE_LOAD_THREADS - 1] = {0};
+    bool started[MODULE_LOAD_THREADS - 1] = {0};
+    int threadCount = (loading->count < MODULE_LOAD_THREADS) ? loading->count : MODULE_LOAD_THREADS;
+    int i = 0;
+
+    for (i = 0; i < (threadCount - 1); i++)
+    {
+        if (0 == pthread_create(&threads[i], NULL, ModuleLoaderThread, loading))
+        {
+            started[i] = true;
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "LoadModules: failed to create loader thread, loading with fewer threads");
+        }
+    }
+
+    ModuleLoaderThread(loading);
+
+    for (i = 0; i < (threadCount - 1); i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static void SaveModuleIndex(const char* indexJson, const char* clientName)
+{
+    JSON_Value* indexValue = NULL;
+    JSON_Object* indexObject = NULL;
+    JSON_Value* modulesValue = NULL;
+    JSON_Array* modulesArray = NULL;
+    JSON_Value* entryValue = NULL;
+    JSON_Object* entryObject = NULL;
+    MODULE* module = NULL;
+    char* serialized = NULL;
+
+    if ((NULL == (indexValue = json_value_init_object())) || (NULL == (indexObject = json_value_get_object(indexValue))) ||
+        (NULL == (modulesValue = json_value_init_array())) || (NULL == (modulesArray = json_value_get_array(modulesValue))) ||
+        (JSONSuccess != json_object_set_string(indexObject, g_indexClientName, clientName)) ||
+        (JSONSuccess != json_object_set_value(indexObject, g_indexModules, modulesValue)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to allocate memory for the module index");
+        json_value_free(modulesValue);
+        json_value_free(indexValue);
+        return;
+    }
+
+    for (module = g_modules; NULL != module; module = module->next)
+    {
+        if ((NULL == (entryValue = json_value_init_object())) || (NULL == (entryObject = json_value_get_object(entryValue))) ||
+            (JSONSuccess != json_object_set_string(entryObject, g_indexPath, module->path)) ||
+            (JSONSuccess != json_object_set_number(entryObject, g_indexModifiedSeconds, (double)module->modified.tv_sec)) ||
+            (JSONSuccess != json_object_set_number(entryObject, g_indexModifiedNanoseconds, (double)module->modified.tv_nsec)) ||
+            (JSONSuccess != json_object_set_number(entryObject, g_indexSize, (double)module->size)) ||
+            (JSONSuccess != json_object_set_value(entryObject, g_indexInfo, json_value_deep_copy(module->infoValue))) ||
+            (JSONSuccess != json_array_append_value(modulesArray, entryValue)))
+        {
+            OsConfigLogError(GetPlatformLog(), "LoadModules: failed to index module '%s'", module->path);
+            json_value_free(entryValue);
+        }
+    }
+
+    if (NULL == (serialized = json_serialize_to_string_pretty(indexValue)))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to serialize the module index");
+    }
+    else if (SecureSaveToFile(indexJson, serialized, (int)strlen(serialized), GetPlatformLog()))
+    {
+        OsConfigLogInfo(GetPlatformLog(), "LoadModules: saved the module index to '%s'", indexJson);
+    }
+    else
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to save the module index to '%s'", indexJson);
+    }
+
+    json_free_serialized_string(serialized);
+    json_value_free(indexValue);
+}
+
+static COMPONENT_ROUTE* FindComponentRoute(const char* component)
+{
+    COMPONENT_ROUTE* route = NULL;
+
+    for (route = g_components[HashString(component) & (g_componentBuckets - 1)]; NULL != route; route = route->next)
+    {
+        if (0 == strcmp(route->component, component))
+        {
+            break;
+        }
+    }
+
+    return route;
+}
+
+// Builds g_components, when a component is implemented by more than one module the first module of g_modules gets it
+static void RouteComponents(void)
+{
+    MODULE* module = NULL;
+    COMPONENT_ROUTE* route = NULL;
+    size_t componentCount = 0;
+    size_t bucket = 0;
+    unsigned int i = 0;
+
+    for (module = g_modules; NULL != module; module = module->next)
+    {
+        componentCount += module->info->componentCount;
+    }
+
+    // A power of two at least as large as the number of components, so that buckets hold one component on average
+    for (g_componentBuckets = 1; g_componentBuckets < componentCount; g_componentBuckets <<= 1);
+
+    if ((NULL == (g_components = (COMPONENT_ROUTE**)calloc(g_componentBuckets, sizeof(COMPONENT_ROUTE*)))) ||
+        (NULL == (g_componentRoutes = (COMPONENT_ROUTE*)calloc(componentCount + 1, sizeof(COMPONENT_ROUTE)))))
+    {
+        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to allocate memory for the component routes, components are looked up by scanning the modules");
+        FREE_MEMORY(g_components);
+        g_componentBuckets = 0;
+        return;
+    }
+
+    route = g_componentRoutes;
+
+    for (module = g_modules; NULL != module; module = module->next)
+    {
+        for (i = 0; i < module->info->componentCount; i++)
+        {
+            if (NULL == FindComponentRoute(module->info->components[i]))
+            {
+                bucket = HashString(module->info->components[i]) & (g_componentBuckets - 1);
+                route->component = module->info->components[i];
+                route->module = module;
+                route->next = g_components[bucket];
+                g_components[bucket] = route;
+                route++;
+            }
+            else
+            {
+                OsConfigLogError(GetPlatformLog(), "LoadModules: component '%s' of '%s' is implemented by another module, ignored", module->info->components[i], module->path);
+            }
+        }
+    }
+}
+
+static void FreeComponentRoutes(void)
+{
+    FREE_MEMORY(g_components);
+    FREE_MEMORY(g_componentRoutes);
+    g_componentBuckets = 0;
+}
+
+// Sets the call timeout of each module, from the "ModuleCallTimeoutSeconds" object of the configuration keyed by module name
+static void SetModuleCallTimeouts(const JSON_Object* configObject)
+{
+    JSON_Object* timeoutsObject = json_object_get_object(configObject, g_moduleCallTimeouts);
+    MODULE* module = NULL;
+    int seconds = 0;
+
+    for (module = g_modules; NULL != module; module = module->next)
+    {
+        module->callTimeoutMilliseconds = MODULE_CALL_TIMEOUT;
+
+        if ((NULL == timeoutsObject) || (NULL == module->info) || (NULL == module->info->name) || !json_object_has_value_of_type(timeoutsObject, module->info->name, JSONNumber))
+        {
+            continue;
+        }
+
+        seconds = (int)json_object_get_number(timeoutsObject, module->info->name);
+
+        if ((seconds <= 0) || (seconds > MAX_MODULE_CALL_TIMEOUT_SECONDS))
+        {
+            OsConfigLogError(GetPlatformLog(), "LoadModules: invalid call timeout %d for module '%s', using the default of %d ms", seconds, module->info->name, MODULE_CALL_TIMEOUT);
+        }
+        else
+        {
+            module->callTimeoutMilliseconds = (unsigned int)seconds * 1000;
+            OsConfigLogInfo(GetPlatformLog(), "LoadModules: calls to module '%s' time out after %d seconds", module->info->name, seconds);
+        }
+    }
+}
+
+static bool IsReportedObjectNamed(const REPORTED_OBJECT* reported)
+{
+    return (NULL != reported->component) && (NULL != reported->object);
+}
+
+static void LinkReportedObjects(REPORTED_OBJECT* reported, int count)
+{
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        reported[i].nextInComponent = -1;
+        reported[i].nextDuplicate = -1;
+        reported[i].firstInComponent = IsReportedObjectNamed(&reported[i]);
+        reported[i].duplicate = !IsReportedObjectNamed(&reported[i]);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = i + 1; IsReportedObjectNamed(&reported[i]) && (j < count); j++)
+        {
+            if (!IsReportedObjectNamed(&reported[j]) || (0 != strcmp(reported[i].component, reported[j].component)))
+            {
+                continue;
+            }
+
+            if (-1 == reported[i].nextInComponent)
+            {
+                reported[i].nextInComponent = j;
+                reported[j].firstInComponent = false;
+            }
+
+            if (0 == strcmp(reported[i].object, reported[j].object))
+            {
+                OsConfigLogError(GetPlatformLog(), "LoadModules: reported object %s.%s is listed more than once", reported[j].component, reported[j].object);
+                reported[i].nextDuplicate = j;
+                reported[j].duplicate = true;
+                break;
+            }
+        }
+    }
+}
+
+// Indexes the modules found in the directory, the modules themselves are loaded on first use.
+// Modules that did not change since they were indexed in indexJson are not loaded at all.
+static void LoadModules(const char* directory, const char* configJson, const char* indexJson)
 {
     MODULE* module = NULL;
     DIR* dir = NULL;
@@ -67,6 +632,13 @@ static void LoadModules(const char* directory, const char* configJson)
     ssize_t clientNameSize = 0;
     ssize_t reportedSize = 0;
     ssize_t pathSize = 0;
+    JSON_Value* indexValue = NULL;
+    JSON_Array* indexedModules = NULL;
+    MODULE_LOADING loading = {0};
+    MODULE_PROBE* probes = NULL;
+    MODULE_PROBE* probe = NULL;
+    int probeCapacity = 0;
+    int indexedCount = 0;
 
     if ((NULL == directory) || (NULL == configJson))
     {
@@ -102,6 +674,17 @@ static void LoadModules(const char* directory, const char* configJson)
         }
 
         OsConfigLogInfo(GetPlatformLog(), "LoadModules: client name '%s'", clientName);
+
+        if ((NULL != indexJson) && FileExists(indexJson) && (NULL != (indexValue = json_parse_file(indexJson))))
+        {
+            indexedModules = ReadModuleIndex(indexValue, clientName);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &loading.started);
+        pthread_mutex_init(&loading.lock, NULL);
+        loading.clientName = clientName;
+        loading.indexedModules = indexedModules;
+
         errno = 0;
 
         if (NULL != (dir = opendir(directory)))
@@ -115,6 +698,20 @@ static void LoadModules(const char* directory, const char* configJson)
                     continue;
                 }
 
+                if (loading.count == probeCapacity)
+                {
+                    probeCapacity = (0 == probeCapacity) ? 16 : (probeCapacity * 2);
+
+                    if (NULL == (probes = (MODULE_PROBE*)realloc(loading.probes, probeCapacity * sizeof(MODULE_PROBE))))
+                    {
+                        OsConfigLogError(GetPlatformLog(), "LoadModules: failed to allocate memory for module '%s'", entry->d_name);
+                        probeCapacity = loading.count;
+                        continue;
+                    }
+
+                    loading.probes = probes;
+                }
+
                 // <directory>/<module .so> + null-terminator
                 pathSize = strlen(directory) + strlen(entry->d_name) + 2;
 
@@ -127,18 +724,9 @@ static void LoadModules(const char* directory, const char* configJson)
                 memset(path, 0, pathSize);
                 snprintf(path, pathSize, "%s/%s", directory, entry->d_name);
 
-                if (NULL != (module = LoadModule(clientName, path)))
-                {
-                    module->next = g_modules;
-                    g_modules = module;
-                    loaded++;
-                }
-                else
-                {
-                    OsConfigLogError(GetPlatformLog(), "LoadModules: failed to load module '%s'", entry->d_name);
-                }
-
-                FREE_MEMORY(path);
+                memset(&loading.probes[loading.count], 0, sizeof(MODULE_PROBE));
+                loading.probes[loading.count].path = path;
+                loading.count += 1;
             }
             closedir(dir);
         }
@@ -152,18 +740,58 @@ static void LoadModules(const char* directory, const char* configJson)
             OsConfigLogError(GetPlatformLog(), "LoadModules: failed during readdir() (%d)", errno);
         }
 
+        ProbeModules(&loading);
+
+        // Added in directory order, the startup timeline shows when each module was picked up and how long it took
+        for (i = 0; i < loading.count; i++)
+        {
+            probe = &loading.probes[i];
+
+            if (NULL != (module = probe->module))
+            {
+                module->next = g_modules;
+                g_modules = module;
+                loaded++;
+                indexedCount += probe->indexed ? 1 : 0;
+
+                OsConfigLogInfo(GetPlatformLog(), "LoadModules: '%s' %s at +%ld ms in %ld ms", probe->path, probe->indexed ? "indexed" : "loaded",
+                    probe->started / 1000, probe->duration / 1000);
+            }
+            else
+            {
+                OsConfigLogError(GetPlatformLog(), "LoadModules: failed to load module '%s'", probe->path);
+            }
+
+            FREE_MEMORY(probe->path);
+        }
+
+        FREE_MEMORY(loading.probes);
+        pthread_mutex_destroy(&loading.lock);
+
+        RouteComponents();
+        SetModuleCallTimeouts(configObject);
+
         if (loaded > 0)
         {
-            OsConfigLogInfo(GetPlatformLog(), "Loaded %d modules from '%s'", loaded, directory);
+            OsConfigLogInfo(GetPlatformLog(), "Indexed %d modules from '%s' in %ld ms (%d unchanged since last indexed)", loaded, directory,
+                GetMicrosecondsSince(&loading.started) / 1000, indexedCount);
         }
         else
         {
             OsConfigLogError(GetPlatformLog(), "No modules found in '%s'", directory);
         }
-    }
 
-    if (config && configObject)
-    {
+        // Rewritten when a module was added, changed or removed
+        if ((NULL != indexJson) && (NULL != clientName) && ((indexedCount != loaded) || (indexedCount != (int)json_array_get_count(indexedModules))))
+        {
+            SaveModuleIndex(indexJson, clientName);
+        }
+
+        json_value_free(indexValue);
+    }
+
+    if (config && configObject)
+    {
         if (NULL != (reportedArray = json_object_get_array(configObject, g_reportedObjectType)))
         {
             reportedCount = (int)json_array_get_count(reportedArray);
@@ -206,6 +834,7 @@ static void LoadModules(const char* directory, const char* configJson)
                     }
 
                     OsConfigLogInfo(GetPlatformLog(), "LoadModules: found %d reported objects in '%s'", reportedTotal, configJson);
+                    LinkReportedObjects(reported, reportedTotal);
 
                     g_reported = reported;
                     g_reportedTotal = reportedTotal;
@@ -225,617 +854,2080 @@ static void LoadModules(const char* directory, const char* configJson)
     FREE_MEMORY(clientName);
 }
 
-void AreModulesLoadedAndLoadIfNot(const char* directory, const char* configJson)
+void AreModulesLoadedAndLoadIfNot(const char* directory, const char* configJson, const char* indexJson)
 {
+    if (atomic_load(&g_modulesLoaded))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_modulesLock);
+
     if (NULL == g_modules)
     {
-        LoadModules(directory, configJson);
+        LoadModules(directory, configJson, indexJson);
     }
+
+    atomic_store(&g_modulesLoaded, (NULL != g_modules));
+
+    pthread_mutex_unlock(&g_modulesLock);
 }
 
-static void FreeModules(MODULE* modules)
+// Calls MmiSet (or MmiSetRaw) of the module and records the call in the metrics, called with the module lock held
+static int CallModuleSet(MODULE* module, MMI_SET set, MMI_HANDLE handle, const char* component, const char* object, const MMI_JSON_STRING payload, const int payloadSizeBytes)
 {
-    MODULE* curr = modules;
-    MODULE* next = NULL;
+    PerfClock clock = {{0, 0}, {0, 0}};
+    int status = MMI_OK;
 
-    while (curr)
+    StartPerfClock(&clock, GetPlatformLog());
+    status = set(handle, component, object, payload, payloadSizeBytes);
+    StopPerfClock(&clock, GetPlatformLog());
+
+    RecordModuleCall(module->info->name, component, object, METRICS_MMI_SET, GetPerfClockTime(&clock, GetPlatformLog()), payloadSizeBytes, status);
+
+    return status;
+}
+
+// Returns a NUL terminated copy of the payload, NULL when out of memory
+static MMI_JSON_STRING CopyPayload(const char* payload, int payloadSizeBytes)
+{
+    MMI_JSON_STRING copy = NULL;
+
+    if (NULL != (copy = (MMI_JSON_STRING)malloc(payloadSizeBytes + 1)))
     {
-        next = curr->next;
-        UnloadModule(curr);
-        curr = next;
+        memcpy(copy, payload, payloadSizeBytes);
+        copy[payloadSizeBytes] = '\0';
     }
 
-    modules = NULL;
+    return copy;
 }
 
-static void FreeSessions(SESSION* sessions)
+// Calls MmiGet of the module and records the call in the metrics, called with the module lock held.
+// The payload of the module goes back to it right away, what is returned is a NUL terminated copy freed with FREE_MEMORY.
+static int CallModuleGet(MODULE* module, MMI_HANDLE handle, const char* component, const char* object, MMI_JSON_STRING* payload, int* payloadSizeBytes)
 {
-    SESSION* curr = sessions;
-    SESSION* next = NULL;
-    MODULE_SESSION* moduleSession = NULL;
+    PerfClock clock = {{0, 0}, {0, 0}};
+    MMI_JSON_STRING modulePayload = NULL;
+    int modulePayloadSizeBytes = 0;
+    int status = MMI_OK;
 
-    while (curr)
-    {
-        next = curr->next;
+    *payload = NULL;
+    *payloadSizeBytes = 0;
 
-        while (curr->modules)
+    StartPerfClock(&clock, GetPlatformLog());
+    status = module->get(handle, component, object, &modulePayload, &modulePayloadSizeBytes);
+    StopPerfClock(&clock, GetPlatformLog());
+
+    RecordModuleCall(module->info->name, component, object, METRICS_MMI_GET, GetPerfClockTime(&clock, GetPlatformLog()), (MMI_OK == status) ? modulePayloadSizeBytes : 0, status);
+
+    if ((MMI_OK == status) && (NULL != modulePayload) && (modulePayloadSizeBytes >= 0))
+    {
+        if (NULL == (*payload = CopyPayload(modulePayload, modulePayloadSizeBytes)))
         {
-            moduleSession = curr->modules;
-            curr->modules = moduleSession->next;
-            moduleSession->module->close(moduleSession->handle);
-            FREE_MEMORY(moduleSession);
+            OsConfigLogError(GetPlatformLog(), "Failed to allocate memory for the payload of '%s.%s'", component, object);
+            status = ENOMEM;
         }
+        else
+        {
+            *payloadSizeBytes = modulePayloadSizeBytes;
+        }
+    }
 
-        FREE_MEMORY(curr->uuid);
-        FREE_MEMORY(curr->client);
-        FREE_MEMORY(curr);
-
-        curr = next;
+    if ((NULL != modulePayload) && (NULL != module->free))
+    {
+        module->free(modulePayload);
     }
 
-    sessions = NULL;
+    return status;
 }
 
-static void FreeReportedObjects(REPORTED_OBJECT* reportedObjects, int numReportedObjects)
+static void InitializeMonotonicCondition(pthread_cond_t* condition)
 {
-    int i = 0;
+    pthread_condattr_t conditionAttributes;
 
-    for (i = 0; i < numReportedObjects; i++)
+    pthread_condattr_init(&conditionAttributes);
+    pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+    pthread_cond_init(condition, &conditionAttributes);
+    pthread_condattr_destroy(&conditionAttributes);
+}
+
+static void AddMilliseconds(struct timespec* time, unsigned int milliseconds)
+{
+    time->tv_sec += milliseconds / 1000;
+    time->tv_nsec += (long)(milliseconds % 1000) * 1000000;
+    if (time->tv_nsec >= 1000000000)
     {
-        FREE_MEMORY(reportedObjects[i].component);
-        FREE_MEMORY(reportedObjects[i].object);
+        time->tv_sec += 1;
+        time->tv_nsec -= 1000000000;
     }
+}
 
-    FREE_MEMORY(reportedObjects);
+static bool IsEarlier(const struct timespec* time, const struct timespec* other)
+{
+    return (time->tv_sec < other->tv_sec) || ((time->tv_sec == other->tv_sec) && (time->tv_nsec < other->tv_nsec));
 }
 
-void UnloadModules(void)
+static bool HasPassed(const struct timespec* deadline)
 {
-    FreeSessions(g_sessions);
-    FreeModules(g_modules);
-    FreeReportedObjects(g_reported, g_reportedTotal);
+    struct timespec now = {0};
 
-    g_reportedTotal = 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return !IsEarlier(&now, deadline);
 }
 
-static char* GenerateUuid(void)
+static bool HasElapsed(const struct timespec* since, unsigned int milliseconds)
 {
-    char* uuid = NULL;
-    static const char uuidTemplate[] = "xxxxxxxx-xxxx-Mxxx-Nxxx-xxxxxxxxxxxx";
-    const char* hex = "0123456789ABCDEF-";
-    int random = 0;
-    char c = ' ';
-    int i = 0;
-    ssize_t size = ARRAY_SIZE(uuidTemplate);
+    struct timespec deadline = *since;
 
-    if (NULL == (uuid = (char*)malloc(size)))
+    AddMilliseconds(&deadline, milliseconds);
+
+    return HasPassed(&deadline);
+}
+
+static const CACHED_OBJECT* FindCachedObject(const MODULE* module, const char* component, const char* object)
+{
+    unsigned int i = 0;
+
+    for (i = 0; (NULL != module->info) && (i < module->info->cachedObjectCount); i++)
     {
-        return NULL;
+        if ((0 == strcmp(module->info->cachedObjects[i].component, component)) && (0 == strcmp(module->info->cachedObjects[i].object, object)))
+        {
+            return &module->info->cachedObjects[i];
+        }
     }
 
-    memset(uuid, 0, size);
-    srand(clock());
+    return NULL;
+}
 
-    for (i = 0; i < size - 1; i++)
+// Called with the dispatcher lock held
+static void ClearCachedPayloads(MODULE_DISPATCHER* dispatcher)
+{
+    CACHED_PAYLOAD* cached = NULL;
+
+    while (NULL != (cached = dispatcher->cache))
     {
-        random = rand() % 16;
-        c = ' ';
+        dispatcher->cache = cached->next;
+        FREE_MEMORY(cached->payload);
+        FREE_MEMORY(cached);
+    }
+}
 
-        switch (uuidTemplate[i])
-        {
-            case 'x':
-                c = hex[random];
-                break;
+// Returns a copy of the payload cached for the object while still fresh, which the caller frees with FREE_MEMORY.
+// The cache is kept by the dispatcher of the module, which is started before any module session is opened.
+static bool GetCachedPayload(MODULE* module, unsigned int maxPayloadSizeBytes, const char* component, const char* object, MMI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    MODULE_DISPATCHER* dispatcher = module->dispatcher;
+    const CACHED_OBJECT* cachedObject = NULL;
+    CACHED_PAYLOAD* cached = NULL;
+    bool found = false;
 
-            case '-':
-                c = '-';
-                break;
+    if ((NULL == dispatcher) || (NULL == (cachedObject = FindCachedObject(module, component, object))))
+    {
+        return false;
+    }
 
-            case 'M':
-                c = hex[(random & 0x03) | 0x08];
-                break;
+    pthread_mutex_lock(&dispatcher->lock);
 
-            case 'N':
-                c = '4';
-        }
-        uuid[i] = c;
+    for (cached = dispatcher->cache; (NULL != cached) && ((cached->object != cachedObject) || (cached->maxPayloadSizeBytes != maxPayloadSizeBytes)); cached = cached->next);
+
+    if ((NULL != cached) && !HasElapsed(&cached->cached, cachedObject->seconds * 1000) && (NULL != (*payload = CopyPayload(cached->payload, cached->payloadSizeBytes))))
+    {
+        *payloadSizeBytes = cached->payloadSizeBytes;
+        found = true;
     }
 
-    return uuid;
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    if (found)
+    {
+        RecordModuleCacheHit(module->info->name, component, object, false);
+    }
+
+    return found;
 }
 
-MPI_HANDLE MpiOpen(const char* clientName, const unsigned int maxPayloadSizeBytes)
+// Keeps a copy of the payload returned by MmiGet when the module allows the object to be cached
+static void CachePayload(MODULE* module, unsigned int maxPayloadSizeBytes, const char* component, const char* object, const MMI_JSON_STRING payload, int payloadSizeBytes)
 {
-    SESSION* session = NULL;
-    MODULE* module = NULL;
-    MODULE_SESSION* moduleSession = NULL;
-    char* uuid = NULL;
+    MODULE_DISPATCHER* dispatcher = module->dispatcher;
+    const CACHED_OBJECT* cachedObject = NULL;
+    CACHED_PAYLOAD* cached = NULL;
+    MMI_JSON_STRING copy = NULL;
 
-    if (NULL == clientName)
+    if ((NULL == dispatcher) || (NULL == payload) || (NULL == (cachedObject = FindCachedObject(module, component, object))) || (NULL == (copy = CopyPayload(payload, payloadSizeBytes))))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiOpen: invalid (null) client name");
+        return;
     }
-    else if (NULL == g_modules)
+
+    pthread_mutex_lock(&dispatcher->lock);
+
+    for (cached = dispatcher->cache; (NULL != cached) && ((cached->object != cachedObject) || (cached->maxPayloadSizeBytes != maxPayloadSizeBytes)); cached = cached->next);
+
+    if ((NULL == cached) && (NULL != (cached = (CACHED_PAYLOAD*)calloc(1, sizeof(CACHED_PAYLOAD)))))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiOpen: modules are not loaded, cannot open a session");
+        cached->object = cachedObject;
+        cached->maxPayloadSizeBytes = maxPayloadSizeBytes;
+        cached->next = dispatcher->cache;
+        dispatcher->cache = cached;
     }
-    else if (NULL == (uuid = GenerateUuid()))
+
+    if (NULL != cached)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to generate UUID");
+        FREE_MEMORY(cached->payload);
+        cached->payload = copy;
+        cached->payloadSizeBytes = payloadSizeBytes;
+        clock_gettime(CLOCK_MONOTONIC, &cached->cached);
     }
     else
     {
-        OsConfigLogDebug(GetPlatformLog(), "MpiOpen: creating session with UUID '%s'", uuid);
+        FREE_MEMORY(copy);
+    }
 
-        if (NULL != (session = (SESSION*)malloc(sizeof(SESSION))))
-        {
-            memset(session, 0, sizeof(MODULE_SESSION));
+    pthread_mutex_unlock(&dispatcher->lock);
+}
 
-            if (NULL != (session->client = strdup(clientName)))
+// Runs a call on the dispatcher thread of the module, with the module lock held
+static void RunModuleCall(MODULE* module, MODULE_CALL* call)
+{
+    switch (call->type)
+    {
+        case MODULE_CALL_OPEN:
+            if (0 == (call->status = EnsureModuleLoaded(module)))
             {
-                if (NULL != (session->uuid = strdup(uuid)))
-                {
-                    module = g_modules;
-
-                    while (module)
-                    {
-                        if (NULL != (moduleSession = (MODULE_SESSION*)malloc(sizeof(MODULE_SESSION))))
-                        {
-                            moduleSession->module = module;
-                            moduleSession->handle = module->open(clientName, maxPayloadSizeBytes);
-                            moduleSession->next = session->modules;
-                            session->modules = moduleSession;
-                        }
-                        else
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for module session");
-                        }
-
-                        module = module->next;
-                    }
+                call->handle = module->open(call->client, call->maxPayloadSizeBytes);
+            }
+            break;
 
-                    session->next = g_sessions;
-                    g_sessions = session;
-                }
-                else
-                {
-                    OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for session '%s'", uuid);
-                    FREE_MEMORY(session->client);
-                    FREE_MEMORY(session);
-                }
+        case MODULE_CALL_CLOSE:
+            if ((NULL != module->handle) && (NULL != module->close))
+            {
+                module->close(call->handle);
             }
-            else
+            break;
+
+        case MODULE_CALL_GET:
+            if (MMI_OK == (call->status = CallModuleGet(module, call->handle, call->component, call->object, &call->payload, &call->payloadSizeBytes)))
             {
-                OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for client name");
-                FREE_MEMORY(session);
+                CachePayload(module, call->maxPayloadSizeBytes, call->component, call->object, call->payload, call->payloadSizeBytes);
             }
-        }
-        else
-        {
-            OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for session '%s'", uuid);
-        }
+            break;
+
+        case MODULE_CALL_SET:
+            call->status = CallModuleSet(module, call->set, call->handle, call->component, call->object, call->payload, call->payloadSizeBytes);
+
+            // What the module reports may change with what was set
+            pthread_mutex_lock(&module->dispatcher->lock);
+            ClearCachedPayloads(module->dispatcher);
+            pthread_mutex_unlock(&module->dispatcher->lock);
     }
+}
 
-    return (MPI_HANDLE)uuid;
+static void FreeModuleCall(MODULE_CALL* call)
+{
+    FREE_MEMORY(call->payload);
+    FREE_MEMORY(call->client);
+    FREE_MEMORY(call->component);
+    FREE_MEMORY(call->object);
+    FREE_MEMORY(call);
 }
 
-static SESSION* FindSession(const char* uuid)
+// Called with the dispatcher lock held, frees the call when the other side is done with it already
+static void ReleaseModuleCall(MODULE_CALL* call)
 {
-    SESSION* session = g_sessions;
+    call->references -= 1;
 
-    while (session)
+    if (0 == call->references)
     {
-        if (0 == strcmp(session->uuid, uuid))
-        {
-            break;
-        }
-        session = session->next;
+        FreeModuleCall(call);
     }
-
-    return session;
 }
 
-void MpiClose(MPI_HANDLE handle)
+static void* ModuleDispatcherThread(void* argument)
 {
-    SESSION* session = NULL;
-    SESSION* prev = NULL;
+    MODULE* module = (MODULE*)argument;
+    MODULE_DISPATCHER* dispatcher = module->dispatcher;
+    MODULE_CALL* call = NULL;
 
-    if (NULL == handle)
-    {
-        OsConfigLogError(GetPlatformLog(), "MpiClose: invalid (null) handle");
-    }
-    else if (NULL == (session = FindSession(handle)))
-    {
-        OsConfigLogError(GetPlatformLog(), "MpiClose: failed to find session for handle (%s)", (char*)handle);
-    }
-    else
+    pthread_mutex_lock(&dispatcher->lock);
+
+    while (true)
     {
-        OsConfigLogDebug(GetPlatformLog(), "MpiClose: closing session with UUID '%s'", session->uuid);
-        while (session->modules)
+        while ((NULL == dispatcher->head) && !dispatcher->stopping)
+        {
+            pthread_cond_wait(&dispatcher->queued, &dispatcher->lock);
+        }
+
+        // The calls still queued are made before stopping, these are mostly module sessions being closed
+        if (NULL == (call = dispatcher->head))
+        {
+            break;
+        }
+
+        dispatcher->head = call->next;
+        call->started = true;
+        clock_gettime(CLOCK_MONOTONIC, &call->startTime);
+        dispatcher->running = call;
+        pthread_mutex_unlock(&dispatcher->lock);
+
+        pthread_mutex_lock(&module->lock);
+        RunModuleCall(module, call);
+        pthread_mutex_unlock(&module->lock);
+
+        pthread_mutex_lock(&dispatcher->lock);
+        dispatcher->running = NULL;
+
+        if (dispatcher->stuck)
         {
-            MODULE_SESSION* moduleSession = session->modules;
-            session->modules = moduleSession->next;
-            moduleSession->module->close(moduleSession->handle);
-            FREE_MEMORY(moduleSession);
+            OsConfigLogInfo(GetPlatformLog(), "Module '%s' completed the call that timed out, it takes calls again", module->info->name);
+            dispatcher->stuck = false;
         }
 
-        // Remove the session from the linked list
-        if (session == g_sessions)
+        if ((MODULE_CALL_OPEN == call->type) && (1 == call->references) && (NULL != call->handle))
         {
-            g_sessions = session->next;
+            // Nobody waits for the module session opened anymore, so it is closed right away
+            call->type = MODULE_CALL_CLOSE;
+            call->next = dispatcher->head;
+            dispatcher->head = call;
         }
         else
         {
-            prev = g_sessions;
-            while (prev->next != session)
-            {
-                prev = prev->next;
-            }
-            prev->next = session->next;
+            call->finished = true;
+            ReleaseModuleCall(call);
         }
 
-        FREE_MEMORY(session->uuid);
-        FREE_MEMORY(session->client);
-        FREE_MEMORY(session);
+        pthread_cond_broadcast(&dispatcher->finished);
     }
+
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    return NULL;
 }
 
-static bool ComponentExists(MODULE* module, const char* component)
+// Starts the dispatcher of the module on first use
+static MODULE_DISPATCHER* GetModuleDispatcher(MODULE* module)
 {
-    bool exists = false;
-    int i = 0;
+    MODULE_DISPATCHER* dispatcher = NULL;
+    int status = 0;
 
-    for (i = 0; i < (int)module->info->componentCount; i++)
+    pthread_mutex_lock(&g_dispatchersLock);
+
+    if ((NULL == (dispatcher = module->dispatcher)) && (NULL != (dispatcher = (MODULE_DISPATCHER*)calloc(1, sizeof(MODULE_DISPATCHER)))))
     {
-        if (0 == strcmp(module->info->components[i], component))
+        pthread_mutex_init(&dispatcher->lock, NULL);
+        pthread_cond_init(&dispatcher->queued, NULL);
+        InitializeMonotonicCondition(&dispatcher->finished);
+        module->dispatcher = dispatcher;
+
+        if (0 != (status = pthread_create(&dispatcher->thread, NULL, ModuleDispatcherThread, module)))
         {
-            exists = true;
-            break;
+            OsConfigLogError(GetPlatformLog(), "Failed to start the dispatcher thread of module '%s' (%d)", module->info->name, status);
+            module->dispatcher = NULL;
+            pthread_cond_destroy(&dispatcher->finished);
+            pthread_cond_destroy(&dispatcher->queued);
+            pthread_mutex_destroy(&dispatcher->lock);
+            FREE_MEMORY(dispatcher);
         }
     }
 
-    return exists;
+    pthread_mutex_unlock(&g_dispatchersLock);
+
+    return dispatcher;
+}
+
+static MODULE_CALL* CreateModuleCall(MODULE_CALL_TYPE type, MMI_HANDLE handle, const char* component, const char* object)
+{
+    MODULE_CALL* call = NULL;
+
+    if (NULL == (call = (MODULE_CALL*)calloc(1, sizeof(MODULE_CALL))))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to allocate memory for a module call");
+    }
+    else if (((NULL != component) && (NULL == (call->component = strdup(component)))) || ((NULL != object) && (NULL == (call->object = strdup(object)))))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to allocate memory for a module call");
+        FREE_MEMORY(call->component);
+        FREE_MEMORY(call);
+    }
+    else
+    {
+        call->type = type;
+        call->handle = handle;
+    }
+
+    return call;
+}
+
+static bool IsSameGet(const MODULE_CALL* call, const MODULE_CALL* get)
+{
+    return (MODULE_CALL_GET == call->type) && (call->maxPayloadSizeBytes == get->maxPayloadSizeBytes) &&
+        (0 == strcmp(call->component, get->component)) && (0 == strcmp(call->object, get->object));
 }
 
-static MODULE_SESSION* FindModuleSession(MODULE_SESSION* modules, const char* component)
+// Returns the same get, for a client with the same payload size limit, running or queued. Called with the dispatcher lock held.
+static MODULE_CALL* FindPendingGet(MODULE_DISPATCHER* dispatcher, const MODULE_CALL* get)
 {
-    MODULE_SESSION* current = modules;
+    MODULE_CALL* call = NULL;
+
+    if ((NULL != (call = dispatcher->running)) && IsSameGet(call, get))
+    {
+        return call;
+    }
 
-    while (current)
+    for (call = dispatcher->head; NULL != call; call = call->next)
     {
-        if (ComponentExists(current->module, component))
+        if (IsSameGet(call, get))
         {
-            break;
+            return call;
         }
-        current = current->next;
     }
 
-    return current;
+    return NULL;
 }
 
-int MpiSet(MPI_HANDLE handle, const char* component, const char* object, const MPI_JSON_STRING payload, const int payloadSizeBytes)
+// Queues the call to the dispatcher of the module and, unless it closes a module session, waits for it to complete.
+// The call may wait in the queue and then run for up to the call timeout of the module each, past that ETIMEDOUT is returned
+// while the module keeps running the call, and until it completes further calls are refused with EBUSY.
+// A caller with a deadline of its own (optional, monotonic) gets ETIMEDOUT past it too, without the module being refused calls.
+// The call is freed here, or later by the dispatcher when still running. What a completed call returned is handed over
+// through handle (open) and payload (get, freed with FREE_MEMORY), which are optional.
+static int DispatchModuleCall(MODULE* module, MODULE_CALL* call, const struct timespec* expires, MMI_HANDLE* handle, MMI_JSON_STRING* payload, int* payloadSizeBytes)
 {
-    int status = MPI_OK;
-    SESSION* session = NULL;
-    MODULE_SESSION* moduleSession = NULL;
-    char* uuid = (char*)handle;
+    MODULE_DISPATCHER* dispatcher = NULL;
+    MODULE_CALL* pending = NULL;
+    MODULE_CALL** link = NULL;
+    struct timespec queued = {0};
+    struct timespec deadline = {0};
+    int status = 0;
+
+    if (NULL == (dispatcher = GetModuleDispatcher(module)))
+    {
+        FreeModuleCall(call);
+        return ENOMEM;
+    }
 
-    if ((NULL == handle) || (NULL == component) || (NULL == object))
+    pthread_mutex_lock(&dispatcher->lock);
+
+    if (dispatcher->stuck && (MODULE_CALL_CLOSE != call->type))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) called with invalid arguments", handle, component, object, payload, payloadSizeBytes);
-        status = EINVAL;
+        pthread_mutex_unlock(&dispatcher->lock);
+        OsConfigLogError(GetPlatformLog(), "Module '%s' is still busy with a call that timed out, the call is refused", module->info->name);
+        FreeModuleCall(call);
+        return EBUSY;
     }
-    else if (NULL == (session = FindSession(uuid)))
+
+    if ((MODULE_CALL_GET == call->type) && (NULL != (pending = FindPendingGet(dispatcher, call))))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSet: no session exists with UUID '%s'", uuid);
-        status = EINVAL;
+        // Waits for the same get already made for another client and shares its payload rather than calling the module again
+        RecordModuleCacheHit(module->info->name, call->component, call->object, true);
+        FreeModuleCall(call);
+        call = pending;
+        call->references += 1;
     }
-    else if (NULL == (moduleSession = FindModuleSession(session->modules, component)))
+    else
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSet: no module exists with component '%s'", component);
-        status = EINVAL;
+        for (link = &dispatcher->head; NULL != *link; link = &(*link)->next);
+        *link = call;
+        call->references = (MODULE_CALL_CLOSE == call->type) ? 1 : 2;
+        pthread_cond_signal(&dispatcher->queued);
     }
-    else if (NULL == moduleSession->module)
+
+    if (MODULE_CALL_CLOSE == call->type)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSet: no module is loaded for session '%s'", uuid);
-        status = EINVAL;
+        pthread_mutex_unlock(&dispatcher->lock);
+        return 0;
     }
-    else
+
+    clock_gettime(CLOCK_MONOTONIC, &queued);
+
+    while ((!call->finished) && (0 == status))
     {
-        if (MMI_OK == (status = moduleSession->module->set(moduleSession->handle, component, object, payload, payloadSizeBytes)))
+        deadline = call->started ? call->startTime : queued;
+        AddMilliseconds(&deadline, module->callTimeoutMilliseconds);
+
+        if ((NULL != expires) && IsEarlier(expires, &deadline))
         {
-            OsConfigLogInfo(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) succeeded", moduleSession->handle, component, object, payload, payloadSizeBytes);
+            deadline = *expires;
+        }
+
+        if (dispatcher->stuck && !call->started)
+        {
+            status = EBUSY;
+        }
+        else if ((ETIMEDOUT != pthread_cond_timedwait(&dispatcher->finished, &dispatcher->lock, &deadline)) || call->finished)
+        {
+            continue;
+        }
+        else if ((!call->started) || ((NULL != expires) && HasPassed(expires) && !HasElapsed(&call->startTime, module->callTimeoutMilliseconds)))
+        {
+            status = ETIMEDOUT;
+        }
+        else if (HasElapsed(&call->startTime, module->callTimeoutMilliseconds))
+        {
+            status = ETIMEDOUT;
+            dispatcher->stuck = true;
+
+            // Calls queued behind this one are refused rather than left waiting for it
+            pthread_cond_broadcast(&dispatcher->finished);
+        }
+    }
+
+    if (call->finished)
+    {
+        status = call->status;
+
+        if (NULL != handle)
+        {
+            *handle = call->handle;
+        }
+
+        if ((NULL != payload) && (NULL != payloadSizeBytes))
+        {
+            // The last of the clients sharing the get takes the payload over, the others get copies
+            if (1 == call->references)
+            {
+                *payload = call->payload;
+                call->payload = NULL;
+            }
+            else if ((NULL != call->payload) && (NULL == (*payload = CopyPayload(call->payload, call->payloadSizeBytes))))
+            {
+                OsConfigLogError(GetPlatformLog(), "Failed to allocate memory for the payload of '%s.%s'", call->component, call->object);
+                status = ENOMEM;
+            }
+
+            *payloadSizeBytes = (MMI_OK == status) ? call->payloadSizeBytes : 0;
+        }
+    }
+    else
+    {
+        OsConfigLogError(GetPlatformLog(), "Module '%s' did not %s the call to '%s.%s' within %u ms (%d)", module->info->name, call->started ? "complete" : "start",
+            call->component ? call->component : "", call->object ? call->object : "", module->callTimeoutMilliseconds, status);
+
+        if (NULL != call->object)
+        {
+            RecordModuleTimeout(module->info->name, call->component, call->object, (MODULE_CALL_SET == call->type) ? METRICS_MMI_SET : METRICS_MMI_GET);
+        }
+
+        // Never started, so taken out of the queue by the first of the clients sharing it to give up
+        if (!call->started)
+        {
+            for (link = &dispatcher->head; (NULL != *link) && (call != *link); link = &(*link)->next);
+
+            if (NULL != *link)
+            {
+                *link = call->next;
+                call->references -= 1;
+            }
+        }
+    }
+
+    ReleaseModuleCall(call);
+
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    return status;
+}
+
+// Stops the dispatcher once the calls queued to it are made. When the module is still busy with a call after the call
+// timeout, the dispatcher thread is detached and false is returned: the module is then left loaded for it.
+static bool StopModuleDispatcher(MODULE* module)
+{
+    MODULE_DISPATCHER* dispatcher = module->dispatcher;
+    struct timespec deadline = {0};
+    bool busy = false;
+
+    if (NULL == dispatcher)
+    {
+        return true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    AddMilliseconds(&deadline, module->callTimeoutMilliseconds);
+
+    pthread_mutex_lock(&dispatcher->lock);
+
+    dispatcher->stopping = true;
+    pthread_cond_signal(&dispatcher->queued);
+
+    while ((NULL != dispatcher->head) || (NULL != dispatcher->running))
+    {
+        if (ETIMEDOUT == pthread_cond_timedwait(&dispatcher->finished, &dispatcher->lock, &deadline))
+        {
+            busy = (NULL != dispatcher->head) || (NULL != dispatcher->running);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    if (busy)
+    {
+        OsConfigLogError(GetPlatformLog(), "Module '%s' is still busy with a call, the module is left loaded", module->info->name);
+        pthread_detach(dispatcher->thread);
+        return false;
+    }
+
+    pthread_join(dispatcher->thread, NULL);
+    ClearCachedPayloads(dispatcher);
+    pthread_cond_destroy(&dispatcher->finished);
+    pthread_cond_destroy(&dispatcher->queued);
+    pthread_mutex_destroy(&dispatcher->lock);
+    FREE_MEMORY(module->dispatcher);
+
+    return true;
+}
+
+static void FreeModules(MODULE* modules)
+{
+    MODULE* curr = modules;
+    MODULE* next = NULL;
+
+    while (curr)
+    {
+        next = curr->next;
+        if (StopModuleDispatcher(curr))
+        {
+            UnloadModule(curr);
+        }
+        curr = next;
+    }
+
+    modules = NULL;
+}
+
+static void CloseModuleSessions(SESSION* session)
+{
+    MODULE_SESSION* moduleSession = NULL;
+    MODULE_CALL* call = NULL;
+
+    while (session->modules)
+    {
+        moduleSession = session->modules;
+        session->modules = moduleSession->next;
+
+        // Queued behind the calls still running in the module, the session is closed once these complete
+        if (NULL != (call = CreateModuleCall(MODULE_CALL_CLOSE, moduleSession->handle, NULL, NULL)))
+        {
+            DispatchModuleCall(moduleSession->module, call, NULL, NULL, NULL, NULL);
+        }
+
+        FREE_MEMORY(moduleSession);
+    }
+}
+
+static void FreeSession(SESSION* session)
+{
+    CloseModuleSessions(session);
+    pthread_mutex_destroy(&session->lock);
+    FREE_MEMORY(session->reportedHashes);
+    FREE_MEMORY(session->uuid);
+    FREE_MEMORY(session->client);
+    FREE_MEMORY(session);
+}
+
+static void FreeSessions(void)
+{
+    SESSION* curr = NULL;
+    SESSION* next = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < g_sessionBuckets; i++)
+    {
+        for (curr = g_sessions[i]; NULL != curr; curr = next)
+        {
+            next = curr->next;
+            FreeSession(curr);
+        }
+    }
+
+    FREE_MEMORY(g_sessions);
+    g_sessionBuckets = 0;
+    g_sessionCount = 0;
+}
+
+static void FreeReportedObjects(REPORTED_OBJECT* reportedObjects, int numReportedObjects)
+{
+    int i = 0;
+
+    for (i = 0; i < numReportedObjects; i++)
+    {
+        FREE_MEMORY(reportedObjects[i].component);
+        FREE_MEMORY(reportedObjects[i].object);
+    }
+
+    FREE_MEMORY(reportedObjects);
+}
+
+void UnloadModules(void)
+{
+    pthread_mutex_lock(&g_modulesLock);
+    pthread_mutex_lock(&g_sessionsLock);
+
+    atomic_store(&g_modulesLoaded, false);
+
+    FreeSessions();
+    FreeComponentRoutes();
+    FreeModules(g_modules);
+    FreeReportedObjects(g_reported, g_reportedTotal);
+
+    g_modules = NULL;
+    g_reported = NULL;
+    g_reportedTotal = 0;
+
+    pthread_mutex_unlock(&g_sessionsLock);
+    pthread_mutex_unlock(&g_modulesLock);
+}
+
+// Seeded once, reseeding on every call with clock() handed out the same UUID to sessions opened within the same clock tick
+static void SeedUuidGenerator(void)
+{
+    srand((unsigned int)time(NULL) ^ (unsigned int)getpid() ^ (unsigned int)clock());
+}
+
+static char* GenerateUuid(void)
+{
+
+    char* uuid = NULL;
+    static const char uuidTemplate[] = "xxxxxxxx-xxxx-Mxxx-Nxxx-xxxxxxxxxxxx";
+    const char* hex = "0123456789ABCDEF-";
+    int random = 0;
+    char c = ' ';
+    int i = 0;
+    ssize_t size = ARRAY_SIZE(uuidTemplate);
+
+    if (NULL == (uuid = (char*)malloc(size)))
+    {
+        return NULL;
+    }
+
+    memset(uuid, 0, size);
+    pthread_once(&g_uuidSeeded, SeedUuidGenerator);
+
+    for (i = 0; i < size - 1; i++)
+    {
+        random = rand() % 16;
+        c = ' ';
+
+        switch (uuidTemplate[i])
+        {
+            case 'x':
+                c = hex[random];
+                break;
+
+            case '-':
+                c = '-';
+                break;
+
+            case 'M':
+                c = hex[(random & 0x03) | 0x08];
+                break;
+
+            case 'N':
+                c = '4';
+        }
+        uuid[i] = c;
+    }
+
+    return uuid;
+}
+
+static time_t GetMonotonicSeconds(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static SESSION** GetSessionBucket(SESSION** buckets, size_t bucketCount, const char* uuid)
+{
+    return &buckets[HashString(uuid) & (bucketCount - 1)];
+}
+
+// Doubles the number of buckets, the sessions stay in the current buckets when there is not enough memory for more.
+// Called with g_sessionsLock held.
+static void GrowSessionTable(void)
+{
+    SESSION** buckets = NULL;
+    SESSION** bucket = NULL;
+    SESSION* session = NULL;
+    SESSION* next = NULL;
+    size_t bucketCount = g_sessionBuckets * 2;
+    size_t i = 0;
+
+    if (NULL == (buckets = (SESSION**)calloc(bucketCount, sizeof(SESSION*))))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to grow the session table past %u buckets", (unsigned int)g_sessionBuckets);
+        return;
+    }
+
+    for (i = 0; i < g_sessionBuckets; i++)
+    {
+        for (session = g_sessions[i]; NULL != session; session = next)
+        {
+            next = session->next;
+            bucket = GetSessionBucket(buckets, bucketCount, session->uuid);
+            session->next = *bucket;
+            *bucket = session;
+        }
+    }
+
+    FREE_MEMORY(g_sessions);
+    g_sessions = buckets;
+    g_sessionBuckets = bucketCount;
+}
+
+// Called with g_sessionsLock held
+static int AddSession(SESSION* session)
+{
+    SESSION** bucket = NULL;
+
+    if (NULL == g_sessions)
+    {
+        if (NULL == (g_sessions = (SESSION**)calloc(SESSION_BUCKETS, sizeof(SESSION*))))
+        {
+            return ENOMEM;
+        }
+        g_sessionBuckets = SESSION_BUCKETS;
+    }
+    else if (g_sessionCount >= g_sessionBuckets)
+    {
+        GrowSessionTable();
+    }
+
+    bucket = GetSessionBucket(g_sessions, g_sessionBuckets, session->uuid);
+    session->next = *bucket;
+    *bucket = session;
+    g_sessionCount += 1;
+
+    return 0;
+}
+
+// Called with g_sessionsLock held
+static void RemoveSession(SESSION* session)
+{
+    SESSION** link = GetSessionBucket(g_sessions, g_sessionBuckets, session->uuid);
+
+    while ((NULL != *link) && (session != *link))
+    {
+        link = &(*link)->next;
+    }
+
+    if (NULL != *link)
+    {
+        *link = session->next;
+        g_sessionCount -= 1;
+    }
+}
+
+MPI_HANDLE MpiOpen(const char* clientName, const unsigned int maxPayloadSizeBytes)
+{
+    SESSION* session = NULL;
+    char* uuid = NULL;
+    int status = 0;
+
+    if (NULL == clientName)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiOpen: invalid (null) client name");
+    }
+    else if (NULL == g_modules)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiOpen: modules are not loaded, cannot open a session");
+    }
+    else if (NULL == (uuid = GenerateUuid()))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to generate UUID");
+    }
+    else
+    {
+        OsConfigLogDebug(GetPlatformLog(), "MpiOpen: creating session with UUID '%s'", uuid);
+
+        if (NULL != (session = (SESSION*)malloc(sizeof(SESSION))))
+        {
+            memset(session, 0, sizeof(SESSION));
+            pthread_mutex_init(&session->lock, NULL);
+            session->maxPayloadSizeBytes = maxPayloadSizeBytes;
+
+            if (NULL != (session->client = strdup(clientName)))
+            {
+                if (NULL != (session->uuid = strdup(uuid)))
+                {
+                    // Module sessions are opened on first use, see OpenModuleSession
+                    session->lastUsed = GetMonotonicSeconds();
+                    pthread_mutex_lock(&g_sessionsLock);
+                    status = AddSession(session);
+                    pthread_mutex_unlock(&g_sessionsLock);
+
+                    if (0 != status)
+                    {
+                        OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for the session table");
+                        FreeSession(session);
+                        FREE_MEMORY(uuid);
+                    }
+                }
+                else
+                {
+                    OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for session '%s'", uuid);
+                    FreeSession(session);
+                    FREE_MEMORY(uuid);
+                }
+            }
+            else
+            {
+                OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for client name");
+                FreeSession(session);
+                FREE_MEMORY(uuid);
+            }
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiOpen: failed to allocate memory for session '%s'", uuid);
+            FREE_MEMORY(uuid);
+        }
+    }
+
+    return (MPI_HANDLE)uuid;
+}
+
+// Called with g_sessionsLock held
+static SESSION* FindSession(const char* uuid)
+{
+    SESSION* session = NULL;
+
+    if (NULL == g_sessions)
+    {
+        return NULL;
+    }
+
+    for (session = *GetSessionBucket(g_sessions, g_sessionBuckets, uuid); NULL != session; session = session->next)
+    {
+        if (0 == strcmp(session->uuid, uuid))
+        {
+            break;
+        }
+    }
+
+    return session;
+}
+
+static void ReleaseSession(SESSION* session)
+{
+    bool isLastReference = false;
+
+    pthread_mutex_unlock(&session->lock);
+
+    pthread_mutex_lock(&g_sessionsLock);
+    session->references -= 1;
+    isLastReference = session->closed && (0 == session->references);
+    pthread_mutex_unlock(&g_sessionsLock);
+
+    if (isLastReference)
+    {
+        FreeSession(session);
+    }
+}
+
+// Returns the session holding its lock, so that it cannot be closed until released with ReleaseSession
+static SESSION* AcquireSession(const char* uuid)
+{
+    SESSION* session = NULL;
+
+    pthread_mutex_lock(&g_sessionsLock);
+    if (NULL != (session = FindSession(uuid)))
+    {
+        session->references += 1;
+        session->lastUsed = GetMonotonicSeconds();
+    }
+    pthread_mutex_unlock(&g_sessionsLock);
+
+    if (NULL != session)
+    {
+        pthread_mutex_lock(&session->lock);
+
+        // Closed while this call waited for the previous one on the same session
+        if (session->closed)
+        {
+            ReleaseSession(session);
+            session = NULL;
+        }
+    }
+
+    return session;
+}
+
+void MpiClose(MPI_HANDLE handle)
+{
+    SESSION* session = NULL;
+
+    if (NULL == handle)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiClose: invalid (null) handle");
+    }
+    else if (NULL == (session = AcquireSession(handle)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiClose: failed to find session for handle (%s)", (char*)handle);
+    }
+    else
+    {
+        OsConfigLogDebug(GetPlatformLog(), "MpiClose: closing session with UUID '%s'", session->uuid);
+        CloseModuleSessions(session);
+
+        pthread_mutex_lock(&g_sessionsLock);
+        RemoveSession(session);
+        session->closed = true;
+        pthread_mutex_unlock(&g_sessionsLock);
+
+        ReleaseSession(session);
+    }
+}
+
+int CloseIdleSessions(unsigned int idleSeconds)
+{
+    SESSION* idleSessions = NULL;
+    SESSION* session = NULL;
+    SESSION** link = NULL;
+    time_t now = GetMonotonicSeconds();
+    size_t i = 0;
+    int count = 0;
+
+    // Keeps the modules loaded while the module sessions of the idle sessions are closed
+    pthread_mutex_lock(&g_modulesLock);
+
+    // Sessions with calls in flight are not idle
+    pthread_mutex_lock(&g_sessionsLock);
+    for (i = 0; i < g_sessionBuckets; i++)
+    {
+        link = &g_sessions[i];
+        while (NULL != (session = *link))
+        {
+            if ((0 == session->references) && ((now - session->lastUsed) >= (time_t)idleSeconds))
+            {
+                *link = session->next;
+                g_sessionCount -= 1;
+                session->closed = true;
+                session->next = idleSessions;
+                idleSessions = session;
+                count += 1;
+            }
+            else
+            {
+                link = &session->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_sessionsLock);
+
+    while (NULL != (session = idleSessions))
+    {
+        idleSessions = session->next;
+        OsConfigLogInfo(GetPlatformLog(), "CloseIdleSessions: closing session '%s' of '%s', idle for %ld seconds", session->uuid, session->client, (long)(now - session->lastUsed));
+        FreeSession(session);
+    }
+
+    pthread_mutex_unlock(&g_modulesLock);
+
+    return count;
+}
+
+static bool ComponentExists(MODULE* module, const char* component)
+{
+    bool exists = false;
+    int i = 0;
+
+    for (i = 0; i < (int)module->info->componentCount; i++)
+    {
+        if (0 == strcmp(module->info->components[i], component))
+        {
+            exists = true;
+            break;
+        }
+    }
+
+    return exists;
+}
+
+static MODULE* FindModule(const char* component)
+{
+    MODULE* module = g_modules;
+    COMPONENT_ROUTE* route = NULL;
+
+    if (NULL != g_components)
+    {
+        return (NULL != (route = FindComponentRoute(component))) ? route->module : NULL;
+    }
+
+    while (module)
+    {
+        if (ComponentExists(module, component))
+        {
+            break;
+        }
+        module = module->next;
+    }
+
+    return module;
+}
+
+// Returns the session of the module that owns the component, loading the module and opening the session when first used.
+// Called with the session lock held.
+static MODULE_SESSION* OpenModuleSession(SESSION* session, const char* component)
+{
+    MODULE_SESSION* moduleSession = NULL;
+    MODULE* module = NULL;
+    MODULE_CALL* call = NULL;
+    MMI_HANDLE handle = NULL;
+    int status = 0;
+
+    if (NULL == (module = FindModule(component)))
+    {
+        return NULL;
+    }
+
+    for (moduleSession = session->modules; NULL != moduleSession; moduleSession = moduleSession->next)
+    {
+        if (moduleSession->module == module)
+        {
+            return moduleSession;
+        }
+    }
+
+    if ((NULL == (call = CreateModuleCall(MODULE_CALL_OPEN, NULL, component, NULL))) || (NULL == (call->client = strdup(session->client))))
+    {
+        OsConfigLogError(GetPlatformLog(), "OpenModuleSession: failed to allocate memory for module session");
+        if (NULL != call)
+        {
+            FreeModuleCall(call);
+        }
+        return NULL;
+    }
+
+    call->maxPayloadSizeBytes = session->maxPayloadSizeBytes;
+
+    if ((0 != (status = DispatchModuleCall(module, call, NULL, &handle, NULL, NULL))) || (NULL == handle))
+    {
+        OsConfigLogError(GetPlatformLog(), "OpenModuleSession: failed to open a session of module '%s' for component '%s' (%d)", module->path, component, status);
+        return NULL;
+    }
+
+    if (NULL == (moduleSession = (MODULE_SESSION*)calloc(1, sizeof(MODULE_SESSION))))
+    {
+        OsConfigLogError(GetPlatformLog(), "OpenModuleSession: failed to allocate memory for module session");
+        if (NULL != (call = CreateModuleCall(MODULE_CALL_CLOSE, handle, NULL, NULL)))
+        {
+            DispatchModuleCall(module, call, NULL, NULL, NULL, NULL);
+        }
+        return NULL;
+    }
+
+    moduleSession->module = module;
+    moduleSession->handle = handle;
+    moduleSession->next = session->modules;
+    session->modules = moduleSession;
+
+    return moduleSession;
+}
+
+// The set runs on the dispatcher thread of the module and, once timed out, keeps running there after the caller returned,
+// so it cannot point into a buffer of the caller: the payload (optional) is handed over to the call and freed with it.
+static int SetModuleObject(MODULE_SESSION* moduleSession, MMI_SET set, const char* component, const char* object, char* payload, int payloadSizeBytes)
+{
+    MODULE_CALL* call = NULL;
+
+    if (NULL == (call = CreateModuleCall(MODULE_CALL_SET, moduleSession->handle, component, object)))
+    {
+        FREE_MEMORY(payload);
+        return ENOMEM;
+    }
+
+    call->payload = payload;
+    call->payloadSizeBytes = payloadSizeBytes;
+    call->set = set;
+
+    return DispatchModuleCall(moduleSession->module, call, NULL, NULL, NULL, NULL);
+}
+
+// Sets a payload the caller keeps, for which the call gets a copy of its own
+static int CopyAndSetModuleObject(MODULE_SESSION* moduleSession, MMI_SET set, const char* component, const char* object, const char* payload, int payloadSizeBytes)
+{
+    char* copy = NULL;
+
+    if ((NULL != payload) && (payloadSizeBytes > 0) && (NULL == (copy = CopyPayload(payload, payloadSizeBytes))))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to allocate memory for the payload of '%s.%s'", component, object);
+        return ENOMEM;
+    }
+
+    return SetModuleObject(moduleSession, set, component, object, copy, payloadSizeBytes);
+}
+
+// Serves the object from the cache when fresh, otherwise gets it through the dispatcher of the module, up to expires when given
+static int GetModuleObject(MODULE* module, MMI_HANDLE handle, unsigned int maxPayloadSizeBytes, const char* component, const char* object, const struct timespec* expires, MMI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    MODULE_CALL* call = NULL;
+
+    if (GetCachedPayload(module, maxPayloadSizeBytes, component, object, payload, payloadSizeBytes))
+    {
+        return MMI_OK;
+    }
+
+    if (NULL == (call = CreateModuleCall(MODULE_CALL_GET, handle, component, object)))
+    {
+        return ENOMEM;
+    }
+
+    call->maxPayloadSizeBytes = maxPayloadSizeBytes;
+
+    return DispatchModuleCall(module, call, expires, NULL, payload, payloadSizeBytes);
+}
+
+int MpiSet(MPI_HANDLE handle, const char* component, const char* object, const MPI_JSON_STRING payload, const int payloadSizeBytes)
+{
+    int status = MPI_OK;
+    SESSION* session = NULL;
+    MODULE_SESSION* moduleSession = NULL;
+    char* uuid = (char*)handle;
+
+    if ((NULL == handle) || (NULL == component) || (NULL == object))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) called with invalid arguments", handle, component, object, payload, payloadSizeBytes);
+        status = EINVAL;
+    }
+    else if (NULL == (session = AcquireSession(uuid)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSet: no session exists with UUID '%s'", uuid);
+        status = EINVAL;
+    }
+    else if (NULL == (moduleSession = OpenModuleSession(session, component)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSet: no module exists with component '%s'", component);
+        status = EINVAL;
+    }
+    else if (NULL == moduleSession->module)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSet: no module is loaded for session '%s'", uuid);
+        status = EINVAL;
+    }
+    else
+    {
+        status = CopyAndSetModuleObject(moduleSession, moduleSession->module->set, component, object, payload, payloadSizeBytes);
+
+        if (MMI_OK == status)
+        {
+            OsConfigLogInfo(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) succeeded", moduleSession->handle, component, object, payload, payloadSizeBytes);
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) failed with %d", moduleSession->handle, component, object, payload, payloadSizeBytes, status);
+        }
+    }
+
+    if (NULL != session)
+    {
+        ReleaseSession(session);
+    }
+
+    return status;
+}
+
+int MpiGet(MPI_HANDLE handle, const char* component, const char* object, MPI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    int status = MPI_OK;
+    SESSION* session = NULL;
+    MODULE_SESSION* moduleSession = NULL;
+    char* uuid = (char*)handle;
+
+    if ((NULL == handle) || (NULL == component) || (NULL == object) || (NULL == payload) || (NULL == payloadSizeBytes))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) called with invalid arguments", handle, component, object, payload, payloadSizeBytes);
+        status = EINVAL;
+    }
+    else if (NULL == (session = AcquireSession(uuid)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiGet: no session exists with UUID '%s'", uuid);
+        status = EINVAL;
+    }
+    else if (NULL == (moduleSession = OpenModuleSession(session, component)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiGet: no module exists with component '%s'", component);
+        status = EINVAL;
+    }
+    else if (NULL == moduleSession->module)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiGet: no module is loaded for session '%s'", uuid);
+        status = EINVAL;
+    }
+    else
+    {
+        status = GetModuleObject(moduleSession->module, moduleSession->handle, session->maxPayloadSizeBytes, component, object, NULL, payload, payloadSizeBytes);
+
+        if (IsDebugLoggingEnabled())
+        {
+            if (MMI_OK == status)
+            {
+                OsConfigLogDebug(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) succeeded", handle, component, object, payload, payloadSizeBytes);
+            }
+            else
+            {
+                OsConfigLogError(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) failed with %d", handle, component, object, payload, payloadSizeBytes, status);
+            }
+        }
+    }
+
+    if (NULL != session)
+    {
+        ReleaseSession(session);
+    }
+
+    return status;
+}
+
+// Modules that do not take raw payloads get each value serialized the same way as parson would from the parsed payload.
+// The value is parsed in the arena of the applier and serialized on the heap, so that the result can be handed over to the set.
+static int SetDesiredObject(MODULE_SESSION* moduleSession, DESIRED_OBJECT* desiredObject, JsonArena* arena)
+{
+    MODULE* module = moduleSession->module;
+    JsonArena* previousArena = NULL;
+    JSON_Value* objectValue = NULL;
+    char* valueJson = NULL;
+    char* objectJson = NULL;
+    int status = MMI_OK;
+
+    if (NULL != module->setRaw)
+    {
+        return CopyAndSetModuleObject(moduleSession, module->setRaw, desiredObject->component, desiredObject->object, desiredObject->value, desiredObject->valueSize);
+    }
+
+    if (NULL == (valueJson = strndup(desiredObject->value, desiredObject->valueSize)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to allocate memory for JSON");
+        status = ENOMEM;
+    }
+    else
+    {
+        previousArena = UseJsonArena(arena);
+
+        if (NULL == (objectValue = json_parse_string(valueJson)))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to parse JSON of '%s.%s'", desiredObject->component, desiredObject->object);
+            status = EINVAL;
+        }
+        else
+        {
+            UseJsonArena(NULL);
+            if (NULL == (objectJson = json_serialize_to_string(objectValue)))
+            {
+                OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to serialize JSON");
+                status = ENOMEM;
+            }
+        }
+
+        UseJsonArena(previousArena);
+    }
+
+    if (MMI_OK == status)
+    {
+        status = SetModuleObject(moduleSession, module->set, desiredObject->component, desiredObject->object, objectJson, (int)strlen(objectJson));
+    }
+
+    if (NULL != arena)
+    {
+        ResetJsonArena(arena);
+    }
+    else
+    {
+        json_value_free(objectValue);
+    }
+
+    FREE_MEMORY(valueJson);
+
+    return status;
+}
+
+static void* DesiredApplierThread(void* argument)
+{
+    DESIRED_APPLICATION* application = (DESIRED_APPLICATION*)argument;
+    DESIRED_MODULE* desiredModule = NULL;
+    DESIRED_OBJECT* desiredObject = NULL;
+    MODULE_SESSION* moduleSession = NULL;
+    JsonArena* arena = CreateJsonArena();
+    int i = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&application->lock);
+        desiredModule = (application->next < application->moduleCount) ? &application->modules[application->next++] : NULL;
+        pthread_mutex_unlock(&application->lock);
+
+        if (NULL == desiredModule)
+        {
+            break;
+        }
+
+        moduleSession = desiredModule->moduleSession;
+
+        for (i = 0; i < desiredModule->count; i++)
+        {
+            desiredObject = &application->objects[desiredModule->indexes[i]];
+
+            if (MMI_OK != (desiredObject->status = SetDesiredObject(moduleSession, desiredObject, arena)))
+            {
+                OsConfigLogError(GetPlatformLog(), "MpiSetDesired: MmiSet(%p, %s, %s) failed with %d", moduleSession->handle, desiredObject->component, desiredObject->object, desiredObject->status);
+            }
+        }
+    }
+
+    FreeJsonArena(arena);
+
+    return NULL;
+}
+
+static DESIRED_OBJECT* AddDesiredObject(DESIRED_APPLICATION* application, const char* component, int module, int status, int* capacity)
+{
+    DESIRED_OBJECT* objects = NULL;
+
+    if (application->objectCount == *capacity)
+    {
+        *capacity = (0 == *capacity) ? 16 : (*capacity * 2);
+
+        if (NULL == (objects = (DESIRED_OBJECT*)realloc(application->objects, *capacity * sizeof(DESIRED_OBJECT))))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to allocate memory for desired objects");
+            return NULL;
+        }
+
+        application->objects = objects;
+    }
+
+    objects = &application->objects[application->objectCount++];
+    memset(objects, 0, sizeof(DESIRED_OBJECT));
+    objects->component = component;
+    objects->module = module;
+    objects->status = status;
+
+    return objects;
+}
+
+// Locates the objects of the payload, without parsing their values, and groups them by the module that owns their component.
+// Objects of unknown components keep an error status.
+static int PrepareDesiredApplication(SESSION* session, const char* payload, int payloadSizeBytes, DESIRED_APPLICATION* application)
+{
+    JsonMember* component = NULL;
+    JsonMember* members = NULL;
+    MODULE_SESSION* moduleSession = NULL;
+    DESIRED_OBJECT* desiredObject = NULL;
+    DESIRED_MODULE* desiredModule = NULL;
+    int memberCount = 0;
+    int capacity = 0;
+    int module = 0;
+    int status = MPI_OK;
+    int i = 0;
+    int j = 0;
+
+    if (0 != ReadJsonObjectMembers(payload, payloadSizeBytes, &application->components, &application->componentCount, GetPlatformLog()))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to parse JSON");
+        return EINVAL;
+    }
+
+    if (NULL == (application->modules = (DESIRED_MODULE*)calloc((application->componentCount > 0) ? application->componentCount : 1, sizeof(DESIRED_MODULE))))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to allocate memory for desired objects");
+        return ENOMEM;
+    }
+
+    for (i = 0; (i < application->componentCount) && (MPI_OK == status); i++)
+    {
+        component = &application->components[i];
+        module = -1;
+
+        if (NULL == (moduleSession = OpenModuleSession(session, component->name)))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no module exists with component '%s'", component->name);
+        }
+        else if (NULL == moduleSession->module)
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no module is loaded for session '%s'", session->uuid);
+        }
+        else
+        {
+            for (module = 0; module < application->moduleCount; module++)
+            {
+                if (application->modules[module].moduleSession->module == moduleSession->module)
+                {
+                    break;
+                }
+            }
+
+            if (module == application->moduleCount)
+            {
+                application->modules[application->moduleCount++].moduleSession = moduleSession;
+            }
+        }
+
+        if (0 != ReadJsonObjectMembers(component->value, component->valueSize, &members, &memberCount, GetPlatformLog()))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: component '%s' is not a JSON object", component->name);
+            status = (NULL == AddDesiredObject(application, component->name, -1, EINVAL, &capacity)) ? ENOMEM : MPI_OK;
+            continue;
+        }
+
+        // A component without a module fails the payload even when it carries no objects
+        if ((module < 0) && (0 == memberCount) && (NULL == AddDesiredObject(application, component->name, -1, EINVAL, &capacity)))
+        {
+            status = ENOMEM;
+        }
+
+        for (j = 0; (j < memberCount) && (MPI_OK == status); j++)
+        {
+            if (NULL == (desiredObject = AddDesiredObject(application, component->name, module, (module < 0) ? EINVAL : MMI_OK, &capacity)))
+            {
+                status = ENOMEM;
+            }
+            else
+            {
+                desiredObject->object = members[j].name;
+                desiredObject->value = members[j].value;
+                desiredObject->valueSize = members[j].valueSize;
+                members[j].name = NULL;
+            }
+        }
+
+        FreeJsonMembers(members, memberCount);
+        members = NULL;
+        memberCount = 0;
+    }
+
+    for (module = 0; (module < application->moduleCount) && (MPI_OK == status); module++)
+    {
+        desiredModule = &application->modules[module];
+
+        if (NULL == (desiredModule->indexes = (int*)calloc((application->objectCount > 0) ? application->objectCount : 1, sizeof(int))))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to allocate memory for module '%s'", desiredModule->moduleSession->module->info->name);
+            status = ENOMEM;
+            break;
+        }
+
+        for (j = 0; j < application->objectCount; j++)
+        {
+            if (module == application->objects[j].module)
+            {
+                desiredModule->indexes[desiredModule->count++] = j;
+            }
+        }
+    }
+
+    return status;
+}
+
+static void FreeDesiredApplication(DESIRED_APPLICATION* application)
+{
+    int i = 0;
+
+    for (i = 0; i < application->objectCount; i++)
+    {
+        FREE_MEMORY(application->objects[i].object);
+    }
+
+    if (NULL != application->modules)
+    {
+        for (i = 0; i < application->moduleCount; i++)
+        {
+            FREE_MEMORY(application->modules[i].indexes);
+        }
+    }
+
+    FreeJsonMembers(application->components, application->componentCount);
+    FREE_MEMORY(application->objects);
+    FREE_MEMORY(application->modules);
+}
+
+int MpiSetDesired(MPI_HANDLE handle, const MPI_JSON_STRING payload, const int payloadSizeBytes)
+{
+    int status = MPI_OK;
+    const char* uuid = (const char*)handle;
+    SESSION* session = NULL;
+    DESIRED_APPLICATION application = {0};
+    pthread_t threads[MODULE_DESIRED_THREADS - 1] = {0};
+    bool started[MODULE_DESIRED_THREADS - 1] = {0};
+    int threadCount = 0;
+    int i = 0;
+
+    if ((NULL == handle) || (NULL == payload) || (0 >= payloadSizeBytes))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) called with invalid arguments", handle, payload, payloadSizeBytes);
+        status = EINVAL;
+    }
+    else if (NULL == (session = AcquireSession(uuid)))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no session exists with UUID '%s'", uuid);
+        status = EINVAL;
+    }
+    else
+    {
+        pthread_mutex_init(&application.lock, NULL);
+
+        // The payload is not parsed as a whole, each value is handed over as the slice of the payload it is
+        if (MPI_OK == (status = PrepareDesiredApplication(session, payload, payloadSizeBytes, &application)))
+        {
+            // Modules are applied concurrently, the calling thread takes part as one of the appliers
+            threadCount = (application.moduleCount < MODULE_DESIRED_THREADS) ? application.moduleCount : MODULE_DESIRED_THREADS;
+
+            for (i = 0; i < (threadCount - 1); i++)
+            {
+                if (0 == pthread_create(&threads[i], NULL, DesiredApplierThread, &application))
+                {
+                    started[i] = true;
+                }
+                else
+                {
+                    OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to create applier thread, applying with fewer threads");
+                }
+            }
+
+            DesiredApplierThread(&application);
+
+            for (i = 0; i < (threadCount - 1); i++)
+            {
+                if (started[i])
+                {
+                    pthread_join(threads[i], NULL);
+                }
+            }
+
+            // The first failure in the order of the payload is the one reported
+            for (i = 0; i < application.objectCount; i++)
+            {
+                if (MMI_OK != application.objects[i].status)
+                {
+                    status = application.objects[i].status;
+                    break;
+                }
+            }
+        }
+
+        FreeDesiredApplication(&application);
+        pthread_mutex_destroy(&application.lock);
+    }
+
+    if (NULL != session)
+    {
+        ReleaseSession(session);
+    }
+
+    if (IsDebugLoggingEnabled())
+    {
+        if (MMI_OK == status)
+        {
+            OsConfigLogDebug(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) succeeded", handle, payload, payloadSizeBytes);
         }
         else
         {
-            OsConfigLogError(GetPlatformLog(), "MpiSet(%p, %s, %s, %p, %d) failed with %d", moduleSession->handle, component, object, payload, payloadSizeBytes, status);
+            OsConfigLogError(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) failed with %d", handle, payload, payloadSizeBytes, status);
         }
     }
 
     return status;
 }
 
-int MpiGet(MPI_HANDLE handle, const char* component, const char* object, MPI_JSON_STRING* payload, int* payloadSizeBytes)
+// Gets the reported object through the dispatcher of the module like any other get, giving up at the deadline of the report.
+// The value is NULL when the call failed or when the payload hashes the same as previousHash (then hash is non-zero).
+static int GetReportedObject(MODULE* module, MMI_HANDLE handle, unsigned int maxPayloadSizeBytes, const char* component, const char* object, const struct timespec* expires,
+    size_t previousHash, JSON_Value** value, size_t* hash)
 {
-    int status = MPI_OK;
-    SESSION* session = NULL;
-    MODULE_SESSION* moduleSession = NULL;
-    char* uuid = (char*)handle;
+    MMI_JSON_STRING mmiPayload = NULL;
+    int mmiPayloadSizeBytes = 0;
+    int mmiStatus = MMI_OK;
 
-    if ((NULL == handle) || (NULL == component) || (NULL == object) || (NULL == payload) || (NULL == payloadSizeBytes))
+    *value = NULL;
+    *hash = 0;
+
+    // The payload is a NUL terminated copy owned here
+    mmiStatus = GetModuleObject(module, handle, maxPayloadSizeBytes, component, object, expires, &mmiPayload, &mmiPayloadSizeBytes);
+
+    OsConfigLogDebug(GetPlatformLog(), "MmiGet(%s, %s) returned %d (%.*s)", component, object, mmiStatus, mmiPayloadSizeBytes, mmiPayload ? mmiPayload : "");
+
+    if (MMI_OK != mmiStatus)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) called with invalid arguments", handle, component, object, payload, payloadSizeBytes);
-        status = EINVAL;
+        OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s), returned %d", component, object, mmiStatus);
     }
-    else if (NULL == (session = FindSession(uuid)))
+    else if (NULL == mmiPayload)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGet: no session exists with UUID '%s'", uuid);
-        status = EINVAL;
+        OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s) returned no payload", component, object);
     }
-    else if (NULL == (moduleSession = FindModuleSession(session->modules, component)))
+    else if ((0 != previousHash) && (previousHash == HashString(mmiPayload)))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGet: no module exists with component '%s'", component);
-        status = EINVAL;
+        *hash = previousHash;
     }
-    else if (NULL == moduleSession->module)
+    else if (NULL == (*value = json_parse_string(mmiPayload)))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGet: no module is loaded for session '%s'", uuid);
-        status = EINVAL;
+        if (IsDebugLoggingEnabled())
+        {
+            OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s) returned an invalid payload '%s'", component, object, mmiPayload);
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s) returned an invalid payload", component, object);
+        }
     }
     else
     {
-        status = moduleSession->module->get(moduleSession->handle, component, object, payload, payloadSizeBytes);
+        *hash = HashString(mmiPayload);
+    }
 
-        if (IsDebugLoggingEnabled())
+    FREE_MEMORY(mmiPayload);
+
+    return mmiStatus;
+}
+
+static void* ReportedCollectorThread(void* argument)
+{
+    REPORTED_COLLECTOR* collector = (REPORTED_COLLECTOR*)argument;
+    REPORTED_COLLECTION* collection = collector->collection;
+    REPORTED_RESULT* result = NULL;
+    size_t previousHash = 0;
+    int status = MMI_OK;
+    int index = 0;
+    int i = 0;
+
+    for (i = 0; i < collector->count; i++)
+    {
+        index = collector->indexes[i];
+        result = &collection->results[index];
+
+        // Past the deadline, or while the module is stuck, the remaining objects of the module are left out
+        if ((ETIMEDOUT == status) || (EBUSY == status))
         {
-            if (MMI_OK == status)
-            {
-                OsConfigLogDebug(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) succeeded", handle, component, object, payload, payloadSizeBytes);
-            }
-            else
-            {
-                OsConfigLogError(GetPlatformLog(), "MpiGet(%p, %s, %s, %p, %p) failed with %d", handle, component, object, payload, payloadSizeBytes, status);
-            }
+            RecordModuleTimeout(collector->module->info->name, g_reported[index].component, g_reported[index].object, METRICS_MMI_GET);
+            continue;
+        }
+
+        previousHash = (NULL != collection->previousHashes) ? collection->previousHashes[index] : 0;
+        status = GetReportedObject(collector->module, collector->handle, collector->maxPayloadSizeBytes, g_reported[index].component, g_reported[index].object,
+            &collection->expires, previousHash, &result->value, &result->hash);
+        result->collected = true;
+
+        if ((ETIMEDOUT == status) || (EBUSY == status))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiGetReported: module '%s' did not return its reported objects in time (%d), the rest of them are left out", collector->module->info->name, status);
         }
     }
 
-    return status;
+    return NULL;
 }
 
-int MpiSetDesired(MPI_HANDLE handle, const MPI_JSON_STRING payload, const int payloadSizeBytes)
+// Starts one collector per module serving the session, each gets the reported objects of its module in order
+static REPORTED_COLLECTOR** StartReportedCollectors(SESSION* session, REPORTED_COLLECTION* collection, int* collectorCount)
 {
-    int status = MPI_OK;
-    const char* uuid = (const char*)handle;
-    char* json = NULL;
-    const char* component = NULL;
-    const char* object = NULL;
-    char* objectJson = NULL;
-    int componentCount = 0;
-    int objectCount = 0;
-    SESSION* session = NULL;
+    REPORTED_COLLECTOR** collectors = NULL;
+    REPORTED_COLLECTOR* collector = NULL;
     MODULE_SESSION* moduleSession = NULL;
-    JSON_Value* rootValue = NULL;
-    JSON_Object* rootObject = NULL;
-    JSON_Object* componentObject = NULL;
-    JSON_Value* objectValue = NULL;
+    MODULE* current = NULL;
+    int count = 0;
     int i = 0;
     int j = 0;
 
-    if ((NULL == handle) || (NULL == payload) || (0 >= payloadSizeBytes))
+    *collectorCount = 0;
+
+    for (current = g_modules; NULL != current; current = current->next)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) called with invalid arguments", handle, payload, payloadSizeBytes);
-        status = EINVAL;
+        count += 1;
     }
-    else if (NULL == (session = FindSession(uuid)))
+
+    if ((0 == count) || (NULL == (collectors = (REPORTED_COLLECTOR**)calloc(count, sizeof(REPORTED_COLLECTOR*)))))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no session exists with UUID '%s'", uuid);
-        status = EINVAL;
+        return NULL;
     }
-    else if (NULL == (json = (char*)malloc(payloadSizeBytes + 1)))
+
+    for (i = 0; i < g_reportedTotal; i++)
     {
-        OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to allocate memory for JSON");
-        status = ENOMEM;
+        if (NULL == (moduleSession = OpenModuleSession(session, g_reported[i].component)))
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiGetReported: no module exists with component '%s'", g_reported[i].component);
+            continue;
+        }
+        else if (NULL == moduleSession->module)
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiGetReported: no module is loaded for session '%s'", session->uuid);
+            continue;
+        }
+
+        for (j = 0, collector = NULL; j < *collectorCount; j++)
+        {
+            if (collectors[j]->module == moduleSession->module)
+            {
+                collector = collectors[j];
+                break;
+            }
+        }
+
+        if ((NULL == collector) && (*collectorCount < count))
+        {
+            if ((NULL == (collector = (REPORTED_COLLECTOR*)calloc(1, sizeof(REPORTED_COLLECTOR)))) || (NULL == (collector->indexes = (int*)calloc(g_reportedTotal, sizeof(int)))))
+            {
+                OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to allocate memory for collector");
+                FREE_MEMORY(collector);
+                continue;
+            }
+
+            collector->collection = collection;
+            collector->module = moduleSession->module;
+            collector->handle = moduleSession->handle;
+            collector->maxPayloadSizeBytes = session->maxPayloadSizeBytes;
+            collectors[(*collectorCount)++] = collector;
+        }
+
+        if (NULL != collector)
+        {
+            collector->indexes[collector->count++] = i;
+        }
     }
-    else
+
+    for (j = 0; j < *collectorCount; j++)
     {
-        memcpy(json, payload, payloadSizeBytes + 1);
+        collector = collectors[j];
 
-        if (NULL == (rootValue = json_parse_string(json)))
+        if (0 == pthread_create(&collector->thread, NULL, ReportedCollectorThread, collector))
         {
-            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to parse JSON");
-            status = EINVAL;
+            collector->started = true;
         }
         else
         {
-            // Iterate over the "keys" in the root object
-            rootObject = json_value_get_object(rootValue);
-            componentCount = (int)json_object_get_count(rootObject);
+            OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to create collector thread for module '%s', collecting inline", collector->module->info->name);
+            ReportedCollectorThread(collector);
+        }
+    }
+
+    return collectors;
+}
+
+// Waits for the collectors, which return by the deadline of the report as their calls into the modules do
+static void StopReportedCollectors(REPORTED_COLLECTOR** collectors, int collectorCount)
+{
+    REPORTED_COLLECTOR* collector = NULL;
+    int i = 0;
+
+    for (i = 0; i < collectorCount; i++)
+    {
+        collector = collectors[i];
+
+        if (collector->started)
+        {
+            pthread_join(collector->thread, NULL);
+        }
+
+        FREE_MEMORY(collector->indexes);
+        FREE_MEMORY(collector);
+    }
+
+    FREE_MEMORY(collectors);
+}
+
+// Streams {"Component":{"Object":value,...},...} with components in the order they first appear in g_reported,
+// so that the report does not depend on which module finished first
+static void WriteReportedObjects(JSON_WRITER* writer, REPORTED_COLLECTION* collection)
+{
+    JSON_Value* value = NULL;
+    bool componentWritten = false;
+    bool objectWritten = false;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+
+    WriteJsonText(writer, "{", 1);
+
+    for (i = 0; i < g_reportedTotal; i++)
+    {
+        if (!g_reported[i].firstInComponent)
+        {
+            continue;
+        }
 
-            for (i = 0; i < componentCount; i++)
+        for (j = i, objectWritten = false; j >= 0; j = g_reported[j].nextInComponent)
+        {
+            if (g_reported[j].duplicate)
             {
-                component = json_object_get_name(rootObject, i);
-                componentObject = json_object_get_object(rootObject, component);
-                moduleSession = FindModuleSession(session->modules, component);
+                continue;
+            }
 
-                if (NULL == moduleSession)
+            // Of an object listed more than once the last value collected is reported, once
+            for (k = j, value = NULL; k >= 0; k = g_reported[k].nextDuplicate)
+            {
+                if (collection->results[k].collected && (NULL != collection->results[k].value))
                 {
-                    OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no module exists with component '%s'", component);
-                    status = EINVAL;
+                    value = collection->results[k].value;
                 }
-                else
-                {
-                    // Iterate over the "keys" in the component object
-                    objectCount = (int)json_object_get_count(componentObject);
-
-                    for (j = 0; j < objectCount; j++)
-                    {
-                        object = json_object_get_name(componentObject, j);
-                        objectValue = json_object_get_value(componentObject, object);
-                        objectJson = json_serialize_to_string(objectValue);
+            }
 
-                        if (NULL == objectJson)
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: failed to serialize JSON");
-                        }
-                        else if (NULL == moduleSession->module)
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MpiSetDesired: no module is loaded for session '%s'", uuid);
-                        }
-                        else
-                        {
-                            if (MMI_OK != (status = moduleSession->module->set(moduleSession->handle, component, object, objectJson, (int)strlen(objectJson))))
-                            {
-                                OsConfigLogError(GetPlatformLog(), "MpiSetDesired: MmiSet(%p, %s, %s) failed with %d", moduleSession->handle, component, object, status);
-                            }
+            if (NULL == value)
+            {
+                continue;
+            }
 
-                            FREE_MEMORY(objectJson);
-                        }
-                    }
+            if (objectWritten)
+            {
+                WriteJsonText(writer, ",", 1);
+            }
+            else
+            {
+                if (componentWritten)
+                {
+                    WriteJsonText(writer, ",", 1);
                 }
+                WriteJsonString(writer, g_reported[i].component, strlen(g_reported[i].component));
+                WriteJsonText(writer, ":{", 2);
+                componentWritten = true;
+                objectWritten = true;
             }
 
-            json_value_free(rootValue);
+            WriteJsonString(writer, g_reported[j].object, strlen(g_reported[j].object));
+            WriteJsonText(writer, ":", 1);
+            WriteJsonValue(writer, value);
         }
 
-        FREE_MEMORY(json);
-    }
-
-    if (IsDebugLoggingEnabled())
-    {
-        if (MMI_OK == status)
-        {
-            OsConfigLogDebug(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) succeeded", handle, payload, payloadSizeBytes);
-        }
-        else
+        if (objectWritten)
         {
-            OsConfigLogError(GetPlatformLog(), "MpiSetDesired(%p, %p, %d) failed with %d", handle, payload, payloadSizeBytes, status);
+            WriteJsonText(writer, "}", 1);
         }
     }
 
-    return status;
+    WriteJsonText(writer, "}", 1);
 }
 
-int MpiGetReported(MPI_HANDLE handle, MPI_JSON_STRING* payload, int* payloadSizeBytes)
+// With a generation only the objects that changed since the generation last returned on the session are reported
+static int GetReported(const char* caller, MPI_HANDLE handle, unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSizeBytes)
 {
     int status = MPI_OK;
     const char* uuid = (const char*)handle;
     SESSION* session = NULL;
-    MODULE_SESSION* moduleSession = NULL;
-    JSON_Value* rootValue = NULL;
-    JSON_Object* rootObject = NULL;
-    JSON_Value* componentValue = NULL;
-    JSON_Object* componentObject = NULL;
-    JSON_Value* objectValue = NULL;
-    MMI_JSON_STRING mmiPayload = NULL;
-    int mmiPayloadSizeBytes = 0;
-    int mmiStatus = MMI_OK;
-    char* payloadJson = NULL;
+    REPORTED_COLLECTION collection = {0};
+    REPORTED_COLLECTOR** collectors = NULL;
+    int collectorCount = 0;
+    JSON_WRITER writer = {0};
+    size_t payloadSize = 0;
+    bool resync = false;
+    bool changed = false;
     int i = 0;
 
     if ((NULL == handle) || (NULL == payload) || (NULL == payloadSizeBytes))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGetReported(%p, %p, %p) called with invalid arguments", handle, payload, payloadSizeBytes);
+        OsConfigLogError(GetPlatformLog(), "%s(%p, %p, %p) called with invalid arguments", caller, handle, payload, payloadSizeBytes);
         status = EINVAL;
     }
-    else if (NULL == (session = FindSession(uuid)))
+    else if (NULL == (session = AcquireSession(uuid)))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGetReported: no session exists with UUID '%s'", uuid);
+        OsConfigLogError(GetPlatformLog(), "%s: no session exists with UUID '%s'", caller, uuid);
         status = EINVAL;
     }
-    else if (NULL == (rootValue = json_value_init_object()))
-    {
-        OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to initialize json object");
-        status = ENOMEM;
-    }
-    else if (NULL == (rootObject = json_value_get_object(rootValue)))
+    else if (NULL == (collection.results = (REPORTED_RESULT*)calloc((g_reportedTotal > 0) ? g_reportedTotal : 1, sizeof(REPORTED_RESULT))))
     {
-        OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to get root json object from value");
+        OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for reported objects", caller);
         status = ENOMEM;
     }
     else
     {
-        for (i = 0; i < g_reportedTotal; i++)
+        collection.count = g_reportedTotal;
+        clock_gettime(CLOCK_MONOTONIC, &collection.expires);
+        AddMilliseconds(&collection.expires, MODULE_REPORTED_TIMEOUT);
+
+        if (NULL != generation)
         {
-            if (NULL == (moduleSession = FindModuleSession(session->modules, g_reported[i].component)))
-            {
-                OsConfigLogError(GetPlatformLog(), "MpiGetReported: no module exists with component '%s'", g_reported[i].component);
-            }
-            else if (NULL == moduleSession->module)
+            // A client that missed or did not apply the last delta starts over with all reported objects
+            if ((NULL == session->reportedHashes) || (*generation != session->reportedGeneration))
             {
-                OsConfigLogError(GetPlatformLog(), "MpiGetReported: no module is loaded for session '%s'", uuid);
+                OsConfigLogDebug(GetPlatformLog(), "%s: generation %u does not match %u for session '%s', reporting all objects", caller, *generation, session->reportedGeneration, session->uuid);
+                FREE_MEMORY(session->reportedHashes);
+                session->reportedHashes = (size_t*)calloc((g_reportedTotal > 0) ? g_reportedTotal : 1, sizeof(size_t));
+                resync = true;
             }
             else
             {
-                mmiStatus = moduleSession->module->get(moduleSession->handle, g_reported[i].component, g_reported[i].object, &mmiPayload, &mmiPayloadSizeBytes);
+                // Read by the collectors, which are done before the hashes are updated below
+                collection.previousHashes = session->reportedHashes;
+            }
+        }
 
-                OsConfigLogDebug(GetPlatformLog(), "MmiGet(%s, %s) returned %d (%.*s)", g_reported[i].component, g_reported[i].object, mmiStatus, mmiPayloadSizeBytes, mmiPayload);
+        // Modules are collected concurrently, all within the timeout of the report
+        collectors = StartReportedCollectors(session, &collection, &collectorCount);
+        StopReportedCollectors(collectors, collectorCount);
 
-                if (MMI_OK != mmiStatus)
-                {
-                    OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s), returned %d", g_reported[i].component, g_reported[i].object, mmiStatus);
-                }
-                else if (NULL == (payloadJson = (char*)malloc(mmiPayloadSizeBytes + 1)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to allocate memory for JSON");
-                }
-                else
-                {
-                    memcpy(payloadJson, mmiPayload, mmiPayloadSizeBytes);
-                    payloadJson[mmiPayloadSizeBytes] = '\0';
+        for (i = 0; i < g_reportedTotal; i++)
+        {
+            // Objects left out or unchanged keep the hash of the value the client has
+            if (collection.results[i].collected && (NULL != collection.results[i].value) && (NULL != generation) && (NULL != session->reportedHashes))
+            {
+                session->reportedHashes[i] = collection.results[i].hash;
+                changed = true;
+            }
+        }
 
-                    if (NULL == (objectValue = json_parse_string(payloadJson)))
-                    {
-                        if (IsDebugLoggingEnabled())
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s) returned an invalid payload '%s'", g_reported[i].component, g_reported[i].object, payloadJson);
-                        }
-                        else
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MmiGet(%s, %s) returned an invalid payload", g_reported[i].component, g_reported[i].object);
-                        }
-                    }
-                    else
-                    {
-                        if (NULL == (componentValue = json_object_get_value(rootObject, g_reported[i].component)))
-                        {
-                            componentValue = json_value_init_object();
-                            json_object_set_value(rootObject, g_reported[i].component, componentValue);
-                        }
+        // Compact and written as the response is sent, whether or not it is a delta
+        WriteReportedObjects(&writer, &collection);
 
-                        if (NULL == (componentObject = json_value_get_object(componentValue)))
-                        {
-                            OsConfigLogError(GetPlatformLog(), "MpiGetReported: failed to get JSON object for component '%s'", g_reported[i].component);
-                        }
-                        else
-                        {
-                            json_object_set_value(componentObject, g_reported[i].object, objectValue);
-                        }
-                    }
+        for (i = 0; i < g_reportedTotal; i++)
+        {
+            json_value_free(collection.results[i].value);
+        }
+        FREE_MEMORY(collection.results);
 
-                    FREE_MEMORY(payloadJson);
+        if (NULL != generation)
+        {
+            if (changed || resync)
+            {
+                // Generation 0 is reserved for a client that has nothing yet
+                session->reportedGeneration += 1;
+                if (0 == session->reportedGeneration)
+                {
+                    session->reportedGeneration = 1;
                 }
-
-                moduleSession->module->free(mmiPayload);
-                mmiPayload = NULL;
             }
+
+            *generation = session->reportedGeneration;
+        }
+
+        if (NULL == (*payload = TakeJsonWriterBuffer(&writer, &payloadSize)))
+        {
+            OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for the reported objects", caller);
+            *payloadSizeBytes = 0;
+            status = ENOMEM;
+        }
+        else
+        {
+            *payloadSizeBytes = (int)payloadSize;
         }
+    }
 
-        *payload = json_serialize_to_string_pretty(rootValue);
-        *payloadSizeBytes = (int)strlen(*payload);
-        json_value_free(rootValue);
+    if (NULL != session)
+    {
+        ReleaseSession(session);
     }
 
     if (IsDebugLoggingEnabled())
     {
         if (MMI_OK == status)
         {
-            OsConfigLogDebug(GetPlatformLog(), "MpiGetDesired(%p, %p) succeeded", handle, payload);
+            OsConfigLogDebug(GetPlatformLog(), "%s(%p, %p) succeeded", caller, handle, payload);
         }
         else
         {
-            OsConfigLogError(GetPlatformLog(), "MpiGetDesired(%p, %p) failed with %d", handle, payload, status);
+            OsConfigLogError(GetPlatformLog(), "%s(%p, %p) failed with %d", caller, handle, payload, status);
         }
     }
 
     return status;
 }
+
+int MpiGetReported(MPI_HANDLE handle, MPI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    return GetReported("MpiGetReported", handle, NULL, payload, payloadSizeBytes);
+}
+
+int MpiGetReportedDelta(MPI_HANDLE handle, unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    if (NULL == generation)
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiGetReportedDelta(%p, %p, %p, %p) called with invalid arguments", handle, generation, payload, payloadSizeBytes);
+        return EINVAL;
+    }
+
+    return GetReported("MpiGetReportedDelta", handle, generation, payload, payloadSizeBytes);
+}
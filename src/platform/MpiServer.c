@@ -1,21 +1,38 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <PlatformCommon.h>
+#include <Metrics.h>
 #include <MpiServer.h>
 #include <ModulesManager.h>
 
 // 500 milliseconds
 #define MPI_WORKER_SLEEP 500
 
-#define MAX_CONTENTLENGTH_LENGTH 16
+// Requests are handled concurrently by a fixed pool of workers fed by the accept loop
+#define MPI_WORKER_THREADS 4
+#define MPI_MAX_PENDING_CONNECTIONS 32
+
+// Persistent (keep-alive) client connections, those idle for longer than the timeout are closed
+#define MPI_MAX_CONNECTIONS 64
+#define MPI_CONNECTION_IDLE_TIMEOUT 30000
+
+// Sessions idle for longer than twice the longest reporting interval of a client (24 hours) were left open by clients that went away
+#define MPI_SESSION_IDLE_TIMEOUT (2 * 24 * 60 * 60)
+
+#define MPI_LISTENER_EVENTS 16
+#define MPI_LISTENER_EVENT UINT64_MAX
+
 #define MAX_ERROR_LENGTH 16
 #define MAX_QUEUED_CONNECTIONS 5
 #define MAX_REASONSTRING_LENGTH 32
-#define MAX_STATUS_CODE_LENGTH 3
 
 #define MODULES_BIN_PATH "/usr/lib/osconfig"
 #define CONFIG_JSON_PATH "/etc/osconfig/osconfig.json"
+#define MODULES_INDEX_PATH "/etc/osconfig/osconfig_modules.cache"
+#define METRICS_PATH "/var/log/osconfig_platform_metrics.json"
 
 static const char* g_socketPrefix = "/run/osconfig";
 static const char* g_mpiSocket = "/run/osconfig/mpid.sock";
@@ -26,16 +43,58 @@ static const char* g_clientSession = "ClientSession";
 static const char* g_componentName = "ComponentName";
 static const char* g_objectName = "ObjectName";
 static const char* g_payload = "Payload";
+static const char* g_generation = "Generation";
+
+typedef struct PENDING_CONNECTION
+{
+    int socketHandle;
+
+    // Index in g_connections, -1 when the connection is closed after one request
+    int slot;
+
+    long enqueuedMilliseconds;
+} PENDING_CONNECTION;
+
+typedef struct MPI_CONNECTION
+{
+    bool inUse;
+    int socketHandle;
+
+    // Waiting in the epoll set for the next request, rather than queued or being handled
+    bool idle;
+    bool watched;
+
+    long lastActiveMilliseconds;
+    unsigned int requests;
+} MPI_CONNECTION;
 
 static int g_socketfd = -1;
+static int g_epollfd = -1;
 static struct sockaddr_un g_socketaddr = {0};
 static socklen_t g_socketlen = 0;
 
-static pthread_t g_mpiServerWorker = 0;
-static int g_mpiServerWorkerError = -1;
-static bool g_serverActive = false;
-
-char g_mpiCall[MPI_CALL_MESSAGE_LENGTH] = {0};
+static pthread_t g_mpiServerListener = 0;
+static int g_mpiServerListenerError = -1;
+static pthread_t g_mpiServerWorkers[MPI_WORKER_THREADS] = {0};
+static int g_mpiServerWorkerErrors[MPI_WORKER_THREADS] = {-1, -1, -1, -1};
+static atomic_bool g_serverActive = false;
+
+// Ring of accepted connections waiting for a worker, guarded by g_queueLock together with the connections and statistics
+static PENDING_CONNECTION g_pendingConnections[MPI_MAX_PENDING_CONNECTIONS] = {{0}};
+static unsigned int g_queueHead = 0;
+static unsigned int g_queueTail = 0;
+static pthread_mutex_t g_queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_queueNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_queueNotFull = PTHREAD_COND_INITIALIZER;
+static MPI_CONNECTION g_connections[MPI_MAX_CONNECTIONS] = {{0}};
+static MPI_SERVER_STATISTICS g_statistics = {0};
+
+// Metrics are saved to METRICS_PATH every MetricsIntervalSeconds (osconfig.json), when set
+static int g_metricsIntervalSeconds = 0;
+static time_t g_lastMetricsSave = 0;
+
+// Per worker thread, the crash handler reports the call that was in progress on the faulting thread
+__thread char g_mpiCall[MPI_CALL_MESSAGE_LENGTH] = {0};
 static const char g_mpiCallObjectTemplate[] = " during %s to %s.%s\n";
 static const char g_mpiCallModelTemplate[] = " during %s\n";
 
@@ -157,6 +216,31 @@ static int CallMpiGetReported(MPI_HANDLE handle, MPI_JSON_STRING* payload, int*
     return status;
 }
 
+static int CallMpiGetReportedDelta(MPI_HANDLE handle, unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSize)
+{
+    int status = MPI_OK;
+
+    snprintf(g_mpiCall, sizeof(g_mpiCall), g_mpiCallModelTemplate, MPI_GET_REPORTED_DELTA_URI);
+
+    status = MpiGetReportedDelta((MPI_HANDLE)handle, generation, payload, payloadSize);
+
+    if (IsDebugLoggingEnabled())
+    {
+        if (MPI_OK == status)
+        {
+            OsConfigLogDebug(GetPlatformLog(), "MpiGetReportedDelta request, session %p ('%s'), generation %u", handle, (char*)handle, *generation);
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "MpiGetReportedDelta request, session %p ('%s'), failed: %d", handle, (char*)handle, status);
+        }
+    }
+
+    memset(g_mpiCall, 0, sizeof(g_mpiCall));
+
+    return status;
+}
+
 HTTP_STATUS SetErrorResponse(const char* uri, int mpiStatus, char** response, int* responseSize)
 {
     int size = 0;
@@ -182,14 +266,33 @@ HTTP_STATUS SetErrorResponse(const char* uri, int mpiStatus, char** response, in
     return status;
 }
 
+// The request is parsed and its payload serialized in the arena of the request, handlers only read these during the call
+static JSON_Value* ParseRequestBody(JsonArena* arena, const char* requestBody)
+{
+    JsonArena* previousArena = UseJsonArena(arena);
+    JSON_Value* rootValue = json_parse_string(requestBody);
+    UseJsonArena(previousArena);
+    return rootValue;
+}
+
+static char* SerializeRequestPayload(JsonArena* arena, const JSON_Value* payloadValue)
+{
+    JsonArena* previousArena = UseJsonArena(arena);
+    char* payload = json_serialize_to_string(payloadValue);
+    UseJsonArena(previousArena);
+    return payload;
+}
+
 HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** response, int* responseSize, MPI_CALLS handlers)
 {
+    JsonArena* arena = NULL;
     JSON_Value* rootValue = NULL;
     JSON_Value* clientValue = NULL;
     JSON_Value* componentValue = NULL;
     JSON_Value* objectValue = NULL;
     JSON_Value* payloadValue = NULL;
     JSON_Value* maxPayloadSizeValue = NULL;
+    JSON_Value* generationValue = NULL;
     JSON_Object* rootObject = NULL;
     int mpiStatus = MPI_OK;
     char* uuid = NULL;
@@ -198,10 +301,17 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
     const char* object = NULL;
     char* payload = NULL;
     int maxPayloadSizeBytes = 0;
+    unsigned int generation = 0;
+    char* reported = NULL;
+    int reportedSize = 0;
     int estimatedSize = 0;
     const char* responseFormat = "\"%s\"";
+    const char* deltaResponseFormat = "{\"Generation\":%u,\"Reported\":%.*s}";
     HTTP_STATUS status = HTTP_OK;
 
+    // Without an arena the request is parsed on the heap
+    arena = CreateJsonArena();
+
     if (NULL == uri)
     {
         OsConfigLogError(GetPlatformLog(), "HandleMpiCall: called with invalid null URI");
@@ -222,7 +332,7 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
         OsConfigLogError(GetPlatformLog(), "HandleMpiCall(%s): called with invalid null response size", uri);
         status = HTTP_BAD_REQUEST;
     }
-    else if (NULL == (rootValue = json_parse_string(requestBody)))
+    else if (NULL == (rootValue = ParseRequestBody(arena, requestBody)))
     {
         OsConfigLogError(GetPlatformLog(), "HandleMpiCall(%s): failed to parse request body", uri);
         status = HTTP_BAD_REQUEST;
@@ -297,7 +407,8 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
             (0 == strcmp(uri, MPI_SET_URI)) ||
             (0 == strcmp(uri, MPI_GET_URI)) ||
             (0 == strcmp(uri, MPI_SET_DESIRED_URI)) ||
-            (0 == strcmp(uri, MPI_GET_REPORTED_URI)))
+            (0 == strcmp(uri, MPI_GET_REPORTED_URI)) ||
+            (0 == strcmp(uri, MPI_GET_REPORTED_DELTA_URI)))
         {
             if (NULL == (clientValue = json_object_get_value(rootObject, g_clientSession)))
             {
@@ -360,7 +471,7 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
                             OsConfigLogError(GetPlatformLog(), "%s: failed to parse '%s' from request body", uri, g_payload);
                             status = HTTP_BAD_REQUEST;
                         }
-                        else if (NULL == (payload = json_serialize_to_string(payloadValue)))
+                        else if (NULL == (payload = SerializeRequestPayload(arena, payloadValue)))
                         {
                             OsConfigLogError(GetPlatformLog(), "%s: failed to get payload string", uri);
                             status = HTTP_BAD_REQUEST;
@@ -391,7 +502,7 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
                     OsConfigLogError(GetPlatformLog(), "%s: failed to parse '%s' from request body", uri, g_payload);
                     status = HTTP_BAD_REQUEST;
                 }
-                else if (NULL == (payload = json_serialize_to_string(payloadValue)))
+                else if (NULL == (payload = SerializeRequestPayload(arena, payloadValue)))
                 {
                     OsConfigLogError(GetPlatformLog(), "%s: failed to get payload string", uri);
                     status = HTTP_BAD_REQUEST;
@@ -410,6 +521,53 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
                     status = SetErrorResponse(uri, mpiStatus, response, responseSize);
                 }
             }
+            else if (0 == strcmp(uri, MPI_GET_REPORTED_DELTA_URI))
+            {
+                // A missing generation is the same as none applied yet
+                if ((NULL != (generationValue = json_object_get_value(rootObject, g_generation))) && (JSONNumber != json_value_get_type(generationValue)))
+                {
+                    OsConfigLogError(GetPlatformLog(), "%s: '%s' is not a number", uri, g_generation);
+                    status = HTTP_BAD_REQUEST;
+                }
+                else
+                {
+                    generation = (NULL != generationValue) ? (unsigned int)json_value_get_number(generationValue) : 0;
+
+                    if (MPI_OK != (mpiStatus = handlers.mpiGetReportedDelta((MPI_HANDLE)client, &generation, &reported, &reportedSize)))
+                    {
+                        OsConfigLogError(GetPlatformLog(), "%s: failed for client '%s' with %d (returning %d)", uri, client, mpiStatus, status);
+                        status = SetErrorResponse(uri, mpiStatus, response, responseSize);
+                    }
+                    else
+                    {
+                        estimatedSize = strlen(deltaResponseFormat) + MAX_ERROR_LENGTH + reportedSize + 1;
+
+                        if (NULL != (*response = (char*)malloc(estimatedSize)))
+                        {
+                            snprintf(*response, estimatedSize, deltaResponseFormat, generation, reportedSize, reported);
+                            *responseSize = strlen(*response);
+                        }
+                        else
+                        {
+                            OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for response", uri);
+                            status = HTTP_INTERNAL_SERVER_ERROR;
+                        }
+                    }
+
+                    FREE_MEMORY(reported);
+                }
+            }
+        }
+        else if (0 == strcmp(uri, MPI_GET_METRICS_URI))
+        {
+            if (NULL == (*response = SerializeMetrics()))
+            {
+                status = HTTP_INTERNAL_SERVER_ERROR;
+            }
+            else
+            {
+                *responseSize = strlen(*response);
+            }
         }
         else
         {
@@ -418,8 +576,16 @@ HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** respo
         }
     }
 
-    json_free_serialized_string(payload);
-    json_value_free(rootValue);
+    if (NULL != arena)
+    {
+        // Everything parsed from the request goes at once with its arena
+        FreeJsonArena(arena);
+    }
+    else
+    {
+        json_free_serialized_string(payload);
+        json_value_free(rootValue);
+    }
 
     return status;
 }
@@ -452,22 +618,20 @@ static char* HttpReasonAsString(HTTP_STATUS statusCode)
     return reason;
 }
 
-static void* MpiServerWorker(void* arguments)
+// Returns true when the connection can stay open for the next request
+static bool HandleConnection(int socketHandle, bool allowKeepAlive)
 {
-    const char* responseFormat = "HTTP/1.1 %d %s\r\nServer: OSConfig\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%.*s";
+    const char* headersFormat = "HTTP/1.1 %d %s\r\nServer: OSConfig\r\nContent-Type: application/json\r\nConnection: %s\r\n" HTTP_ACCEPT_MEMFD_BODY_HEADER;
 
-    int socketHandle = -1;
-    char* uri = NULL;
-    int contentLength = 0;
-    char* requestBody = NULL;
+    HttpMessage request = {0};
     HTTP_STATUS status = HTTP_OK;
     char* httpReason = NULL;
     char* responseBody = NULL;
     int responseSize = 0;
-    char* buffer = NULL;
-    int estimatedSize = 0;
-    int actualSize = 0;
-    ssize_t bytes = 0;
+    char* headers = NULL;
+    bool keepAlive = false;
+    int result = 0;
+    PerfClock clock = {{0, 0}, {0, 0}};
 
     MPI_CALLS mpiCalls = {
         CallMpiOpen,
@@ -475,96 +639,485 @@ static void* MpiServerWorker(void* arguments)
         CallMpiSet,
         CallMpiGet,
         CallMpiSetDesired,
-        CallMpiGetReported
+        CallMpiGetReported,
+        CallMpiGetReportedDelta
     };
 
+    OsConfigLogDebug(GetPlatformLog(), "Reading request: path %s, handle '%d'", g_mpiSocket, socketHandle);
+
+    // A persistent connection becomes readable also when the client closes it, there is nobody to respond to then
+    if (ECONNRESET == (result = ReadHttpMessageFromSocket(socketHandle, &request, GetPlatformLog())))
+    {
+        OsConfigLogDebug(GetPlatformLog(), "Connection closed by client: path %s, handle '%d'", g_mpiSocket, socketHandle);
+        return false;
+    }
+    else if ((EAGAIN == result) || (EWOULDBLOCK == result))
+    {
+        OsConfigLogInfo(GetPlatformLog(), "Closing connection '%d', no complete request within %d ms", socketHandle, MPI_CONNECTION_IDLE_TIMEOUT);
+        return false;
+    }
+
+    AreModulesLoadedAndLoadIfNot(MODULES_BIN_PATH, CONFIG_JSON_PATH, MODULES_INDEX_PATH);
+
+    if (0 != result)
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to read request from connection '%d' (%d)", socketHandle, result);
+        status = HTTP_BAD_REQUEST;
+    }
+    else if ((NULL == request.method) || (0 != strcmp(request.method, "POST")))
+    {
+        OsConfigLogError(GetPlatformLog(), "Unsupported request on connection '%d'", socketHandle);
+        status = HTTP_BAD_REQUEST;
+    }
+
+    // After a malformed request the position of the next one in the stream is unknown
+    keepAlive = request.keepAlive && allowKeepAlive && (HTTP_OK == status) && g_serverActive;
+
+    if (HTTP_OK == status)
+    {
+        OsConfigLogDebug(GetPlatformLog(), "%s: content-length %d, body, '%s', %u reads", request.uri, request.contentLength, request.body, request.reads);
+        StartPerfClock(&clock, GetPlatformLog());
+        status = HandleMpiCall(request.uri, request.contentLength ? request.body : NULL, &responseBody, &responseSize, mpiCalls);
+        StopPerfClock(&clock, GetPlatformLog());
+        RecordMpiRequest(request.uri, GetPerfClockTime(&clock, GetPlatformLog()), request.contentLength, responseSize, status);
+    }
+
+    httpReason = HttpReasonAsString(status);
+
+    // Large bodies go back as a memfd to clients that accept it
+    if (NULL == (headers = FormatAllocateString(headersFormat, (int)status, httpReason, keepAlive ? "keep-alive" : "close")))
+    {
+        OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for HTTP response", request.uri);
+        keepAlive = false;
+    }
+    else if (0 != (result = SendHttpMessageToSocket(socketHandle, headers, responseBody, responseBody ? responseSize : 0, request.acceptsMemfdBody, GetPlatformLog())))
+    {
+        OsConfigLogError(GetPlatformLog(), "%s: failed to write complete HTTP response of %d bytes (%d)", request.uri, responseSize, result);
+        keepAlive = false;
+    }
+
+    FreeHttpMessage(&request);
+    FREE_MEMORY(responseBody);
+    FREE_MEMORY(httpReason);
+    FREE_MEMORY(headers);
+
+    return keepAlive;
+}
+
+static long GetMonotonicMilliseconds(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Returns the connection slot for a newly accepted connection, or -1 when the limit of persistent connections is reached
+static int OpenConnection(int socketHandle)
+{
+    int slot = -1;
+    int i = 0;
+
+    pthread_mutex_lock(&g_queueLock);
+
+    for (i = 0; i < MPI_MAX_CONNECTIONS; i++)
+    {
+        if (!g_connections[i].inUse)
+        {
+            memset(&g_connections[i], 0, sizeof(MPI_CONNECTION));
+            g_connections[i].inUse = true;
+            g_connections[i].socketHandle = socketHandle;
+            g_statistics.connections += 1;
+            slot = i;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_queueLock);
+
+    return slot;
+}
+
+static void CloseConnection(int socketHandle, int slot)
+{
+    if (slot >= 0)
+    {
+        pthread_mutex_lock(&g_queueLock);
+        g_connections[slot].inUse = false;
+        g_statistics.connections -= 1;
+        pthread_mutex_unlock(&g_queueLock);
+    }
+
+    if (0 != close(socketHandle))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to close socket: path %s, handle '%d'", g_mpiSocket, socketHandle);
+    }
+
+    OsConfigLogDebug(GetPlatformLog(), "Closed connection: path %s, handle '%d'", g_mpiSocket, socketHandle);
+}
+
+// Hands a persistent connection back to the listener, which dispatches it again when the next request arrives
+static bool KeepConnection(int socketHandle, int slot)
+{
+    struct epoll_event event = {0};
+    int operation = EPOLL_CTL_ADD;
+
+    pthread_mutex_lock(&g_queueLock);
+    operation = g_connections[slot].watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    g_connections[slot].watched = true;
+    g_connections[slot].idle = true;
+    g_connections[slot].lastActiveMilliseconds = GetMonotonicMilliseconds();
+    pthread_mutex_unlock(&g_queueLock);
+
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.u64 = (uint64_t)slot;
+
+    if (0 != epoll_ctl(g_epollfd, operation, socketHandle, &event))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to watch connection '%d' for the next request (%d)", socketHandle, errno);
+        return false;
+    }
+
+    return true;
+}
+
+// Called with g_queueLock held
+static void UpdateWaitStatistics(long waitMilliseconds)
+{
+    g_statistics.dispatched += 1;
+    g_statistics.totalWaitMilliseconds += waitMilliseconds;
+    if (waitMilliseconds > g_statistics.maxWaitMilliseconds)
+    {
+        g_statistics.maxWaitMilliseconds = waitMilliseconds;
+    }
+
+    RecordQueueWait(waitMilliseconds * 1000);
+}
+
+static void* MpiServerWorker(void* arguments)
+{
+    PENDING_CONNECTION connection = {0};
+    long waitMilliseconds = 0;
+    unsigned int queueDepth = 0;
+
     UNUSED(arguments);
 
-    while (g_serverActive)
+    while (true)
     {
-        status = HTTP_OK;
+        pthread_mutex_lock(&g_queueLock);
 
-        if (0 <= (socketHandle = accept(g_socketfd, (struct sockaddr*)&g_socketaddr, &g_socketlen)))
+        while (g_serverActive && (0 == g_statistics.queueDepth))
         {
-            AreModulesLoadedAndLoadIfNot(MODULES_BIN_PATH, CONFIG_JSON_PATH);
+            pthread_cond_wait(&g_queueNotEmpty, &g_queueLock);
+        }
 
-            OsConfigLogDebug(GetPlatformLog(), "Accepted connection: path %s, handle '%d'", g_socketaddr.sun_path, socketHandle);
+        if (!g_serverActive)
+        {
+            pthread_mutex_unlock(&g_queueLock);
+            break;
+        }
 
-            if (NULL == (uri = ReadUriFromSocket(socketHandle, GetPlatformLog())))
-            {
-                OsConfigLogError(GetPlatformLog(), "Failed to read request URI %d", socketHandle);
-                status = HTTP_BAD_REQUEST;
-            }
-            else if (0 != (contentLength = ReadHttpContentLengthFromSocket(socketHandle, GetPlatformLog())))
-            {
-                if (NULL == (requestBody = (char*)malloc(contentLength + 1)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for HTTP body, Content-Length %d", uri, contentLength);
-                    status = HTTP_BAD_REQUEST;
-                }
-                else
-                {
-                    memset(requestBody, 0, contentLength + 1);
-                    if (contentLength != (int)(bytes = read(socketHandle, requestBody, contentLength)))
-                    {
-                        OsConfigLogError(GetPlatformLog(), "%s: failed to read complete HTTP body, Content-Length %d, bytes read %d", uri, contentLength, (int)bytes);
-                        status = HTTP_BAD_REQUEST;
-                    }
-                }
-            }
+        connection = g_pendingConnections[g_queueHead];
+        g_queueHead = (g_queueHead + 1) % MPI_MAX_PENDING_CONNECTIONS;
+        queueDepth = --g_statistics.queueDepth;
+        waitMilliseconds = GetMonotonicMilliseconds() - connection.enqueuedMilliseconds;
+        UpdateWaitStatistics(waitMilliseconds);
+        g_statistics.busyWorkers += 1;
 
-            if (HTTP_OK == status)
+        if (connection.slot >= 0)
+        {
+            if (g_connections[connection.slot].requests > 0)
             {
-                OsConfigLogDebug(GetPlatformLog(), "%s: content-length %d, body, '%s'", uri, contentLength, requestBody);
-                status = HandleMpiCall(uri, requestBody, &responseBody, &responseSize, mpiCalls);
+                g_statistics.reused += 1;
             }
+            g_connections[connection.slot].requests += 1;
+        }
 
-            httpReason = HttpReasonAsString(status);
-            estimatedSize = strlen(responseFormat) + MAX_STATUS_CODE_LENGTH + strlen(httpReason) + MAX_CONTENTLENGTH_LENGTH + responseSize + 1;
+        pthread_cond_signal(&g_queueNotFull);
+        pthread_mutex_unlock(&g_queueLock);
 
-            if (NULL != (buffer = (char*)malloc(estimatedSize)))
-            {
-                memset(buffer, 0, estimatedSize);
+        OsConfigLogDebug(GetPlatformLog(), "Dispatching connection '%d' after %ld ms in queue, %u more pending", connection.socketHandle, waitMilliseconds, queueDepth);
 
-                snprintf(buffer, estimatedSize, responseFormat, (int)status, httpReason, responseSize, responseSize, (responseBody ? responseBody : ""));
-                actualSize = (int)strlen(buffer);
+        if (!HandleConnection(connection.socketHandle, connection.slot >= 0) || !KeepConnection(connection.socketHandle, connection.slot))
+        {
+            CloseConnection(connection.socketHandle, connection.slot);
+        }
 
-                if (actualSize != (bytes = write(socketHandle, buffer, actualSize)))
-                {
-                    OsConfigLogError(GetPlatformLog(), "%s: failed to write complete HTTP response, %d bytes of %d", uri, (int)bytes, actualSize);
-                }
+        pthread_mutex_lock(&g_queueLock);
+        g_statistics.busyWorkers -= 1;
+        pthread_mutex_unlock(&g_queueLock);
+    }
+
+    return NULL;
+}
+
+static bool EnqueueConnection(int socketHandle, int slot)
+{
+    bool enqueued = false;
+
+    pthread_mutex_lock(&g_queueLock);
+
+    // Backpressure: stop accepting while every slot is taken, further clients wait in the listen backlog
+    while (g_serverActive && (MPI_MAX_PENDING_CONNECTIONS == g_statistics.queueDepth))
+    {
+        pthread_cond_wait(&g_queueNotFull, &g_queueLock);
+    }
+
+    if (g_serverActive)
+    {
+        g_pendingConnections[g_queueTail].socketHandle = socketHandle;
+        g_pendingConnections[g_queueTail].slot = slot;
+        g_pendingConnections[g_queueTail].enqueuedMilliseconds = GetMonotonicMilliseconds();
+        g_queueTail = (g_queueTail + 1) % MPI_MAX_PENDING_CONNECTIONS;
+        g_statistics.queueDepth += 1;
+        if (g_statistics.queueDepth > g_statistics.maxQueueDepth)
+        {
+            g_statistics.maxQueueDepth = g_statistics.queueDepth;
+        }
+
+        pthread_cond_signal(&g_queueNotEmpty);
+        enqueued = true;
+    }
+
+    pthread_mutex_unlock(&g_queueLock);
+
+    return enqueued;
+}
+
+// A client that stops sending in the middle of a request, or stops reading its response, would otherwise hold a worker for good
+static void SetConnectionTimeouts(int socketHandle)
+{
+    struct timeval timeout = {MPI_CONNECTION_IDLE_TIMEOUT / 1000, (MPI_CONNECTION_IDLE_TIMEOUT % 1000) * 1000};
+
+    if ((0 != setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))) ||
+        (0 != setsockopt(socketHandle, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to set timeouts on connection '%d' (%d)", socketHandle, errno);
+    }
+}
+
+static void AcceptConnections(void)
+{
+    int socketHandle = -1;
+    int slot = -1;
+
+    while (g_serverActive && (0 <= (socketHandle = accept(g_socketfd, NULL, NULL))))
+    {
+        // The listening socket is non-blocking, connections are handled with blocking reads and writes
+        fcntl(socketHandle, F_SETFL, fcntl(socketHandle, F_GETFL) & ~O_NONBLOCK);
+        SetConnectionTimeouts(socketHandle);
+
+        // Past the limit the connection is still served, but closed after its first response
+        if (0 > (slot = OpenConnection(socketHandle)))
+        {
+            OsConfigLogDebug(GetPlatformLog(), "Limit of %d persistent connections reached, connection '%d' will not be kept alive", MPI_MAX_CONNECTIONS, socketHandle);
+        }
+
+        if (!EnqueueConnection(socketHandle, slot))
+        {
+            CloseConnection(socketHandle, slot);
+        }
+    }
+
+    if ((socketHandle < 0) && (EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to accept connection on socket '%s' (%d)", g_mpiSocket, errno);
+    }
+}
+
+static void DispatchConnection(int slot)
+{
+    int socketHandle = -1;
+
+    pthread_mutex_lock(&g_queueLock);
+    if (g_connections[slot].inUse && g_connections[slot].idle)
+    {
+        g_connections[slot].idle = false;
+        socketHandle = g_connections[slot].socketHandle;
+    }
+    pthread_mutex_unlock(&g_queueLock);
+
+    if ((socketHandle >= 0) && !EnqueueConnection(socketHandle, slot))
+    {
+        CloseConnection(socketHandle, slot);
+    }
+}
+
+static void CloseIdleConnections(void)
+{
+    long now = GetMonotonicMilliseconds();
+    int i = 0;
+
+    pthread_mutex_lock(&g_queueLock);
+
+    for (i = 0; i < MPI_MAX_CONNECTIONS; i++)
+    {
+        if (g_connections[i].inUse && g_connections[i].idle && ((now - g_connections[i].lastActiveMilliseconds) > MPI_CONNECTION_IDLE_TIMEOUT))
+        {
+            OsConfigLogDebug(GetPlatformLog(), "Closing connection '%d' idle for more than %d ms", g_connections[i].socketHandle, MPI_CONNECTION_IDLE_TIMEOUT);
+            close(g_connections[i].socketHandle);
+            g_connections[i].inUse = false;
+            g_statistics.connections -= 1;
+        }
+    }
+
+    pthread_mutex_unlock(&g_queueLock);
+}
+
+static void* MpiServerListener(void* arguments)
+{
+    struct epoll_event events[MPI_LISTENER_EVENTS];
+    int count = 0;
+    int i = 0;
+
+    UNUSED(arguments);
+
+    while (g_serverActive)
+    {
+        // Wakes up periodically to notice shutdown and to close idle connections
+        count = epoll_wait(g_epollfd, events, MPI_LISTENER_EVENTS, MPI_WORKER_SLEEP);
+
+        for (i = 0; i < count; i++)
+        {
+            if (MPI_LISTENER_EVENT == events[i].data.u64)
+            {
+                AcceptConnections();
             }
             else
             {
-                OsConfigLogError(GetPlatformLog(), "%s: failed to allocate memory for HTTP response, %d bytes of %d", uri, 0, estimatedSize);
+                DispatchConnection((int)events[i].data.u64);
             }
+        }
 
-            if (0 != close(socketHandle))
-            {
-                OsConfigLogError(GetPlatformLog(), "Failed to close socket: path %s, handle '%d'", g_socketaddr.sun_path, socketHandle);
-            }
+        CloseIdleConnections();
+    }
+
+    return NULL;
+}
+
+void MpiGetServerStatistics(MPI_SERVER_STATISTICS* statistics)
+{
+    if (NULL != statistics)
+    {
+        pthread_mutex_lock(&g_queueLock);
+        memcpy(statistics, &g_statistics, sizeof(MPI_SERVER_STATISTICS));
+        pthread_mutex_unlock(&g_queueLock);
+    }
+}
+
+static void StartServerThreads(void)
+{
+    struct epoll_event event = {0};
+    int i = 0;
+
+    if (0 > (g_epollfd = epoll_create1(EPOLL_CLOEXEC)))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to create epoll instance for socket '%s' (%d)", g_mpiSocket, errno);
+        return;
+    }
 
-            OsConfigLogDebug(GetPlatformLog(), "Closed connection: path %s, handle '%d'", g_socketaddr.sun_path, socketHandle);
+    event.events = EPOLLIN;
+    event.data.u64 = MPI_LISTENER_EVENT;
 
-            contentLength = 0;
-            responseSize = 0;
+    if ((0 != fcntl(g_socketfd, F_SETFL, fcntl(g_socketfd, F_GETFL) | O_NONBLOCK)) || (0 != epoll_ctl(g_epollfd, EPOLL_CTL_ADD, g_socketfd, &event)))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to watch socket '%s' (%d)", g_mpiSocket, errno);
+        close(g_epollfd);
+        g_epollfd = -1;
+        return;
+    }
 
-            FREE_MEMORY(requestBody);
-            FREE_MEMORY(responseBody);
-            FREE_MEMORY(httpReason);
-            FREE_MEMORY(buffer);
-            FREE_MEMORY(uri);
+    g_serverActive = true;
 
-            SleepMilliseconds(MPI_WORKER_SLEEP);
+    for (i = 0; i < MPI_WORKER_THREADS; i++)
+    {
+        if (0 == (g_mpiServerWorkerErrors[i] = pthread_create(&g_mpiServerWorkers[i], NULL, MpiServerWorker, NULL)))
+        {
+            g_statistics.workers += 1;
+        }
+        else
+        {
+            OsConfigLogError(GetPlatformLog(), "Failed to create MPI server worker thread (%d)", g_mpiServerWorkerErrors[i]);
         }
     }
 
-    return NULL;
+    if (0 != (g_mpiServerListenerError = pthread_create(&g_mpiServerListener, NULL, MpiServerListener, NULL)))
+    {
+        OsConfigLogError(GetPlatformLog(), "Failed to create MPI server listener thread (%d)", g_mpiServerListenerError);
+    }
+
+    OsConfigLogInfo(GetPlatformLog(), "MPI server started with %u worker threads, up to %d pending and %d persistent connections", g_statistics.workers, MPI_MAX_PENDING_CONNECTIONS, MPI_MAX_CONNECTIONS);
+}
+
+static void StopServerThreads(void)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&g_queueLock);
+    g_serverActive = false;
+    pthread_cond_broadcast(&g_queueNotEmpty);
+    pthread_cond_broadcast(&g_queueNotFull);
+    pthread_mutex_unlock(&g_queueLock);
+
+    if (0 == g_mpiServerListenerError)
+    {
+        pthread_join(g_mpiServerListener, NULL);
+        g_mpiServerListenerError = -1;
+    }
+
+    for (i = 0; i < MPI_WORKER_THREADS; i++)
+    {
+        if (0 == g_mpiServerWorkerErrors[i])
+        {
+            pthread_join(g_mpiServerWorkers[i], NULL);
+            g_mpiServerWorkerErrors[i] = -1;
+        }
+    }
+
+    // Connections accepted but never dispatched
+    while (g_statistics.queueDepth > 0)
+    {
+        if (g_pendingConnections[g_queueHead].slot < 0)
+        {
+            close(g_pendingConnections[g_queueHead].socketHandle);
+        }
+        g_queueHead = (g_queueHead + 1) % MPI_MAX_PENDING_CONNECTIONS;
+        g_statistics.queueDepth -= 1;
+    }
+
+    // Persistent connections, idle or queued
+    for (i = 0; i < MPI_MAX_CONNECTIONS; i++)
+    {
+        if (g_connections[i].inUse)
+        {
+            close(g_connections[i].socketHandle);
+            g_connections[i].inUse = false;
+        }
+    }
+
+    if (0 <= g_epollfd)
+    {
+        close(g_epollfd);
+        g_epollfd = -1;
+    }
+
+    OsConfigLogInfo(GetPlatformLog(), "MPI server stopped after dispatching %lu requests (%lu on reused connections), maximum queue depth %u, average wait %ld ms, maximum wait %ld ms",
+        g_statistics.dispatched, g_statistics.reused, g_statistics.maxQueueDepth, g_statistics.dispatched ? (long)(g_statistics.totalWaitMilliseconds / g_statistics.dispatched) : 0, g_statistics.maxWaitMilliseconds);
+
+    g_statistics.workers = 0;
+    g_statistics.connections = 0;
 }
 
 void MpiInitialize(void)
 {
     struct stat st;
+    char* configuration = NULL;
+
+    if (NULL != (configuration = LoadStringFromFile(CONFIG_JSON_PATH, false, GetPlatformLog())))
+    {
+        g_metricsIntervalSeconds = GetMetricsIntervalFromJsonConfig(configuration, GetPlatformLog());
+        FREE_MEMORY(configuration);
+    }
+
     if (-1 == stat(g_socketPrefix, &st))
     {
         // S_IRUSR (0x00400): Read permission, owner
@@ -594,8 +1147,7 @@ void MpiInitialize(void)
             {
                 OsConfigLogInfo(GetPlatformLog(), "Listening on socket '%s'", g_mpiSocket);
 
-                g_serverActive = true;
-                g_mpiServerWorkerError = pthread_create(&g_mpiServerWorker, NULL, MpiServerWorker, NULL);
+                StartServerThreads();
             }
             else
             {
@@ -615,13 +1167,7 @@ void MpiInitialize(void)
 
 void MpiShutdown(void)
 {
-    g_serverActive = false;
-
-    if (g_mpiServerWorkerError == 0)
-    {
-        pthread_join(g_mpiServerWorker, NULL);
-        g_mpiServerWorkerError = -1;
-    }
+    StopServerThreads();
 
     UnloadModules();
 
@@ -629,7 +1175,36 @@ void MpiShutdown(void)
     unlink(g_mpiSocket);
 }
 
+static void SaveMetrics(void)
+{
+    char* metrics = NULL;
+
+    if (NULL == (metrics = SerializeMetrics()))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiDoWork: failed to serialize the metrics");
+    }
+    else if (!SecureSaveToFile(METRICS_PATH, metrics, (int)strlen(metrics), GetPlatformLog()))
+    {
+        OsConfigLogError(GetPlatformLog(), "MpiDoWork: failed to save the metrics to '%s'", METRICS_PATH);
+    }
+
+    FREE_MEMORY(metrics);
+}
+
 void MpiDoWork(void)
 {
-    return;
+    int closed = 0;
+    time_t now = time(NULL);
+
+    if (0 < (closed = CloseIdleSessions(MPI_SESSION_IDLE_TIMEOUT)))
+    {
+        OsConfigLogInfo(GetPlatformLog(), "MpiDoWork: closed %d idle sessions", closed);
+    }
+
+    // MpiDoWork runs every 30 seconds, shorter intervals are rounded up to that
+    if ((0 < g_metricsIntervalSeconds) && ((now - g_lastMetricsSave) >= g_metricsIntervalSeconds))
+    {
+        SaveMetrics();
+        g_lastMetricsSave = now;
+    }
 }
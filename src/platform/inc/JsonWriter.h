@@ -0,0 +1,41 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <parson.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Writes compact JSON in a single pass into a buffer that grows as needed and is sent as is.
+// The output is the same as json_serialize_to_string. A writer starts zeroed, a failed write fails all that follow.
+typedef struct JSON_WRITER
+{
+    char* buffer;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} JSON_WRITER;
+
+void WriteJsonText(JSON_WRITER* writer, const char* text, size_t length);
+void WriteJsonString(JSON_WRITER* writer, const char* string, size_t length);
+void WriteJsonValue(JSON_WRITER* writer, const JSON_Value* value);
+
+// Returns the null terminated buffer for the caller to free with FREE_MEMORY and resets the writer, NULL if a write failed
+char* TakeJsonWriterBuffer(JSON_WRITER* writer, size_t* size);
+void FreeJsonWriter(JSON_WRITER* writer);
+
+// Compact JSON for wire responses, pretty printing is for logs and files read by people
+char* SerializeJsonValue(const JSON_Value* value, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSONWRITER_H
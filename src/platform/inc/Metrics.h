@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#define MPI_GET_METRICS_URI "MpiGetMetrics"
+
+// Log-linear buckets, 4 per power of two, covering values up to UINT32_MAX within 25%
+#define METRICS_HISTOGRAM_BUCKETS 124
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum METRICS_CALL
+{
+    METRICS_MMI_GET = 0,
+    METRICS_MMI_SET = 1,
+    METRICS_MMI_CALLS = 2
+} METRICS_CALL;
+
+// Counters are updated without locks, by atomic increments only
+void RecordModuleCall(const char* module, const char* component, const char* object, METRICS_CALL call, long microseconds, int payloadSizeBytes, int status);
+void RecordModuleTimeout(const char* module, const char* component, const char* object, METRICS_CALL call);
+void RecordModuleCacheHit(const char* module, const char* component, const char* object, bool coalesced);
+void RecordMpiRequest(const char* uri, long microseconds, int requestSizeBytes, int responseSizeBytes, int httpStatus);
+void RecordQueueWait(long microseconds);
+
+// Histogram helpers, exposed for testing
+unsigned int GetMetricsBucket(unsigned long long value);
+unsigned long long GetMetricsBucketLimit(unsigned int bucket);
+
+// Returns all metrics serialized as JSON, the caller frees it with FREE_MEMORY
+char* SerializeMetrics(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
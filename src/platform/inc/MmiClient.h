@@ -26,6 +26,14 @@ typedef struct VERSION
     unsigned int tweak;
 } VERSION;
 
+// A reported object whose MmiGet payload can be served again for the given time, as declared in the module info
+typedef struct CACHED_OBJECT
+{
+    char* component;
+    char* object;
+    unsigned int seconds;
+} CACHED_OBJECT;
+
 typedef struct MODULE_INFO
 {
     char* name;
@@ -39,6 +47,9 @@ typedef struct MODULE_INFO
     char* licenseUri;
     char* projectUri;
     unsigned int userAccount; // TODO
+    bool rawPayloads;
+    CACHED_OBJECT* cachedObjects;
+    unsigned int cachedObjectCount;
 } MODULE_INFO;
 
 typedef struct MODULE
@@ -52,12 +63,34 @@ typedef struct MODULE
     MMI_GETINFO getInfo;
     MMI_SET set;
     MMI_GET get;
+    MMI_SET setRaw; // Optional, NULL unless the module takes raw payloads
     MMI_FREE free;
 
+    // Serializes the MMI calls into the module, modules are not required to be thread safe
+    pthread_mutex_t lock;
+
+    // Runs the calls made on behalf of clients, each given up to callTimeoutMilliseconds to complete
+    struct MODULE_DISPATCHER* dispatcher;
+    unsigned int callTimeoutMilliseconds;
+
+    // Module info as returned by MmiGetInfo and the file it came from, as kept in the module index
+    JSON_Value* infoValue;
+    struct timespec modified;
+    off_t size;
+
     struct MODULE* next;
 } MODULE;
 
+// Loads the module and gets its info
 MODULE* LoadModule(const char* client, const char* path);
+
+// Creates the module from its indexed info without loading it, EnsureModuleLoaded loads it when first needed
+MODULE* LoadIndexedModule(const char* path, const JSON_Value* infoValue);
+int EnsureModuleLoaded(MODULE* module);
+
+// Unloads the module library but keeps the module and its info, called with the module lock held
+void UnloadModuleLibrary(MODULE* module);
+
 void UnloadModule(MODULE* module);
 
 #endif // MMICLIENT_H
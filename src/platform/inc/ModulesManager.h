@@ -9,9 +9,13 @@ extern "C"
 {
 #endif
 
-void AreModulesLoadedAndLoadIfNot(const char* path, const char* configJson);
+void AreModulesLoadedAndLoadIfNot(const char* path, const char* configJson, const char* indexJson);
 void UnloadModules(void);
 
+// Closes the sessions that no call was made on for idleSeconds or longer, left open by clients that went away.
+// Returns the number of sessions closed.
+int CloseIdleSessions(unsigned int idleSeconds);
+
 #ifdef __cplusplus
 }
 #endif
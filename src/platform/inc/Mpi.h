@@ -40,6 +40,15 @@ int MpiGetReported(
     MPI_HANDLE clientSession,
     MPI_JSON_STRING* payload,
     int* payloadSizeBytes);
+
+// Same as MpiGetReported but returns only the reported objects whose value changed since the previous call on the session.
+// The generation in is the one last applied by the client (0 for none) and out is the one of the returned payload,
+// a generation that does not match the last returned one gets all reported objects.
+int MpiGetReportedDelta(
+    MPI_HANDLE clientSession,
+    unsigned int* generation,
+    MPI_JSON_STRING* payload,
+    int* payloadSizeBytes);
 void MpiClose(MPI_HANDLE clientSession);
 
 void MpiFree(MPI_JSON_STRING payload);
@@ -12,6 +12,7 @@
 #define MPI_GET_URI "MpiGet"
 #define MPI_SET_DESIRED_URI "MpiSetDesired"
 #define MPI_GET_REPORTED_URI "MpiGetReported"
+#define MPI_GET_REPORTED_DELTA_URI "MpiGetReportedDelta"
 
 #ifdef __cplusplus
 extern "C"
@@ -32,6 +33,7 @@ typedef int(*MpiSetCall)(MPI_HANDLE, const char*, const char*, MPI_JSON_STRING,
 typedef int(*MpiGetCall)(MPI_HANDLE, const char*, const char*, MPI_JSON_STRING*, int*);
 typedef int(*MpiSetDesiredCall)(MPI_HANDLE, const MPI_JSON_STRING, const int);
 typedef int(*MpiGetReportedCall)(MPI_HANDLE, MPI_JSON_STRING*, int*);
+typedef int(*MpiGetReportedDeltaCall)(MPI_HANDLE, unsigned int*, MPI_JSON_STRING*, int*);
 
 typedef struct MPI_CALLS
 {
@@ -41,10 +43,32 @@ typedef struct MPI_CALLS
     MpiGetCall mpiGet;
     MpiSetDesiredCall mpiSetDesired;
     MpiGetReportedCall mpiGetReported;
+    MpiGetReportedDeltaCall mpiGetReportedDelta;
 } MPI_CALLS;
 
+typedef struct MPI_SERVER_STATISTICS
+{
+    // Accepted connections currently waiting for a worker and the most seen at once
+    unsigned int queueDepth;
+    unsigned int maxQueueDepth;
+
+    // Connections handed to workers and the time they spent queued
+    unsigned long dispatched;
+    unsigned long long totalWaitMilliseconds;
+    long maxWaitMilliseconds;
+
+    unsigned int workers;
+    unsigned int busyWorkers;
+
+    // Open persistent connections and the requests served over a connection kept alive from an earlier one
+    unsigned int connections;
+    unsigned long reused;
+} MPI_SERVER_STATISTICS;
+
 HTTP_STATUS HandleMpiCall(const char* uri, const char* requestBody, char** response, int* responseSize, MPI_CALLS handlers);
 
+void MpiGetServerStatistics(MPI_SERVER_STATISTICS* statistics);
+
 #ifdef __cplusplus
 }
 #endif
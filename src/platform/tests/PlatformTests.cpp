@@ -2,9 +2,17 @@
 // Licensed under the MIT License.
 
 #include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <PlatformCommon.h>
+#include <JsonWriter.h>
+#include <Metrics.h>
+#include <ModulesManager.h>
 #include <MpiServer.h>
+#include <StubModule.h>
 
 namespace Tests
 {
@@ -77,6 +85,16 @@ namespace Tests
         return MPI_OK;
     }
 
+    static int MockCallMpiGetReportedDelta(MPI_HANDLE handle, unsigned int* generation, MPI_JSON_STRING* payload, int* payloadSize)
+    {
+        UNUSED(handle);
+
+        *generation += 1;
+        *payload = strdup(g_mockPayload);
+        *payloadSize = strlen(g_mockPayload);
+        return MPI_OK;
+    }
+
     static const MPI_CALLS g_mpiCalls =
     {
         MockCallMpiOpen,
@@ -84,7 +102,8 @@ namespace Tests
         MockCallMpiSet,
         MockCallMpiGet,
         MockCallMpiSetDesired,
-        MockCallMpiGetReported
+        MockCallMpiGetReported,
+        MockCallMpiGetReportedDelta
     };
 
     TEST_F(MpiServerTests, HandleMpiRequestInvalidRequest)
@@ -330,4 +349,839 @@ namespace Tests
         EXPECT_EQ(strlen(g_mockPayload), responseSize);
         FREE_MEMORY(response);
     }
+
+    TEST_F(MpiServerTests, MpiGetReportedDeltaRequestInvalidRequestBody)
+    {
+        std::vector<std::string> requests = {
+            "{\"Generation\": 1}",
+            "{\"ClientSession\": 123, \"Generation\": 1}",
+            "{\"ClientSession\": \"Valid_Client\", \"Generation\": \"1\"}"
+        };
+
+        for (auto request : requests)
+        {
+            char* response = nullptr;
+            int responseSize = 0;
+
+            EXPECT_EQ(HTTP_BAD_REQUEST, HandleMpiCall(MPI_GET_REPORTED_DELTA_URI, request.c_str(), &response, &responseSize, g_mpiCalls));
+            EXPECT_EQ(nullptr, response);
+            EXPECT_EQ(0, responseSize);
+            FREE_MEMORY(response);
+        }
+    }
+
+    TEST_F(MpiServerTests, MpiGetReportedDeltaRequest)
+    {
+        const char* expected = "{\"Generation\":8,\"Reported\":\"MockPayload\"}";
+        const char* expectedWithoutGeneration = "{\"Generation\":1,\"Reported\":\"MockPayload\"}";
+        char* response = nullptr;
+        int responseSize = 0;
+
+        EXPECT_EQ(HTTP_OK, HandleMpiCall(MPI_GET_REPORTED_DELTA_URI, "{\"ClientSession\": \"Valid_Client\", \"Generation\": 7}", &response, &responseSize, g_mpiCalls));
+        EXPECT_STREQ(expected, response);
+        EXPECT_EQ(strlen(expected), responseSize);
+        FREE_MEMORY(response);
+
+        EXPECT_EQ(HTTP_OK, HandleMpiCall(MPI_GET_REPORTED_DELTA_URI, "{\"ClientSession\": \"Valid_Client\"}", &response, &responseSize, g_mpiCalls));
+        EXPECT_STREQ(expectedWithoutGeneration, response);
+        EXPECT_EQ(strlen(expectedWithoutGeneration), responseSize);
+        FREE_MEMORY(response);
+    }
+
+    TEST_F(MpiServerTests, MpiGetServerStatistics)
+    {
+        MPI_SERVER_STATISTICS statistics;
+        memset(&statistics, 0xFF, sizeof(statistics));
+
+        MpiGetServerStatistics(&statistics);
+        EXPECT_EQ(0, statistics.queueDepth);
+        EXPECT_EQ(0, statistics.maxQueueDepth);
+        EXPECT_EQ(0, statistics.dispatched);
+        EXPECT_EQ(0, statistics.totalWaitMilliseconds);
+        EXPECT_EQ(0, statistics.maxWaitMilliseconds);
+        EXPECT_EQ(0, statistics.workers);
+        EXPECT_EQ(0, statistics.busyWorkers);
+        EXPECT_EQ(0, statistics.connections);
+        EXPECT_EQ(0, statistics.reused);
+
+        MpiGetServerStatistics(nullptr);
+    }
+
+    TEST_F(MpiServerTests, MetricsBuckets)
+    {
+        unsigned int bucket = 0;
+
+        for (unsigned long long value : {0ULL, 1ULL, 3ULL, 4ULL, 7ULL, 8ULL, 9ULL, 10ULL, 1000ULL, 123456ULL, 4294967295ULL})
+        {
+            bucket = GetMetricsBucket(value);
+            EXPECT_LT(bucket, (unsigned int)METRICS_HISTOGRAM_BUCKETS);
+            EXPECT_LE(value, GetMetricsBucketLimit(bucket));
+            EXPECT_GE(value, (0 == bucket) ? 0 : GetMetricsBucketLimit(bucket - 1) + 1);
+
+            // Within 25% of the value
+            EXPECT_LE(GetMetricsBucketLimit(bucket) - value, value / 4);
+        }
+
+        EXPECT_EQ(METRICS_HISTOGRAM_BUCKETS - 1, (int)GetMetricsBucket(1ULL << 40));
+        EXPECT_EQ(4294967295ULL, GetMetricsBucketLimit(METRICS_HISTOGRAM_BUCKETS - 1));
+    }
+
+    TEST_F(MpiServerTests, MpiGetMetricsRequest)
+    {
+        char* response = nullptr;
+        int responseSize = 0;
+        JSON_Value* rootValue = nullptr;
+        JSON_Object* object = nullptr;
+
+        for (int i = 0; i < 10; i++)
+        {
+            RecordModuleCall("MetricsModule", "MetricsComponent", "MetricsObject", METRICS_MMI_GET, 100 * (i + 1), 10, (9 == i) ? EINVAL : MMI_OK);
+        }
+        RecordModuleCall("MetricsModule", "MetricsComponent", "OtherObject", METRICS_MMI_SET, 50, 20, MMI_OK);
+        RecordModuleTimeout("MetricsModule", "MetricsComponent", "MetricsObject", METRICS_MMI_GET);
+        RecordModuleCacheHit("MetricsModule", "MetricsComponent", "CachedObject", false);
+        RecordModuleCacheHit("MetricsModule", "MetricsComponent", "CachedObject", true);
+        RecordModuleCall("MetricsModule", "MetricsComponent", "CachedObject", METRICS_MMI_GET, 100, 10, MMI_OK);
+        RecordModuleCall("MetricsModule", "MetricsComponent", "CachedObject", METRICS_MMI_GET, 100, 10, MMI_OK);
+
+        EXPECT_EQ(HTTP_OK, HandleMpiCall(MPI_GET_METRICS_URI, "{}", &response, &responseSize, g_mpiCalls));
+        ASSERT_NE(nullptr, response);
+        EXPECT_EQ(strlen(response), responseSize);
+        ASSERT_NE(nullptr, rootValue = json_parse_string(response));
+
+        ASSERT_NE(nullptr, object = json_object_dotget_object(json_value_get_object(rootValue), "Modules.MetricsModule"));
+        EXPECT_EQ(12, json_object_dotget_number(object, "MmiGet.Count"));
+        EXPECT_EQ(1, json_object_dotget_number(object, "MmiGet.Errors"));
+        EXPECT_EQ(1, json_object_dotget_number(object, "MmiGet.Timeouts"));
+        EXPECT_EQ(1, json_object_dotget_number(object, "MmiSet.Count"));
+
+        EXPECT_EQ(1, json_object_dotget_number(object, "Components.MetricsComponent.Objects.CachedObject.MmiGet.CacheHits"));
+        EXPECT_EQ(1, json_object_dotget_number(object, "Components.MetricsComponent.Objects.CachedObject.MmiGet.Coalesced"));
+        EXPECT_EQ(0.5, json_object_dotget_number(object, "Components.MetricsComponent.Objects.CachedObject.MmiGet.HitRate"));
+        EXPECT_FALSE(json_object_dothas_value(object, "Components.MetricsComponent.Objects.MetricsObject.MmiGet.HitRate"));
+
+        ASSERT_NE(nullptr, object = json_object_dotget_object(object, "Components.MetricsComponent.Objects.MetricsObject.MmiGet"));
+        EXPECT_EQ(10, json_object_dotget_number(object, "Latency.Count"));
+        EXPECT_EQ(1000, json_object_dotget_number(object, "Latency.Max"));
+        EXPECT_LE(500, json_object_dotget_number(object, "Latency.P50"));
+        EXPECT_GE(625, json_object_dotget_number(object, "Latency.P50"));
+        EXPECT_EQ(1000, json_object_dotget_number(object, "Latency.P99"));
+        EXPECT_EQ(10, json_object_dotget_number(object, "PayloadBytes.Max"));
+
+        json_value_free(rootValue);
+        FREE_MEMORY(response);
+    }
+
+    class JsonWriterTests : public ::testing::Test {};
+
+    TEST_F(JsonWriterTests, SameAsParsonCompact)
+    {
+        const char* documents[] = {
+            "{}",
+            "[]",
+            "null",
+            "\"\"",
+            "{\"a\":{},\"b\":[],\"c\":[{}, [[]]]}",
+            "{\"Numbers\": [0, -0, 1, -1, 0.1, 3.14159265358979, 1e300, -2.5e-300, 4294967295, 123456789012345678]}",
+            "{\"Strings\": [\"plain\", \"quote \\\" backslash \\\\ slash /\", \"\\b\\f\\n\\r\\t\\u0001\\u001f\\u000b\", \"caf\\u00e9 \\u6f22 \\ud83d\\ude00\"]}",
+            "{\"Esc\\\"aped/Name\": true, \"False\": false, \"Null\": null, \"Nested\": {\"Deeper\": {\"Deepest\": [1, \"two\", {\"three\": 3}]}}}"
+        };
+        JSON_Value* value = nullptr;
+        char* expected = nullptr;
+        char* actual = nullptr;
+        size_t size = 0;
+
+        for (const char* document : documents)
+        {
+            ASSERT_NE(nullptr, value = json_parse_string(document)) << document;
+            ASSERT_NE(nullptr, expected = json_serialize_to_string(value));
+            ASSERT_NE(nullptr, actual = SerializeJsonValue(value, &size));
+            EXPECT_STREQ(expected, actual);
+            EXPECT_EQ(strlen(expected), size);
+            json_free_serialized_string(expected);
+            FREE_MEMORY(actual);
+            json_value_free(value);
+        }
+    }
+
+    TEST_F(JsonWriterTests, EmbeddedNull)
+    {
+        JSON_WRITER writer = {};
+        char* actual = nullptr;
+        size_t size = 0;
+
+        WriteJsonString(&writer, "a\0b", 3);
+        ASSERT_NE(nullptr, actual = TakeJsonWriterBuffer(&writer, &size));
+        EXPECT_STREQ("\"a\\u0000b\"", actual);
+        EXPECT_EQ(10, size);
+        EXPECT_EQ(nullptr, writer.buffer);
+        FREE_MEMORY(actual);
+    }
+
+    // A report of many objects, assembled in a document and pretty printed as before, against streamed compact
+    TEST_F(JsonWriterTests, ReportedPayloadIsCompact)
+    {
+        const int componentCount = 20;
+        const int objectCount = 500;
+        std::vector<std::string> components;
+        std::vector<std::string> objects;
+        std::vector<JSON_Value*> values;
+        JSON_Value* rootValue = nullptr;
+        JSON_Value* componentValue = nullptr;
+        JSON_WRITER writer = {};
+        char* pretty = nullptr;
+        char* streamed = nullptr;
+        size_t prettySize = 0;
+        size_t streamedSize = 0;
+        int i = 0;
+        int j = 0;
+
+        for (i = 0; i < componentCount; i++)
+        {
+            components.push_back("Component" + std::to_string(i));
+        }
+
+        for (j = 0; j < objectCount; j++)
+        {
+            objects.push_back("reportedObject" + std::to_string(j));
+            values.push_back(json_parse_string(("{\"state\": \"compliant\", \"path\": \"/etc/osconfig/" + std::to_string(j) + "\", \"count\": " +
+                std::to_string(j) + ", \"items\": [1, 2, 3]}").c_str()));
+            ASSERT_NE(nullptr, values.back());
+        }
+
+        rootValue = json_value_init_object();
+        for (i = 0; i < componentCount; i++)
+        {
+            componentValue = json_value_init_object();
+            json_object_set_value(json_value_get_object(rootValue), components[i].c_str(), componentValue);
+            for (j = 0; j < objectCount; j++)
+            {
+                json_object_set_value(json_value_get_object(componentValue), objects[j].c_str(), json_value_deep_copy(values[j]));
+            }
+        }
+        pretty = json_serialize_to_string_pretty(rootValue);
+        json_value_free(rootValue);
+
+        WriteJsonText(&writer, "{", 1);
+        for (i = 0; i < componentCount; i++)
+        {
+            WriteJsonText(&writer, (0 == i) ? "" : ",", (0 == i) ? 0 : 1);
+            WriteJsonString(&writer, components[i].c_str(), components[i].size());
+            WriteJsonText(&writer, ":{", 2);
+            for (j = 0; j < objectCount; j++)
+            {
+                WriteJsonText(&writer, (0 == j) ? "" : ",", (0 == j) ? 0 : 1);
+                WriteJsonString(&writer, objects[j].c_str(), objects[j].size());
+                WriteJsonText(&writer, ":", 1);
+                WriteJsonValue(&writer, values[j]);
+            }
+            WriteJsonText(&writer, "}", 1);
+        }
+        WriteJsonText(&writer, "}", 1);
+        streamed = TakeJsonWriterBuffer(&writer, &streamedSize);
+
+        ASSERT_NE(nullptr, pretty);
+        ASSERT_NE(nullptr, streamed);
+        prettySize = strlen(pretty);
+
+        rootValue = json_parse_string(streamed);
+        componentValue = json_parse_string(pretty);
+        EXPECT_TRUE(json_value_equals(rootValue, componentValue));
+        EXPECT_LT(streamedSize, prettySize);
+
+        json_value_free(rootValue);
+        json_value_free(componentValue);
+        json_free_serialized_string(pretty);
+        FREE_MEMORY(streamed);
+        for (auto value : values)
+        {
+            json_value_free(value);
+        }
+    }
+
+    // Indexes a module that is never loaded, enough to open sessions without a module binary
+    class ModulesManagerTests : public ::testing::Test
+    {
+    protected:
+        char m_directory[32] = "/tmp/osconfig_platform_XXXXXX";
+        std::string m_modules;
+        std::string m_config;
+        std::string m_index;
+
+        void SetUp() override
+        {
+            struct stat fileStat = {};
+            char* index = nullptr;
+
+            ASSERT_NE(nullptr, mkdtemp(m_directory));
+            m_modules = std::string(m_directory) + "/modules";
+            m_config = std::string(m_directory) + "/osconfig.json";
+            m_index = std::string(m_directory) + "/osconfig_modules.cache";
+
+            ASSERT_EQ(0, mkdir(m_modules.c_str(), 0700));
+            ASSERT_TRUE(SavePayloadToFile((m_modules + "/Indexed.so").c_str(), "Indexed", 7, nullptr));
+            ASSERT_EQ(0, stat((m_modules + "/Indexed.so").c_str(), &fileStat));
+            ASSERT_TRUE(SavePayloadToFile(m_config.c_str(), "{\"ModelVersion\": 1, \"Reported\": []}", 35, nullptr));
+
+            index = FormatAllocateString("{\"ClientName\": \"Azure OSConfig 1;%s\", \"Modules\": [{\"Path\": \"%s/Indexed.so\", "
+                "\"ModifiedSeconds\": %ld, \"ModifiedNanoseconds\": %ld, \"Size\": %ld, \"Info\": {\"Name\": \"Indexed\", "
+                "\"Description\": \"Indexed\", \"Manufacturer\": \"Microsoft\", \"VersionInfo\": \"1.0\", \"Components\": [\"Indexed\"], \"Lifetime\": 1}}]}",
+                OSCONFIG_VERSION, m_modules.c_str(), (long)fileStat.st_mtim.tv_sec, (long)fileStat.st_mtim.tv_nsec, (long)fileStat.st_size);
+            ASSERT_NE(nullptr, index);
+            ASSERT_TRUE(SavePayloadToFile(m_index.c_str(), index, strlen(index), nullptr));
+            FREE_MEMORY(index);
+
+            AreModulesLoadedAndLoadIfNot(m_modules.c_str(), m_config.c_str(), m_index.c_str());
+        }
+
+        void TearDown() override
+        {
+            UnloadModules();
+            remove((m_modules + "/Indexed.so").c_str());
+            rmdir(m_modules.c_str());
+            remove(m_config.c_str());
+            remove(m_index.c_str());
+            rmdir(m_directory);
+        }
+
+    };
+
+    TEST_F(ModulesManagerTests, CloseIdleSessions)
+    {
+        MPI_JSON_STRING payload = nullptr;
+        int payloadSize = 0;
+        MPI_HANDLE handles[3] = {};
+
+        for (auto& handle : handles)
+        {
+            ASSERT_NE(nullptr, handle = MpiOpen("ModulesManagerTests", 0));
+        }
+
+        EXPECT_EQ(0, CloseIdleSessions(3600));
+        EXPECT_EQ(EINVAL, MpiGet(handles[0], "Unknown", "Unknown", &payload, &payloadSize));
+        EXPECT_EQ(3, CloseIdleSessions(0));
+        EXPECT_EQ(0, CloseIdleSessions(0));
+
+        for (auto& handle : handles)
+        {
+            MpiClose(handle);
+            FREE_MEMORY(handle);
+        }
+    }
+
+    TEST_F(ModulesManagerTests, GetReportedIsCompact)
+    {
+        MPI_JSON_STRING payload = nullptr;
+        int payloadSize = 0;
+        unsigned int generation = 0;
+        MPI_HANDLE handle = nullptr;
+
+        ASSERT_NE(nullptr, handle = MpiOpen("ModulesManagerTests", 0));
+
+        EXPECT_EQ(MPI_OK, MpiGetReported(handle, &payload, &payloadSize));
+        EXPECT_STREQ("{}", payload);
+        EXPECT_EQ(2, payloadSize);
+        FREE_MEMORY(payload);
+
+        EXPECT_EQ(MPI_OK, MpiGetReportedDelta(handle, &generation, &payload, &payloadSize));
+        EXPECT_STREQ("{}", payload);
+        EXPECT_EQ(2, payloadSize);
+        EXPECT_EQ(1, generation);
+        FREE_MEMORY(payload);
+
+        MpiClose(handle);
+        FREE_MEMORY(handle);
+    }
+
+    // Enough sessions to grow the session table several times, every handle must still find its own session
+    TEST_F(ModulesManagerTests, SessionRoutingWithManySessions)
+    {
+        const int sessionCount = 4096;
+        std::vector<MPI_HANDLE> handles(sessionCount);
+        MPI_JSON_STRING payload = nullptr;
+        int payloadSize = 0;
+        int i = 0;
+
+        for (auto& handle : handles)
+        {
+            ASSERT_NE(nullptr, handle = MpiOpen("ModulesManagerTests", 0));
+        }
+
+        for (auto& handle : handles)
+        {
+            ASSERT_EQ(MPI_OK, MpiGetReported(handle, &payload, &payloadSize));
+            FREE_MEMORY(payload);
+        }
+
+        for (i = 0; i < sessionCount; i += 2)
+        {
+            MpiClose(handles[i]);
+        }
+
+        for (i = 0; i < sessionCount; i++)
+        {
+            if (0 == (i % 2))
+            {
+                EXPECT_EQ(EINVAL, MpiGetReported(handles[i], &payload, &payloadSize));
+            }
+            else
+            {
+                EXPECT_EQ(MPI_OK, MpiGetReported(handles[i], &payload, &payloadSize));
+                FREE_MEMORY(payload);
+            }
+        }
+
+        EXPECT_EQ(sessionCount / 2, CloseIdleSessions(0));
+
+        for (auto& handle : handles)
+        {
+            EXPECT_EQ(EINVAL, MpiGetReported(handle, &payload, &payloadSize));
+            FREE_MEMORY(handle);
+        }
+    }
+
+    // Loads copies of the stub modules StubA and StubB, calls into either time out after a second.
+    // The tests keep their own reference to each copy so that what a stub counted survives it being unloaded and loaded again.
+    class StubModulesTests : public ::testing::Test
+    {
+    protected:
+        struct Stub
+        {
+            std::string path;
+            void* library = nullptr;
+            STUB_BLOCK_CALLS blockCalls = nullptr;
+            STUB_GET_CALL_COUNT getCallCount = nullptr;
+            STUB_WAIT_FOR_CALL_COUNT waitForCallCount = nullptr;
+            STUB_GET_SET_OBJECTS getSetObjects = nullptr;
+        };
+
+        static const unsigned int m_wait = 10000;
+
+        char m_directory[32] = "/tmp/osconfig_stubs_XXXXXX";
+        std::string m_modules;
+        std::string m_config;
+        std::string m_index;
+        Stub m_a;
+        Stub m_b;
+        MPI_HANDLE m_handle = nullptr;
+
+        void SetUp() override
+        {
+            ASSERT_NE(nullptr, mkdtemp(m_directory));
+            m_modules = std::string(m_directory) + "/modules";
+            m_config = std::string(m_directory) + "/osconfig.json";
+            m_index = std::string(m_directory) + "/osconfig_modules.cache";
+            ASSERT_EQ(0, mkdir(m_modules.c_str(), 0700));
+
+            CopyStub(STUB_A_PATH, "StubA.so", m_a);
+            CopyStub(STUB_B_PATH, "StubB.so", m_b);
+        }
+
+        void TearDown() override
+        {
+            for (Stub* stub : {&m_a, &m_b})
+            {
+                Unblock(*stub);
+            }
+
+            if (nullptr != m_handle)
+            {
+                MpiClose(m_handle);
+                FREE_MEMORY(m_handle);
+            }
+
+            UnloadModules();
+
+            for (Stub* stub : {&m_a, &m_b})
+            {
+                if (nullptr != stub->library)
+                {
+                    dlclose(stub->library);
+                }
+                remove(stub->path.c_str());
+            }
+
+            rmdir(m_modules.c_str());
+            remove(m_config.c_str());
+            remove(m_index.c_str());
+            rmdir(m_directory);
+        }
+
+        void CopyStub(const char* source, const char* name, Stub& stub)
+        {
+            std::ifstream input(source, std::ios::binary);
+            std::ofstream output(m_modules + "/" + name, std::ios::binary);
+
+            ASSERT_TRUE(input.good());
+            output << input.rdbuf();
+            output.close();
+
+            stub.path = m_modules + "/" + name;
+            ASSERT_NE(nullptr, stub.library = dlopen(stub.path.c_str(), RTLD_NOW));
+            ASSERT_NE(nullptr, stub.blockCalls = (STUB_BLOCK_CALLS)dlsym(stub.library, "StubBlockCalls"));
+            ASSERT_NE(nullptr, stub.getCallCount = (STUB_GET_CALL_COUNT)dlsym(stub.library, "StubGetCallCount"));
+            ASSERT_NE(nullptr, stub.waitForCallCount = (STUB_WAIT_FOR_CALL_COUNT)dlsym(stub.library, "StubWaitForCallCount"));
+            ASSERT_NE(nullptr, stub.getSetObjects = (STUB_GET_SET_OBJECTS)dlsym(stub.library, "StubGetSetObjects"));
+        }
+
+        static void Unblock(Stub& stub)
+        {
+            int call = 0;
+
+            for (call = 0; (nullptr != stub.blockCalls) && (call < STUB_CALL_TYPES); call++)
+            {
+                stub.blockCalls((STUB_CALL)call, false);
+            }
+        }
+
+        // Loads the modules with the reported objects given as a JSON array and opens a session
+        void Load(const std::string& reported = "[]")
+        {
+            std::string config = "{\"ModelVersion\": 1, \"Reported\": " + reported + ", \"ModuleCallTimeoutSeconds\": {\"StubA\": 1, \"StubB\": 1}}";
+
+            ASSERT_TRUE(SavePayloadToFile(m_config.c_str(), config.c_str(), config.size(), nullptr));
+            AreModulesLoadedAndLoadIfNot(m_modules.c_str(), m_config.c_str(), m_index.c_str());
+            ASSERT_NE(nullptr, m_handle = MpiOpen("StubModulesTests", 0));
+        }
+
+        int Get(const char* component, const char* object, std::string* value = nullptr)
+        {
+            MPI_JSON_STRING payload = nullptr;
+            int payloadSize = 0;
+            int status = MpiGet(m_handle, component, object, &payload, &payloadSize);
+
+            if ((MPI_OK == status) && (nullptr != value))
+            {
+                value->assign(payload, payloadSize);
+            }
+            FREE_MEMORY(payload);
+
+            return status;
+        }
+
+        int Set(const char* component, const char* object, const char* value)
+        {
+            return MpiSet(m_handle, component, object, (MPI_JSON_STRING)value, (int)strlen(value));
+        }
+
+        // How many gets of the object of StubA joined the same get in flight, as counted in the metrics
+        static double GetCoalescedCount(const char* object)
+        {
+            std::string path = std::string("Modules.StubA.Components.StubA.Objects.") + object + ".MmiGet.Coalesced";
+            JSON_Value* metricsValue = nullptr;
+            char* metrics = nullptr;
+            double count = 0;
+
+            if ((nullptr != (metrics = SerializeMetrics())) && (nullptr != (metricsValue = json_parse_string(metrics))))
+            {
+                count = json_object_dotget_number(json_value_get_object(metricsValue), path.c_str());
+            }
+
+            json_value_free(metricsValue);
+            FREE_MEMORY(metrics);
+
+            return count;
+        }
+
+        // Retries while the module is still finishing a call that timed out, which it is for a moment after the stub returned
+        int GetOnceNotBusy(const char* component, const char* object)
+        {
+            int status = EBUSY;
+            int i = 0;
+
+            for (i = 0; (EBUSY == (status = Get(component, object))) && (i < 1000); i++)
+            {
+                usleep(10000);
+            }
+
+            return status;
+        }
+    };
+
+    TEST_F(StubModulesTests, CallTimesOut)
+    {
+        Load();
+        ASSERT_EQ(MPI_OK, Get("StubA", "object"));
+
+        m_a.blockCalls(STUB_CALL_GET, true);
+        EXPECT_EQ(ETIMEDOUT, Get("StubA", "object"));
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_GET, false));
+        EXPECT_EQ(1, m_a.getCallCount(STUB_CALL_GET, true));
+    }
+
+    TEST_F(StubModulesTests, CallsAreRefusedWhileModuleIsStuck)
+    {
+        Load();
+        ASSERT_EQ(MPI_OK, Get("StubA", "object"));
+
+        m_a.blockCalls(STUB_CALL_GET, true);
+        ASSERT_EQ(ETIMEDOUT, Get("StubA", "object"));
+
+        // Refused without reaching the module, other modules are not held up
+        EXPECT_EQ(EBUSY, Get("StubA", "other"));
+        EXPECT_EQ(EBUSY, Set("StubA", "other", "1"));
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_GET, false));
+        EXPECT_EQ(0, m_a.getCallCount(STUB_CALL_SET, false));
+        EXPECT_EQ(MPI_OK, Get("StubB", "object"));
+
+        m_a.blockCalls(STUB_CALL_GET, false);
+        EXPECT_EQ(MPI_OK, GetOnceNotBusy("StubA", "object"));
+    }
+
+    TEST_F(StubModulesTests, LateCompletionFreesCall)
+    {
+        int freed = 0;
+
+        Load();
+        ASSERT_EQ(MPI_OK, Get("StubA", "object"));
+
+        m_a.blockCalls(STUB_CALL_GET, true);
+        ASSERT_EQ(ETIMEDOUT, Get("StubA", "object"));
+        freed = m_a.getCallCount(STUB_CALL_FREE, true);
+
+        // Nobody waits for the payload returned late, it is given back to the module
+        m_a.blockCalls(STUB_CALL_GET, false);
+        EXPECT_TRUE(m_a.waitForCallCount(STUB_CALL_FREE, true, freed + 1, m_wait));
+        EXPECT_EQ(MPI_OK, GetOnceNotBusy("StubA", "object"));
+    }
+
+    TEST_F(StubModulesTests, OpenCompletingAfterCallerLeftIsClosed)
+    {
+        Load();
+
+        m_a.blockCalls(STUB_CALL_OPEN, true);
+        EXPECT_EQ(EINVAL, Get("StubA", "object"));
+        EXPECT_EQ(1, m_a.getCallCount(STUB_CALL_OPEN, false));
+        EXPECT_EQ(0, m_a.getCallCount(STUB_CALL_CLOSE, false));
+
+        m_a.blockCalls(STUB_CALL_OPEN, false);
+        EXPECT_TRUE(m_a.waitForCallCount(STUB_CALL_CLOSE, true, 1, m_wait));
+
+        EXPECT_EQ(MPI_OK, GetOnceNotBusy("StubA", "object"));
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_OPEN, true));
+    }
+
+    // The same get made by two sessions while the first is still in the module is made into the module once
+    TEST_F(StubModulesTests, SameGetsInFlightAreCoalesced)
+    {
+        MPI_HANDLE other = nullptr;
+        MPI_JSON_STRING payloads[2] = {};
+        int payloadSizes[2] = {};
+        int statuses[2] = {-1, -1};
+        double coalesced = 0;
+        int gets = 0;
+        int i = 0;
+
+        Load();
+        ASSERT_NE(nullptr, other = MpiOpen("StubModulesTests", 0));
+        ASSERT_EQ(MPI_OK, Get("StubA", "object"));
+        ASSERT_EQ(MPI_OK, MpiGet(other, "StubA", "object", &payloads[0], &payloadSizes[0]));
+        FREE_MEMORY(payloads[0]);
+        gets = m_a.getCallCount(STUB_CALL_GET, false);
+
+        // The metrics are kept for the life of the process
+        coalesced = GetCoalescedCount("coalesced");
+
+        m_a.blockCalls(STUB_CALL_GET, true);
+        std::thread first([&]() { statuses[0] = MpiGet(m_handle, "StubA", "coalesced", &payloads[0], &payloadSizes[0]); });
+        EXPECT_TRUE(m_a.waitForCallCount(STUB_CALL_GET, false, gets + 1, m_wait));
+        std::thread second([&]() { statuses[1] = MpiGet(other, "StubA", "coalesced", &payloads[1], &payloadSizes[1]); });
+
+        // The second get is released once it joined the first
+        for (i = 0; (GetCoalescedCount("coalesced") < (coalesced + 1)) && (i < 1000); i++)
+        {
+            usleep(1000);
+        }
+
+        m_a.blockCalls(STUB_CALL_GET, false);
+        first.join();
+        second.join();
+
+        EXPECT_EQ(coalesced + 1, GetCoalescedCount("coalesced"));
+        EXPECT_EQ(gets + 1, m_a.getCallCount(STUB_CALL_GET, false));
+
+        // Each session gets a copy of its own
+        EXPECT_NE(payloads[0], payloads[1]);
+        for (i = 0; i < 2; i++)
+        {
+            EXPECT_EQ(MPI_OK, statuses[i]);
+            EXPECT_EQ(std::string("\"coalesced\""), std::string(payloads[i], payloadSizes[i]));
+            FREE_MEMORY(payloads[i]);
+        }
+
+        MpiClose(other);
+        FREE_MEMORY(other);
+    }
+
+    TEST_F(StubModulesTests, CachedPayloadExpires)
+    {
+        std::string value;
+        int gets = 0;
+
+        Load();
+        ASSERT_EQ(MPI_OK, Get("StubA", "cached", &value));
+        EXPECT_EQ("\"cached\"", value);
+        gets = m_a.getCallCount(STUB_CALL_GET, true);
+
+        // Served from the cache, then from the module again once the second the module allows has passed
+        EXPECT_EQ(MPI_OK, Get("StubA", "cached", &value));
+        EXPECT_EQ("\"cached\"", value);
+        EXPECT_EQ(gets, m_a.getCallCount(STUB_CALL_GET, true));
+
+        usleep(1100000);
+        EXPECT_EQ(MPI_OK, Get("StubA", "cached", &value));
+        EXPECT_EQ("\"cached\"", value);
+        EXPECT_EQ(gets + 1, m_a.getCallCount(STUB_CALL_GET, true));
+
+        // Objects the module does not allow to cache are always got from the module
+        EXPECT_EQ(MPI_OK, Get("StubA", "object"));
+        EXPECT_EQ(MPI_OK, Get("StubA", "object"));
+        EXPECT_EQ(gets + 3, m_a.getCallCount(STUB_CALL_GET, true));
+    }
+
+    // A module that does not return its reported objects holds up neither the report nor the objects of the other modules
+    TEST_F(StubModulesTests, ReportIsReturnedWhenCollectorTimesOut)
+    {
+        const std::string both = "{\"StubA\":{\"reported\":\"reported\"},\"StubB\":{\"reported\":\"reported\"}}";
+        const std::string stubB = "{\"StubB\":{\"reported\":\"reported\"}}";
+        MPI_JSON_STRING payload = nullptr;
+        int payloadSize = 0;
+
+        Load("[{\"ComponentName\": \"StubA\", \"ObjectName\": \"reported\"}, {\"ComponentName\": \"StubB\", \"ObjectName\": \"reported\"}]");
+        ASSERT_EQ(MPI_OK, MpiGetReported(m_handle, &payload, &payloadSize));
+        EXPECT_EQ(both, std::string(payload, payloadSize));
+        FREE_MEMORY(payload);
+
+        m_a.blockCalls(STUB_CALL_GET, true);
+        ASSERT_EQ(MPI_OK, MpiGetReported(m_handle, &payload, &payloadSize));
+        EXPECT_EQ(stubB, std::string(payload, payloadSize));
+        FREE_MEMORY(payload);
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_GET, false));
+        EXPECT_EQ(1, m_a.getCallCount(STUB_CALL_GET, true));
+
+        // Refused while the module is still in the get that timed out
+        ASSERT_EQ(MPI_OK, MpiGetReported(m_handle, &payload, &payloadSize));
+        EXPECT_EQ(stubB, std::string(payload, payloadSize));
+        FREE_MEMORY(payload);
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_GET, false));
+
+        m_a.blockCalls(STUB_CALL_GET, false);
+        ASSERT_EQ(MPI_OK, GetOnceNotBusy("StubA", "reported"));
+        ASSERT_EQ(MPI_OK, MpiGetReported(m_handle, &payload, &payloadSize));
+        EXPECT_EQ(both, std::string(payload, payloadSize));
+        FREE_MEMORY(payload);
+    }
+
+    TEST_F(StubModulesTests, ReportedDeltaHasOnlyChangedObjects)
+    {
+        MPI_JSON_STRING payload = nullptr;
+        int payloadSize = 0;
+        unsigned int generation = 0;
+        unsigned int first = 0;
+
+        Load("[{\"ComponentName\": \"StubA\", \"ObjectName\": \"one\"}, {\"ComponentName\": \"StubA\", \"ObjectName\": \"two\"}, "
+            "{\"ComponentName\": \"StubB\", \"ObjectName\": \"three\"}]");
+
+        // Nothing applied yet, all objects
+        ASSERT_EQ(MPI_OK, MpiGetReportedDelta(m_handle, &generation, &payload, &payloadSize));
+        EXPECT_EQ("{\"StubA\":{\"one\":\"one\",\"two\":\"two\"},\"StubB\":{\"three\":\"three\"}}", std::string(payload, payloadSize));
+        EXPECT_NE(0, generation);
+        first = generation;
+        FREE_MEMORY(payload);
+
+        // Unchanged objects are left out and the generation stays
+        ASSERT_EQ(MPI_OK, MpiGetReportedDelta(m_handle, &generation, &payload, &payloadSize));
+        EXPECT_EQ("{}", std::string(payload, payloadSize));
+        EXPECT_EQ(first, generation);
+        FREE_MEMORY(payload);
+
+        ASSERT_EQ(MPI_OK, Set("StubA", "two", "\"changed\""));
+        ASSERT_EQ(MPI_OK, Set("StubB", "three", "3"));
+
+        ASSERT_EQ(MPI_OK, MpiGetReportedDelta(m_handle, &generation, &payload, &payloadSize));
+        EXPECT_EQ("{\"StubA\":{\"two\":\"changed\"},\"StubB\":{\"three\":3}}", std::string(payload, payloadSize));
+        EXPECT_EQ(first + 1, generation);
+        FREE_MEMORY(payload);
+
+        ASSERT_EQ(MPI_OK, MpiGetReportedDelta(m_handle, &generation, &payload, &payloadSize));
+        EXPECT_EQ("{}", std::string(payload, payloadSize));
+        EXPECT_EQ(first + 1, generation);
+        FREE_MEMORY(payload);
+
+        // A client that did not apply the last delta gets all objects again
+        generation = first;
+        ASSERT_EQ(MPI_OK, MpiGetReportedDelta(m_handle, &generation, &payload, &payloadSize));
+        EXPECT_EQ("{\"StubA\":{\"one\":\"one\",\"two\":\"changed\"},\"StubB\":{\"three\":3}}", std::string(payload, payloadSize));
+        EXPECT_EQ(first + 2, generation);
+        FREE_MEMORY(payload);
+    }
+
+    // While StubA is held in its first set, StubB gets all of its objects set, and each module gets its objects in order
+    TEST_F(StubModulesTests, DesiredModulesAreAppliedConcurrentlyInOrder)
+    {
+        const char* desired = "{\"StubA\": {\"a1\": 1, \"a2\": 2, \"a3\": 3}, \"StubB\": {\"b1\": 1, \"b2\": 2, \"b3\": 3}}";
+        char objects[256] = {0};
+        std::string value;
+        int status = -1;
+
+        Load();
+
+        m_a.blockCalls(STUB_CALL_SET, true);
+        std::thread applier([&]() { status = MpiSetDesired(m_handle, (MPI_JSON_STRING)desired, (int)strlen(desired)); });
+
+        EXPECT_TRUE(m_a.waitForCallCount(STUB_CALL_SET, false, 1, m_wait));
+        EXPECT_TRUE(m_b.waitForCallCount(STUB_CALL_SET, true, 3, m_wait));
+        EXPECT_EQ(0, m_a.getCallCount(STUB_CALL_SET, true));
+
+        m_a.blockCalls(STUB_CALL_SET, false);
+        applier.join();
+
+        EXPECT_EQ(MPI_OK, status);
+        m_a.getSetObjects(objects, sizeof(objects));
+        EXPECT_STREQ("a1,a2,a3", objects);
+        m_b.getSetObjects(objects, sizeof(objects));
+        EXPECT_STREQ("b1,b2,b3", objects);
+
+        // Serialized on the heap and handed over to the set
+        EXPECT_EQ(MPI_OK, Get("StubA", "a2", &value));
+        EXPECT_EQ("2", value);
+    }
+
+    TEST_F(StubModulesTests, ModulesAreIndexedInParallelAndIndexIsReused)
+    {
+        const struct timespec modified[2] = {{1000000000, 0}, {1000000000, 0}};
+
+        // Both modules are asked for their info at the same time
+        m_a.blockCalls(STUB_CALL_GETINFO, true);
+        m_b.blockCalls(STUB_CALL_GETINFO, true);
+        std::thread loader([&]() { Load(); });
+        EXPECT_TRUE(m_a.waitForCallCount(STUB_CALL_GETINFO, false, 1, m_wait));
+        EXPECT_TRUE(m_b.waitForCallCount(STUB_CALL_GETINFO, false, 1, m_wait));
+        Unblock(m_a);
+        Unblock(m_b);
+        loader.join();
+        EXPECT_EQ(MPI_OK, Get("StubA", "object"));
+        EXPECT_EQ(MPI_OK, Get("StubB", "object"));
+
+        // Loaded again from the index, without asking the modules
+        MpiClose(m_handle);
+        FREE_MEMORY(m_handle);
+        UnloadModules();
+        Load();
+        EXPECT_EQ(1, m_a.getCallCount(STUB_CALL_GETINFO, true));
+        EXPECT_EQ(1, m_b.getCallCount(STUB_CALL_GETINFO, true));
+        EXPECT_EQ(MPI_OK, Get("StubA", "object"));
+        EXPECT_EQ(MPI_OK, Get("StubB", "object"));
+
+        // Only the module whose file changed since it was indexed is asked again
+        ASSERT_EQ(0, utimensat(AT_FDCWD, m_a.path.c_str(), modified, 0));
+        MpiClose(m_handle);
+        FREE_MEMORY(m_handle);
+        UnloadModules();
+        Load();
+        EXPECT_EQ(2, m_a.getCallCount(STUB_CALL_GETINFO, true));
+        EXPECT_EQ(1, m_b.getCallCount(STUB_CALL_GETINFO, true));
+        EXPECT_EQ(MPI_OK, Get("StubA", "object"));
+        EXPECT_EQ(MPI_OK, Get("StubB", "object"));
+    }
 }
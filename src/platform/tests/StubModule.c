@@ -0,0 +1,244 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Mmi.h>
+#include "StubModule.h"
+
+#define STUB_MAX_OBJECTS 64
+#define STUB_MAX_SET_OBJECTS 1024
+
+static const char* g_stubInfo = "{\"Name\": \"%s\", \"Description\": \"Stub module for the ModulesManager tests\", \"Manufacturer\": \"Microsoft\", "
+    "\"VersionInfo\": \"1.0\", \"Components\": [\"%s\"], \"Lifetime\": 1, \"CachedObjects\": [{\"ComponentName\": \"%s\", \"ObjectName\": \"cached\", \"CacheSeconds\": 1}]}";
+
+typedef struct STUB_OBJECT
+{
+    char* object;
+    char* value;
+    int valueSize;
+} STUB_OBJECT;
+
+static pthread_mutex_t g_stubLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_stubChanged = PTHREAD_COND_INITIALIZER;
+static bool g_blocked[STUB_CALL_TYPES] = {0};
+static int g_entered[STUB_CALL_TYPES] = {0};
+static int g_completed[STUB_CALL_TYPES] = {0};
+
+// The value last set for each object, objects never set report their own name
+static STUB_OBJECT g_objects[STUB_MAX_OBJECTS] = {{0}};
+static int g_objectCount = 0;
+
+static char g_setObjects[STUB_MAX_SET_OBJECTS] = {0};
+
+static void EnterCall(STUB_CALL call)
+{
+    pthread_mutex_lock(&g_stubLock);
+    g_entered[call] += 1;
+    pthread_cond_broadcast(&g_stubChanged);
+
+    while (g_blocked[call])
+    {
+        pthread_cond_wait(&g_stubChanged, &g_stubLock);
+    }
+
+    pthread_mutex_unlock(&g_stubLock);
+}
+
+static void CompleteCall(STUB_CALL call)
+{
+    pthread_mutex_lock(&g_stubLock);
+    g_completed[call] += 1;
+    pthread_cond_broadcast(&g_stubChanged);
+    pthread_mutex_unlock(&g_stubLock);
+}
+
+static int CopyValue(const char* value, int valueSize, MMI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    if (NULL == (*payload = (MMI_JSON_STRING)malloc(valueSize)))
+    {
+        return ENOMEM;
+    }
+
+    memcpy(*payload, value, valueSize);
+    *payloadSizeBytes = valueSize;
+
+    return MMI_OK;
+}
+
+void StubBlockCalls(STUB_CALL call, bool blocked)
+{
+    pthread_mutex_lock(&g_stubLock);
+    g_blocked[call] = blocked;
+    pthread_cond_broadcast(&g_stubChanged);
+    pthread_mutex_unlock(&g_stubLock);
+}
+
+int StubGetCallCount(STUB_CALL call, bool completed)
+{
+    int count = 0;
+
+    pthread_mutex_lock(&g_stubLock);
+    count = completed ? g_completed[call] : g_entered[call];
+    pthread_mutex_unlock(&g_stubLock);
+
+    return count;
+}
+
+bool StubWaitForCallCount(STUB_CALL call, bool completed, int count, unsigned int milliseconds)
+{
+    struct timespec deadline = {0};
+    int* counts = completed ? g_completed : g_entered;
+    int status = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&g_stubLock);
+
+    while ((counts[call] < count) && (ETIMEDOUT != status))
+    {
+        status = pthread_cond_timedwait(&g_stubChanged, &g_stubLock, &deadline);
+    }
+
+    status = (counts[call] >= count) ? 0 : ETIMEDOUT;
+
+    pthread_mutex_unlock(&g_stubLock);
+
+    return (0 == status);
+}
+
+void StubGetSetObjects(char* objects, size_t size)
+{
+    pthread_mutex_lock(&g_stubLock);
+    snprintf(objects, size, "%s", g_setObjects);
+    pthread_mutex_unlock(&g_stubLock);
+}
+
+int MmiGetInfo(const char* clientName, MMI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    int status = MMI_OK;
+    char info[512] = {0};
+
+    (void)clientName;
+
+    EnterCall(STUB_CALL_GETINFO);
+    snprintf(info, sizeof(info), g_stubInfo, STUB_MODULE_NAME, STUB_MODULE_NAME, STUB_MODULE_NAME);
+    status = CopyValue(info, (int)strlen(info), payload, payloadSizeBytes);
+    CompleteCall(STUB_CALL_GETINFO);
+
+    return status;
+}
+
+MMI_HANDLE MmiOpen(const char* clientName, const unsigned int maxPayloadSizeBytes)
+{
+    MMI_HANDLE handle = NULL;
+
+    (void)maxPayloadSizeBytes;
+
+    EnterCall(STUB_CALL_OPEN);
+    handle = (MMI_HANDLE)strdup(clientName);
+    CompleteCall(STUB_CALL_OPEN);
+
+    return handle;
+}
+
+void MmiClose(MMI_HANDLE clientSession)
+{
+    EnterCall(STUB_CALL_CLOSE);
+    free(clientSession);
+    CompleteCall(STUB_CALL_CLOSE);
+}
+
+int MmiSet(MMI_HANDLE clientSession, const char* componentName, const char* objectName, const MMI_JSON_STRING payload, const int payloadSizeBytes)
+{
+    STUB_OBJECT* object = NULL;
+    char* value = NULL;
+    int status = MMI_OK;
+    int i = 0;
+
+    (void)clientSession;
+    (void)componentName;
+
+    EnterCall(STUB_CALL_SET);
+
+    pthread_mutex_lock(&g_stubLock);
+
+    for (i = 0; (i < g_objectCount) && (0 != strcmp(g_objects[i].object, objectName)); i++);
+
+    if ((i == g_objectCount) && (g_objectCount < STUB_MAX_OBJECTS))
+    {
+        g_objects[g_objectCount].object = strdup(objectName);
+        g_objectCount += 1;
+    }
+
+    if ((i == STUB_MAX_OBJECTS) || (NULL == (value = (char*)malloc(payloadSizeBytes))))
+    {
+        status = ENOMEM;
+    }
+    else
+    {
+        object = &g_objects[i];
+        memcpy(value, payload, payloadSizeBytes);
+        free(object->value);
+        object->value = value;
+        object->valueSize = payloadSizeBytes;
+
+        snprintf(g_setObjects + strlen(g_setObjects), sizeof(g_setObjects) - strlen(g_setObjects), "%s%s", ('\0' == g_setObjects[0]) ? "" : ",", objectName);
+    }
+
+    pthread_mutex_unlock(&g_stubLock);
+
+    CompleteCall(STUB_CALL_SET);
+
+    return status;
+}
+
+int MmiGet(MMI_HANDLE clientSession, const char* componentName, const char* objectName, MMI_JSON_STRING* payload, int* payloadSizeBytes)
+{
+    char name[256] = {0};
+    int status = MMI_OK;
+    int i = 0;
+
+    (void)clientSession;
+    (void)componentName;
+
+    EnterCall(STUB_CALL_GET);
+
+    pthread_mutex_lock(&g_stubLock);
+
+    for (i = 0; (i < g_objectCount) && (0 != strcmp(g_objects[i].object, objectName)); i++);
+
+    if (i < g_objectCount)
+    {
+        status = CopyValue(g_objects[i].value, g_objects[i].valueSize, payload, payloadSizeBytes);
+    }
+    else
+    {
+        snprintf(name, sizeof(name), "\"%s\"", objectName);
+        status = CopyValue(name, (int)strlen(name), payload, payloadSizeBytes);
+    }
+
+    pthread_mutex_unlock(&g_stubLock);
+
+    CompleteCall(STUB_CALL_GET);
+
+    return status;
+}
+
+void MmiFree(MMI_JSON_STRING payload)
+{
+    EnterCall(STUB_CALL_FREE);
+    free(payload);
+    CompleteCall(STUB_CALL_FREE);
+}
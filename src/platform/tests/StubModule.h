@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef STUBMODULE_H
+#define STUBMODULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A module for the ModulesManager tests whose MMI calls are counted and can be held until released.
+// The same source is built as more than one module, the tests get the controls below with dlsym.
+// Each module has one component named as the module, whose object "cached" may be cached for a second.
+
+typedef enum STUB_CALL
+{
+    STUB_CALL_GETINFO = 0,
+    STUB_CALL_OPEN = 1,
+    STUB_CALL_CLOSE = 2,
+    STUB_CALL_GET = 3,
+    STUB_CALL_SET = 4,
+    STUB_CALL_FREE = 5,
+    STUB_CALL_TYPES = 6
+} STUB_CALL;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Calls of the type entered after this wait until unblocked
+void StubBlockCalls(STUB_CALL call, bool blocked);
+
+// Calls of the type entered so far, or completed so far
+int StubGetCallCount(STUB_CALL call, bool completed);
+
+// Waits for the count of calls of the type to reach count, false when it did not within milliseconds
+bool StubWaitForCallCount(STUB_CALL call, bool completed, int count, unsigned int milliseconds);
+
+// The objects set so far, in the order they were set, separated by commas
+void StubGetSetObjects(char* objects, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+typedef void (*STUB_BLOCK_CALLS)(STUB_CALL, bool);
+typedef int (*STUB_GET_CALL_COUNT)(STUB_CALL, bool);
+typedef bool (*STUB_WAIT_FOR_CALL_COUNT)(STUB_CALL, bool, int, unsigned int);
+typedef void (*STUB_GET_SET_OBJECTS)(char*, size_t);
+
+#endif // STUBMODULE_H